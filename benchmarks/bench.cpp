@@ -0,0 +1,903 @@
+/*! \file bench.cpp
+ *  \brief A benchmark suite for the overheads of the library and the runtime.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+#include <CLUtils/sort.hpp>
+#include <CLUtils/stencil.hpp>
+#include <CLUtils/gemm.hpp>
+#include <CLUtils/histogram.hpp>
+#include <CLUtils/compact.hpp>
+#include <CLUtils/upload.hpp>
+#include <CLUtils/verify.hpp>
+
+
+const std::string kernel_filename { "kernels/kernels.cl" };
+/*! \brief The number of timed repetitions of a benchmark. */
+const unsigned int nRepeat = 20;
+/*! \brief The number of lookups/launches in a repetition of the short benchmarks. */
+const unsigned int nBatch = 1000;
+/*! \brief The timer of the benchmarks.
+ *  \details It reads the TSC, so the enqueue and lookup times aren't 
+ *           dominated by the cost of reading the clock.
+ */
+typedef clutils::CPUTimer<double, std::micro, clutils::TSCClock> Timer;
+
+
+/*! \brief The amount of work in a repetition of a benchmark, 
+ *         which gets reported as a rate.
+ *  \details A plain number is taken to be bytes, and reported in GB/s.
+ */
+struct Rate
+{
+    /*! \param[in] bytes the bytes transferred in a repetition, or 0. */
+    Rate (double bytes = 0) : amount (bytes), scale (1e3), unit ("GB/s") {}
+
+    /*! \param[in] amount the amount of work in a repetition.
+     *  \param[in] scale the amount per us that makes one unit.
+     *  \param[in] unit the name of the unit.
+     */
+    Rate (double amount, double scale, const char *unit) : amount (amount), scale (scale), unit (unit) {}
+
+    /*! \brief A rate in megapixels per second. */
+    static Rate megapixels (double pixels) { return Rate (pixels, 1.0, "MP/s"); }
+
+    /*! \brief A rate in billions of floating-point operations per second. */
+    static Rate gigaflops (double flops) { return Rate (flops, 1e3, "GFLOP/s"); }
+
+    double amount;  /*!< The amount of work in a repetition. */
+    double scale;  /*!< The amount per us that makes one unit. */
+    const char *unit;  /*!< The name of the unit. */
+};
+
+
+/*! \brief Runs benchmarks and prints a line of results for each.
+ *  \details A benchmark is a callable that gets a timer. It sets up whatever 
+ *           it needs, and times the part it measures with `start`/`stop`. 
+ *           It runs once to warm up, and then `nRepeat` times.
+ *           
+ *           The medians can be recorded in a baseline file, and compared 
+ *           with one. A benchmark regresses when its median exceeds the 
+ *           baseline by more than a relative tolerance, plus three times 
+ *           the larger median absolute deviation of the two runs, so noisy 
+ *           benchmarks get a proportionally wider margin.
+ */
+class Suite
+{
+public:
+    /*! \param[in] filter runs only the benchmarks whose name contains it. */
+    Suite (const std::string &filter) : filter (filter)
+    {
+        std::cout << std::left << std::setw (32) << " Benchmark" << std::right 
+                  << std::setw (12) << "Mean" << std::setw (12) << "Median" 
+                  << std::setw (12) << "Min" << std::setw (12) << "Max" 
+                  << std::setw (14) << "Rate" << std::endl;
+        std::cout << " " << std::string (93, '-') << std::endl;
+    }
+
+    /*! \brief Runs a benchmark.
+     *
+     *  \param[in] name the name of the benchmark.
+     *  \param[in] rate the bytes transferred in a repetition, or 0, 
+     *                  or another amount of work, reported per second.
+     *  \param[in] ops the operations timed in a repetition. 
+     *                 The times are reported per operation.
+     *  \param[in] bench the benchmark.
+     */
+    template <typename F>
+    void run (const std::string &name, Rate rate, unsigned int ops, F bench)
+    {
+        if (name.find (filter) == std::string::npos)
+            return;
+
+        Timer timer;
+        clutils::ProfilingInfo<nRepeat> prof (name, "us");
+        for (unsigned int i = 0; i <= nRepeat; ++i)
+        {
+            timer.reset ();
+            bench (timer);
+            if (i) prof[i - 1] = timer.duration () / ops;  // The first run is a warm-up
+        }
+
+        std::ios::fmtflags f (std::cout.flags ());
+        std::cout << std::fixed << std::setprecision (3);
+        std::cout << " " << std::left << std::setw (31) << name << std::right 
+                  << std::setw (9) << prof.mean () << " us" 
+                  << std::setw (9) << prof.median () << " us" 
+                  << std::setw (9) << prof.min () << " us" 
+                  << std::setw (9) << prof.max () << " us";
+        if (rate.amount)
+            std::cout << std::setw (9) << rate.amount / ops / prof.min () / rate.scale << " " << rate.unit;
+        std::cout << std::endl;
+        std::cout.flags (f);
+
+        results.push_back ({ name, prof.median (), prof.mad () });
+    }
+
+    /*! \brief Writes the medians of the benchmarks that ran to a baseline file.
+     *
+     *  \param[in] filename the name of the baseline file.
+     *  \param[in] device the name of the device the benchmarks ran on.
+     */
+    void record (const std::string &filename, const std::string &device) const
+    {
+        std::ofstream file (filename);
+        if (!file)
+        {
+            std::cerr << "Error: Could not write the baseline file " << filename << std::endl;
+            exit (EXIT_FAILURE);
+        }
+
+        file << baselineVersion << std::endl;
+        file << "# device " << device << std::endl;
+        for (auto &r : results)
+            file << r.name << " " << r.median << " " << r.mad << std::endl;
+
+        std::cout << std::endl << " Recorded " << results.size () 
+                  << " benchmarks in " << filename << std::endl;
+    }
+
+    /*! \brief Compares the medians of the benchmarks that ran with a baseline file.
+     *  \details Benchmarks missing from the baseline are skipped. So is the 
+     *           whole comparison, when the baseline is empty, comes from 
+     *           another device, or has none of the benchmarks that ran.
+     *
+     *  \param[in] filename the name of the baseline file.
+     *  \param[in] device the name of the device the benchmarks ran on.
+     *  \param[in] tolerance the relative slowdown that is tolerated.
+     *  \return The number of regressions, or -1 when nothing could be compared.
+     */
+    int compare (const std::string &filename, const std::string &device, 
+                 double tolerance) const
+    {
+        std::ifstream file (filename);
+        std::string line;
+        if (!file || !std::getline (file, line) || line != baselineVersion)
+        {
+            std::cerr << "Error: " << filename << " is not a version " 
+                      << baselineVersion.substr (baselineVersion.rfind (' ') + 1) 
+                      << " baseline file" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+
+        std::map<std::string, Result> baseline;
+        std::string baseDevice;
+        while (std::getline (file, line))
+        {
+            if (line.compare (0, 9, "# device ") == 0)
+                baseDevice = line.substr (9);
+            if (line.empty () || line[0] == '#')
+                continue;
+
+            Result r;
+            std::istringstream ss (line);
+            if (ss >> r.name >> r.median >> r.mad)
+                baseline[r.name] = r;
+        }
+
+        std::ios::fmtflags f (std::cout.flags ());
+        std::cout << std::fixed << std::setprecision (3) << std::endl;
+        if (baseDevice != device)
+        {
+            if (baseDevice.empty ())
+                std::cout << " There is no baseline in " << filename 
+                          << ". Skipping the comparison." << std::endl;
+            else
+                std::cout << " The baseline was recorded on \"" << baseDevice << "\", not on \"" 
+                          << device << "\". Skipping the comparison." << std::endl;
+            std::cout.flags (f);
+            return -1;
+        }
+
+        int regressions = 0, compared = 0;
+        for (auto &r : results)
+        {
+            auto it = baseline.find (r.name);
+            if (it == baseline.end ())
+                continue;
+
+            const Result &base (it->second);
+            double margin = 3 * std::max (base.mad, r.mad);
+            ++compared;
+
+            if (r.median > base.median * (1 + tolerance) + margin)
+            {
+                std::cout << " REGRESSION " << r.name << ": " << r.median 
+                          << " us vs " << base.median << " us" << std::endl;
+                ++regressions;
+            }
+            else if (r.median < base.median * (1 - tolerance) - margin)
+            {
+                std::cout << " Improvement " << r.name << ": " << r.median 
+                          << " us vs " << base.median << " us (consider recording a new baseline)" << std::endl;
+            }
+        }
+
+        std::cout << " " << regressions << " regressions in " << compared 
+                  << " benchmarks compared with " << filename << std::endl;
+        std::cout.flags (f);
+
+        return compared ? regressions : -1;
+    }
+
+private:
+    /*! \brief The timings of a benchmark that are kept. */
+    struct Result
+    {
+        std::string name;  /*!< The name of the benchmark. */
+        double median;  /*!< The median time in us. */
+        double mad;  /*!< The median absolute deviation of the times in us. */
+    };
+
+    /*! \brief The first line of a baseline file. */
+    static const std::string baselineVersion;
+
+    std::string filter;  /*!< The filter on the benchmark names. */
+    std::vector<Result> results;  /*!< The results of the benchmarks that ran. */
+};
+
+const std::string Suite::baselineVersion { "# CLUtils performance baseline, version 1" };
+
+/*! \brief The exit code when there's no baseline to compare with. 
+ *         CTest reports it as a skipped test. */
+const int skipReturnCode = 77;
+
+
+/*! \brief Formats a size in bytes, e.g. `64KB`. */
+std::string sizeName (size_t bytes)
+{
+    const char *units[] = { "B", "KB", "MB", "GB" };
+    unsigned int u = 0;
+    while (bytes >= 1024 && bytes % 1024 == 0 && u < 3)
+    {
+        bytes /= 1024;
+        ++u;
+    }
+
+    return std::to_string (bytes) + units[u];
+}
+
+
+/*! \brief Times the setup of an environment, and the build of programs. */
+void benchSetup (Suite &suite, clutils::CLEnv &env)
+{
+    suite.run ("CLEnv/first", 0, 1, [] (Timer &timer)
+    {
+        timer.start ();
+        clutils::CLEnv env (kernel_filename, nullptr, clutils::DeviceSelection::FIRST);
+        timer.stop ();
+    });
+
+    suite.run ("CLEnv/properties", 0, 1, [] (Timer &timer)
+    {
+        timer.start ();
+        clutils::CLEnv env (kernel_filename);
+        timer.stop ();
+    });
+
+    unsigned int seed = 0;
+
+    // Distinct build options keep the program 
+    // caches of the library and the runtime out of it
+    suite.run ("addProgram", 0, 1, [&] (Timer &timer)
+    {
+        std::string options = "-D CLUTILS_BENCH_SEED=" + std::to_string (seed++);
+        timer.start ();
+        env.addProgram (0, kernel_filename, nullptr, options.c_str ());
+        timer.stop ();
+    });
+
+    suite.run ("getProgramIdx/cached", 0, nBatch, [&] (Timer &timer)
+    {
+        timer.start ();
+        for (unsigned int i = 0; i < nBatch; ++i)
+            env.getProgramIdx (0, { kernel_filename });
+        timer.stop ();
+    });
+
+    suite.run ("getKernel", 0, nBatch, [&] (Timer &timer)
+    {
+        timer.start ();
+        for (unsigned int i = 0; i < nBatch; ++i)
+            env.getKernel ("vecAddN");
+        timer.stop ();
+    });
+}
+
+
+/*! \brief Times the reads of the clocks a `CPUTimer` can use. */
+void benchClocks (Suite &suite)
+{
+    suite.run ("clock/steady", 0, nBatch, [&] (Timer &timer)
+    {
+        timer.start ();
+        for (unsigned int i = 0; i < nBatch; ++i)
+            std::chrono::steady_clock::now ();
+        timer.stop ();
+    });
+
+    suite.run ("clock/tsc", 0, nBatch, [&] (Timer &timer)
+    {
+        timer.start ();
+        for (unsigned int i = 0; i < nBatch; ++i)
+            clutils::TSCClock::now ();
+        timer.stop ();
+    });
+}
+
+
+/*! \brief Times the launch of kernels that do no work. */
+void benchLaunch (Suite &suite, clutils::CLEnv &env)
+{
+    cl::CommandQueue &queue (env.getQueue ());
+    cl::Kernel &kernel (env.getKernel ("vecAddN"));
+
+    cl::Buffer dBuf (env.getContext (), CL_MEM_READ_WRITE, sizeof (cl_int));
+    kernel.setArg (0, dBuf);
+    kernel.setArg (1, dBuf);
+    kernel.setArg (2, dBuf);
+    kernel.setArg (3, (cl_uint) 0);
+
+    suite.run ("launch/enqueue", 0, nBatch, [&] (Timer &timer)
+    {
+        timer.start ();
+        for (unsigned int i = 0; i < nBatch; ++i)
+            queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (1), cl::NullRange);
+        timer.stop ();
+        queue.finish ();
+    });
+
+    suite.run ("launch/roundtrip", 0, 1, [&] (Timer &timer)
+    {
+        timer.start ();
+        queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (1), cl::NullRange);
+        queue.finish ();
+        timer.stop ();
+    });
+
+    suite.run ("finish/idle", 0, 1, [&] (Timer &timer)
+    {
+        timer.start ();
+        queue.finish ();
+        timer.stop ();
+    });
+}
+
+
+/*! \brief Times the transfers between host and device across buffer sizes.
+ *  \details `read`/`write` transfer from pageable host memory. `map` 
+ *           copies through a mapping of a pinned buffer, which includes 
+ *           the unmap. `finish` times the wait for a non-blocking write, 
+ *           separately from its enqueue.
+ */
+void benchTransfers (Suite &suite, clutils::CLEnv &env)
+{
+    cl::Context &context (env.getContext ());
+    cl::CommandQueue &queue (env.getQueue ());
+    cl::Device device = queue.getInfo<CL_QUEUE_DEVICE> ();
+    size_t maxAlloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE> ();
+
+    for (size_t size : { 1 << 12, 1 << 16, 1 << 20, 1 << 24, 1 << 26 })
+    {
+        if (size > maxAlloc)
+            break;
+
+        std::string s = "/" + sizeName (size);
+        std::vector<char> hBuf (size, 1);
+        cl::Buffer dBuf (context, CL_MEM_READ_WRITE, size);
+        cl::Buffer hPinned (context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size);
+
+        suite.run ("write" + s, size, 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            queue.enqueueWriteBuffer (dBuf, CL_TRUE, 0, size, hBuf.data ());
+            timer.stop ();
+        });
+
+        suite.run ("read" + s, size, 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            queue.enqueueReadBuffer (dBuf, CL_TRUE, 0, size, hBuf.data ());
+            timer.stop ();
+        });
+
+        suite.run ("map/write" + s, size, 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            void *ptr = queue.enqueueMapBuffer (hPinned, CL_TRUE, CL_MAP_WRITE, 0, size);
+            std::memcpy (ptr, hBuf.data (), size);
+            queue.enqueueUnmapMemObject (hPinned, ptr);
+            queue.finish ();
+            timer.stop ();
+        });
+
+        suite.run ("map/read" + s, size, 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            void *ptr = queue.enqueueMapBuffer (hPinned, CL_TRUE, CL_MAP_READ, 0, size);
+            std::memcpy (hBuf.data (), ptr, size);
+            queue.enqueueUnmapMemObject (hPinned, ptr);
+            queue.finish ();
+            timer.stop ();
+        });
+
+        suite.run ("enqueue/write" + s, 0, 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            queue.enqueueWriteBuffer (dBuf, CL_FALSE, 0, size, hBuf.data ());
+            timer.stop ();
+            queue.finish ();
+        });
+
+        suite.run ("finish/write" + s, 0, 1, [&] (Timer &timer)
+        {
+            queue.enqueueWriteBuffer (dBuf, CL_FALSE, 0, size, hBuf.data ());
+            timer.start ();
+            queue.finish ();
+            timer.stop ();
+        });
+    }
+}
+
+
+/*! \brief Times the primitives and a kernel of the library on `n` elements. 
+ *  \details The times include the wait for the kernels to complete.
+ */
+void benchKernels (Suite &suite, clutils::CLEnv &env)
+{
+    const unsigned int n = 1 << 22;
+    std::string s = "/" + std::to_string (n);
+    cl::Context &context (env.getContext ());
+    cl::CommandQueue &queue (env.getQueue ());
+
+    std::vector<cl_uint> hKeys (n);
+    for (unsigned int i = 0; i < n; ++i)
+        hKeys[i] = (i * 2654435761u) ^ (i >> 7);
+
+    cl::Buffer dIn (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+    cl::Buffer dOut (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+    cl::Buffer dTmp (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n * sizeof (cl_int), hKeys.data ());
+
+    cl::Kernel &kernel (env.getKernel ("vecAddN"));
+    kernel.setArg (0, dIn);
+    kernel.setArg (1, dIn);
+    kernel.setArg (2, dOut);
+    kernel.setArg (3, n);
+    suite.run ("vecAdd" + s, 3.0 * n * sizeof (cl_int), 1, [&] (Timer &timer)
+    {
+        timer.start ();
+        queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (n), cl::NDRange (256));
+        queue.finish ();
+        timer.stop ();
+    });
+
+    clutils::Reduce<cl_int> reduce (env);
+    suite.run ("reduce" + s, 1.0 * n * sizeof (cl_int), 1, [&] (Timer &timer)
+    {
+        timer.start ();
+        reduce.run (dIn, n, dOut);
+        queue.finish ();
+        timer.stop ();
+    });
+
+    clutils::Scan<cl_int> scan (env);
+    suite.run ("scan" + s, 2.0 * n * sizeof (cl_int), 1, [&] (Timer &timer)
+    {
+        timer.start ();
+        scan.run (dIn, n, dOut);
+        queue.finish ();
+        timer.stop ();
+    });
+
+    // The keys get reshuffled before every sort
+    clutils::RadixSort<cl_uint> sort (env);
+    suite.run ("sort" + s, 0, 1, [&] (Timer &timer)
+    {
+        queue.enqueueCopyBuffer (dIn, dTmp, 0, 0, n * sizeof (cl_uint));
+        queue.finish ();
+        timer.start ();
+        sort.run (dTmp, n);
+        queue.finish ();
+        timer.stop ();
+    });
+}
+
+
+/*! \brief Times the naive, tiled, and separable convolutions 
+ *         on a `width x height` image, with a few filter radii.
+ *  \details The times include the wait for the kernels to complete.
+ */
+void benchStencil (Suite &suite, clutils::CLEnv &env)
+{
+    const unsigned int width = 2048, height = 2048, n = width * height;
+    cl::Context &context (env.getContext ());
+    cl::CommandQueue &queue (env.getQueue ());
+
+    std::vector<cl_float> hImg (n);
+    for (unsigned int i = 0; i < n; ++i)
+        hImg[i] = (float) ((i * 2654435761u) >> 24);
+
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, n * sizeof (cl_float));
+    cl::Buffer dOut (context, CL_MEM_WRITE_ONLY, n * sizeof (cl_float));
+    queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n * sizeof (cl_float), hImg.data ());
+
+    for (unsigned int radius : { 1u, 3u, 7u })
+    {
+        std::string s = "/r" + std::to_string (radius) + "/" + std::to_string (width) + "x" + std::to_string (height);
+        std::vector<cl_float> filter = clutils::gaussianFilter<cl_float> (radius, radius / 2.0 + 0.5);
+        clutils::Convolution<cl_float> conv (env, clutils::CLEnvInfo<1> (), radius);
+        conv.setFilter (filter, filter);
+
+        suite.run ("stencil/naive" + s, Rate::megapixels (n), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            conv.runNaive (dIn, dOut, width, height);
+            queue.finish ();
+            timer.stop ();
+        });
+
+        suite.run ("stencil/separable" + s, Rate::megapixels (n), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            conv.run (dIn, dOut, width, height);
+            queue.finish ();
+            timer.stop ();
+        });
+
+        // The same filter, as a 2D one
+        std::vector<cl_float> filter2D (filter.size () * filter.size ());
+        for (unsigned int j = 0; j < filter.size (); ++j)
+            for (unsigned int i = 0; i < filter.size (); ++i)
+                filter2D[j * filter.size () + i] = filter[j] * filter[i];
+        conv.setFilter (filter2D);
+
+        suite.run ("stencil/tiled" + s, Rate::megapixels (n), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            conv.run (dIn, dOut, width, height);
+            queue.finish ();
+            timer.stop ();
+        });
+    }
+}
+
+
+/*! \brief Times the naive and tiled matrix multiplications on square 
+ *         matrices, and on a batch of small ones, along with `host::gemm`.
+ *  \details The times include the wait for the kernels to complete.
+ */
+void benchGemm (Suite &suite, clutils::CLEnv &env)
+{
+    cl::Context &context (env.getContext ());
+    cl::CommandQueue &queue (env.getQueue ());
+
+    // { M = N = K, batch }
+    const unsigned int shapes[][2] = { { 512, 1 }, { 16, 4096 } };
+    for (auto &shape : shapes)
+    {
+        const unsigned int d = shape[0], batch = shape[1], n = d * d * batch;
+        const double flops = 2.0 * d * d * d * batch;
+        std::string s = "/" + std::to_string (d) + (batch > 1 ? "x" + std::to_string (batch) : "");
+
+        std::vector<cl_float> hA (n), hB (n), hC (n);
+        std::vector<cl_half> hHalf (n);
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            hA[i] = hB[i] = ((i * 2654435761u) >> 24) / 256.f;
+            hHalf[i] = clutils::floatToHalf (hA[i]);
+        }
+
+        cl::Buffer dA (context, CL_MEM_READ_ONLY, n * sizeof (cl_float));
+        cl::Buffer dB (context, CL_MEM_READ_ONLY, n * sizeof (cl_float));
+        cl::Buffer dC (context, CL_MEM_WRITE_ONLY, n * sizeof (cl_float));
+        cl::Buffer dHalf (context, CL_MEM_READ_ONLY, n * sizeof (cl_half));
+        cl::Buffer dHalfC (context, CL_MEM_WRITE_ONLY, n * sizeof (cl_half));
+        queue.enqueueWriteBuffer (dA, CL_FALSE, 0, n * sizeof (cl_float), hA.data ());
+        queue.enqueueWriteBuffer (dB, CL_FALSE, 0, n * sizeof (cl_float), hB.data ());
+        queue.enqueueWriteBuffer (dHalf, CL_TRUE, 0, n * sizeof (cl_half), hHalf.data ());
+
+        clutils::Gemm<cl_float> gemm (env);
+        suite.run ("gemm/naive" + s, Rate::gigaflops (flops), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            gemm.runNaive (dA, dB, dC, d, d, d, batch);
+            queue.finish ();
+            timer.stop ();
+        });
+
+        suite.run ("gemm/tiled" + s, Rate::gigaflops (flops), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            gemm.runBatched (dA, dB, dC, d, d, d, batch);
+            queue.finish ();
+            timer.stop ();
+        });
+
+        clutils::Gemm<cl_half> gemmHalf (env);
+        suite.run ("gemm/tiled/half" + s, Rate::gigaflops (flops), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            gemmHalf.runBatched (dHalf, dHalf, dHalfC, d, d, d, batch);
+            queue.finish ();
+            timer.stop ();
+        });
+
+        suite.run ("gemm/host" + s, Rate::gigaflops (flops), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            clutils::host::gemm (hA.data (), hB.data (), hC.data (), d, d, d, batch);
+            timer.stop ();
+        });
+    }
+}
+
+
+/*! \brief Times the histogram and the compaction on `n` uniform 
+ *         and `n` skewed elements.
+ *  \details The uniform elements spread over 256 bins, and half of them 
+ *           get selected. 90% of the skewed elements are 0, so they pile 
+ *           up in a single bin, and few of them get selected.
+ *           The times include the wait for the kernels to complete.
+ */
+void benchHistogram (Suite &suite, clutils::CLEnv &env)
+{
+    const unsigned int n = 1 << 22;
+    cl::Context &context (env.getContext ());
+    cl::CommandQueue &queue (env.getQueue ());
+
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, n * sizeof (cl_uint));
+    cl::Buffer dOut (context, CL_MEM_READ_WRITE, n * sizeof (cl_uint));
+    cl::Buffer dCounts (context, CL_MEM_READ_WRITE, 256 * sizeof (cl_uint));
+
+    clutils::Histogram<cl_uint> hist (env, clutils::CLEnvInfo<1> (), 256, 0, 256);
+    clutils::Compact<cl_uint, clutils::Predicate::GREATER_EQUAL> compact (env);
+
+    for (int isSkewed = 0; isSkewed < 2; ++isSkewed)
+    {
+        std::string s = (isSkewed ? "/skewed/" : "/uniform/") + std::to_string (n);
+
+        std::vector<cl_uint> hIn (n);
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            cl_uint h = i * 2654435761u;
+            hIn[i] = (isSkewed && h % 10) ? 0 : h >> 24;
+        }
+        queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n * sizeof (cl_uint), hIn.data ());
+
+        suite.run ("histogram" + s, 1.0 * n * sizeof (cl_uint), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            hist.run (dIn, n, dCounts);
+            queue.finish ();
+            timer.stop ();
+        });
+
+        suite.run ("select" + s, 1.0 * n * sizeof (cl_uint), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            compact.select (dIn, n, dOut, 128, dCounts);
+            queue.finish ();
+            timer.stop ();
+        });
+    }
+}
+
+
+/*! \brief Times repeated uploads of the same data, with writes, and through 
+ *         an upload cache, which only hashes the data when they're cached.
+ *  \details The rates are of the bytes requested, not of the bytes written. 
+ *           `upload/changed` changes the data in every repetition, so it 
+ *           pays for both the hash and the write.
+ */
+void benchUpload (Suite &suite, clutils::CLEnv &env)
+{
+    cl::Context &context (env.getContext ());
+    cl::CommandQueue &queue (env.getQueue ());
+
+    for (size_t size : { 1 << 16, 1 << 20, 1 << 24 })
+    {
+        std::string s = "/" + sizeName (size);
+        std::vector<char> hBuf (size, 1);
+        cl::Buffer dBuf (context, CL_MEM_READ_ONLY, size);
+        clutils::UploadCache uploads (env, clutils::CLEnvInfo<1> (), 4 * size);
+
+        suite.run ("upload/write" + s, size, 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            queue.enqueueWriteBuffer (dBuf, CL_TRUE, 0, size, hBuf.data ());
+            timer.stop ();
+        });
+
+        suite.run ("upload/cached" + s, size, 1, [&] (Timer &timer)
+        {
+            cl::Event written;
+            timer.start ();
+            uploads.upload (hBuf.data (), size, nullptr, &written);
+            written.wait ();
+            timer.stop ();
+        });
+
+        suite.run ("upload/changed" + s, size, 1, [&] (Timer &timer)
+        {
+            ++hBuf[0];
+            cl::Event written;
+            timer.start ();
+            uploads.upload (hBuf.data (), size, nullptr, &written);
+            written.wait ();
+            timer.stop ();
+        });
+    }
+}
+
+
+/*! \brief Times the host reference comparisons and hash on every supported 
+ *         instruction set, on a single thread.
+ */
+void benchVerify (Suite &suite)
+{
+    const size_t n = 1 << 22;
+    std::string s = "/" + std::to_string (n);
+    // Every element of `near` is 1 ULP off, so all of the distances get worked out
+    std::vector<cl_float> expected (n), actual (n), near (n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        expected[i] = actual[i] = i * 0.5f;
+        near[i] = std::nextafter (expected[i], 0.f);
+    }
+    std::vector<size_t> first (8);
+
+    clutils::host::SimdLevel current = clutils::host::simdLevel ();
+    for (int l = 0; l <= (int) clutils::host::supportedSimdLevel (); ++l)
+    {
+        std::string level = clutils::host::simdLevelName (clutils::host::setSimdLevel ((clutils::host::SimdLevel) l));
+
+        suite.run ("verify/exact/" + level + s, 2.0 * n * sizeof (cl_float), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            clutils::host::detail::compare32 (expected.data (), actual.data (), n, first.data (), first.size ());
+            timer.stop ();
+        });
+
+        suite.run ("verify/ulp/" + level + s, 2.0 * n * sizeof (cl_float), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            clutils::host::detail::compareULP (expected.data (), near.data (), n, 4, first.data (), first.size ());
+            timer.stop ();
+        });
+
+        suite.run ("verify/hash/" + level + s, 1.0 * n * sizeof (cl_float), 1, [&] (Timer &timer)
+        {
+            timer.start ();
+            clutils::host::hash (expected.data (), n * sizeof (cl_float));
+            timer.stop ();
+        });
+    }
+    clutils::host::setSimdLevel (current);
+}
+
+
+/*! \brief Prints the usage of the suite, and exits. */
+void usage (const char *program)
+{
+    std::cerr << "Usage: " << program << " [filter] [--record <file>] "
+              << "[--baseline <file>] [--tolerance <fraction>] [--require-baseline]" << std::endl
+              << "  filter       runs only the benchmarks whose name contains it" << std::endl
+              << "  --record     writes the medians to a baseline file" << std::endl
+              << "  --baseline   fails when a median regresses against a baseline file" << std::endl
+              << "  --tolerance  the relative slowdown that is tolerated (default 0.1)" << std::endl
+              << "  --require-baseline" << std::endl
+              << "               fails, instead of exiting with " << skipReturnCode 
+              << ", when there's no baseline for the device" << std::endl;
+    exit (EXIT_FAILURE);
+}
+
+
+/*! \brief Runs the benchmark suite.
+ *  \details It exits with a failure when a benchmark 
+ *           regresses against the baseline file. When there's no 
+ *           baseline for the device, it exits with `skipReturnCode`, 
+ *           or with a failure under `--require-baseline`.
+ */
+int main (int argc, char **argv)
+{
+    try
+    {
+        std::string filter, recordFile, baselineFile;
+        double tolerance = 0.1;
+        bool requireBaseline = false;
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg (argv[i]);
+            if (arg == "--record" && i + 1 < argc)
+                recordFile = argv[++i];
+            else if (arg == "--baseline" && i + 1 < argc)
+                baselineFile = argv[++i];
+            else if (arg == "--tolerance" && i + 1 < argc)
+                tolerance = std::atof (argv[++i]);
+            else if (arg == "--require-baseline")
+                requireBaseline = true;
+            else if (arg[0] == '-')
+                usage (argv[0]);
+            else
+                filter = arg;
+        }
+
+        clutils::CLEnv env (kernel_filename);
+        std::string device = env.getQueue ().getInfo<CL_QUEUE_DEVICE> ().getInfo<CL_DEVICE_NAME> ();
+        device.erase (device.find_last_not_of (std::string (" \0", 2)) + 1);
+        std::cout << " Device: " << device << std::endl;
+        if (clutils::TSCClock::available ())
+            std::cout << " Clock: TSC at " << clutils::TSCClock::frequency () / 1e9 << " GHz" << std::endl << std::endl;
+        else
+            std::cout << " Clock: steady_clock" << std::endl << std::endl;
+
+        Suite suite (filter);
+        benchClocks (suite);
+        benchSetup (suite, env);
+        benchLaunch (suite, env);
+        benchTransfers (suite, env);
+        benchKernels (suite, env);
+        benchStencil (suite, env);
+        benchGemm (suite, env);
+        benchHistogram (suite, env);
+        benchUpload (suite, env);
+        benchVerify (suite);
+
+        if (!recordFile.empty ())
+            suite.record (recordFile, device);
+
+        if (!baselineFile.empty ())
+        {
+            int regressions = suite.compare (baselineFile, device, tolerance);
+            if (regressions < 0)
+                return requireBaseline ? EXIT_FAILURE : skipReturnCode;
+            if (regressions > 0)
+                return EXIT_FAILURE;
+        }
+
+        return 0;
+    }
+    catch (const cl::Error &error)
+    {
+        std::cerr << error.what ()
+                  << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
+                  << ")"  << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,133 @@
+/*! \file fusion.cpp
+ *  \brief A benchmark for the elementwise kernel fusion. The chain
+ *         `C = A + B; D = C * k; E = max (D, 0)` is timed as three
+ *         kernels with intermediate buffers, and as one fused kernel.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <CLUtils.hpp>
+#include <CLUtils/fusion.hpp>
+
+
+const unsigned int n_elements = 1 << 24;  // 16M elements
+const unsigned int nRepeat = 10;
+
+
+/*! \brief Prints the bandwidth achieved by a test.
+ *
+ *  \param[in] label a label for the test.
+ *  \param[in] bytes the number of bytes the test reads and writes.
+ *  \param[in] ms the execution time of the test in milliseconds.
+ */
+void printBandwidth (const char *label, double bytes, double ms)
+{
+    std::cout << "   " << label << ": " << bytes / ms / 1e6 << " GB/s" << std::endl;
+}
+
+
+int main (/*int argc, char **argv*/)
+{
+    try
+    {
+        using namespace clutils::expr;
+
+        clutils::CLEnv clEnv;
+        cl::Context &context (clEnv.addContext (0));
+        cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+        const size_t bufSize = n_elements * sizeof (cl_float);
+        const cl_float k = 0.5f;
+
+        std::vector<cl_float> hA (n_elements), hB (n_elements), hE (n_elements);
+        for (unsigned int i = 0; i < n_elements; ++i)
+        {
+            hA[i] = (cl_float) (i % 64) - 32.f;
+            hB[i] = (cl_float) (i % 7);
+        }
+
+        cl::Buffer dA (context, CL_MEM_READ_ONLY, bufSize);
+        cl::Buffer dB (context, CL_MEM_READ_ONLY, bufSize);
+        cl::Buffer dC (context, CL_MEM_READ_WRITE, bufSize);
+        cl::Buffer dD (context, CL_MEM_READ_WRITE, bufSize);
+        cl::Buffer dE (context, CL_MEM_WRITE_ONLY, bufSize);
+        queue.enqueueWriteBuffer (dA, CL_FALSE, 0, bufSize, hA.data ());
+        queue.enqueueWriteBuffer (dB, CL_FALSE, 0, bufSize, hB.data ());
+
+        clutils::Elementwise<cl_float> ew (clEnv);
+        clutils::CPUTimer<double, std::milli> timer;
+        auto A = vec<cl_float> (dA), B = vec<cl_float> (dB);
+        auto C = vec<cl_float> (dC), D = vec<cl_float> (dD);
+
+        // Separate kernels ---------------------------------------------------
+
+        clutils::ProfilingInfo<nRepeat> pSeparate ("3 kernels"), pFused ("Fused");
+
+        for (unsigned int i = 0; i <= nRepeat; ++i)
+        {
+            timer.start ();
+            ew.run (dC, A + B, n_elements);
+            ew.run (dD, C * k, n_elements);
+            ew.run (dE, max (D, 0), n_elements);
+            queue.finish ();
+            double t = timer.stop ();
+            if (i) pSeparate[i - 1] = t;  // The first run builds the kernels
+        }
+
+        // Fused kernel -------------------------------------------------------
+
+        for (unsigned int i = 0; i <= nRepeat; ++i)
+        {
+            timer.start ();
+            ew.run (dE, max ((A + B) * k, 0), n_elements);
+            queue.finish ();
+            double t = timer.stop ();
+            if (i) pFused[i - 1] = t;
+        }
+
+        queue.enqueueReadBuffer (dE, CL_TRUE, 0, bufSize, hE.data ());
+        bool correct = true;
+        for (unsigned int i = 0; i < n_elements; ++i)
+            if (hE[i] != std::max ((hA[i] + hB[i]) * k, 0.f)) { correct = false; break; }
+
+        // The separate kernels make 7 passes over global memory, the fused one makes 3
+        pFused.print (pSeparate, "Elementwise chain (16M floats)");
+        printBandwidth ("3 kernels", 7.0 * bufSize, pSeparate.mean ());
+        printBandwidth ("Fused    ", 3.0 * bufSize, pFused.mean ());
+        std::cout << (correct ? "   Success!" : "   Failed!") << std::endl;
+
+        return 0;
+    }
+    catch (const cl::Error &error)
+    {
+        std::cerr << error.what ()
+                  << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
+                  << ")"  << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,181 @@
+/*! \file pipelines.cpp
+ *  \brief An example of coroutine pipelines. Many vector additions,
+ *         staged as in the vecAdd example, are run one after the other,
+ *         blocking between stages, and as coroutines on an executor.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <CLUtils.hpp>
+#include <CLUtils/coro.hpp>
+
+
+const std::string kernel_filename { "kernels/kernels.cl" };
+const unsigned int n_pipelines = 256;
+const unsigned int n_elements = 1 << 14;  // 16K elements per pipeline
+const size_t bufferSize = n_elements * sizeof (int);
+
+
+/*! \brief The buffers and the kernel of a vector addition.
+ *  \details Every pipeline has its own kernel object, since pipelines 
+ *           that run concurrently can't share kernel arguments.
+ */
+struct Pipeline
+{
+    Pipeline (clutils::CLEnv &clEnv) : kernel (clEnv.getProgram (0), "vecAdd")
+    {
+        cl::Context &context (clEnv.getContext ());
+        hBufferA = cl::Buffer (context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bufferSize);
+        hBufferB = cl::Buffer (context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bufferSize);
+        dBufferA = cl::Buffer (context, CL_MEM_READ_ONLY, bufferSize);
+        dBufferB = cl::Buffer (context, CL_MEM_READ_ONLY, bufferSize);
+        dBufferC = cl::Buffer (context, CL_MEM_WRITE_ONLY, bufferSize);
+
+        kernel.setArg (0, dBufferA);
+        kernel.setArg (1, dBufferB);
+        kernel.setArg (2, dBufferC);
+    }
+
+    cl::Kernel kernel;
+    cl::Buffer hBufferA, hBufferB;  /*!< Staging buffers */
+    cl::Buffer dBufferA, dBufferB, dBufferC;  /*!< Device buffers */
+};
+
+
+/*! \brief Runs a pipeline, blocking on `finish` whenever the host needs the data.
+ *
+ *  \return `true` if the results are correct.
+ */
+bool runBlocking (cl::CommandQueue &queue, Pipeline &p, int seed)
+{
+    int *A = (int *) queue.enqueueMapBuffer (p.hBufferA, CL_FALSE, CL_MAP_WRITE, 0, bufferSize);
+    int *B = (int *) queue.enqueueMapBuffer (p.hBufferB, CL_FALSE, CL_MAP_WRITE, 0, bufferSize);
+    queue.finish ();
+
+    for (unsigned int i = 0; i < n_elements; ++i)
+    {
+        A[i] = seed + i;
+        B[i] = i;
+    }
+
+    queue.enqueueUnmapMemObject (p.hBufferA, A);
+    queue.enqueueUnmapMemObject (p.hBufferB, B);
+    queue.enqueueCopyBuffer (p.hBufferA, p.dBufferA, 0, 0, bufferSize);
+    queue.enqueueCopyBuffer (p.hBufferB, p.dBufferB, 0, 0, bufferSize);
+    queue.enqueueNDRangeKernel (p.kernel, cl::NullRange, cl::NDRange (n_elements), cl::NDRange (256));
+    queue.enqueueCopyBuffer (p.dBufferC, p.hBufferA, 0, 0, bufferSize);
+
+    int *C = (int *) queue.enqueueMapBuffer (p.hBufferA, CL_TRUE, CL_MAP_READ, 0, bufferSize);
+    bool status = true;
+    for (unsigned int i = 0; i < n_elements; ++i)
+        if (C[i] != seed + 2 * (int) i) { status = false; break; }
+    queue.enqueueUnmapMemObject (p.hBufferA, C);
+    queue.finish ();
+
+    return status;
+}
+
+
+/*! \brief Runs a pipeline as a coroutine. 
+ *  \details It suspends, instead of blocking, whenever the host needs 
+ *           the data. The commands in between aren't awaited, since 
+ *           the queue executes them in order anyway.
+ */
+clutils::coro::Task<> runAsync (cl::CommandQueue &queue, Pipeline &p, int seed, std::atomic<unsigned int> &failures)
+{
+    namespace coro = clutils::coro;
+
+    int *A = (int *) co_await coro::map (queue, p.hBufferA, CL_MAP_WRITE, 0, bufferSize);
+    int *B = (int *) co_await coro::map (queue, p.hBufferB, CL_MAP_WRITE, 0, bufferSize);
+
+    for (unsigned int i = 0; i < n_elements; ++i)
+    {
+        A[i] = seed + i;
+        B[i] = i;
+    }
+
+    coro::unmap (queue, p.hBufferA, A);
+    coro::unmap (queue, p.hBufferB, B);
+    coro::copy (queue, p.hBufferA, p.dBufferA, 0, 0, bufferSize);
+    coro::copy (queue, p.hBufferB, p.dBufferB, 0, 0, bufferSize);
+    coro::kernel (queue, p.kernel, cl::NDRange (n_elements), cl::NDRange (256));
+    coro::copy (queue, p.dBufferC, p.hBufferA, 0, 0, bufferSize);
+
+    int *C = (int *) co_await coro::map (queue, p.hBufferA, CL_MAP_READ, 0, bufferSize);
+    bool status = true;
+    for (unsigned int i = 0; i < n_elements; ++i)
+        if (C[i] != seed + 2 * (int) i) { status = false; break; }
+    co_await coro::unmap (queue, p.hBufferA, C);
+
+    if (!status) ++failures;
+}
+
+
+int main ()
+{
+    try
+    {
+        clutils::CLEnv clEnv (kernel_filename);
+        cl::CommandQueue &queue (clEnv.getQueue ());
+
+        std::vector<Pipeline> pipelines;
+        pipelines.reserve (n_pipelines);
+        for (unsigned int i = 0; i < n_pipelines; ++i)
+            pipelines.emplace_back (clEnv);
+
+        clutils::CPUTimer<double, std::milli> timer;
+
+        unsigned int failures = 0;
+        timer.start ();
+        for (unsigned int i = 0; i < n_pipelines; ++i)
+            failures += !runBlocking (queue, pipelines[i], i);
+        timer.stop ();
+        std::cout << "Blocking:   " << n_pipelines << " pipelines in " 
+                  << timer.duration () << " ms, " << failures << " failed" << std::endl;
+
+        std::atomic<unsigned int> asyncFailures (0);
+        clutils::coro::Executor executor (4);
+        timer.start ();
+        for (unsigned int i = 0; i < n_pipelines; ++i)
+            executor.spawn (runAsync (queue, pipelines[i], i, asyncFailures));
+        executor.wait ();
+        timer.stop ();
+        std::cout << "Coroutines: " << n_pipelines << " pipelines in " 
+                  << timer.duration () << " ms, " << asyncFailures << " failed" << std::endl;
+
+        return (failures || asyncFailures) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    catch (const cl::Error &error)
+    {
+        std::cerr << error.what ()
+                  << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
+                  << ")"  << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,139 @@
+/*! \file primitives.cpp
+ *  \brief A benchmark for the parallel primitives (reduce, scan).
+ *         Every primitive is timed against its host baseline
+ *         (`std::accumulate`, `std::partial_sum`), and the
+ *         achieved bandwidth is reported in GB/s.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <vector>
+#include <numeric>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+
+
+const unsigned int n_elements = 1 << 24;  // 16M elements
+const unsigned int nRepeat = 10;
+
+
+/*! \brief Prints the bandwidth achieved by a test.
+ *
+ *  \param[in] label a label for the test.
+ *  \param[in] bytes the number of bytes the test reads and writes.
+ *  \param[in] ms the execution time of the test in milliseconds.
+ */
+void printBandwidth (const char *label, double bytes, double ms)
+{
+    std::cout << "   " << label << ": " << bytes / ms / 1e6 << " GB/s" << std::endl;
+}
+
+
+int main (/*int argc, char **argv*/)
+{
+    try
+    {
+        clutils::CLEnv clEnv;
+        cl::Context &context (clEnv.addContext (0));
+        cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+        std::vector<cl_int> hIn (n_elements), hOut (n_elements);
+        for (unsigned int i = 0; i < n_elements; ++i)
+            hIn[i] = i % 64;
+
+        cl::Buffer dIn (context, CL_MEM_READ_ONLY, n_elements * sizeof (cl_int));
+        cl::Buffer dOut (context, CL_MEM_READ_WRITE, n_elements * sizeof (cl_int));
+        queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n_elements * sizeof (cl_int), hIn.data ());
+
+        clutils::Reduce<cl_int> reduce (clEnv);
+        clutils::Scan<cl_int> scan (clEnv);
+        clutils::CPUTimer<double, std::milli> timer;
+
+        // Reduce -------------------------------------------------------------
+
+        clutils::ProfilingInfo<nRepeat> pHostRed ("std::accumulate"), pDevRed ("Reduce<int, Sum>");
+        volatile cl_int sink = 0;
+
+        for (unsigned int i = 0; i < nRepeat; ++i)
+        {
+            timer.start ();
+            sink = std::accumulate (hIn.begin (), hIn.end (), 0);
+            pHostRed[i] = timer.stop ();
+        }
+
+        cl_int result = reduce.run (dIn, n_elements);  // Warm up
+        for (unsigned int i = 0; i < nRepeat; ++i)
+        {
+            timer.start ();
+            reduce.run (dIn, n_elements, dOut);
+            queue.finish ();
+            pDevRed[i] = timer.stop ();
+        }
+
+        pDevRed.print (pHostRed, "Reduce (16M ints)");
+        printBandwidth ("Host  ", n_elements * sizeof (cl_int), pHostRed.mean ());
+        printBandwidth ("Device", n_elements * sizeof (cl_int), pDevRed.mean ());
+        std::cout << (result == sink ? "   Success!" : "   Failed!") << std::endl;
+
+        // Scan ---------------------------------------------------------------
+
+        clutils::ProfilingInfo<nRepeat> pHostScan ("std::partial_sum"), pDevScan ("Scan<int, Sum>");
+
+        for (unsigned int i = 0; i < nRepeat; ++i)
+        {
+            timer.start ();
+            std::partial_sum (hIn.begin (), hIn.end (), hOut.begin ());
+            pHostScan[i] = timer.stop ();
+        }
+
+        scan.run (dIn, n_elements, dOut);  // Warm up
+        queue.finish ();
+        for (unsigned int i = 0; i < nRepeat; ++i)
+        {
+            timer.start ();
+            scan.run (dIn, n_elements, dOut);
+            queue.finish ();
+            pDevScan[i] = timer.stop ();
+        }
+
+        std::vector<cl_int> hRes (n_elements);
+        queue.enqueueReadBuffer (dOut, CL_TRUE, 0, n_elements * sizeof (cl_int), hRes.data ());
+
+        pDevScan.print (pHostScan, "Inclusive Scan (16M ints)");
+        printBandwidth ("Host  ", 2.0 * n_elements * sizeof (cl_int), pHostScan.mean ());
+        printBandwidth ("Device", 2.0 * n_elements * sizeof (cl_int), pDevScan.mean ());
+        std::cout << (hRes == hOut ? "   Success!" : "   Failed!") << std::endl;
+
+        return 0;
+    }
+    catch (const cl::Error &error)
+    {
+        std::cerr << error.what ()
+                  << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
+                  << ")"  << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
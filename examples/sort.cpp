@@ -0,0 +1,151 @@
+/*! \file sort.cpp
+ *  \brief A benchmark for the radix sort. It reports the sorting rate in
+ *         keys/second for 1M to 64M keys, against `std::sort` and
+ *         a parallel host sort.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <thread>
+#include <algorithm>
+#include <CLUtils.hpp>
+#include <CLUtils/sort.hpp>
+
+
+const unsigned int nRepeat = 3;
+
+
+/*! \brief Sorts a vector on all hardware threads. 
+ *  \details Every thread sorts a chunk with `std::sort`, 
+ *           and then the chunks get merged pairwise in parallel.
+ */
+void parallelSort (std::vector<cl_uint> &v)
+{
+    unsigned int nThreads = std::max (std::thread::hardware_concurrency (), 1u);
+    std::vector<size_t> bounds;
+    for (unsigned int t = 0; t <= nThreads; ++t)
+        bounds.push_back (v.size () * t / nThreads);
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < nThreads; ++t)
+        threads.emplace_back ([&v, &bounds, t] { 
+            std::sort (v.begin () + bounds[t], v.begin () + bounds[t + 1]); });
+    for (auto &th : threads) th.join ();
+
+    for (unsigned int width = 1; width < nThreads; width *= 2)
+    {
+        threads.clear ();
+        for (unsigned int t = 0; t + width < nThreads; t += 2 * width)
+        {
+            size_t b = bounds[t], m = bounds[t + width];
+            size_t e = bounds[std::min (t + 2 * width, nThreads)];
+            threads.emplace_back ([&v, b, m, e] { 
+                std::inplace_merge (v.begin () + b, v.begin () + m, v.begin () + e); });
+        }
+        for (auto &th : threads) th.join ();
+    }
+}
+
+
+/*! \brief Prints the sorting rate of a test.
+ *
+ *  \param[in] label a label for the test.
+ *  \param[in] n the number of keys.
+ *  \param[in] ms the execution time of the test in milliseconds.
+ */
+void printRate (const char *label, unsigned int n, double ms)
+{
+    std::cout << "   " << label << ": " << n / ms / 1e3 << " Mkeys/s" << std::endl;
+}
+
+
+int main (/*int argc, char **argv*/)
+{
+    try
+    {
+        clutils::CLEnv clEnv;
+        cl::Context &context (clEnv.addContext (0));
+        cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+        clutils::RadixSort<cl_uint> sort (clEnv);
+        clutils::CPUTimer<double, std::milli> timer;
+
+        std::default_random_engine generator;
+        std::uniform_int_distribution<cl_uint> distribution;
+
+        for (unsigned int n : { 1u << 20, 1u << 22, 1u << 24, 1u << 26 })
+        {
+            std::vector<cl_uint> hKeys (n), hWork (n), hRes (n);
+            for (auto &k : hKeys) k = distribution (generator);
+
+            cl::Buffer dKeys (context, CL_MEM_READ_WRITE, n * sizeof (cl_uint));
+
+            clutils::ProfilingInfo<nRepeat> pStd ("std::sort"), pPar ("Parallel host sort"), 
+                                            pDev ("RadixSort<uint>");
+
+            for (unsigned int i = 0; i < nRepeat; ++i)
+            {
+                hWork = hKeys;
+                timer.start ();
+                std::sort (hWork.begin (), hWork.end ());
+                pStd[i] = timer.stop ();
+
+                hWork = hKeys;
+                timer.start ();
+                parallelSort (hWork);
+                pPar[i] = timer.stop ();
+
+                queue.enqueueWriteBuffer (dKeys, CL_TRUE, 0, n * sizeof (cl_uint), hKeys.data ());
+                timer.start ();
+                sort.run (dKeys, n);
+                queue.finish ();
+                pDev[i] = timer.stop ();
+            }
+
+            queue.enqueueReadBuffer (dKeys, CL_TRUE, 0, n * sizeof (cl_uint), hRes.data ());
+
+            std::string title = "Sort (" + std::to_string (n >> 20) + "M uints)";
+            pDev.print (pStd, title.c_str ());
+            pPar.print (nullptr, false);
+            std::cout << std::endl;
+            printRate ("std::sort    ", n, pStd.mean ());
+            printRate ("Parallel sort", n, pPar.mean ());
+            printRate ("RadixSort    ", n, pDev.mean ());
+            std::cout << (hRes == hWork ? "   Success!" : "   Failed!") << std::endl;
+        }
+
+        return 0;
+    }
+    catch (const cl::Error &error)
+    {
+        std::cerr << error.what ()
+                  << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
+                  << ")"  << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,125 @@
+/*! \file startup.cpp
+ *  \brief A benchmark for the startup time of `CLEnv`. Building for the
+ *         devices with queues only is timed against enumerating every
+ *         platform and building for every device in the first platform.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <vector>
+#include <CLUtils.hpp>
+
+
+const std::vector<std::string> kernel_filenames { "kernels/kernels.cl", "kernels/kernels2.cl" };
+const char *build_options = "-D INIT_NUM=1";
+const unsigned int nRepeat = 5;
+
+
+int main (/*int argc, char **argv*/)
+{
+    try
+    {
+        clutils::CPUTimer<double, std::milli> timer;
+
+        // Report the environment --------------------------------------------
+
+        std::vector<cl::Platform> platforms;
+        cl::Platform::get (&platforms);
+        std::cout << std::endl << "Platforms: " << platforms.size () << std::endl;
+        for (auto &platform : platforms)
+        {
+            std::vector<cl::Device> devices;
+            platform.getDevices (CL_DEVICE_TYPE_ALL, &devices);
+            std::cout << "   " << platform.getInfo<CL_PLATFORM_NAME> () 
+                      << ": " << devices.size () << " device(s)" << std::endl;
+        }
+
+        std::cout << std::endl << "Device ranking (properties)" << std::endl;
+        for (auto &score : clutils::rankDevices (platforms))
+            std::cout << "   platform " << score.pIdx << ", device " << score.dIdx 
+                      << ": " << score.score << std::endl;
+
+        // Empty environment --------------------------------------------------
+
+        clutils::ProfilingInfo<nRepeat> pEmpty ("CLEnv ()");
+        for (unsigned int i = 0; i < nRepeat; ++i)
+        {
+            timer.start ();
+            clutils::CLEnv clEnv;
+            pEmpty[i] = timer.stop ();
+        }
+
+        // Lazy build ---------------------------------------------------------
+
+        clutils::ProfilingInfo<nRepeat> pLazy ("CLEnv (kernels)");
+        for (unsigned int i = 0; i < nRepeat; ++i)
+        {
+            timer.start ();
+            clutils::CLEnv clEnv (kernel_filenames, build_options, 
+                                  clutils::DeviceSelection::PROPERTIES, true);
+            clEnv.getKernel ("vecAdd");
+            pLazy[i] = timer.stop ();
+        }
+
+        // Eager build --------------------------------------------------------
+
+        clutils::ProfilingInfo<nRepeat> pEager ("Every device");
+        for (unsigned int i = 0; i < nRepeat; ++i)
+        {
+            timer.start ();
+
+            // Enumerate the devices on every platform
+            std::vector<cl::Platform> plats;
+            cl::Platform::get (&plats);
+            for (auto &platform : plats)
+            {
+                std::vector<cl::Device> devices;
+                platform.getDevices (CL_DEVICE_TYPE_ALL, &devices);
+            }
+
+            // Build for every device in the first platform
+            clutils::CLEnv clEnv;
+            clEnv.addContext (0);
+            for (unsigned int d = 0; d < clEnv.devices[0].size (); ++d)
+                clEnv.addQueue (0, d);
+            clEnv.addProgram (0, kernel_filenames, "vecAdd", build_options);
+
+            pEager[i] = timer.stop ();
+        }
+
+        pEmpty.print ("Empty environment");
+        pLazy.print (pEager, "Startup with kernels");
+
+        return 0;
+    }
+    catch (const cl::Error &error)
+    {
+        std::cerr << error.what ()
+                  << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
+                  << ")"  << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,118 @@
+/*! \file streaming.cpp
+ *  \brief A benchmark for the out-of-core streaming. A vector addition
+ *         is streamed in chunks through the device, with a single slot
+ *         (no overlap), and with overlapped slots.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <CLUtils.hpp>
+#include <CLUtils/stream.hpp>
+
+
+const unsigned int nRepeat = 5;
+
+
+/*! \brief Prints the bandwidth achieved by a test.
+ *
+ *  \param[in] label a label for the test.
+ *  \param[in] bytes the number of bytes the test transfers.
+ *  \param[in] ms the execution time of the test in milliseconds.
+ */
+void printBandwidth (const char *label, double bytes, double ms)
+{
+    std::cout << "   " << label << ": " << bytes / ms / 1e6 << " GB/s" << std::endl;
+}
+
+
+/*! \brief Streams `a + b` over a dataset of the requested 
+ *         size in MB (the default is 256MB per input).
+ */
+int main (int argc, char **argv)
+{
+    try
+    {
+        size_t n = (argc > 1 ? std::atol (argv[1]) : 256) * (1 << 20) / sizeof (cl_int);
+
+        clutils::CLEnv clEnv ("kernels/kernels.cl");
+        cl::Kernel &kernel (clEnv.getKernel ("vecAddN"));
+
+        std::vector<cl_int> hA (n), hB (n), hC (n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            hA[i] = i;
+            hB[i] = i;
+        }
+        std::vector<clutils::StreamInput> inputs { { hA.data (), sizeof (cl_int) }, 
+                                                   { hB.data (), sizeof (cl_int) } };
+
+        clutils::StreamProcessor single (clEnv, clutils::CLEnvInfo<1> (), 1);
+        clutils::StreamProcessor overlapped (clEnv, clutils::CLEnvInfo<1> (), 3);
+        clutils::CPUTimer<double, std::milli> timer;
+        clutils::ProfilingInfo<nRepeat> pSingle ("1 slot"), pOverlapped ("3 slots");
+
+        for (unsigned int i = 0; i <= nRepeat; ++i)
+        {
+            timer.start ();
+            single.run (kernel, inputs, n, sizeof (cl_int), clutils::memorySink (hC.data ()));
+            double t = timer.stop ();
+            if (i) pSingle[i - 1] = t;  // The first run allocates the slots
+        }
+
+        for (unsigned int i = 0; i <= nRepeat; ++i)
+        {
+            timer.start ();
+            overlapped.run (kernel, inputs, n, sizeof (cl_int), clutils::memorySink (hC.data ()));
+            double t = timer.stop ();
+            if (i) pOverlapped[i - 1] = t;
+        }
+
+        bool correct = true;
+        for (size_t i = 0; i < n; ++i)
+            if (hC[i] != 2 * (cl_int) i) { correct = false; break; }
+
+        // Two inputs go to the device, and one output comes back
+        double bytes = 3.0 * n * sizeof (cl_int);
+        std::cout << "   Chunk: " << overlapped.chunkElements (inputs, sizeof (cl_int)) 
+                  << " elements" << std::endl;
+        pOverlapped.print (pSingle, "Streamed vector addition");
+        printBandwidth ("1 slot ", bytes, pSingle.mean ());
+        printBandwidth ("3 slots", bytes, pOverlapped.mean ());
+        std::cout << (correct ? "   Success!" : "   Failed!") << std::endl;
+
+        return 0;
+    }
+    catch (const cl::Error &error)
+    {
+        std::cerr << error.what ()
+                  << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
+                  << ")"  << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
@@ -0,0 +1,156 @@
+/*! \file transfer.cpp
+ *  \brief A benchmark for the transfer coalescer. Thousands of small
+ *         regions are written to and read from a pool buffer, one
+ *         command per region, and coalesced.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <CLUtils.hpp>
+#include <CLUtils/transfer.hpp>
+
+
+const unsigned int nRegions = 4096;
+const unsigned int nRepeat = 10;
+
+
+/*! \brief Prints the transfer rate achieved by a test.
+ *
+ *  \param[in] label a label for the test.
+ *  \param[in] transfers the number of transfers in the test.
+ *  \param[in] ms the execution time of the test in milliseconds.
+ *  \param[in] commands the number of commands the test enqueued.
+ */
+void printRate (const char *label, double transfers, double ms, unsigned int commands)
+{
+    std::cout << "   " << label << ": " << transfers / ms * 1e3 << " transfers/s, " 
+              << commands << " commands" << std::endl;
+}
+
+
+int main (/*int argc, char **argv*/)
+{
+    try
+    {
+        clutils::CLEnv clEnv;
+        cl::Context &context (clEnv.addContext (0));
+        cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+        // Regions of 16 to 512 bytes, scattered in a pool
+        std::default_random_engine generator (1);
+        std::uniform_int_distribution<size_t> sizes (4, 128);
+        std::vector<size_t> offsets (nRegions), lengths (nRegions);
+        size_t poolSize = 0;
+        for (unsigned int i = 0; i < nRegions; ++i)
+        {
+            lengths[i] = 4 * sizes (generator);
+            offsets[i] = poolSize;
+            poolSize += lengths[i] + 64;
+        }
+
+        std::vector<char> hData (poolSize, 1), hBack (poolSize);
+        cl::Buffer dPool (context, CL_MEM_READ_WRITE, poolSize);
+
+        clutils::TransferCoalescer tc (clEnv);
+        clutils::CPUTimer<double, std::milli> timer;
+        clutils::ProfilingInfo<nRepeat> pDirectW ("Direct"), pCoalescedW ("Coalesced");
+        clutils::ProfilingInfo<nRepeat> pDirectR ("Direct"), pCoalescedR ("Coalesced");
+
+        // Writes -------------------------------------------------------------
+
+        for (unsigned int i = 0; i <= nRepeat; ++i)
+        {
+            timer.start ();
+            for (unsigned int r = 0; r < nRegions; ++r)
+                queue.enqueueWriteBuffer (dPool, CL_FALSE, offsets[r], lengths[r], &hData[offsets[r]]);
+            queue.finish ();
+            double t = timer.stop ();
+            if (i) pDirectW[i - 1] = t;  // The first run warms up the driver
+        }
+
+        unsigned int commandsW = 0;
+        for (unsigned int i = 0; i <= nRepeat; ++i)
+        {
+            timer.start ();
+            for (unsigned int r = 0; r < nRegions; ++r)
+                tc.write (dPool, offsets[r], lengths[r], &hData[offsets[r]]);
+            tc.flush ();
+            queue.finish ();
+            double t = timer.stop ();
+            if (i) pCoalescedW[i - 1] = t;
+            commandsW = tc.commands ();
+        }
+
+        // Reads --------------------------------------------------------------
+
+        for (unsigned int i = 0; i <= nRepeat; ++i)
+        {
+            timer.start ();
+            for (unsigned int r = 0; r < nRegions; ++r)
+                queue.enqueueReadBuffer (dPool, CL_FALSE, offsets[r], lengths[r], &hBack[offsets[r]]);
+            queue.finish ();
+            double t = timer.stop ();
+            if (i) pDirectR[i - 1] = t;
+        }
+
+        unsigned int commandsR = 0;
+        for (unsigned int i = 0; i <= nRepeat; ++i)
+        {
+            timer.start ();
+            for (unsigned int r = 0; r < nRegions; ++r)
+                tc.read (dPool, offsets[r], lengths[r], &hBack[offsets[r]]);
+            tc.flush ();
+            double t = timer.stop ();
+            if (i) pCoalescedR[i - 1] = t;
+            commandsR = tc.commands ();
+        }
+
+        bool correct = true;
+        for (unsigned int r = 0; r < nRegions; ++r)
+            for (size_t k = offsets[r]; k < offsets[r] + lengths[r]; ++k)
+                if (hBack[k] != hData[k]) correct = false;
+
+        pCoalescedW.print (pDirectW, "Small writes (4096 regions)");
+        printRate ("Direct   ", nRegions, pDirectW.mean (), nRegions);
+        printRate ("Coalesced", nRegions, pCoalescedW.mean (), commandsW);
+        pCoalescedR.print (pDirectR, "Small reads (4096 regions)");
+        printRate ("Direct   ", nRegions, pDirectR.mean (), nRegions);
+        printRate ("Coalesced", nRegions, pCoalescedR.mean (), commandsR);
+        std::cout << (correct ? "   Success!" : "   Failed!") << std::endl;
+
+        return 0;
+    }
+    catch (const cl::Error &error)
+    {
+        std::cerr << error.what ()
+                  << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
+                  << ")"  << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
@@ -29,11 +29,15 @@
 
 #include <iostream>
 #include <vector>
+#include <atomic>
 #include <CLUtils.hpp>
+#include <CLUtils/pool.hpp>
 
 
 const std::string kernel_filename { "kernels/kernels.cl" };
 const int n_elements = 1 << 24;  // 16M elements
+const int n_chunks = 8;
+const int n_chunk_elements = n_elements / n_chunks;
 
 
 /*! \brief Creates an OpenCL environment, and then
@@ -85,30 +89,48 @@ vecAdd::vecAdd (const std::string &kernel_filename)
 }
 
 
-/*! \brief Prepares the buffers, initializes the data, and executes the kernels. */
+/*! \brief Prepares the buffers, initializes the data, and executes the kernels.
+ *  \details The host work is split in chunks, and spread over the threads of 
+ *           the pool. A chunk is sent to the device as soon as it's filled, 
+ *           while the next one is being filled, and a chunk of the results 
+ *           is verified while the next ones are being mapped.
+ */
 void vecAdd::run ()
 {
-    // Get pointers to the staging buffers
-    int *A = (int *) queue.enqueueMapBuffer 
-                (hBufferA, CL_FALSE, CL_MEM_WRITE_ONLY, 0, n_elements * sizeof (int));
-    int *B = (int *) queue.enqueueMapBuffer 
-                (hBufferB, CL_FALSE, CL_MEM_WRITE_ONLY, 0, n_elements * sizeof (int));
-    queue.finish ();
+    clutils::ThreadPool &pool = clutils::ThreadPool::instance ();
+    const size_t chunk_bytes = n_chunk_elements * sizeof (int);
 
-    // Initialize the staging buffers
-    for (int i = 0; i < n_elements; ++i)
+    // Get pointers to the chunks of the staging buffers
+    std::vector<int *> A (n_chunks), B (n_chunks);
+    for (int k = 0; k < n_chunks; ++k)
     {
-        A[i] = i;
-        B[i] = i;
+        A[k] = (int *) queue.enqueueMapBuffer 
+                    (hBufferA, CL_FALSE, CL_MAP_WRITE, k * chunk_bytes, chunk_bytes);
+        B[k] = (int *) queue.enqueueMapBuffer 
+                    (hBufferB, CL_FALSE, CL_MAP_WRITE, k * chunk_bytes, chunk_bytes);
     }
+    queue.finish ();
 
-    // Unmap the staging buffers
-    queue.enqueueUnmapMemObject (hBufferA, A);
-    queue.enqueueUnmapMemObject (hBufferB, B);
-
-    // Transfer the data to the device
-    queue.enqueueCopyBuffer (hBufferA, dBufferA, 0, 0, n_elements * sizeof (int));
-    queue.enqueueCopyBuffer (hBufferB, dBufferB, 0, 0, n_elements * sizeof (int));
+    for (int k = 0; k < n_chunks; ++k)
+    {
+        // Initialize a chunk of the staging buffers
+        const int first = k * n_chunk_elements;
+        pool.parallel_for (0, n_chunk_elements, [&] (size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                A[k][i] = first + (int) i;
+                B[k][i] = first + (int) i;
+            }
+        });
+
+        // Unmap the chunk, and transfer it to the device
+        queue.enqueueUnmapMemObject (hBufferA, A[k]);
+        queue.enqueueUnmapMemObject (hBufferB, B[k]);
+        queue.enqueueCopyBuffer (hBufferA, dBufferA, k * chunk_bytes, k * chunk_bytes, chunk_bytes);
+        queue.enqueueCopyBuffer (hBufferB, dBufferB, k * chunk_bytes, k * chunk_bytes, chunk_bytes);
+        queue.flush ();
+    }
 
     // Dispatch the kernel
     queue.enqueueNDRangeKernel (kernel_vecAdd, cl::NullRange, global, local);
@@ -116,18 +138,36 @@ void vecAdd::run ()
     // Read back the output data
     queue.enqueueCopyBuffer (dBufferC, hBufferA, 0, 0, n_elements * sizeof (int));
 
-    queue.finish ();
+    // Map the chunks of the results
+    std::vector<int *> C (n_chunks);
+    std::vector<cl::Event> mapped (n_chunks);
+    for (int k = 0; k < n_chunks; ++k)
+        C[k] = (int *) queue.enqueueMapBuffer 
+                    (hBufferA, CL_FALSE, CL_MAP_READ, k * chunk_bytes, chunk_bytes, nullptr, &mapped[k]);
+    queue.flush ();
 
     // Verify the results
-    bool status = true;
-    for (int i = 0; i < n_elements; ++i)
+    std::atomic<bool> status (true);
+    for (int k = 0; k < n_chunks; ++k)
     {
-        if (A[i] != i+i)
+        mapped[k].wait ();
+
+        const int first = k * n_chunk_elements;
+        pool.parallel_for (0, n_chunk_elements, [&] (size_t begin, size_t end)
         {
-            status = false;
-            break;
-        }
+            for (size_t i = begin; i < end && status.load (std::memory_order_relaxed); ++i)
+            {
+                if (C[k][i] != 2 * (first + (int) i))
+                {
+                    status = false;
+                    break;
+                }
+            }
+        });
+
+        queue.enqueueUnmapMemObject (hBufferA, C[k]);
     }
+    queue.finish ();
 
     if (status) 
         std::cout << "Success!" << std::endl;
@@ -0,0 +1,160 @@
+/*! \file vectorWidth.cpp
+ *  \brief A benchmark for the vectorized kernels. The scalar `vecAdd`
+ *         is timed against `vecAddVec` built for every vector width,
+ *         and for the width that CLEnv injects from the device.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <CLUtils.hpp>
+
+
+const std::string kernel_filename { "kernels/kernels.cl" };
+const unsigned int n_elements = 1 << 24;  // 16M elements
+const unsigned int nRepeat = 10;
+
+
+/*! \brief Prints the bandwidth achieved by a test.
+ *
+ *  \param[in] label a label for the test.
+ *  \param[in] bytes the number of bytes the test reads and writes.
+ *  \param[in] ms the execution time of the test in milliseconds.
+ */
+void printBandwidth (const char *label, double bytes, double ms)
+{
+    std::cout << "   " << label << ": " << bytes / ms / 1e6 << " GB/s" << std::endl;
+}
+
+
+/*! \brief Times a kernel on the device.
+ *
+ *  \param[in] queue the command queue on which the kernel is enqueued.
+ *  \param[in] kernel the kernel to execute.
+ *  \param[in] width the number of elements handled by a work-item.
+ *  \param[in] timer a timer for the device in which the queue resides.
+ *  \param[out] pInfo the profiling data to fill.
+ */
+template <unsigned int nRepeat>
+void timeKernel (cl::CommandQueue &queue, cl::Kernel &kernel, unsigned int width, 
+                 clutils::GPUTimer<std::milli> &timer, 
+                 clutils::ProfilingInfo<nRepeat> &pInfo)
+{
+    unsigned int nItems = (n_elements + width - 1) / width;
+    cl::NDRange global ((nItems + 255) / 256 * 256), local (256);
+
+    queue.enqueueNDRangeKernel (kernel, cl::NullRange, global, local);  // Warm up
+    for (unsigned int i = 0; i < nRepeat; ++i)
+    {
+        queue.enqueueNDRangeKernel (kernel, cl::NullRange, global, local, 
+                                    nullptr, &timer.event ());
+        timer.wait ();
+        pInfo[i] = timer.duration ();
+    }
+}
+
+
+int main (/*int argc, char **argv*/)
+{
+    try
+    {
+        clutils::CLEnv clEnv;
+        cl::Context &context (clEnv.addContext (0));
+        cl::CommandQueue &queue (clEnv.addQueue (0, 0, CL_QUEUE_PROFILING_ENABLE));
+        clutils::GPUTimer<std::milli> timer (clEnv.devices[0][0]);
+
+        std::vector<cl_int> hA (n_elements), hC (n_elements);
+        for (unsigned int i = 0; i < n_elements; ++i)
+            hA[i] = i % 64;
+
+        cl::Buffer dA (context, CL_MEM_READ_ONLY, n_elements * sizeof (cl_int));
+        cl::Buffer dC (context, CL_MEM_WRITE_ONLY, n_elements * sizeof (cl_int));
+        queue.enqueueWriteBuffer (dA, CL_TRUE, 0, n_elements * sizeof (cl_int), hA.data ());
+
+        const double bytes = 3.0 * n_elements * sizeof (cl_int);
+
+        // Scalar baseline ----------------------------------------------------
+
+        cl::Kernel &kernel_scalar (clEnv.addProgram (0, kernel_filename, "vecAdd"));
+        kernel_scalar.setArg (0, dA);
+        kernel_scalar.setArg (1, dA);
+        kernel_scalar.setArg (2, dC);
+
+        clutils::ProfilingInfo<nRepeat> pScalar ("vecAdd");
+        timeKernel (queue, kernel_scalar, 1, timer, pScalar);
+
+        std::cout << std::endl << "Scalar (16M ints)" << std::endl;
+        printBandwidth ("vecAdd", bytes, pScalar.mean ());
+
+        // Vectorized ---------------------------------------------------------
+
+        // Mirrors the width that CLEnv injects (the minimum across the devices)
+        unsigned int preferred = 16;
+        for (const cl::Device &device : clEnv.devices[0])
+            preferred = std::min (preferred, 
+                device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT> ());
+
+        const unsigned int widths[] = { 0, 1, 2, 4, 8, 16 };
+        for (unsigned int width : widths)
+        {
+            // Width 0 stands for the default build, which uses the injected width
+            std::string options = width ? "-D VEC_WIDTH=" + std::to_string (width) : "";
+            unsigned int w = width ? width : preferred;
+
+            unsigned int pgIdx = clEnv.getProgramIdx (0, { kernel_filename }, options.c_str ());
+            cl::Kernel &kernel (clEnv.getKernel ("vecAddVec", pgIdx));
+            kernel.setArg (0, dA);
+            kernel.setArg (1, dA);
+            kernel.setArg (2, dC);
+            kernel.setArg (3, n_elements);
+
+            std::string label = "vecAddVec (" + std::to_string (w) + 
+                                (width ? ")" : ", preferred)");
+            clutils::ProfilingInfo<nRepeat> pVec (label);
+            timeKernel (queue, kernel, w, timer, pVec);
+
+            queue.enqueueReadBuffer (dC, CL_TRUE, 0, n_elements * sizeof (cl_int), hC.data ());
+            bool correct = true;
+            for (unsigned int i = 0; i < n_elements; ++i)
+                if (hC[i] != 2 * hA[i]) { correct = false; break; }
+
+            pVec.print (pScalar, "Vectorized (16M ints)");
+            printBandwidth ("Device", bytes, pVec.mean ());
+            std::cout << (correct ? "   Success!" : "   Failed!") << std::endl;
+        }
+
+        return 0;
+    }
+    catch (const cl::Error &error)
+    {
+        std::cerr << error.what ()
+                  << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
+                  << ")"  << std::endl;
+        exit (EXIT_FAILURE);
+    }
+}
@@ -35,15 +35,31 @@
 #include <iostream>
 #include <iomanip>
 #include <vector>
+#include <list>
+#include <deque>
+#include <memory>
+#include <atomic>
 #include <algorithm>
 #include <numeric>
 #include <unordered_map>
+#include <map>
+#include <functional>
+#include <mutex>
 #include <chrono>
 #include <cassert>
 #include <cmath>
+#include <cstdint>
 
 #define __CL_ENABLE_EXCEPTIONS
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define CLUTILS_HAS_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CLUTILS_HAS_TSC
+#endif
+
 #if defined(__APPLE__) || defined(__MACOSX)
 #include <OpenCL/cl.hpp>
 #else
@@ -67,6 +83,13 @@ namespace clutils
     void readSource (const std::vector<std::string> &kernel_filenames, 
                      std::vector<std::string> &sourceCodes);
 
+    /*! \brief Returns include directives for the directories of the requested files. */
+    std::string includeOptions (const std::vector<std::string> &kernel_filenames);
+
+    /*! \brief Returns define directives with the preferred and native 
+     *         vector widths of the requested devices. */
+    std::string vectorWidthOptions (const std::vector<cl::Device> &devs);
+
     /*! \brief Splits a string on the requested delimiter. */
     void split (const std::string &str, char delim, 
                 std::vector<std::string> &names);
@@ -77,6 +100,163 @@ namespace clutils
         make_kernel_pair (const std::string &kernel_filename);
 
 
+    /*! \brief Policies for picking the device a `CLEnv` binds to. */
+    enum class DeviceSelection : uint8_t
+    {
+        FIRST,       /*!< The first device in the first platform. */
+        PROPERTIES,  /*!< The device that scores highest on its properties. */
+        CALIBRATION  /*!< The device that scores highest on a calibration 
+                      *   micro-benchmark. Scores are cached per host. */
+    };
+
+    /*! \brief The score of a device. */
+    struct DeviceScore
+    {
+        unsigned int pIdx;  /*!< The index of the platform. */
+        unsigned int dIdx;  /*!< The index of the device in the platform. */
+        double score;  /*!< The score of the device. Higher is better. */
+    };
+
+    /*! \brief Scores a device on the properties reported by the runtime. */
+    double propertyScore (const cl::Device &device);
+
+    /*! \brief Scores a device on a calibration micro-benchmark. */
+    double calibrationScore (const cl::Device &device);
+
+    /*! \brief Returns the file that caches the calibration scores. */
+    std::string deviceCacheFile ();
+
+    /*! \brief Scores the devices in the requested platforms, 
+     *         and sorts them from best to worst. */
+    std::vector<DeviceScore> rankDevices (const std::vector<cl::Platform> &platforms, 
+                                          DeviceSelection selection = DeviceSelection::PROPERTIES);
+
+
+    /*! \brief Accounts the device memory of a context against a budget, 
+     *         and evicts cached buffers when the budget runs out.
+     *  \details There are two kinds of buffers. The buffers the library 
+     *           allocates for its own use (scratch and staging buffers) are 
+     *           created with `createBuffer`. They count against the budget 
+     *           until the runtime releases them. Cached buffers are created 
+     *           with `cache`, are referred to by an index, and have a host 
+     *           backing store. When a request doesn't fit in the budget, or 
+     *           the runtime fails an allocation, the least recently used 
+     *           cached buffers are read back to their backing store and 
+     *           released. `acquire` restores an evicted buffer transparently. 
+     *           A working set larger than the budget then costs transfers 
+     *           instead of failing. Caches that hold buffers from `createBuffer` 
+     *           (e.g. `UploadCache`) can register with `addReclaimer`, and are 
+     *           asked to drop buffers when evicting isn't enough.
+     *           
+     *           The manager is shared by everything that allocates on the 
+     *           context, so it's safe to use from several threads.
+     *           
+     *           \code
+     *           MemoryManager &memory (clEnv.getMemoryManager ());
+     *           unsigned int idx = memory.cache (CL_MEM_READ_WRITE, size, hData);
+     *           kernel.setArg (0, memory.acquire (idx));
+     *           \endcode
+     *  \note The buffer returned by `acquire` is meant to be used right away. 
+     *        A later `acquire` or `createBuffer`, from any thread, may evict 
+     *        it, unless it is locked. The buffers of a single kernel launch have to fit in 
+     *        the budget together.
+     *  \note The transfers are issued on an in-order queue, so evictions 
+     *        observe the commands that were enqueued on the buffers before them.
+     */
+    class MemoryManager
+    {
+    public:
+        MemoryManager (const cl::Context &context, const cl::CommandQueue &queue, size_t budget = 0);
+        ~MemoryManager ();
+        MemoryManager (const MemoryManager&) = delete;
+        MemoryManager& operator= (const MemoryManager&) = delete;
+        /*! \brief Creates a buffer that counts against the budget while it's alive. */
+        cl::Buffer createBuffer (cl_mem_flags flags, size_t size);
+        /*! \brief Creates a cached buffer that can be evicted to the host. */
+        unsigned int cache (cl_mem_flags flags, size_t size, const void *ptr = nullptr);
+        /*! \brief Gets back a cached buffer, restoring it if it was evicted. */
+        const cl::Buffer& acquire (unsigned int idx);
+        /*! \brief Protects a cached buffer from eviction. */
+        void lock (unsigned int idx);
+        /*! \brief Allows a cached buffer to be evicted again. */
+        void unlock (unsigned int idx);
+        /*! \brief Releases a cached buffer and its backing store. */
+        void release (unsigned int idx);
+        /*! \brief Tells whether a cached buffer is on the device. */
+        bool isResident (unsigned int idx) const;
+        /*! \brief The budget in bytes. */
+        size_t budget () const { std::lock_guard<std::mutex> guard (mtx); return limit; }
+        /*! \brief Changes the budget, and evicts buffers down to it. */
+        void setBudget (size_t bytes);
+        /*! \brief The device memory accounted in bytes. */
+        size_t used () const { std::lock_guard<std::mutex> guard (mtx); return usedBytes (); }
+        /*! \brief The number of evictions so far. */
+        unsigned int evictions () const { std::lock_guard<std::mutex> guard (mtx); return nEvictions; }
+        /*! \brief The number of restorations so far. */
+        unsigned int restorations () const { std::lock_guard<std::mutex> guard (mtx); return nRestorations; }
+        /*! \brief Registers a function that drops one of the buffers a cache 
+         *         holds, for when evicting doesn't make enough room. */
+        unsigned int addReclaimer (std::function<size_t ()> reclaimer);
+        /*! \brief Unregisters a function from `addReclaimer`. */
+        void removeReclaimer (unsigned int id);
+
+    private:
+        /*! \brief The state of a cached buffer. */
+        struct Entry
+        {
+            cl_mem_flags flags;  /*!< The flags of the buffer. */
+            size_t size;  /*!< The size of the buffer in bytes. */
+            cl::Buffer buffer;  /*!< The buffer, while resident. */
+            std::vector<char> host;  /*!< The backing store. */
+            cl::Event pending;  /*!< The last transfer between the buffer and the backing store. */
+            bool valid;  /*!< Tells whether the backing store holds the contents of the buffer. */
+            bool resident;  /*!< Tells whether the buffer is on the device. */
+            bool live;  /*!< Tells whether the entry holds a buffer, or has been released. */
+            unsigned int locks;  /*!< The number of locks on the buffer. */
+            std::list<unsigned int>::iterator use;  /*!< The position of the buffer in the LRU list. */
+        };
+
+        /*! \brief Evicts the least recently used buffer, 
+         *         other than `keep`, that isn't locked. */
+        bool evictOne (unsigned int keep);
+        /*! \brief Asks the reclaimers to drop a buffer, 
+         *         and returns the bytes that got released. */
+        size_t reclaim ();
+        /*! \brief The device memory accounted in bytes, with the lock held. */
+        size_t usedBytes () const { return cachedBytes + *libraryBytes; }
+        /*! \brief Evicts buffers until `size` more bytes fit in the budget. */
+        bool makeRoom (size_t size, unsigned int keep);
+        /*! \brief Allocates a buffer, evicting buffers when the runtime runs out of memory. */
+        cl::Buffer allocate (cl_mem_flags flags, size_t size, unsigned int keep);
+        /*! \brief Returns an entry, or exits on an invalid index. */
+        Entry& entry (unsigned int idx);
+
+        cl::Context context;  /*!< The context of the buffers. */
+        cl::CommandQueue queue;  /*!< The queue for the evictions and restorations. */
+        size_t limit;  /*!< The budget in bytes. */
+        size_t cachedBytes;  /*!< The size of the resident cached buffers. */
+        /*! \brief The size of the live buffers from `createBuffer`.
+         *  \details It's decremented by the destructor callbacks of the 
+         *           buffers, which may run after the manager is gone. */
+        std::shared_ptr< std::atomic<size_t> > libraryBytes;
+        /*! \brief The cached buffers.
+         *  \details A deque keeps the backing stores in place as entries get 
+         *           added, since transfers may be pending on them. */
+        std::deque<Entry> entries;
+        std::vector<unsigned int> freeEntries;  /*!< Indices of released entries. */
+        std::list<unsigned int> lru;  /*!< Cached buffers from least to most recently used. */
+        unsigned int nEvictions;  /*!< The number of evictions. */
+        unsigned int nRestorations;  /*!< The number of restorations. */
+        /*! \brief The functions from `addReclaimer`, in the order they were added. */
+        std::map< unsigned int, std::function<size_t ()> > reclaimers;
+        unsigned int nextReclaimer;  /*!< The id of the next reclaimer. */
+        /*! \brief Guards the state of the manager.
+         *  \details `libraryBytes` is atomic instead, since the runtime 
+         *           updates it from its own threads. */
+        mutable std::mutex mtx;
+    };
+
+
     /*! \brief Sets up an OpenCL environment.
      *  \details Prepares the essential OpenCL objects for the execution of 
      *           kernels. This class aims to allow rapid prototyping by hiding 
@@ -87,10 +267,19 @@ namespace clutils
     {
     public:
         CLEnv (const std::vector<std::string> &kernel_filenames = std::vector<std::string> (), 
-               const char *build_options = nullptr);
+               const char *build_options = nullptr, 
+               DeviceSelection selection = DeviceSelection::PROPERTIES, 
+               bool lazy_build = false);
         CLEnv (const std::string &kernel_filename, 
-               const char *build_options = nullptr);
+               const char *build_options = nullptr, 
+               DeviceSelection selection = DeviceSelection::PROPERTIES, 
+               bool lazy_build = false);
         virtual ~CLEnv () {};
+        /*! \brief Chooses whether the programs created from now on are only 
+         *         built for the devices that have a queue in their context.
+         *  \details With lazy builds, a queue for another device rebuilds 
+         *           the programs of its context (see `addQueue`). */
+        void setLazyBuild (bool lazy) { lazyBuild = lazy; }
         /*! \brief Gets back one of the existing contexts. */
         cl::Context& getContext (unsigned int pIdx = 0);
         /*! \brief Gets back one of the existing command queues 
@@ -106,6 +295,9 @@ namespace clutils
         cl::CommandQueue& addQueue (unsigned int ctxIdx, unsigned int dIdx, cl_command_queue_properties props = 0);
         /*! \brief Creates a queue for the GL-shared device in the specified context. */
         cl::CommandQueue& addQueueGL (unsigned int ctxIdx, cl_command_queue_properties props = 0);
+        /*! \brief Gets back the memory manager of a context, 
+         *         creating it the first time it's requested. */
+        MemoryManager& getMemoryManager (unsigned int ctxIdx = 0, size_t budget = 0);
         /*! \brief Creates a program for the specified context. */
         cl::Kernel& addProgram (unsigned int ctxIdx, 
                                 const std::vector<std::string> &kernel_filenames, 
@@ -115,12 +307,31 @@ namespace clutils
                                 const std::string &kernel_filename, 
                                 const char *kernel_name = nullptr, 
                                 const char *build_options = nullptr);
+        /*! \brief Gets the index of a program built from the specified files 
+         *         and options, creating the program if it doesn't exist yet. */
+        unsigned int getProgramIdx (unsigned int ctxIdx, 
+                                    const std::vector<std::string> &kernel_filenames, 
+                                    const char *build_options = nullptr);
+        /*! \brief Creates a program for the specified context from source code. */
+        cl::Kernel& addProgramSource (unsigned int ctxIdx, 
+                                      const std::string &source, 
+                                      const char *kernel_name = nullptr, 
+                                      const char *build_options = nullptr);
+        /*! \brief Gets the index of a program built from source code that is 
+         *         identified by a signature, creating the program if it doesn't 
+         *         exist yet. */
+        unsigned int getSourceProgramIdx (unsigned int ctxIdx, 
+                                          const std::string &signature, 
+                                          const std::string &source, 
+                                          const char *build_options = nullptr);
 
         // Objects associated with an OpenCL environment.
         // For each of a number of objects, there is a vector that 
         // can hold all instances of that object.
 
-        std::vector<cl::Platform> platforms;  /*!< List of platforms. */
+        /*! \brief List of platforms.
+         *  \details It gets filled the first time a platform is needed. */
+        std::vector<cl::Platform> platforms;
         /*! \brief List of devices per platform.
          *  \details Holds a vector of devices per platform. */
         std::vector< std::vector<cl::Device> > devices;
@@ -134,6 +345,9 @@ namespace clutils
         /*! \brief List of kernels per program.
          *  \details Holds a vector of kernels per program. */
         std::vector< std::vector<cl::Kernel> > kernels;
+        /*! \brief List of memory managers per context.
+         *  \details They are created on demand by `getMemoryManager`. */
+        std::vector< std::unique_ptr<MemoryManager> > memoryManagers;
 
     protected:
         /*! \brief Initializes the OpenGL memory buffers.
@@ -150,6 +364,22 @@ namespace clutils
         virtual void initGLMemObjects () {};
 
     private:
+        /*! \brief Enumerates the platforms, if that hasn't happened yet. */
+        void initPlatforms ();
+        /*! \brief Gets the devices that have a queue in the specified context. */
+        std::vector<cl::Device> queuedDevices (unsigned int ctxIdx);
+        /*! \brief Builds the programs of a context for a device 
+         *         that they haven't been built for yet. */
+        void buildForDevice (unsigned int ctxIdx, const cl::Device &device);
+        /*! \brief Creates a program from source codes, and builds it. */
+        std::vector<std::string> createProgram (unsigned int ctxIdx, 
+                                                const std::vector<std::string> &sourceCodes, 
+                                                const char *build_options);
+        /*! \brief Builds a program, and retrieves its kernels. */
+        std::vector<std::string> buildProgram (unsigned int pgIdx, 
+                                               const std::vector<cl::Device> &devs, 
+                                               const char *build_options);
+
         /*! \brief Maps kernel names to kernel indices.
          *         There is one unordered_map for every program.
          *  
@@ -158,6 +388,29 @@ namespace clutils
          *  name to the kernel index in kernels[i].
          */
         std::vector< std::unordered_map<std::string, unsigned int> > kernelIdx;
+        /*! \brief Maps program signatures to program indices.
+         *  \details A signature is made up of the context index, the kernel 
+         *           filenames and the build options of a program created 
+         *           through `getProgramIdx`. For programs created through 
+         *           `getSourceProgramIdx`, the filenames are replaced by 
+         *           the signature supplied by the caller.
+         */
+        std::unordered_map<std::string, unsigned int> programIdx;
+
+        /*! \brief What is needed to rebuild a program for more devices. */
+        struct ProgramSource
+        {
+            unsigned int ctxIdx;  /*!< The context of the program. */
+            std::vector<std::string> sourceCodes;  /*!< The source codes of the program. */
+            std::string options;  /*!< The build options of the program. */
+            std::vector<cl::Device> devices;  /*!< The devices the program is built for. */
+        };
+        /*! \brief List of program sources.
+         *  \details For every program in programs, there is an element in programSources.
+         */
+        std::vector<ProgramSource> programSources;
+        /*! \brief Tells whether programs are only built for the devices with queues. */
+        bool lazyBuild;
     };
 
 
@@ -233,6 +486,90 @@ namespace clutils
     };
 
 
+    /*! \brief A view over a region of a buffer.
+     *  \details Views let a buffer be split among kernels, queues or devices 
+     *           without new allocations or copies. When the origin of the 
+     *           region satisfies the `CL_DEVICE_MEM_BASE_ADDR_ALIGN` of every 
+     *           device in the buffer's context, the view wraps a sub-buffer. 
+     *           Otherwise, it keeps the parent buffer and a byte offset, 
+     *           which the launch helpers forward to the kernels as an 
+     *           additional argument. Either way, a kernel gets the pair 
+     *           `buffer ()`, `offset<T> ()`.
+     *           
+     *           A `cl::Buffer` converts implicitly to a view of the whole buffer, 
+     *           so a view is accepted everywhere the launch helpers of the 
+     *           library (`Reduce`, `Scan`, `RadixSort`, `Elementwise`) take a buffer.
+     */
+    class BufferView
+    {
+    public:
+        /*! \brief Creates a view of a whole buffer. */
+        BufferView (const cl::Buffer &buffer);
+        /*! \brief Creates a view of a region of a buffer. */
+        BufferView (const cl::Buffer &buffer, size_t origin, size_t size, cl_mem_flags flags = 0);
+        /*! \brief Creates a view of a region of this view. */
+        BufferView slice (size_t origin, size_t size, cl_mem_flags flags = 0) const;
+        /*! \brief The buffer that gets passed to the kernels. */
+        const cl::Buffer& buffer () const { return buf; }
+        /*! \brief The offset of the view in `buffer ()`, in bytes. */
+        size_t offset () const { return off; }
+        /*! \brief The offset of the view in `buffer ()`, in elements of type `T`. */
+        template <typename T>
+        cl_uint offset () const
+        {
+            assert (off % sizeof (T) == 0);
+            return off / sizeof (T);
+        }
+        /*! \brief The size of the view in bytes. */
+        size_t size () const;
+        /*! \brief Tells whether the view wraps a sub-buffer, or a parent buffer and an offset. */
+        bool isSubBuffer () const { return sub; }
+        /*! \brief The alignment in bytes a sub-buffer origin needs in a context. */
+        static size_t alignment (const cl::Context &context);
+
+    private:
+        cl::Buffer buf;  /*!< The buffer that gets passed to the kernels. */
+        size_t off;  /*!< The byte offset of the view in `buf`. */
+        size_t len;  /*!< The size of the view in bytes. */
+        bool whole;  /*!< Tells whether the view covers all of `buf`. */
+        bool sub;  /*!< Tells whether `buf` is a sub-buffer created for the view. */
+    };
+
+
+    /*! \brief Splits the first `n` elements of a buffer into views that 
+     *         can be handed to different queues or devices. */
+    std::vector<BufferView> partition (const cl::Buffer &buffer, size_t n, 
+                                       size_t elementSize, unsigned int parts);
+
+
+
+    /*! \brief A read-only memory mapping of a file.
+     *  \details The pages are brought in by the OS as they are accessed, 
+     *           so files larger than the host memory can be processed.
+     */
+    class MappedFile
+    {
+    public:
+        explicit MappedFile (const std::string &filename);
+        ~MappedFile ();
+        MappedFile (const MappedFile&) = delete;
+        MappedFile& operator= (const MappedFile&) = delete;
+        /*! \brief The contents of the file. */
+        const void* data () const { return ptr; }
+        /*! \brief The size of the file in bytes. */
+        size_t size () const { return len; }
+
+    private:
+        void *ptr;  /*!< The address of the mapping. */
+        size_t len;  /*!< The size of the file in bytes. */
+        #if defined(_WIN32)
+        void *file, *mapping;  /*!< The handles of the file and the mapping. */
+        #else
+        int fd;  /*!< The file descriptor. */
+        #endif
+    };
+
+
     /*! \brief A class that collects and manipulates timing information 
      *         about a test.
      *  \details It stores the execution times of a test in a vector, 
@@ -298,6 +635,33 @@ namespace clutils
             return *std::max_element (tExec.begin (), tExec.end ());
         }
 
+        /*! \brief Returns the median time of the \#nSize executon times.
+         *  \details Unlike the mean, it isn't dragged by the occasional 
+         *           outlier (a context switch, a page fault), so it's the 
+         *           time to compare between runs.
+         *  
+         *  \return The median of the vector elements.
+         */
+        rep median ()
+        {
+            return medianOf (tExec);
+        }
+
+        /*! \brief Returns the median absolute deviation of the 
+         *         \#nSize executon times from their median.
+         *  
+         *  \return A robust measure of the spread of the vector elements.
+         */
+        rep mad ()
+        {
+            rep m = median ();
+            std::vector<rep> dev (tExec.size ());
+            for (size_t i = 0; i < tExec.size (); ++i)
+                dev[i] = std::abs (tExec[i] - m);
+
+            return medianOf (dev);
+        }
+
         /*! \brief Returns the relative performance speedup wrt `refProf`.
          *  
          *  \param[in] refProf a reference test.
@@ -327,6 +691,7 @@ namespace clutils
             std::cout << " " << label << std::endl;
             std::cout << " " << std::string (label.size (), '-') << std::endl;
             std::cout << "   Mean   : " << std::setw (tWidth) << mean ()  << " " << tUnit << std::endl;
+            std::cout << "   Median : " << std::setw (tWidth) << median () << " " << tUnit << std::endl;
             std::cout << "   Min    : " << std::setw (tWidth) << min ()   << " " << tUnit << std::endl;
             std::cout << "   Max    : " << std::setw (tWidth) << max ()   << " " << tUnit << std::endl;
             std::cout << "   Total  : " << std::setw (tWidth) << total () << " " << tUnit << std::endl;
@@ -358,6 +723,19 @@ namespace clutils
         }
 
     private:
+        /*! \brief Returns the median of a vector of times. */
+        static rep medianOf (std::vector<rep> t)
+        {
+            size_t mid = t.size () / 2;
+            std::nth_element (t.begin (), t.begin () + mid, t.end ());
+            if (t.size () % 2)
+                return t[mid];
+
+            rep upper = t[mid];
+            rep lower = *std::max_element (t.begin (), t.begin () + mid);
+            return (lower + upper) / 2;
+        }
+
         std::string label;  /*!< A label characterizing the test. */
         std::vector<rep> tExec;  /*!< Execution times. */
         uint8_t tWidth;  /*!< Width of the results when printing. */
@@ -365,14 +743,106 @@ namespace clutils
     };
 
 
+    /*! \brief A clock that reads the time stamp counter (TSC) of the CPU.
+     *  \details It satisfies the requirements of a `std::chrono` clock, so it 
+     *           can be the clock of a `CPUTimer`. Reading the TSC takes a 
+     *           handful of nanoseconds, which makes it suitable for timing 
+     *           sub-microsecond sections, like the enqueue of a command. The 
+     *           TSC is calibrated against `std::chrono::steady_clock` on the 
+     *           first use of the clock, which takes about 2ms, and the clock 
+     *           reports nanoseconds on the same epoch. On CPUs without an 
+     *           invariant TSC (its rate changes with the frequency of the 
+     *           core, or it isn't synchronized between cores), and on other 
+     *           architectures, the clock falls back to 
+     *           `std::chrono::steady_clock`.
+     */
+    class TSCClock
+    {
+    public:
+        typedef std::chrono::nanoseconds duration;
+        typedef duration::rep rep;
+        typedef duration::period period;
+        typedef std::chrono::time_point<TSCClock> time_point;
+        static const bool is_steady = true;
+
+        /*! \brief Returns the current time. */
+        static time_point now ()
+        {
+            const Calibration &c (calibration ());
+            if (!c.available)
+                return time_point (std::chrono::duration_cast<duration> (
+                    std::chrono::steady_clock::now ().time_since_epoch ()));
+
+            double ticks = (double) (int64_t) (readTSC () - c.base);
+            return time_point (duration (c.offset + (rep) (ticks * c.nsPerTick)));
+        }
+
+        /*! \brief Tells whether the clock reads the TSC, or falls back to `steady_clock`. */
+        static bool available ()
+        {
+            return calibration ().available;
+        }
+
+        /*! \brief Returns the rate of the TSC in ticks per second, or 0 when it's not available. */
+        static double frequency ()
+        {
+            const Calibration &c (calibration ());
+            return c.available ? 1e9 / c.nsPerTick : 0.0;
+        }
+
+        /*! \brief Reads the TSC, or returns 0 on other architectures.
+         *  \details A load fence keeps the read from being executed 
+         *           ahead of the instructions that precede it.
+         */
+        static uint64_t readTSC ()
+        {
+            #if defined(CLUTILS_HAS_TSC)
+            _mm_lfence ();
+            return __rdtsc ();
+            #else
+            return 0;
+            #endif
+        }
+
+    private:
+        /*! \brief The relation between the TSC and `steady_clock`. */
+        struct Calibration
+        {
+            bool available;  /*!< Tells whether there is an invariant TSC. */
+            uint64_t base;  /*!< The TSC at the end of the calibration. */
+            double nsPerTick;  /*!< The duration of a tick in nanoseconds. */
+            int64_t offset;  /*!< The `steady_clock` time at the end of the calibration in nanoseconds. */
+        };
+
+        /*! \brief Measures the rate of the TSC against `steady_clock`. */
+        static Calibration calibrate ();
+
+        /*! \brief Returns the calibration.
+         *  \details It's measured on the first use of the clock, so programs that 
+         *           don't use it don't pay for it, and it's ready for clocks that 
+         *           get read during static initialization.
+         */
+        static const Calibration& calibration ()
+        {
+            static const Calibration c = calibrate ();
+            return c;
+        }
+    };
+
+
     /*! \brief A class for measuring execution times.
-     *  \details CPUTimer is an interface for `std::chrono::duration`.
+     *  \details CPUTimer is an interface for `std::chrono::duration`. The time 
+     *           is accumulated in ticks of the clock, and it's converted to 
+     *           `period` units only when it's requested.
      *  
      *  \tparam rep the type of the value returned by `duration`.
      *  \tparam period the unit of time for the value returned by `duration`.
      *                 It is declared as an `std::ratio<std::intmax_t num, std::intmax_t den>`.
+     *  \tparam clock the clock the timer reads. It can be any `std::chrono` clock, 
+     *                or `TSCClock` for timing sections of tens of nanoseconds.
      */
-    template <typename rep = int64_t, typename period = std::milli>
+    template <typename rep = int64_t, typename period = std::milli, 
+              typename clock = std::chrono::high_resolution_clock>
     class CPUTimer
     {
     public:
@@ -381,7 +851,9 @@ namespace clutils
          * 
          *  \param[in] initVal a value to initialize the timer with.
          */
-        CPUTimer (int initVal = 0) : tDuration (initVal)
+        CPUTimer (int initVal = 0) 
+            : tDuration (std::chrono::duration_cast<typename clock::duration> (
+                  std::chrono::duration<rep, period> (initVal)))
         {
         }
 
@@ -396,7 +868,7 @@ namespace clutils
             if (tReset)
                 reset ();
 
-            tReference = std::chrono::high_resolution_clock::now ();
+            tReference = clock::now ();
         }
 
         /*! \brief Stops the timer. 
@@ -405,8 +877,7 @@ namespace clutils
          */
         rep stop ()
         {
-            tDuration += std::chrono::duration_cast< std::chrono::duration<rep, period> > 
-                (std::chrono::high_resolution_clock::now () - tReference);
+            tDuration += clock::now () - tReference;
 
             return duration ();
         }
@@ -418,20 +889,20 @@ namespace clutils
          */
         rep duration ()
         {
-            return tDuration.count ();
+            return std::chrono::duration_cast< std::chrono::duration<rep, period> > (tDuration).count ();
         }
 
         /*! \brief Resets the timer. */
         void reset ()
         {
-            tDuration = std::chrono::duration<rep, period>::zero ();
+            tDuration = clock::duration::zero ();
         }
 
     private:
         /*! A reference point for when the timer started. */
-        std::chrono::time_point<std::chrono::high_resolution_clock> tReference;
-        /*! The time measured by the timer. */
-        std::chrono::duration<rep, period> tDuration;
+        typename clock::time_point tReference;
+        /*! The time measured by the timer, in ticks of the clock. */
+        typename clock::duration tDuration;
     };
 
 
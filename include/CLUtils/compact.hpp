@@ -0,0 +1,256 @@
+/*! \file compact.hpp
+ *  \brief Declarations of classes for stream compaction on the device.
+ *  \details The kernels are specialized on the element type and the 
+ *           predicate through build options, and are built through 
+ *           `CLEnv::getProgramIdx`, so that objects of the same type 
+ *           share a single build.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef CLUTILS_COMPACT_HPP
+#define CLUTILS_COMPACT_HPP
+
+#include <string>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief The comparisons of the elements with a value, 
+     *         that select elements in `Compact`.
+     */
+    enum class Predicate : uint8_t
+    {
+        LESS,           /*!< `x < value` */
+        LESS_EQUAL,     /*!< `x <= value` */
+        GREATER,        /*!< `x > value` */
+        GREATER_EQUAL,  /*!< `x >= value` */
+        EQUAL,          /*!< `x == value` */
+        NOT_EQUAL       /*!< `x != value` */
+    };
+
+    /*! \brief Returns the define that selects a predicate in the kernels. */
+    inline const char* predicateName (Predicate p)
+    {
+        switch (p)
+        {
+            case Predicate::LESS:          return "PRED_LESS";
+            case Predicate::LESS_EQUAL:    return "PRED_LESS_EQUAL";
+            case Predicate::GREATER:       return "PRED_GREATER";
+            case Predicate::GREATER_EQUAL: return "PRED_GREATER_EQUAL";
+            case Predicate::EQUAL:         return "PRED_EQUAL";
+            default:                       return "PRED_NOT_EQUAL";
+        }
+    }
+
+
+    /*! \brief Selects the elements of a buffer that satisfy a predicate, 
+     *         or partitions the buffer on it.
+     *  \details The elements get flagged, an exclusive `Scan` over the flags 
+     *           gives the positions of the selected elements, and a scatter 
+     *           moves them there. Both operations are stable. The number of 
+     *           selected elements is written to the device, so the output 
+     *           can be consumed without a round trip to the host. 
+     *           The buffer for the positions is kept between calls, and 
+     *           only gets reallocated when a larger input shows up.
+     *
+     *  \tparam T the element type.
+     *  \tparam P the predicate, `x P value`.
+     */
+    template <typename T, Predicate P = Predicate::NOT_EQUAL>
+    class Compact
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment 
+         *                  the kernels will be built and run in.
+         *  \param[in] wgSize the work-group size. It must be a power of 2.
+         *  \param[in] kernel_filename the file with the compaction kernels.
+         */
+        Compact (CLEnv &env, CLEnvInfo<1> info = CLEnvInfo<1> (), unsigned int wgSize = 256, 
+                 const std::string &kernel_filename = "kernels/compact.cl")
+            : memory (env.getMemoryManager (info.ctxIdx)), 
+              queue (env.getQueue (info.ctxIdx, info.qIdx[0])), 
+              scan (env, info, wgSize), wgSize (wgSize), capacity (0)
+        {
+            std::string options = std::string ("-D T=") + CLType<T>::name () + " -D " + predicateName (P);
+            unsigned int pgIdx = env.getProgramIdx (info.ctxIdx, { kernel_filename }, options.c_str ());
+            kernelFlag = env.getKernel ("flagSelected", pgIdx);
+            kernelScatter = env.getKernel ("scatterSelected", pgIdx);
+
+            dCount = memory.createBuffer (CL_MEM_READ_WRITE, sizeof (cl_uint));
+        }
+
+        /*! \brief Copies the elements that satisfy the predicate 
+         *         to the front of the output, in order.
+         *  \note `in` and `out` should not overlap.
+         *
+         *  \param[in] in the input buffer, or a view of it.
+         *  \param[in] n the number of elements.
+         *  \param[out] out the output buffer, or a view of it.
+         *  \param[in] value the value the elements are compared with.
+         *  \param[out] count a buffer, or a view, whose first element 
+         *                    receives the number of selected elements.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the last kernel execution.
+         */
+        void select (const BufferView &in, unsigned int n, const BufferView &out, T value, 
+                     const BufferView &count, 
+                     const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            compact (in, n, out, value, count, false, events, event);
+        }
+
+        /*! \brief Copies the elements that satisfy the predicate 
+         *         to the front of the output, in order, and reads back their number.
+         *  \note It blocks until the number is available.
+         *
+         *  \param[in] in the input buffer, or a view of it.
+         *  \param[in] n the number of elements.
+         *  \param[out] out the output buffer, or a view of it.
+         *  \param[in] value the value the elements are compared with.
+         *  \param[in] events a wait-list of events.
+         *  \return The number of selected elements.
+         */
+        unsigned int select (const BufferView &in, unsigned int n, const BufferView &out, T value, 
+                             const std::vector<cl::Event> *events = nullptr)
+        {
+            select (in, n, out, value, dCount, events);
+            return readCount ();
+        }
+
+        /*! \brief Copies the elements that satisfy the predicate to the front 
+         *         of the output, and the rest after them, both in order.
+         *  \note `in` and `out` should not overlap.
+         *
+         *  \param[in] in the input buffer, or a view of it.
+         *  \param[in] n the number of elements.
+         *  \param[out] out the output buffer, or a view of it.
+         *  \param[in] value the value the elements are compared with.
+         *  \param[out] count a buffer, or a view, whose first element 
+         *                    receives the number of selected elements.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the last kernel execution.
+         */
+        void partition (const BufferView &in, unsigned int n, const BufferView &out, T value, 
+                        const BufferView &count, 
+                        const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            compact (in, n, out, value, count, true, events, event);
+        }
+
+        /*! \brief Copies the elements that satisfy the predicate to the front 
+         *         of the output, and the rest after them, both in order, 
+         *         and reads back the number of selected elements.
+         *  \note It blocks until the number is available.
+         *
+         *  \param[in] in the input buffer, or a view of it.
+         *  \param[in] n the number of elements.
+         *  \param[out] out the output buffer, or a view of it.
+         *  \param[in] value the value the elements are compared with.
+         *  \param[in] events a wait-list of events.
+         *  \return The number of selected elements.
+         */
+        unsigned int partition (const BufferView &in, unsigned int n, const BufferView &out, T value, 
+                                const std::vector<cl::Event> *events = nullptr)
+        {
+            partition (in, n, out, value, dCount, events);
+            return readCount ();
+        }
+
+    private:
+        /*! \brief Makes sure there is a buffer for the positions of `n` elements. */
+        void reserve (unsigned int n)
+        {
+            if (n <= capacity)
+                return;
+
+            dPositions = memory.createBuffer (CL_MEM_READ_WRITE, n * sizeof (cl_uint));
+            capacity = n;
+        }
+
+        /*! \brief Reads back the number of selected elements. */
+        unsigned int readCount ()
+        {
+            cl_uint result;
+            queue.enqueueReadBuffer (dCount, CL_TRUE, 0, sizeof (cl_uint), &result);
+
+            return result;
+        }
+
+        /*! \brief Flags the elements, scans the flags, and scatters the elements. */
+        void compact (const BufferView &in, unsigned int n, const BufferView &out, T value, 
+                      const BufferView &count, bool isPartition, 
+                      const std::vector<cl::Event> *events, cl::Event *event)
+        {
+            if (n == 0)
+            {
+                queue.enqueueFillBuffer (count.buffer (), (cl_uint) 0, count.offset (), 
+                                         sizeof (cl_uint), events, event);
+                return;
+            }
+
+            reserve (n);
+            cl::NDRange global ((n + wgSize - 1) / wgSize * wgSize);
+
+            kernelFlag.setArg (0, in.buffer ());
+            kernelFlag.setArg (1, in.offset<T> ());
+            kernelFlag.setArg (2, dPositions);
+            kernelFlag.setArg (3, n);
+            kernelFlag.setArg (4, value);
+            queue.enqueueNDRangeKernel (kernelFlag, cl::NullRange, global, cl::NDRange (wgSize), events);
+
+            scan.run (dPositions, n, dPositions, ScanType::EXCLUSIVE);
+
+            kernelScatter.setArg (0, in.buffer ());
+            kernelScatter.setArg (1, in.offset<T> ());
+            kernelScatter.setArg (2, out.buffer ());
+            kernelScatter.setArg (3, out.offset<T> ());
+            kernelScatter.setArg (4, dPositions);
+            kernelScatter.setArg (5, count.buffer ());
+            kernelScatter.setArg (6, count.offset<cl_uint> ());
+            kernelScatter.setArg (7, n);
+            kernelScatter.setArg (8, value);
+            kernelScatter.setArg (9, (cl_uint) isPartition);
+            queue.enqueueNDRangeKernel (kernelScatter, cl::NullRange, global, cl::NDRange (wgSize), 
+                                        nullptr, event);
+        }
+
+        MemoryManager &memory;  /*!< The manager the buffers are allocated from. */
+        cl::CommandQueue &queue;  /*!< The queue the kernels get enqueued on. */
+        Scan<cl_uint> scan;  /*!< The scan over the flags. */
+        cl::Kernel kernelFlag, kernelScatter;  /*!< The compaction kernels. */
+        unsigned int wgSize;  /*!< The work-group size. */
+        unsigned int capacity;  /*!< The number of elements the positions are allocated for. */
+        cl::Buffer dPositions;  /*!< The flags, and then the positions, of the elements. */
+        cl::Buffer dCount;  /*!< The number of selected elements, for the blocking calls. */
+    };
+
+}
+
+#endif  // CLUTILS_COMPACT_HPP
@@ -0,0 +1,509 @@
+/*! \file coro.hpp
+ *  \brief Declarations of coroutine tasks, an executor for them, and
+ *         awaitables for OpenCL events and commands.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+
+#ifndef CLUTILS_CORO_HPP
+#define CLUTILS_CORO_HPP
+
+#if !defined(__cpp_impl_coroutine)
+#error "CLUtils/coro.hpp requires C++20 coroutines (e.g. -std=c++20)"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <CLUtils.hpp>
+
+
+namespace clutils
+{
+namespace coro
+{
+
+    class Executor;
+
+
+    /*! \brief A lazy coroutine that produces a value of type `T`.
+     *  \details The coroutine starts when the task is awaited, and the 
+     *           awaiting coroutine resumes when it returns. A task can be 
+     *           awaited once. Exceptions propagate to the awaiting coroutine.
+     *           Top-level tasks are started with `Executor::spawn`.
+     */
+    template <typename T = void>
+    class Task;
+
+
+    namespace detail
+    {
+
+        /*! \brief Resumes the coroutine that awaits a task, when the task returns. */
+        struct FinalAwaiter
+        {
+            bool await_ready () noexcept { return false; }
+
+            template <typename P>
+            std::coroutine_handle<> await_suspend (std::coroutine_handle<P> h) noexcept
+            {
+                std::coroutine_handle<> next = h.promise ().continuation;
+                return next ? next : std::noop_coroutine ();
+            }
+
+            void await_resume () noexcept {}
+        };
+
+
+        /*! \brief The part of the promise of a task that doesn't depend on its value. */
+        struct PromiseBase
+        {
+            std::suspend_always initial_suspend () noexcept { return {}; }
+            FinalAwaiter final_suspend () noexcept { return {}; }
+            void unhandled_exception () { error = std::current_exception (); }
+
+            std::coroutine_handle<> continuation;
+            std::exception_ptr error;
+        };
+
+
+        /*! \brief A coroutine that runs a top-level task, and reports to its executor.
+         *  \details It's destroyed when it returns.
+         */
+        struct Detached
+        {
+            struct promise_type
+            {
+                Detached get_return_object ()
+                {
+                    return { std::coroutine_handle<promise_type>::from_promise (*this) };
+                }
+                std::suspend_always initial_suspend () noexcept { return {}; }
+                std::suspend_never final_suspend () noexcept { return {}; }
+                void return_void () {}
+                void unhandled_exception () { std::terminate (); }
+            };
+
+            std::coroutine_handle<promise_type> handle;
+        };
+
+    }
+
+
+    template <typename T>
+    class Task
+    {
+    public:
+        struct promise_type : detail::PromiseBase
+        {
+            Task get_return_object () { return Task (handle::from_promise (*this)); }
+            void return_value (T v) { value = std::move (v); }
+
+            T value;
+        };
+
+        typedef std::coroutine_handle<promise_type> handle;
+
+        Task (Task &&other) noexcept : h (std::exchange (other.h, nullptr)) {}
+        Task (const Task&) = delete;
+        Task& operator= (const Task&) = delete;
+
+        ~Task ()
+        {
+            if (h) h.destroy ();
+        }
+
+        bool await_ready () noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend (std::coroutine_handle<> awaiting) noexcept
+        {
+            h.promise ().continuation = awaiting;
+            return h;
+        }
+
+        T await_resume ()
+        {
+            if (h.promise ().error)
+                std::rethrow_exception (h.promise ().error);
+            return std::move (h.promise ().value);
+        }
+
+    private:
+        explicit Task (handle h) : h (h) {}
+
+        handle h;
+    };
+
+
+    template <>
+    class Task<void>
+    {
+    public:
+        struct promise_type : detail::PromiseBase
+        {
+            Task get_return_object () { return Task (handle::from_promise (*this)); }
+            void return_void () {}
+        };
+
+        typedef std::coroutine_handle<promise_type> handle;
+
+        Task (Task &&other) noexcept : h (std::exchange (other.h, nullptr)) {}
+        Task (const Task&) = delete;
+        Task& operator= (const Task&) = delete;
+
+        ~Task ()
+        {
+            if (h) h.destroy ();
+        }
+
+        bool await_ready () noexcept { return false; }
+
+        std::coroutine_handle<> await_suspend (std::coroutine_handle<> awaiting) noexcept
+        {
+            h.promise ().continuation = awaiting;
+            return h;
+        }
+
+        void await_resume ()
+        {
+            if (h.promise ().error)
+                std::rethrow_exception (h.promise ().error);
+        }
+
+    private:
+        explicit Task (handle h) : h (h) {}
+
+        handle h;
+    };
+
+
+    /*! \brief Runs coroutines on a few host threads.
+     *  \details Coroutines that await device work don't occupy a thread. 
+     *           The runtime signals the completion of the work with an event 
+     *           callback, and the coroutine gets queued to resume on one of 
+     *           the threads of the executor. So, thousands of pipelines can 
+     *           be in flight at the same time, interleaved on the threads.
+     */
+    class Executor
+    {
+    public:
+        /*! \param[in] nThreads the number of threads. */
+        explicit Executor (unsigned int nThreads = std::thread::hardware_concurrency ()) 
+            : stop (false), active (0)
+        {
+            for (unsigned int i = 0; i < std::max (nThreads, 1u); ++i)
+                threads.emplace_back (&Executor::work, this);
+        }
+
+        /*! \brief Waits for the spawned tasks, and then joins the threads. */
+        ~Executor ()
+        {
+            {
+                std::unique_lock<std::mutex> lock (mtx);
+                done.wait (lock, [this] { return active == 0; });
+                stop = true;
+            }
+            ready.notify_all ();
+
+            for (auto &thread : threads)
+                thread.join ();
+        }
+
+        Executor (const Executor&) = delete;
+        Executor& operator= (const Executor&) = delete;
+
+        /*! \brief Queues a coroutine to resume on one of the threads.
+         *  \details It notifies under the lock, since the resumed coroutine 
+         *           could return, and let the executor get destroyed, before 
+         *           a callback thread gets to notify.
+         */
+        void post (std::coroutine_handle<> h)
+        {
+            std::lock_guard<std::mutex> lock (mtx);
+            queue.push_back (h);
+            ready.notify_one ();
+        }
+
+        /*! \brief Starts a task on the executor.
+         *  \details The task runs detached. If it throws, `wait` rethrows the exception.
+         */
+        template <typename T>
+        void spawn (Task<T> task)
+        {
+            {
+                std::lock_guard<std::mutex> lock (mtx);
+                ++active;
+            }
+            post (run (std::move (task)).handle);
+        }
+
+        /*! \brief Blocks until all the spawned tasks have returned.
+         *  \details It rethrows the first exception a spawned task threw.
+         */
+        void wait ()
+        {
+            std::unique_lock<std::mutex> lock (mtx);
+            done.wait (lock, [this] { return active == 0; });
+
+            if (error)
+                std::rethrow_exception (std::exchange (error, nullptr));
+        }
+
+        /*! \brief Returns the executor of the calling thread, or `nullptr` 
+         *         if the thread doesn't belong to an executor.
+         */
+        static Executor*& current ()
+        {
+            static thread_local Executor *executor = nullptr;
+            return executor;
+        }
+
+    private:
+        /*! \brief Runs a spawned task, and counts it out when it returns. */
+        template <typename T>
+        detail::Detached run (Task<T> task)
+        {
+            std::exception_ptr e;
+            try
+            {
+                co_await task;
+            }
+            catch (...)
+            {
+                e = std::current_exception ();
+            }
+
+            std::lock_guard<std::mutex> lock (mtx);
+            if (e && !error) error = e;
+            if (--active == 0) done.notify_all ();
+        }
+
+        /*! \brief The loop of a thread. */
+        void work ()
+        {
+            current () = this;
+
+            for (;;)
+            {
+                std::coroutine_handle<> h;
+                {
+                    std::unique_lock<std::mutex> lock (mtx);
+                    ready.wait (lock, [this] { return stop || !queue.empty (); });
+                    if (queue.empty ()) return;
+                    h = queue.front ();
+                    queue.pop_front ();
+                }
+                h.resume ();
+            }
+        }
+
+        std::mutex mtx;
+        std::condition_variable ready, done;
+        std::deque<std::coroutine_handle<>> queue;
+        std::vector<std::thread> threads;
+        bool stop;
+        size_t active;  /*!< The number of spawned tasks that haven't returned. */
+        std::exception_ptr error;
+    };
+
+
+    /*! \brief Awaits the completion of an event.
+     *  \details The awaiting coroutine resumes on the executor it runs on, 
+     *           or on the thread of the callback if it's not on an executor. 
+     *           If the command failed, a `cl::Error` is thrown. The command 
+     *           has to be submitted to the device, so if a queue is given, 
+     *           it gets flushed before the coroutine suspends.
+     */
+    class EventAwaiter
+    {
+    public:
+        /*! \param[in] event the event of the command.
+         *  \param[in] queue the queue of the command, to flush, or `nullptr`.
+         */
+        EventAwaiter (const cl::Event &event, const cl::CommandQueue *queue = nullptr) 
+            : event (event), queue (queue), status (CL_COMPLETE), executor (nullptr)
+        {
+        }
+
+        bool await_ready ()
+        {
+            status = event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS> ();
+            return status <= CL_COMPLETE;
+        }
+
+        void await_suspend (std::coroutine_handle<> h)
+        {
+            handle = h;
+            executor = Executor::current ();
+            if (queue) queue->flush ();
+
+            // The callback may resume the coroutine, and destroy the awaiter, before this returns
+            cl::Event e (event);
+            e.setCallback (CL_COMPLETE, &callback, this);
+        }
+
+        void await_resume ()
+        {
+            if (status < 0)
+                throw cl::Error (status, "clutils::coro::EventAwaiter");
+        }
+
+    private:
+        static void CL_CALLBACK callback (cl_event, cl_int s, void *data)
+        {
+            EventAwaiter *self = static_cast<EventAwaiter*> (data);
+            self->status = s;
+            if (self->executor)
+                self->executor->post (self->handle);
+            else
+                self->handle.resume ();
+        }
+
+    protected:
+        cl::Event event;
+        const cl::CommandQueue *queue;
+        cl_int status;
+        Executor *executor;
+        std::coroutine_handle<> handle;
+    };
+
+
+    /*! \brief Awaits a mapping, and resumes with the mapped pointer. */
+    class MapAwaiter : public EventAwaiter
+    {
+    public:
+        MapAwaiter (const cl::Event &event, const cl::CommandQueue *queue, void *ptr) 
+            : EventAwaiter (event, queue), ptr (ptr)
+        {
+        }
+
+        void* await_resume ()
+        {
+            EventAwaiter::await_resume ();
+            return ptr;
+        }
+
+    private:
+        void *ptr;
+    };
+
+
+    /*! \brief Enqueues a write to a buffer. 
+     *  \details The host memory must stay valid until the write completes.
+     */
+    inline EventAwaiter write (const cl::CommandQueue &queue, const cl::Buffer &buffer, 
+                               size_t offset, size_t size, const void *ptr)
+    {
+        cl::Event event;
+        queue.enqueueWriteBuffer (buffer, CL_FALSE, offset, size, ptr, nullptr, &event);
+        return EventAwaiter (event, &queue);
+    }
+
+
+    /*! \brief Enqueues a read from a buffer. */
+    inline EventAwaiter read (const cl::CommandQueue &queue, const cl::Buffer &buffer, 
+                              size_t offset, size_t size, void *ptr)
+    {
+        cl::Event event;
+        queue.enqueueReadBuffer (buffer, CL_FALSE, offset, size, ptr, nullptr, &event);
+        return EventAwaiter (event, &queue);
+    }
+
+
+    /*! \brief Enqueues a copy between buffers. */
+    inline EventAwaiter copy (const cl::CommandQueue &queue, const cl::Buffer &src, const cl::Buffer &dst, 
+                              size_t srcOffset, size_t dstOffset, size_t size)
+    {
+        cl::Event event;
+        queue.enqueueCopyBuffer (src, dst, srcOffset, dstOffset, size, nullptr, &event);
+        return EventAwaiter (event, &queue);
+    }
+
+
+    /*! \brief Enqueues a fill of a buffer with a pattern. */
+    template <typename T>
+    EventAwaiter fill (const cl::CommandQueue &queue, const cl::Buffer &buffer, 
+                       T pattern, size_t offset, size_t size)
+    {
+        cl::Event event;
+        queue.enqueueFillBuffer (buffer, pattern, offset, size, nullptr, &event);
+        return EventAwaiter (event, &queue);
+    }
+
+
+    /*! \brief Enqueues a kernel.
+     *  \details Kernel arguments are set on the calling thread, so concurrent 
+     *           coroutines should not share a `cl::Kernel`.
+     */
+    inline EventAwaiter kernel (const cl::CommandQueue &queue, const cl::Kernel &kernel, 
+                                const cl::NDRange &global, const cl::NDRange &local = cl::NullRange, 
+                                const cl::NDRange &offset = cl::NullRange)
+    {
+        cl::Event event;
+        queue.enqueueNDRangeKernel (kernel, offset, global, local, nullptr, &event);
+        return EventAwaiter (event, &queue);
+    }
+
+
+    /*! \brief Enqueues the mapping of a region of a buffer. 
+     *  \details `co_await` resumes with the mapped pointer.
+     */
+    inline MapAwaiter map (const cl::CommandQueue &queue, const cl::Buffer &buffer, 
+                           cl_map_flags flags, size_t offset, size_t size)
+    {
+        cl::Event event;
+        void *ptr = queue.enqueueMapBuffer (buffer, CL_FALSE, flags, offset, size, nullptr, &event);
+        return MapAwaiter (event, &queue, ptr);
+    }
+
+
+    /*! \brief Enqueues the unmapping of a region of a buffer. */
+    inline EventAwaiter unmap (const cl::CommandQueue &queue, const cl::Memory &memory, void *ptr)
+    {
+        cl::Event event;
+        queue.enqueueUnmapMemObject (memory, ptr, nullptr, &event);
+        return EventAwaiter (event, &queue);
+    }
+
+
+    /*! \brief Enqueues a marker, which completes when all the commands enqueued so far complete. */
+    inline EventAwaiter marker (const cl::CommandQueue &queue)
+    {
+        cl::Event event;
+        queue.enqueueMarkerWithWaitList (nullptr, &event);
+        return EventAwaiter (event, &queue);
+    }
+
+}
+}
+
+#endif  // CLUTILS_CORO_HPP
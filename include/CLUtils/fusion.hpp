@@ -0,0 +1,412 @@
+/*! \file fusion.hpp
+ *  \brief Declarations of classes for fusing elementwise operations 
+ *         on buffers into a single kernel.
+ *  \details Expressions on buffers are captured with expression templates. 
+ *           The structure of an expression is encoded in its type, from 
+ *           which the source of a kernel that evaluates the whole expression 
+ *           is generated. The kernel is built at runtime through `CLEnv`, 
+ *           once per expression type.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef CLUTILS_FUSION_HPP
+#define CLUTILS_FUSION_HPP
+
+#include <string>
+#include <sstream>
+#include <utility>
+#include <type_traits>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief Building blocks of the elementwise expressions.
+     *  \details The operators and functions in this namespace are found 
+     *           through argument-dependent lookup, so expressions can be 
+     *           written without qualifying them.
+     */
+    namespace expr
+    {
+
+        /*! \brief A buffer operand of an expression.
+         *  \details The operand can also be a view of a buffer. The offset 
+         *            of the view is passed as a kernel argument, so views 
+         *            with different offsets share a kernel.
+         *
+         *  \tparam T the element type.
+         */
+        template <typename T>
+        struct Vec
+        {
+            typedef T value_type;
+
+            explicit Vec (const BufferView &view) : view (view) {}
+
+            /*! \brief Appends the kernel parameters, and returns the code that reads the element. */
+            static std::string emit (std::ostream &params, unsigned int &idx)
+            {
+                std::string name = "b" + std::to_string (idx);
+                std::string offset = "o" + std::to_string (idx);
+                params << ", global const " << CLType<T>::name () << " *" << name
+                       << ", const uint " << offset;
+                idx += 2;
+                return name + "[" + offset + " + i]";
+            }
+
+            /*! \brief Sets the kernel arguments. */
+            void setArgs (cl::Kernel &kernel, unsigned int &idx) const
+            {
+                kernel.setArg (idx++, view.buffer ());
+                kernel.setArg (idx++, view.offset<T> ());
+            }
+
+            BufferView view;
+        };
+
+
+        /*! \brief A scalar operand of an expression.
+         *  \details Scalars are passed as kernel arguments, so changing 
+         *           their value doesn't lead to a new build.
+         *
+         *  \tparam T the element type.
+         */
+        template <typename T>
+        struct Scalar
+        {
+            typedef T value_type;
+
+            explicit Scalar (T value) : value (value) {}
+
+            /*! \brief Appends the kernel parameter, and returns the code that reads the scalar. */
+            static std::string emit (std::ostream &params, unsigned int &idx)
+            {
+                std::string name = "s" + std::to_string (idx++);
+                params << ", const " << CLType<T>::name () << " " << name;
+                return name;
+            }
+
+            /*! \brief Sets the kernel argument. */
+            void setArgs (cl::Kernel &kernel, unsigned int &idx) const
+            {
+                kernel.setArg (idx++, value);
+            }
+
+            T value;
+        };
+
+
+        /*! \brief An operation on two sub-expressions.
+         *
+         *  \tparam Op the operation.
+         *  \tparam L the left operand.
+         *  \tparam R the right operand.
+         */
+        template <typename Op, typename L, typename R>
+        struct BinaryExpr
+        {
+            static_assert (std::is_same<typename L::value_type, typename R::value_type>::value, 
+                           "The operands of an expression must have the same element type");
+
+            typedef typename L::value_type value_type;
+
+            BinaryExpr (const L &l, const R &r) : l (l), r (r) {}
+
+            static std::string emit (std::ostream &params, unsigned int &idx)
+            {
+                std::string a = L::emit (params, idx);
+                std::string b = R::emit (params, idx);
+                return Op::emit (a, b);
+            }
+
+            void setArgs (cl::Kernel &kernel, unsigned int &idx) const
+            {
+                l.setArgs (kernel, idx);
+                r.setArgs (kernel, idx);
+            }
+
+            L l;
+            R r;
+        };
+
+
+        /*! \brief An operation on a sub-expression.
+         *
+         *  \tparam Op the operation.
+         *  \tparam E the operand.
+         */
+        template <typename Op, typename E>
+        struct UnaryExpr
+        {
+            typedef typename E::value_type value_type;
+
+            explicit UnaryExpr (const E &e) : e (e) {}
+
+            static std::string emit (std::ostream &params, unsigned int &idx)
+            {
+                return Op::emit (E::emit (params, idx));
+            }
+
+            void setArgs (cl::Kernel &kernel, unsigned int &idx) const
+            {
+                e.setArgs (kernel, idx);
+            }
+
+            E e;
+        };
+
+
+        struct Add { static std::string emit (const std::string &a, const std::string &b) { return "(" + a + " + " + b + ")"; } };
+        struct Sub { static std::string emit (const std::string &a, const std::string &b) { return "(" + a + " - " + b + ")"; } };
+        struct Mul { static std::string emit (const std::string &a, const std::string &b) { return "(" + a + " * " + b + ")"; } };
+        struct Div { static std::string emit (const std::string &a, const std::string &b) { return "(" + a + " / " + b + ")"; } };
+        struct Min { static std::string emit (const std::string &a, const std::string &b) { return "min (" + a + ", " + b + ")"; } };
+        struct Max { static std::string emit (const std::string &a, const std::string &b) { return "max (" + a + ", " + b + ")"; } };
+        struct Neg { static std::string emit (const std::string &a) { return "(-" + a + ")"; } };
+        struct Sqrt { static std::string emit (const std::string &a) { return "sqrt (" + a + ")"; } };
+        struct Exp { static std::string emit (const std::string &a) { return "exp (" + a + ")"; } };
+
+
+        /*! \brief Identifies the types that are expressions. */
+        template <typename E> struct IsExpr : std::false_type {};
+        template <typename T> struct IsExpr< Vec<T> > : std::true_type {};
+        template <typename T> struct IsExpr< Scalar<T> > : std::true_type {};
+        template <typename Op, typename L, typename R> struct IsExpr< BinaryExpr<Op, L, R> > : std::true_type {};
+        template <typename Op, typename E> struct IsExpr< UnaryExpr<Op, E> > : std::true_type {};
+
+
+        /*! \brief Turns an operand into an expression.
+         *  \details Expressions are forwarded as they are. 
+         *           Arithmetic values become scalars of type `T`.
+         */
+        template <typename E, typename T, bool = IsExpr<E>::value>
+        struct AsExpr
+        {
+            typedef E type;
+            static const E& wrap (const E &e) { return e; }
+        };
+
+        template <typename E, typename T>
+        struct AsExpr<E, T, false>
+        {
+            typedef Scalar<T> type;
+            static Scalar<T> wrap (const E &e) { return Scalar<T> (T (e)); }
+        };
+
+
+        /*! \brief Composes a binary expression. 
+         *  \details It's only defined when one of the operands is an expression, 
+         *           so that the operators don't apply to anything else.
+         */
+        template <typename Op, typename L, typename R, 
+                  bool = IsExpr<L>::value || IsExpr<R>::value>
+        struct MakeBinary {};
+
+        template <typename Op, typename L, typename R>
+        struct MakeBinary<Op, L, R, true>
+        {
+            typedef typename std::conditional<IsExpr<L>::value, L, R>::type::value_type T;
+            typedef BinaryExpr<Op, typename AsExpr<L, T>::type, typename AsExpr<R, T>::type> type;
+
+            static type make (const L &l, const R &r)
+            {
+                return type (AsExpr<L, T>::wrap (l), AsExpr<R, T>::wrap (r));
+            }
+        };
+
+
+        /*! \brief Creates a buffer operand. */
+        template <typename T>
+        Vec<T> vec (const BufferView &view) { return Vec<T> (view); }
+
+        template <typename L, typename R>
+        typename MakeBinary<Add, L, R>::type operator+ (const L &l, const R &r) { return MakeBinary<Add, L, R>::make (l, r); }
+
+        template <typename L, typename R>
+        typename MakeBinary<Sub, L, R>::type operator- (const L &l, const R &r) { return MakeBinary<Sub, L, R>::make (l, r); }
+
+        template <typename L, typename R>
+        typename MakeBinary<Mul, L, R>::type operator* (const L &l, const R &r) { return MakeBinary<Mul, L, R>::make (l, r); }
+
+        template <typename L, typename R>
+        typename MakeBinary<Div, L, R>::type operator/ (const L &l, const R &r) { return MakeBinary<Div, L, R>::make (l, r); }
+
+        template <typename L, typename R>
+        typename MakeBinary<Min, L, R>::type min (const L &l, const R &r) { return MakeBinary<Min, L, R>::make (l, r); }
+
+        template <typename L, typename R>
+        typename MakeBinary<Max, L, R>::type max (const L &l, const R &r) { return MakeBinary<Max, L, R>::make (l, r); }
+
+        template <typename E>
+        typename std::enable_if<IsExpr<E>::value, UnaryExpr<Neg, E> >::type 
+        operator- (const E &e) { return UnaryExpr<Neg, E> (e); }
+
+        /*! \note It's only meant for floating-point expressions. */
+        template <typename E>
+        typename std::enable_if<IsExpr<E>::value, UnaryExpr<Sqrt, E> >::type 
+        sqrt (const E &e) { return UnaryExpr<Sqrt, E> (e); }
+
+        /*! \note It's only meant for floating-point expressions. */
+        template <typename E>
+        typename std::enable_if<IsExpr<E>::value, UnaryExpr<Exp, E> >::type 
+        exp (const E &e) { return UnaryExpr<Exp, E> (e); }
+
+
+        /*! \brief Generates the kernel that evaluates an expression.
+         *  \details The kernel is named `fused`. Its first two parameters 
+         *           are the output buffer and the number of elements, and 
+         *           they are followed by the operands in the order they 
+         *           appear in the expression.
+         *
+         *  \tparam E the expression.
+         *  \return A pair with the signature and the source of the kernel. 
+         *          The signature is the expression as it appears in the kernel, 
+         *          preceded by the element type.
+         */
+        template <typename E>
+        std::pair<std::string, std::string> generate ()
+        {
+            typedef typename E::value_type T;
+
+            std::ostringstream params;
+            unsigned int idx = 3;
+            std::string code = E::emit (params, idx);
+
+            std::ostringstream source;
+            source << "kernel\n"
+                   << "void fused (global " << CLType<T>::name () << " *out, const uint outOffset, const uint n" 
+                   << params.str () << ")\n"
+                   << "{\n"
+                   << "    uint i = get_global_id (0);\n"
+                   << "    if (i < n)\n"
+                   << "        out[outOffset + i] = " << code << ";\n"
+                   << "}\n";
+
+            return std::make_pair (std::string (CLType<T>::name ()) + ":" + code, source.str ());
+        }
+
+
+        /*! \brief Holds the kernel of an expression type.
+         *  \details The kernel source only depends on the expression type, 
+         *           so it's generated once per type.
+         */
+        template <typename E>
+        const std::pair<std::string, std::string>& kernelOf ()
+        {
+            static const std::pair<std::string, std::string> kernel = generate<E> ();
+            return kernel;
+        }
+
+    }
+
+
+    /*! \brief Evaluates elementwise expressions on buffers with a single kernel.
+     *  \details A chain like `E = max ((A + B) * k, 0)` is evaluated in one 
+     *           pass, without intermediate buffers. The kernel for every 
+     *           expression type is built the first time it's evaluated, 
+     *           and is then cached in `CLEnv` by the expression signature.
+     *           
+     *           \code
+     *           using namespace clutils::expr;
+     *           Elementwise<cl_float> ew (clEnv);
+     *           auto A = vec<cl_float> (dA), B = vec<cl_float> (dB);
+     *           ew.run (dE, max ((A + B) * k, 0), n);
+     *           \endcode
+     *
+     *  \tparam T the element type.
+     */
+    template <typename T>
+    class Elementwise
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment
+         *                  the kernels will be built and run in.
+         *  \param[in] wgSize the work-group size.
+         */
+        Elementwise (CLEnv &env, CLEnvInfo<1> info = CLEnvInfo<1> (), unsigned int wgSize = 256)
+            : env (env), queue (env.getQueue (info.ctxIdx, info.qIdx[0])), 
+              ctxIdx (info.ctxIdx), wgSize (wgSize)
+        {
+        }
+
+        /*! \brief Evaluates an expression on the first `n` elements of its buffers.
+         *  \note The output buffer may also appear in the expression.
+         *
+         *  \param[out] out the output buffer, or a view of it.
+         *  \param[in] e the expression.
+         *  \param[in] n the number of elements.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the kernel execution.
+         */
+        template <typename E>
+        void run (const BufferView &out, const E &e, unsigned int n,
+                  const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            static_assert (std::is_same<typename E::value_type, T>::value, 
+                           "The expression must have the element type of the output");
+
+            // There's nothing to evaluate, but the event still has to follow the wait-list
+            if (n == 0)
+            {
+                queue.enqueueMarkerWithWaitList (events, event);
+                return;
+            }
+
+            cl::Kernel &kernel (getKernel<E> ());
+
+            unsigned int idx = 3;
+            kernel.setArg (0, out.buffer ());
+            kernel.setArg (1, out.offset<T> ());
+            kernel.setArg (2, n);
+            e.setArgs (kernel, idx);
+
+            queue.enqueueNDRangeKernel (kernel, cl::NullRange, 
+                                        cl::NDRange ((n + wgSize - 1) / wgSize * wgSize),
+                                        cl::NDRange (wgSize), events, event);
+        }
+
+        /*! \brief Gets the kernel of an expression type, building it if necessary. */
+        template <typename E>
+        cl::Kernel& getKernel ()
+        {
+            const std::pair<std::string, std::string> &kernel = expr::kernelOf<E> ();
+            unsigned int pgIdx = env.getSourceProgramIdx (ctxIdx, kernel.first, kernel.second);
+            return env.getKernel ("fused", pgIdx);
+        }
+
+    private:
+        CLEnv &env;  /*!< The environment that caches the programs. */
+        cl::CommandQueue &queue;  /*!< The queue the kernels get enqueued on. */
+        unsigned int ctxIdx;  /*!< The context the programs get built for. */
+        unsigned int wgSize;  /*!< The work-group size. */
+    };
+
+}
+
+#endif  // CLUTILS_FUSION_HPP
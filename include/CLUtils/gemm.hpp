@@ -0,0 +1,327 @@
+/*! \file gemm.hpp
+ *  \brief Declarations of classes for matrix multiplications on the device.
+ *  \details The kernels are specialized on the element type and the tile 
+ *           sizes through build options, and are built through 
+ *           `CLEnv::getProgramIdx`, so that objects with the same 
+ *           configuration share a single build.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef CLUTILS_GEMM_HPP
+#define CLUTILS_GEMM_HPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <CLUtils.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief Converts a float to a half, rounding to the nearest even value, 
+     *         like `vstore_half` does by default.
+     */
+    inline cl_half floatToHalf (cl_float f)
+    {
+        cl_uint x;
+        std::memcpy (&x, &f, sizeof (x));
+        cl_uint sign = (x >> 16) & 0x8000;
+        x &= 0x7fffffff;
+
+        if (x >= 0x7f800000)  // Inf, NaN
+            return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0);
+        if (x >= 0x477ff000)  // Rounds to Inf
+            return sign | 0x7c00;
+        if (x < 0x33000000)  // Rounds to 0
+            return sign;
+
+        cl_uint e = x >> 23, h, rem, half;
+        if (e < 113)  // Subnormal half
+        {
+            cl_uint m = (x & 0x7fffff) | 0x800000, shift = 126 - e;
+            h = m >> shift;
+            rem = m & ((1u << shift) - 1);
+            half = 1u << (shift - 1);
+        }
+        else
+        {
+            h = (x - (112u << 23)) >> 13;
+            rem = x & 0x1fff;
+            half = 0x1000;
+        }
+
+        if (rem > half || (rem == half && (h & 1)))
+            ++h;  // A carry into the exponent is still correct
+
+        return sign | h;
+    }
+
+    /*! \brief Converts a half to a float, like `vload_half`. */
+    inline cl_float halfToFloat (cl_half h)
+    {
+        cl_uint sign = (cl_uint) (h & 0x8000) << 16;
+        cl_uint e = (h >> 10) & 0x1f, m = h & 0x3ff, x;
+
+        if (e == 31)  // Inf, NaN
+            x = sign | 0x7f800000 | (m << 13);
+        else if (e)
+            x = sign | ((e + 112) << 23) | (m << 13);
+        else
+        {
+            cl_float f = m * (1.f / (1 << 24));
+            return sign ? -f : f;
+        }
+
+        cl_float f;
+        std::memcpy (&f, &x, sizeof (f));
+        return f;
+    }
+
+
+    /*! \brief Maps an element type of `Gemm` to the build options of the kernels. */
+    template <typename T>
+    struct GemmType;
+
+    template <>
+    struct GemmType<cl_float>
+    {
+        static const char* options () { return "-D T=float"; }
+    };
+
+    /*! \note `cl_half` is a `cl_ushort`. */
+    template <>
+    struct GemmType<cl_half>
+    {
+        static const char* options () { return "-D T=half -D T_HALF"; }
+    };
+
+
+    /*! \brief The tiling of a `Gemm` kernel.
+     *  \details A work-group computes an `m x n` tile of `C`, stepping over 
+     *           `K` by `k`, and each of its work-items computes `wptM x wptN` 
+     *           outputs. The work-group size is `(n / wptN, m / wptM)`.
+     */
+    struct GemmTile
+    {
+        unsigned int m, n, k;  /*!< The tile of `C`, and the depth of a step. */
+        unsigned int wptM, wptN;  /*!< The outputs per work-item. */
+
+        /*! \brief Returns the work-group size along `N`. */
+        unsigned int wgX () const { return n / wptN; }
+        /*! \brief Returns the work-group size along `M`. */
+        unsigned int wgY () const { return m / wptM; }
+        /*! \brief Returns the local memory the tile needs, in bytes. */
+        size_t localMem () const { return ((m + 1) * k + k * n) * sizeof (cl_float); }
+    };
+
+
+    /*! \brief Multiplies matrices, `C = alpha * A * B + beta * C`, 
+     *         or batches of them.
+     *  \details The kernel tiles `C` over the work-groups, and stages the 
+     *           tiles of `A` and `B` through local memory. Every work-item 
+     *           accumulates several outputs in registers. The tiling is picked 
+     *           at construction, as the largest one whose work-group the 
+     *           device supports and whose local memory fits in half of 
+     *           `CL_DEVICE_LOCAL_MEM_SIZE`.
+     *           
+     *           A batch of matrices is multiplied in a single launch, with 
+     *           the batch index as the third dimension of the workspace. 
+     *           Matrices smaller than a quarter of the tile use a second 
+     *           program with an 8x8 tile, so that the work-items aren't 
+     *           mostly idle.
+     *  \note The matrices are in row-major order, and the matrices of a batch 
+     *        are contiguous. The products are accumulated in float, also for half.
+     *
+     *  \tparam T the element type (`cl_float`, `cl_half`).
+     */
+    template <typename T = cl_float>
+    class Gemm
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment 
+         *                  the kernels will be built and run in.
+         *  \param[in] kernel_filename the file with the matrix multiplication kernels.
+         */
+        Gemm (CLEnv &env, CLEnvInfo<1> info = CLEnvInfo<1> (), 
+              const std::string &kernel_filename = "kernels/gemm.cl")
+            : queue (env.getQueue (info.ctxIdx, info.qIdx[0]))
+        {
+            cl::Device device = queue.getInfo<CL_QUEUE_DEVICE> ();
+            size_t maxWGSize = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE> ();
+            std::vector<size_t> maxWISizes = device.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES> ();
+            cl_ulong localMem = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE> ();
+
+            // From the most to the least work per work-group. The last 
+            // one fits any device, and is the tile of the small matrices.
+            const GemmTile tiles[] = { { 64, 64, 16, 4, 4 }, { 32, 64, 16, 2, 4 }, { 32, 32, 16, 2, 2 }, 
+                                       { 32, 32, 8, 4, 4 }, { 16, 16, 8, 2, 2 }, { 8, 8, 8, 1, 1 } };
+            const unsigned int nTiles = sizeof (tiles) / sizeof (tiles[0]);
+
+            for (unsigned int t = 0; t < nTiles; ++t)
+            {
+                const GemmTile &tile = tiles[t];
+                if (t + 1 < nTiles && (tile.wgX () * tile.wgY () > maxWGSize || tile.wgX () > maxWISizes[0] || 
+                                       tile.wgY () > maxWISizes[1] || tile.localMem () > localMem / 2))
+                    continue;
+
+                // The compiler might still limit the work-group size below the tile's
+                cl::Kernel kernel = env.getKernel ("gemm", build (env, info.ctxIdx, tile, kernel_filename));
+                if (t + 1 < nTiles && kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE> (device) < 
+                                      tile.wgX () * tile.wgY ())
+                    continue;
+
+                large = tile;
+                kernelLarge = kernel;
+                break;
+            }
+
+            small = tiles[nTiles - 1];
+            unsigned int pgIdx = build (env, info.ctxIdx, small, kernel_filename);
+            kernelSmall = env.getKernel ("gemm", pgIdx);
+            kernelNaive = env.getKernel ("gemmNaive", pgIdx);
+        }
+
+        /*! \brief Multiplies two matrices, `C = alpha * A * B + beta * C`.
+         *  \note `C` isn't read when `beta` is 0.
+         *
+         *  \param[in] A the `M x K` matrix, or a view of it.
+         *  \param[in] B the `K x N` matrix, or a view of it.
+         *  \param[in,out] C the `M x N` matrix, or a view of it.
+         *  \param[in] M the rows of `A` and `C`.
+         *  \param[in] N the columns of `B` and `C`.
+         *  \param[in] K the columns of `A` and rows of `B`.
+         *  \param[in] alpha the factor of the product.
+         *  \param[in] beta the factor of `C`.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the kernel execution.
+         */
+        void run (const BufferView &A, const BufferView &B, const BufferView &C, 
+                  unsigned int M, unsigned int N, unsigned int K, float alpha = 1.f, float beta = 0.f, 
+                  const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            runBatched (A, B, C, M, N, K, 1, alpha, beta, events, event);
+        }
+
+        /*! \brief Multiplies `batch` pairs of matrices, `C[i] = alpha * A[i] * B[i] + beta * C[i]`, 
+         *         in a single launch.
+         *  \note `C` isn't read when `beta` is 0.
+         *
+         *  \param[in] A the `M x K` matrices, or a view of them.
+         *  \param[in] B the `K x N` matrices, or a view of them.
+         *  \param[in,out] C the `M x N` matrices, or a view of them.
+         *  \param[in] M the rows of `A` and `C`.
+         *  \param[in] N the columns of `B` and `C`.
+         *  \param[in] K the columns of `A` and rows of `B`.
+         *  \param[in] batch the number of matrices in each of `A`, `B`, and `C`.
+         *  \param[in] alpha the factor of the products.
+         *  \param[in] beta the factor of `C`.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the kernel execution.
+         */
+        void runBatched (const BufferView &A, const BufferView &B, const BufferView &C, 
+                         unsigned int M, unsigned int N, unsigned int K, unsigned int batch, 
+                         float alpha = 1.f, float beta = 0.f, 
+                         const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            bool isSmall = 4 * static_cast<cl_ulong> (M) * N < static_cast<cl_ulong> (large.m) * large.n;
+            const GemmTile &tile = isSmall ? small : large;
+            cl::Kernel &kernel = isSmall ? kernelSmall : kernelLarge;
+
+            setArgs (kernel, A, B, C, M, N, K, alpha, beta);
+            cl::NDRange global ((N + tile.n - 1) / tile.n * tile.wgX (), (M + tile.m - 1) / tile.m * tile.wgY (), batch);
+            queue.enqueueNDRangeKernel (kernel, cl::NullRange, global, 
+                                        cl::NDRange (tile.wgX (), tile.wgY (), 1), events, event);
+        }
+
+        /*! \brief Multiplies `batch` pairs of matrices, reading 
+         *         them straight from global memory.
+         *  \details It's the baseline of the tiled kernel.
+         *
+         *  \param[in] A the `M x K` matrices, or a view of them.
+         *  \param[in] B the `K x N` matrices, or a view of them.
+         *  \param[in,out] C the `M x N` matrices, or a view of them.
+         *  \param[in] M the rows of `A` and `C`.
+         *  \param[in] N the columns of `B` and `C`.
+         *  \param[in] K the columns of `A` and rows of `B`.
+         *  \param[in] batch the number of matrices in each of `A`, `B`, and `C`.
+         *  \param[in] alpha the factor of the products.
+         *  \param[in] beta the factor of `C`.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the kernel execution.
+         */
+        void runNaive (const BufferView &A, const BufferView &B, const BufferView &C, 
+                       unsigned int M, unsigned int N, unsigned int K, unsigned int batch = 1, 
+                       float alpha = 1.f, float beta = 0.f, 
+                       const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            setArgs (kernelNaive, A, B, C, M, N, K, alpha, beta);
+            queue.enqueueNDRangeKernel (kernelNaive, cl::NullRange, cl::NDRange (N, M, batch), 
+                                        cl::NullRange, events, event);
+        }
+
+        /*! \brief Returns the tiling of the kernel for large matrices. */
+        const GemmTile& getTile () const { return large; }
+
+    private:
+        /*! \brief Builds the program for a tiling, and returns its index. */
+        unsigned int build (CLEnv &env, unsigned int ctxIdx, const GemmTile &tile, const std::string &kernel_filename)
+        {
+            std::string options = std::string (GemmType<T>::options ()) + 
+                                  " -D TILE_M=" + std::to_string (tile.m) + 
+                                  " -D TILE_N=" + std::to_string (tile.n) + 
+                                  " -D TILE_K=" + std::to_string (tile.k) + 
+                                  " -D WPT_M=" + std::to_string (tile.wptM) + 
+                                  " -D WPT_N=" + std::to_string (tile.wptN);
+            return env.getProgramIdx (ctxIdx, { kernel_filename }, options.c_str ());
+        }
+
+        /*! \brief Sets up the arguments of a kernel. */
+        void setArgs (cl::Kernel &kernel, const BufferView &A, const BufferView &B, const BufferView &C, 
+                      unsigned int M, unsigned int N, unsigned int K, float alpha, float beta)
+        {
+            kernel.setArg (0, A.buffer ());
+            kernel.setArg (1, A.offset<T> ());
+            kernel.setArg (2, B.buffer ());
+            kernel.setArg (3, B.offset<T> ());
+            kernel.setArg (4, C.buffer ());
+            kernel.setArg (5, C.offset<T> ());
+            kernel.setArg (6, M);
+            kernel.setArg (7, N);
+            kernel.setArg (8, K);
+            kernel.setArg (9, alpha);
+            kernel.setArg (10, beta);
+        }
+
+        cl::CommandQueue &queue;  /*!< The queue the kernels get enqueued on. */
+        GemmTile large, small;  /*!< The tilings for large and small matrices. */
+        cl::Kernel kernelLarge, kernelSmall, kernelNaive;  /*!< The matrix multiplication kernels. */
+    };
+
+}
+
+#endif  // CLUTILS_GEMM_HPP
@@ -0,0 +1,410 @@
+/*! \file hazards.hpp
+ *  \brief Declarations of a tracker that derives the dependencies between
+ *         commands from the memory they access, for out-of-order queues.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+
+#ifndef CLUTILS_HAZARDS_HPP
+#define CLUTILS_HAZARDS_HPP
+
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <CLUtils.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief The way a command accesses a memory object. */
+    enum class Access : uint8_t
+    {
+        READ,       /*!< The command only reads. */
+        WRITE,      /*!< The command only writes. */
+        READ_WRITE  /*!< The command reads and writes. */
+    };
+
+
+    /*! \brief A region of a buffer accessed by a command.
+     *  \details Regions of sub-buffers are kept in the coordinates 
+     *           of their parent, so that they overlap correctly.
+     */
+    struct MemRegion
+    {
+        /*! \brief Describes the access to a region of a buffer or sub-buffer.
+         *
+         *  \param[in] buffer the buffer.
+         *  \param[in] offset the offset of the region in `buffer`, in bytes.
+         *  \param[in] size the size of the region in bytes. If 0, 
+         *                  the region extends to the end of `buffer`.
+         *  \param[in] access the way the region is accessed.
+         */
+        MemRegion (const cl::Buffer &buffer, size_t offset, size_t size, Access access) 
+            : access (access)
+        {
+            if (size == 0)
+                size = buffer.getInfo<CL_MEM_SIZE> () - offset;
+
+            cl::Memory parent = buffer.getInfo<CL_MEM_ASSOCIATED_MEMOBJECT> ();
+            if (parent () != nullptr)
+            {
+                offset += buffer.getInfo<CL_MEM_OFFSET> ();
+                mem = parent ();
+            }
+            else
+                mem = buffer ();
+
+            begin = offset;
+            end = offset + size;
+        }
+
+        /*! \brief Describes the access to a view. */
+        MemRegion (const BufferView &view, Access access) 
+            : MemRegion (view.buffer (), view.offset (), view.size (), access)
+        {
+        }
+
+        /*! \brief Tells whether the region overlaps with a range of the same buffer. */
+        bool overlaps (size_t b, size_t e) const
+        {
+            return begin < e && b < end;
+        }
+
+        cl_mem mem;  /*!< The buffer, or the parent of a sub-buffer. */
+        size_t begin;  /*!< The first byte of the region in `mem`. */
+        size_t end;  /*!< One past the last byte of the region in `mem`. */
+        Access access;  /*!< The way the region is accessed. */
+    };
+
+
+    /*! \brief Derives the dependencies between commands on an out-of-order queue.
+     *  \details On a queue created with `CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE`, 
+     *           commands only wait for the events in their wait lists. The 
+     *           tracker keeps, for every buffer, the regions that the commands 
+     *           in flight read and write, along with their events. A command 
+     *           that reads a region waits for the last writers of it (RAW). A 
+     *           command that writes it waits for the last writers (WAW) and for 
+     *           the readers since then (WAR). A writer that a later reader of the 
+     *           same bytes already waits for is left out of the wait list, as 
+     *           are commands that have completed. Commands on disjoint regions, 
+     *           e.g. the parts of a `partition`, don't wait for each other.
+     *           
+     *           Kernel arguments are tracked when they are set through `setArg`. 
+     *           The access of a buffer argument is taken from its qualifiers 
+     *           (`constant`, or `const global`) when the runtime reports them 
+     *           (programs built with `-cl-kernel-arg-info`), and is otherwise 
+     *           assumed to be `READ_WRITE`, which is correct but conservative. 
+     *           It can also be given explicitly.
+     *  
+     *  \note The tracker is not thread-safe, and all the commands on its 
+     *        queue have to go through it.
+     */
+    class HazardTracker
+    {
+    public:
+        /*! \param[in] queue the command queue. It's normally an out-of-order one, 
+         *                   but the tracker works on in-order queues as well.
+         */
+        explicit HazardTracker (const cl::CommandQueue &queue) 
+            : queue (queue), nCommands (0), nDependencies (0)
+        {
+        }
+
+        /*! \brief Returns the queue of the tracker. */
+        const cl::CommandQueue& getQueue () const
+        {
+            return queue;
+        }
+
+        /*! \brief Sets a kernel argument that is not a memory object. */
+        template <typename T>
+        void setArg (cl::Kernel &kernel, cl_uint idx, const T &value)
+        {
+            kernel.setArg (idx, value);
+            args[kernel ()].erase (idx);
+        }
+
+        /*! \brief Sets a buffer argument, with its access deduced from the kernel. */
+        void setArg (cl::Kernel &kernel, cl_uint idx, const cl::Buffer &buffer)
+        {
+            setArg (kernel, idx, BufferView (buffer), argAccess (kernel, idx));
+        }
+
+        /*! \brief Sets the buffer of a view as an argument, with its access deduced from the kernel.
+         *  \details If the view is not a sub-buffer, its offset has to be set separately.
+         */
+        void setArg (cl::Kernel &kernel, cl_uint idx, const BufferView &view)
+        {
+            setArg (kernel, idx, view, argAccess (kernel, idx));
+        }
+
+        /*! \brief Sets the buffer of a view as an argument, with an explicit access.
+         *  \details The kernel is assumed to access only the region of the view.
+         */
+        void setArg (cl::Kernel &kernel, cl_uint idx, const BufferView &view, Access access)
+        {
+            kernel.setArg (idx, view.buffer ());
+            std::map<cl_uint, MemRegion> &kArgs (args[kernel ()]);
+            kArgs.erase (idx);
+            kArgs.insert (std::make_pair (idx, MemRegion (view, access)));
+        }
+
+        /*! \brief Enqueues a kernel, after the commands it depends on through its arguments. */
+        cl::Event enqueueKernel (const cl::Kernel &kernel, const cl::NDRange &global, 
+                                 const cl::NDRange &local = cl::NullRange, 
+                                 const cl::NDRange &offset = cl::NullRange)
+        {
+            std::vector<MemRegion> regions;
+            for (auto &arg : args[kernel ()])
+                regions.push_back (arg.second);
+
+            return enqueue (regions, [&] (const std::vector<cl::Event> *waitList, cl::Event *event)
+            {
+                queue.enqueueNDRangeKernel (kernel, offset, global, local, waitList, event);
+            });
+        }
+
+        /*! \brief Enqueues a non-blocking write to a buffer. */
+        cl::Event enqueueWrite (const cl::Buffer &buffer, size_t offset, size_t size, const void *ptr)
+        {
+            return enqueue ({ MemRegion (buffer, offset, size, Access::WRITE) }, 
+                            [&] (const std::vector<cl::Event> *waitList, cl::Event *event)
+            {
+                queue.enqueueWriteBuffer (buffer, CL_FALSE, offset, size, ptr, waitList, event);
+            });
+        }
+
+        /*! \brief Enqueues a read from a buffer. */
+        cl::Event enqueueRead (const cl::Buffer &buffer, size_t offset, size_t size, void *ptr, 
+                               bool blocking = false)
+        {
+            return enqueue ({ MemRegion (buffer, offset, size, Access::READ) }, 
+                            [&] (const std::vector<cl::Event> *waitList, cl::Event *event)
+            {
+                queue.enqueueReadBuffer (buffer, blocking, offset, size, ptr, waitList, event);
+            });
+        }
+
+        /*! \brief Enqueues a copy between buffers. */
+        cl::Event enqueueCopy (const cl::Buffer &src, const cl::Buffer &dst, 
+                               size_t srcOffset, size_t dstOffset, size_t size)
+        {
+            return enqueue ({ MemRegion (src, srcOffset, size, Access::READ), 
+                              MemRegion (dst, dstOffset, size, Access::WRITE) }, 
+                            [&] (const std::vector<cl::Event> *waitList, cl::Event *event)
+            {
+                queue.enqueueCopyBuffer (src, dst, srcOffset, dstOffset, size, waitList, event);
+            });
+        }
+
+        /*! \brief Enqueues a fill of a buffer with a pattern. */
+        template <typename T>
+        cl::Event enqueueFill (const cl::Buffer &buffer, T pattern, size_t offset, size_t size)
+        {
+            return enqueue ({ MemRegion (buffer, offset, size, Access::WRITE) }, 
+                            [&] (const std::vector<cl::Event> *waitList, cl::Event *event)
+            {
+                queue.enqueueFillBuffer (buffer, pattern, offset, size, waitList, event);
+            });
+        }
+
+        /*! \brief Enqueues any command, after the commands it depends on.
+         *
+         *  \param[in] regions the regions the command accesses.
+         *  \param[in] command a callable that enqueues the command on the queue. 
+         *                     It gets the wait list (`nullptr` if it's empty), 
+         *                     and the event it has to return.
+         *  \return The event of the command.
+         */
+        template <typename F>
+        cl::Event enqueue (const std::vector<MemRegion> &regions, F command)
+        {
+            deps.clear ();
+            for (auto &r : regions)
+                collect (r);
+
+            cl::Event event;
+            command (deps.empty () ? nullptr : &deps, &event);
+
+            for (auto &r : regions)
+                commit (r, event);
+
+            ++nCommands;
+            nDependencies += deps.size ();
+
+            return event;
+        }
+
+        /*! \brief Waits for all the commands, and clears the tracked accesses. */
+        void finish ()
+        {
+            queue.finish ();
+            buffers.clear ();
+        }
+
+        /*! \brief Returns the wait list of the last command. */
+        const std::vector<cl::Event>& waitList () const
+        {
+            return deps;
+        }
+
+        /*! \brief Returns the number of commands enqueued. */
+        size_t commands () const
+        {
+            return nCommands;
+        }
+
+        /*! \brief Returns the total number of events in the wait lists of the commands. */
+        size_t dependencies () const
+        {
+            return nDependencies;
+        }
+
+    private:
+        /*! \brief An access of a command in flight to a region of a buffer. */
+        struct Record
+        {
+            size_t begin, end;
+            bool write;
+            cl::Event event;
+        };
+
+        /*! \brief The accesses in flight to a buffer. */
+        struct Buffer
+        {
+            Buffer () : limit (minLimit) {}
+
+            std::vector<Record> records;
+            size_t limit;  /*!< The number of records after which the completed ones get pruned. */
+        };
+
+        /*! \brief The least number of records before a buffer gets pruned. */
+        static const size_t minLimit = 32;
+
+        /*! \brief Deduces the access of a kernel argument from its qualifiers. */
+        static Access argAccess (const cl::Kernel &kernel, cl_uint idx)
+        {
+            try
+            {
+                if (kernel.getArgInfo<CL_KERNEL_ARG_ADDRESS_QUALIFIER> (idx) == CL_KERNEL_ARG_ADDRESS_CONSTANT)
+                    return Access::READ;
+                if (kernel.getArgInfo<CL_KERNEL_ARG_TYPE_QUALIFIER> (idx) & CL_KERNEL_ARG_TYPE_CONST)
+                    return Access::READ;
+            }
+            catch (const cl::Error&)
+            {
+                // The program was built without -cl-kernel-arg-info
+            }
+
+            return Access::READ_WRITE;
+        }
+
+        /*! \brief Adds the events a region access depends on to the wait list. */
+        void collect (const MemRegion &r)
+        {
+            auto it = buffers.find (r.mem);
+            if (it == buffers.end ())
+                return;
+
+            std::vector<Record> &records (it->second.records);
+            for (size_t i = 0; i < records.size (); ++i)
+            {
+                const Record &rec (records[i]);
+                if (!r.overlaps (rec.begin, rec.end))
+                    continue;
+                if (!rec.write && r.access == Access::READ)
+                    continue;
+                if (rec.write && r.access != Access::READ && coveredByReader (records, i, r))
+                    continue;
+
+                addDependency (rec.event);
+            }
+        }
+
+        /*! \brief Tells whether a later reader covers the overlap of a writer with a region. 
+         *  \details That reader already waits for the writer, so waiting for it is enough.
+         */
+        static bool coveredByReader (const std::vector<Record> &records, size_t w, const MemRegion &r)
+        {
+            size_t b = std::max (records[w].begin, r.begin);
+            size_t e = std::min (records[w].end, r.end);
+            for (size_t j = w + 1; j < records.size (); ++j)
+                if (!records[j].write && records[j].begin <= b && e <= records[j].end)
+                    return true;
+
+            return false;
+        }
+
+        /*! \brief Adds an event to the wait list, if it's not there already. */
+        void addDependency (const cl::Event &event)
+        {
+            for (auto &e : deps)
+                if (e () == event ())
+                    return;
+
+            deps.push_back (event);
+        }
+
+        /*! \brief Records the access of a command to a region. */
+        void commit (const MemRegion &r, const cl::Event &event)
+        {
+            Buffer &buffer (buffers[r.mem]);
+            std::vector<Record> &records (buffer.records);
+            bool write = r.access != Access::READ;
+
+            // The accesses a write covers completely are behind it now
+            if (write)
+                records.erase (std::remove_if (records.begin (), records.end (), [&r] (const Record &rec)
+                {
+                    return r.begin <= rec.begin && rec.end <= r.end;
+                }), records.end ());
+
+            records.push_back ({ r.begin, r.end, write, event });
+
+            // Pruning backs off while most of the commands are still in flight
+            if (records.size () > buffer.limit)
+            {
+                records.erase (std::remove_if (records.begin (), records.end (), [] (const Record &rec)
+                {
+                    return rec.event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS> () == CL_COMPLETE;
+                }), records.end ());
+                buffer.limit = 2 * records.size () > minLimit ? 2 * records.size () : minLimit;
+            }
+        }
+
+        cl::CommandQueue queue;
+        std::map<cl_mem, Buffer> buffers;  /*!< The accesses in flight per buffer. */
+        std::map<cl_kernel, std::map<cl_uint, MemRegion>> args;  /*!< The buffer arguments per kernel. */
+        std::vector<cl::Event> deps;  /*!< The wait list of the last command. */
+        size_t nCommands;
+        size_t nDependencies;
+    };
+
+}
+
+#endif  // CLUTILS_HAZARDS_HPP
@@ -0,0 +1,178 @@
+/*! \file histogram.hpp
+ *  \brief Declarations of classes for histograms on the device.
+ *  \details The kernels are specialized on the element type, the number 
+ *           of bins, and the work-group size, through build options, and 
+ *           are built through `CLEnv::getProgramIdx`, so that objects with 
+ *           the same configuration share a single build.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef CLUTILS_HISTOGRAM_HPP
+#define CLUTILS_HISTOGRAM_HPP
+
+#include <string>
+#include <vector>
+#include <type_traits>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief Counts the elements of a buffer in evenly sized bins over [lo, hi).
+     *  \details Every work-group builds a private histogram of its part of the 
+     *           input in local memory, with local atomics, and writes it out. 
+     *           A second pass sums the histograms of the work-groups. 
+     *           
+     *           When the local memory allows it, a work-group keeps several 
+     *           interleaved copies of its histogram, and its work-items spread 
+     *           over them. That keeps the atomics on a popular bin from 
+     *           serializing when the input is skewed. The number of copies is 
+     *           picked at construction, as the largest one (up to 8) that fits 
+     *           in half of `CL_DEVICE_LOCAL_MEM_SIZE`. When not even one copy 
+     *           fits, the histograms of the work-groups are kept in global memory.
+     *  \note The elements outside of [lo, hi) are ignored.
+     *
+     *  \tparam T the element type (`cl_int`, `cl_uint`, `cl_float`).
+     */
+    template <typename T>
+    class Histogram
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment 
+         *                  the kernels will be built and run in.
+         *  \param[in] nBins the number of bins.
+         *  \param[in] lo the lower bound of the first bin.
+         *  \param[in] hi the upper bound (exclusive) of the last bin.
+         *  \param[in] wgSize the work-group size.
+         *  \param[in] kernel_filename the file with the histogram kernels.
+         */
+        Histogram (CLEnv &env, CLEnvInfo<1> info, unsigned int nBins, T lo, T hi, 
+                   unsigned int wgSize = 256, const std::string &kernel_filename = "kernels/histogram.cl")
+            : queue (env.getQueue (info.ctxIdx, info.qIdx[0])), 
+              nBins (nBins), lo (lo), hi (hi), wgSize (wgSize), replicas (8)
+        {
+            static_assert (sizeof (T) == 4, "Histogram supports 32-bit elements");
+
+            cl::Device device = queue.getInfo<CL_QUEUE_DEVICE> ();
+            cl_ulong localMem = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE> ();
+            while (replicas > 0 && replicas * nBins * sizeof (cl_uint) > localMem / 2)
+                replicas /= 2;
+
+            std::string options = std::string ("-D T=") + CLType<T>::name () + 
+                                  " -D N_BINS=" + std::to_string (nBins) + 
+                                  " -D REPLICAS=" + std::to_string (replicas) + 
+                                  " -D WG_SIZE=" + std::to_string (wgSize);
+            if (std::is_floating_point<T>::value)
+                options += " -D T_FLOAT";
+            unsigned int pgIdx = env.getProgramIdx (info.ctxIdx, { kernel_filename }, options.c_str ());
+            kernelHist = env.getKernel (replicas ? "histogramLocal" : "histogramGlobal", pgIdx);
+            kernelMerge = env.getKernel ("mergeHistograms", pgIdx);
+
+            // A few work-groups per compute unit keep the device busy, 
+            // while the merge pass stays short
+            nGroups = 4 * device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS> ();
+
+            dPartial = env.getMemoryManager (info.ctxIdx).createBuffer (
+                CL_MEM_READ_WRITE, nGroups * nBins * sizeof (cl_uint));
+        }
+
+        /*! \brief Counts the first `n` elements of a buffer.
+         *
+         *  \param[in] in the input buffer, or a view of it.
+         *  \param[in] n the number of elements.
+         *  \param[out] counts a buffer, or a view, that receives the `nBins` counts.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the last kernel execution.
+         */
+        void run (const BufferView &in, unsigned int n, const BufferView &counts, 
+                  const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            unsigned int groups = std::min (nGroups, (n + wgSize - 1) / wgSize);
+            groups = std::max (groups, 1u);
+
+            kernelHist.setArg (0, in.buffer ());
+            kernelHist.setArg (1, in.offset<T> ());
+            kernelHist.setArg (2, dPartial);
+            kernelHist.setArg (3, n);
+            kernelHist.setArg (4, lo);
+            kernelHist.setArg (5, hi);
+            kernelHist.setArg (6, (cl_float) (nBins / ((double) hi - lo)));
+            queue.enqueueNDRangeKernel (kernelHist, cl::NullRange, cl::NDRange (groups * wgSize), 
+                                        cl::NDRange (wgSize), events);
+
+            kernelMerge.setArg (0, dPartial);
+            kernelMerge.setArg (1, groups);
+            kernelMerge.setArg (2, counts.buffer ());
+            kernelMerge.setArg (3, counts.offset<cl_uint> ());
+            queue.enqueueNDRangeKernel (kernelMerge, cl::NullRange, 
+                                        cl::NDRange ((nBins + wgSize - 1) / wgSize * wgSize), 
+                                        cl::NDRange (wgSize), nullptr, event);
+        }
+
+        /*! \brief Counts the first `n` elements of a buffer, 
+         *         and reads back the histogram.
+         *  \note It blocks until the histogram is available.
+         *
+         *  \param[in] in the input buffer, or a view of it.
+         *  \param[in] n the number of elements.
+         *  \param[in] events a wait-list of events.
+         *  \return The `nBins` counts.
+         */
+        std::vector<cl_uint> run (const BufferView &in, unsigned int n, 
+                                  const std::vector<cl::Event> *events = nullptr)
+        {
+            // Every bin is merged by a single work-item, so the
+            // histogram can take the place of the first partial one
+            run (in, n, dPartial, events);
+
+            std::vector<cl_uint> counts (nBins);
+            queue.enqueueReadBuffer (dPartial, CL_TRUE, 0, nBins * sizeof (cl_uint), counts.data ());
+
+            return counts;
+        }
+
+        /*! \brief Returns the number of copies of the histogram per work-group, 
+         *         or 0 if the histograms are kept in global memory.
+         */
+        unsigned int getReplicas () const { return replicas; }
+
+    private:
+        cl::CommandQueue &queue;  /*!< The queue the kernels get enqueued on. */
+        cl::Kernel kernelHist, kernelMerge;  /*!< The histogram kernels. */
+        unsigned int nBins;  /*!< The number of bins. */
+        T lo, hi;  /*!< The range of the bins. */
+        unsigned int wgSize;  /*!< The work-group size. */
+        unsigned int replicas;  /*!< The copies of the histogram per work-group. */
+        unsigned int nGroups;  /*!< The maximum number of work-groups in the first pass. */
+        cl::Buffer dPartial;  /*!< The histograms of the work-groups. */
+    };
+
+}
+
+#endif  // CLUTILS_HISTOGRAM_HPP
@@ -0,0 +1,368 @@
+/*! \file notifier.hpp
+ *  \brief Declarations of a notifier that signals the completion of
+ *         commands on a file descriptor, for event loops.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+
+#ifndef CLUTILS_NOTIFIER_HPP
+#define CLUTILS_NOTIFIER_HPP
+
+#include <atomic>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <CLUtils.hpp>
+
+#if defined(_WIN32)
+#error "CompletionNotifier requires a POSIX system"
+#elif defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+namespace clutils
+{
+
+    /*! \brief An unbounded lock-free queue with many producers and a single consumer.
+     *  \details It's an intrusive linked list (D. Vyukov's MPSC queue). A push is 
+     *           an exchange on the head, and never waits. A pop only touches the 
+     *           tail. While a producer is between its exchange and the link to its 
+     *           node, the nodes after it are not visible to the consumer yet.
+     *  
+     *  \tparam T the type of the elements.
+     */
+    template <typename T>
+    class MPSCQueue
+    {
+    public:
+        MPSCQueue () : head (&stub), tail (&stub)
+        {
+            stub.next.store (nullptr, std::memory_order_relaxed);
+        }
+
+        ~MPSCQueue ()
+        {
+            T value;
+            while (pop (value));
+        }
+
+        MPSCQueue (const MPSCQueue&) = delete;
+        MPSCQueue& operator= (const MPSCQueue&) = delete;
+
+        /*! \brief Appends an element. It can be called by any thread. */
+        void push (const T &value)
+        {
+            link (new Node (value));
+        }
+
+        /*! \brief Removes the oldest element. It's called only by the consumer.
+         *
+         *  \param[out] value the element.
+         *  \return `false` if there are no visible elements.
+         */
+        bool pop (T &value)
+        {
+            Node *t = tail;
+            Node *next = t->next.load (std::memory_order_acquire);
+            if (t == &stub)
+            {
+                if (!next) return false;
+                tail = t = next;
+                next = next->next.load (std::memory_order_acquire);
+            }
+
+            if (!next)
+            {
+                // The last node can only be detached behind the stub
+                if (t != head.load (std::memory_order_acquire)) return false;
+                link (&stub);
+                next = t->next.load (std::memory_order_acquire);
+                if (!next) return false;
+            }
+
+            tail = next;
+            value = std::move (t->value);
+            delete t;
+            return true;
+        }
+
+        /*! \brief Tells whether the queue is empty, after `pop` returned `false`.
+         *  \details `pop` also fails when a producer is between its exchange and its 
+         *           link, with its element, and the ones pushed after it, not visible 
+         *           yet. The head has moved past the tail then. It's called only by 
+         *           the consumer.
+         */
+        bool empty () const
+        {
+            return head.load (std::memory_order_acquire) == tail;
+        }
+
+    private:
+        struct Node
+        {
+            Node () {}
+            explicit Node (const T &value) : value (value) {}
+
+            std::atomic<Node*> next;
+            T value;
+        };
+
+        void link (Node *node)
+        {
+            node->next.store (nullptr, std::memory_order_relaxed);
+            Node *prev = head.exchange (node, std::memory_order_acq_rel);
+            prev->next.store (node, std::memory_order_release);
+        }
+
+        Node stub;
+        std::atomic<Node*> head;  /*!< The last node. Shared by the producers. */
+        Node *tail;  /*!< The first node. Owned by the consumer. */
+    };
+
+
+    /*! \brief The completion of a command watched by a `CompletionNotifier`. */
+    struct Completion
+    {
+        uint64_t tag;  /*!< The tag the command was watched with. */
+        cl_int status;  /*!< `CL_COMPLETE`, or a negative error code if the command failed. */
+    };
+
+
+    /*! \brief Signals the completion of commands on a file descriptor.
+     *  \details It lets an event loop (`epoll`, `poll`, `select`) drive 
+     *           OpenCL work without a thread blocked on `wait` or `finish`. 
+     *           `watch` registers a callback on an event, which the runtime 
+     *           calls from its own thread when the command completes. The 
+     *           callback pushes the completion to a lock-free queue, and 
+     *           signals the descriptor, an eventfd on Linux and a pipe 
+     *           elsewhere. The descriptor becomes readable, and the loop 
+     *           collects the completions with `drain`. The descriptor is 
+     *           signaled once per `drain`, no matter how many commands 
+     *           complete in between, so a burst of completions costs a 
+     *           single system call.
+     *  
+     *  \note The notifier has to outlive the callbacks of its events. The 
+     *        destructor waits for the commands being watched to complete.
+     */
+    class CompletionNotifier
+    {
+    public:
+        CompletionNotifier () : signaled (false), inFlight (0)
+        {
+            #if defined(__linux__)
+            rfd = wfd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (rfd < 0)
+            #else
+            int fds[2];
+            bool ok = pipe (fds) == 0;
+            if (ok)
+            {
+                rfd = fds[0]; wfd = fds[1];
+                for (int fd : fds)
+                {
+                    fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+                    fcntl (fd, F_SETFD, FD_CLOEXEC);
+                }
+            }
+            if (!ok)
+            #endif
+            {
+                std::cerr << "Error: Could not create the descriptor of the notifier: " 
+                          << std::strerror (errno) << " (" << __FILE__ << ":" << __LINE__ << ")" << std::endl;
+                exit (EXIT_FAILURE);
+            }
+        }
+
+        ~CompletionNotifier ()
+        {
+            while (inFlight.load (std::memory_order_acquire))
+                std::this_thread::yield ();
+
+            close (rfd);
+            if (wfd != rfd) close (wfd);
+        }
+
+        CompletionNotifier (const CompletionNotifier&) = delete;
+        CompletionNotifier& operator= (const CompletionNotifier&) = delete;
+
+        /*! \brief Returns the descriptor to poll for readability. */
+        int fd () const
+        {
+            return rfd;
+        }
+
+        /*! \brief Watches for the completion of a command.
+         *
+         *  \param[in] event the event of the command.
+         *  \param[in] tag a value that identifies the command in its `Completion`.
+         */
+        void watch (cl::Event event, uint64_t tag)
+        {
+            Context *ctx = new Context { this, tag };
+            inFlight.fetch_add (1, std::memory_order_relaxed);
+            try
+            {
+                event.setCallback (CL_COMPLETE, &callback, ctx);
+            }
+            catch (const cl::Error&)
+            {
+                inFlight.fetch_sub (1, std::memory_order_relaxed);
+                delete ctx;
+                throw;
+            }
+        }
+
+        /*! \brief Watches for the completion of all the commands enqueued in a queue so far.
+         *  \details It enqueues a marker, so it doesn't flush the queue.
+         *
+         *  \param[in] queue the command queue.
+         *  \param[in] tag a value that identifies the marker in its `Completion`.
+         *  \return The event of the marker.
+         */
+        cl::Event watch (const cl::CommandQueue &queue, uint64_t tag)
+        {
+            cl::Event marker;
+            queue.enqueueMarkerWithWaitList (nullptr, &marker);
+            watch (marker, tag);
+            return marker;
+        }
+
+        /*! \brief Collects the commands that completed.
+         *  \details It's called by a single thread, typically when the descriptor 
+         *           becomes readable. It clears the descriptor first, so commands 
+         *           that complete during the call signal it again, even if they 
+         *           get collected by this call. A later call may then find none. 
+         *           When a completion is still being queued, it signals the 
+         *           descriptor itself, and a later call collects it.
+         *
+         *  \param[in] handler a callable that gets each `Completion`.
+         *  \return The number of completions handled.
+         */
+        template <typename F>
+        size_t drain (F handler)
+        {
+            // In this order, a callback that finds the notifier signaled queued 
+            // its completion before the reset, so the pops below can see it
+            clear ();
+            signaled.store (false, std::memory_order_seq_cst);
+
+            size_t n = 0;
+            Completion c;
+            while (completions.pop (c))
+            {
+                handler (c);
+                ++n;
+            }
+
+            // A callback in the middle of its push leaves completions that this call 
+            // can't see. Their signals may have been consumed by `clear`, and the 
+            // callback won't signal again once it finds the notifier signaled, 
+            // so the descriptor gets signaled here, for a later call to collect them.
+            if (!completions.empty ())
+            {
+                signaled.store (true, std::memory_order_seq_cst);
+                signal ();
+            }
+
+            return n;
+        }
+
+        /*! \brief Returns the number of commands that are watched and have yet to complete. */
+        size_t pending () const
+        {
+            return inFlight.load (std::memory_order_relaxed);
+        }
+
+    private:
+        /*! \brief The data of the callback of an event. */
+        struct Context
+        {
+            CompletionNotifier *notifier;
+            uint64_t tag;
+        };
+
+        /*! \brief Queues a completion, and signals the descriptor if it's not signaled already.
+         *  \details It's called by the runtime, on any thread.
+         */
+        static void CL_CALLBACK callback (cl_event, cl_int status, void *data)
+        {
+            Context *ctx = static_cast<Context*> (data);
+            CompletionNotifier *self = ctx->notifier;
+            self->completions.push ({ ctx->tag, status });
+            delete ctx;
+
+            if (!self->signaled.exchange (true, std::memory_order_seq_cst))
+                self->signal ();
+
+            // The notifier may be destroyed past this point
+            self->inFlight.fetch_sub (1, std::memory_order_release);
+        }
+
+        /*! \brief Makes the descriptor readable. */
+        void signal ()
+        {
+            #if defined(__linux__)
+            uint64_t one = 1;
+            while (write (wfd, &one, sizeof (one)) < 0 && errno == EINTR);
+            #else
+            char one = 1;
+            while (write (wfd, &one, sizeof (one)) < 0 && errno == EINTR);
+            #endif
+        }
+
+        /*! \brief Makes the descriptor not readable. */
+        void clear ()
+        {
+            #if defined(__linux__)
+            uint64_t count;
+            while (read (rfd, &count, sizeof (count)) < 0 && errno == EINTR);
+            #else
+            char buf[64];
+            for (;;)
+            {
+                ssize_t n = read (rfd, buf, sizeof (buf));
+                if (n == 0 || (n < 0 && errno != EINTR)) break;
+            }
+            #endif
+        }
+
+        MPSCQueue<Completion> completions;
+        std::atomic<bool> signaled;  /*!< Tells whether the descriptor is signaled, or about to be. */
+        std::atomic<size_t> inFlight;
+        int rfd, wfd;
+    };
+
+}
+
+#endif  // CLUTILS_NOTIFIER_HPP
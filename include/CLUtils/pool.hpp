@@ -0,0 +1,359 @@
+/*! \file pool.hpp
+ *  \brief Declarations of a work-stealing pool of host threads, for
+ *         preparing and consuming the data of the kernels in parallel.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+
+#ifndef CLUTILS_POOL_HPP
+#define CLUTILS_POOL_HPP
+
+#include <cstring>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <functional>
+#include <exception>
+#include <algorithm>
+#include <type_traits>
+
+
+namespace clutils
+{
+
+    /*! \brief A work-stealing pool of host threads.
+     *  \details Every worker owns a deque of tasks. It pushes the tasks it 
+     *           spawns, and pops them, at the back of its deque, and when it 
+     *           runs out of tasks, it steals from the front of the others'. 
+     *           The tasks spawned by threads outside the pool go to a deque 
+     *           of their own, that the workers steal from.
+     *  \details `parallel_for` splits a range in halves, down to a grain, and 
+     *           the calling thread takes part in the work while it waits, so 
+     *           a pool of `n` threads has `n - 1` workers. Since the waiting 
+     *           threads run tasks, `parallel_for` can be nested.
+     *  \note It's meant for the host side of a pipeline, like filling a mapped 
+     *        staging buffer, or verifying a chunk of results, while the device 
+     *        works on the next chunk.
+     *  \code
+     *  int *A = (int *) queue.enqueueMapBuffer (hBufferA, CL_TRUE, CL_MAP_WRITE, 0, n * sizeof (int));
+     *  clutils::ThreadPool::instance ().parallel_for (A, A + n, [&] (int *first, int *last)
+     *  {
+     *      for (int *p = first; p != last; ++p)
+     *          *p = p - A;
+     *  });
+     *  queue.enqueueUnmapMemObject (hBufferA, A);
+     *  \endcode
+     */
+    class ThreadPool
+    {
+    public:
+        /*! \brief Returns the pool of the process, with a thread per core. */
+        static ThreadPool& instance ()
+        {
+            static ThreadPool pool;
+            return pool;
+        }
+
+        /*! \param[in] nThreads the number of threads, including the one that waits. 
+         *                      `0` uses the number of hardware threads.
+         */
+        explicit ThreadPool (unsigned int nThreads = 0) : queued (0), sleeping (0), stopping (false)
+        {
+            if (nThreads == 0)
+                nThreads = std::max (std::thread::hardware_concurrency (), 1u);
+
+            // The last deque takes the tasks of the threads outside the pool
+            for (unsigned int i = 0; i < nThreads; ++i)
+                queues.emplace_back (new TaskQueue);
+            for (unsigned int i = 0; i < nThreads - 1; ++i)
+                workers.emplace_back (&ThreadPool::work, this, i);
+        }
+
+        ThreadPool (const ThreadPool&) = delete;
+        ThreadPool& operator= (const ThreadPool&) = delete;
+
+        /*! \brief Runs the remaining tasks, and joins the workers. */
+        ~ThreadPool ()
+        {
+            {
+                std::lock_guard<std::mutex> lock (sleepMutex);
+                stopping = true;
+            }
+            wake.notify_all ();
+
+            for (auto &worker : workers)
+                worker.join ();
+        }
+
+        /*! \brief Returns the number of threads, including the one that waits. */
+        unsigned int size () const
+        {
+            return queues.size ();
+        }
+
+        /*! \brief Runs a task asynchronously.
+         *  \note A pool of one thread has no workers, so it runs the task on the spot.
+         *
+         *  \param[in] f the task.
+         *  \return A future for the result of the task, or for its exception.
+         */
+        template <typename F>
+        std::future<typename std::result_of<F ()>::type> submit (F f)
+        {
+            typedef typename std::result_of<F ()>::type R;
+            auto task = std::make_shared<std::packaged_task<R ()>> (std::move (f));
+            std::future<R> result = task->get_future ();
+            if (workers.empty ())
+                (*task) ();
+            else
+                push ([task] { (*task) (); });
+            return result;
+        }
+
+        /*! \brief Calls `f (first, last)` on subranges of `[begin, end)`, in parallel.
+         *  \note It blocks until all of the subranges are done. If `f` throws, 
+         *        the subranges that haven't started yet are skipped, and the 
+         *        first exception is rethrown.
+         *
+         *  \param[in] begin the beginning of the range.
+         *  \param[in] end the end of the range.
+         *  \param[in] f the function that processes a subrange.
+         *  \param[in] grain the size of the subranges below which they are not split.
+         *                   `0` aims for 8 subranges per thread.
+         */
+        template <typename F>
+        void parallel_for (size_t begin, size_t end, F f, size_t grain = 0)
+        {
+            if (begin >= end)
+                return;
+
+            if (grain == 0)
+                grain = std::max<size_t> ((end - begin) / (8 * size ()), 1);
+
+            if (end - begin <= grain || size () == 1)
+            {
+                f (begin, end);
+                return;
+            }
+
+            Group group;
+            split (group, f, begin, end, grain);
+
+            // Help with the tasks while the subranges are in flight
+            unsigned int idx = slot ();
+            while (group.pending.load (std::memory_order_acquire) > 0)
+                if (!runOne (idx))
+                    std::this_thread::yield ();
+
+            if (group.error)
+                std::rethrow_exception (group.error);
+        }
+
+        /*! \brief Calls `f (first, last)` on subranges of the elements in 
+         *         `[begin, end)`, in parallel. It's meant for mapped buffers.
+         *
+         *  \param[in] begin a pointer to the first element.
+         *  \param[in] end a pointer past the last element.
+         *  \param[in] f the function that processes a subrange.
+         *  \param[in] grain the number of elements below which the subranges are not split.
+         */
+        template <typename T, typename F>
+        void parallel_for (T *begin, T *end, F f, size_t grain = 0)
+        {
+            parallel_for ((size_t) 0, (size_t) (end - begin), 
+                          [begin, &f] (size_t first, size_t last) { f (begin + first, begin + last); }, grain);
+        }
+
+        /*! \brief Copies `bytes` from `src` to `dst`, in pieces of at least 1MB.
+         *  \note Copying into pinned memory is bound by the bandwidth that 
+         *        a single core can pull, so a few threads go a long way.
+         */
+        void copy (void *dst, const void *src, size_t bytes)
+        {
+            parallel_for ((char *) dst, (char *) dst + bytes, [dst, src] (char *first, char *last)
+            {
+                std::memcpy (first, (const char *) src + (first - (char *) dst), last - first);
+            }, std::max<size_t> (bytes / size (), 1 << 20));
+        }
+
+    private:
+        typedef std::function<void ()> Task;
+
+        /*! \brief A deque of tasks. */
+        struct TaskQueue
+        {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        /*! \brief The state shared by the subranges of a `parallel_for`. */
+        struct Group
+        {
+            Group () : pending (1), failed (false) {}
+            std::atomic<size_t> pending;  /*!< The subranges that haven't finished. */
+            std::atomic<bool> failed;  /*!< Whether a subrange threw. */
+            std::mutex mutex;  /*!< Guards the exception. */
+            std::exception_ptr error;  /*!< The first exception thrown. */
+        };
+
+        /*! \brief The pool and the deque of the calling thread. */
+        struct Context
+        {
+            ThreadPool *pool;
+            unsigned int index;
+        };
+
+        static Context& context ()
+        {
+            static thread_local Context ctx { nullptr, 0 };
+            return ctx;
+        }
+
+        /*! \brief Returns the deque of the calling thread. */
+        unsigned int slot () const
+        {
+            const Context &ctx = context ();
+            return ctx.pool == this ? ctx.index : queues.size () - 1;
+        }
+
+        /*! \brief Spawns the upper halves of a range, and processes what's left. */
+        template <typename F>
+        void split (Group &group, F &f, size_t begin, size_t end, size_t grain)
+        {
+            while (end - begin > grain)
+            {
+                size_t middle = begin + (end - begin) / 2;
+                group.pending.fetch_add (1, std::memory_order_relaxed);
+                push ([this, &group, &f, middle, end, grain] { split (group, f, middle, end, grain); });
+                end = middle;
+            }
+
+            if (!group.failed.load (std::memory_order_relaxed))
+            {
+                try
+                {
+                    f (begin, end);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock (group.mutex);
+                    if (!group.error)
+                        group.error = std::current_exception ();
+                    group.failed.store (true, std::memory_order_relaxed);
+                }
+            }
+
+            group.pending.fetch_sub (1, std::memory_order_release);
+        }
+
+        /*! \brief Pushes a task on the deque of the calling thread, and wakes up a worker. */
+        void push (Task task)
+        {
+            TaskQueue &q = *queues[slot ()];
+            queued.fetch_add (1);
+            {
+                std::lock_guard<std::mutex> lock (q.mutex);
+                q.tasks.push_back (std::move (task));
+            }
+
+            // A worker going to sleep increments `sleeping` before it 
+            // checks `queued`, so one of the two sees the other
+            if (sleeping.load () > 0)
+            {
+                std::lock_guard<std::mutex> lock (sleepMutex);
+                wake.notify_one ();
+            }
+        }
+
+        /*! \brief Runs a task from the back of its own deque, or from the front of another's.
+         *  \return Whether it found a task.
+         */
+        bool runOne (unsigned int idx)
+        {
+            Task task;
+            for (unsigned int k = 0; k < queues.size () && !task; ++k)
+            {
+                TaskQueue &q = *queues[(idx + k) % queues.size ()];
+                std::lock_guard<std::mutex> lock (q.mutex);
+                if (q.tasks.empty ())
+                    continue;
+                if (k == 0)
+                {
+                    task = std::move (q.tasks.back ());
+                    q.tasks.pop_back ();
+                }
+                else
+                {
+                    task = std::move (q.tasks.front ());
+                    q.tasks.pop_front ();
+                }
+            }
+
+            if (!task)
+                return false;
+
+            queued.fetch_sub (1);
+            task ();
+            return true;
+        }
+
+        /*! \brief The loop of a worker. */
+        void work (unsigned int idx)
+        {
+            context () = Context { this, idx };
+
+            while (true)
+            {
+                if (runOne (idx))
+                    continue;
+
+                std::unique_lock<std::mutex> lock (sleepMutex);
+                if (stopping && queued.load () == 0)
+                    return;
+                ++sleeping;
+                wake.wait (lock, [this] { return queued.load () > 0 || stopping; });
+                --sleeping;
+            }
+        }
+
+        std::vector<std::unique_ptr<TaskQueue>> queues;  /*!< The deques, the last one for outside threads. */
+        std::vector<std::thread> workers;
+        std::atomic<size_t> queued;  /*!< The tasks in the deques. */
+        std::atomic<unsigned int> sleeping;  /*!< The workers waiting for tasks. */
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        bool stopping;
+    };
+
+}
+
+#endif  // CLUTILS_POOL_HPP
@@ -0,0 +1,381 @@
+/*! \file primitives.hpp
+ *  \brief Declarations of classes for parallel primitives
+ *         (reductions, prefix scans) on top of `CLEnv`.
+ *  \details The primitives are templated on the element type and operator.
+ *           Each template instantiation maps to a set of build options that
+ *           specialize the kernels, and builds its program through
+ *           `CLEnv::getProgramIdx`, so that objects of the same type
+ *           share a single build.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef CLUTILS_PRIMITIVES_HPP
+#define CLUTILS_PRIMITIVES_HPP
+
+#include <string>
+#include <limits>
+#include <CLUtils.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief Maps a host type to the name of the associated
+     *         OpenCL C type and its limits.
+     *  \details The names are forwarded to the kernels as build options.
+     */
+    template <typename T>
+    struct CLType;
+
+    template <>
+    struct CLType<cl_int>
+    {
+        static const char* name () { return "int"; }
+        static const char* min () { return "INT_MIN"; }
+        static const char* max () { return "INT_MAX"; }
+    };
+
+    template <>
+    struct CLType<cl_uint>
+    {
+        static const char* name () { return "uint"; }
+        static const char* min () { return "0"; }
+        static const char* max () { return "UINT_MAX"; }
+    };
+
+    template <>
+    struct CLType<cl_long>
+    {
+        static const char* name () { return "long"; }
+        static const char* min () { return "LONG_MIN"; }
+        static const char* max () { return "LONG_MAX"; }
+    };
+
+    template <>
+    struct CLType<cl_ulong>
+    {
+        static const char* name () { return "ulong"; }
+        static const char* min () { return "0"; }
+        static const char* max () { return "ULONG_MAX"; }
+    };
+
+    template <>
+    struct CLType<cl_float>
+    {
+        static const char* name () { return "float"; }
+        static const char* min () { return "-FLT_MAX"; }
+        static const char* max () { return "FLT_MAX"; }
+    };
+
+
+    /*! \brief Addition operator for the primitives. */
+    struct Sum
+    {
+        /*! \brief The define that selects the operator in the kernels. */
+        static const char* name () { return "OP_SUM"; }
+        /*! \brief The identity element of the operator. */
+        template <typename T> static T identity () { return T (0); }
+        /*! \brief Host version of the operator. */
+        template <typename T> T operator() (T a, T b) const { return a + b; }
+    };
+
+    /*! \brief Minimum operator for the primitives. */
+    struct Min
+    {
+        /*! \brief The define that selects the operator in the kernels. */
+        static const char* name () { return "OP_MIN"; }
+        /*! \brief The identity element of the operator. */
+        template <typename T> static T identity () { return std::numeric_limits<T>::max (); }
+        /*! \brief Host version of the operator. */
+        template <typename T> T operator() (T a, T b) const { return std::min (a, b); }
+    };
+
+    /*! \brief Maximum operator for the primitives. */
+    struct Max
+    {
+        /*! \brief The define that selects the operator in the kernels. */
+        static const char* name () { return "OP_MAX"; }
+        /*! \brief The identity element of the operator. */
+        template <typename T> static T identity () { return std::numeric_limits<T>::lowest (); }
+        /*! \brief Host version of the operator. */
+        template <typename T> T operator() (T a, T b) const { return std::max (a, b); }
+    };
+
+
+    /*! \brief Composes the build options that specialize
+     *         the primitives' kernels.
+     *
+     *  \tparam T the element type.
+     *  \tparam Op the operator (`Sum`, `Min`, `Max`).
+     *  \param[in] wgSize the work-group size the kernels are compiled for.
+     *  \return The build options.
+     */
+    template <typename T, typename Op>
+    std::string primitiveOptions (unsigned int wgSize)
+    {
+        return std::string ("-D T=") + CLType<T>::name () +
+               " -D T_MIN=" + CLType<T>::min () + " -D T_MAX=" + CLType<T>::max () +
+               " -D " + Op::name () + " -D WG_SIZE=" + std::to_string (wgSize);
+    }
+
+
+    /*! \brief Performs a reduction on a buffer.
+     *  \details The reduction happens in two passes. In the first pass, a
+     *           number of work-groups proportional to the compute units
+     *           accumulate the input in registers, and reduce their partial
+     *           results in local memory. In the second pass, a single
+     *           work-group reduces the partial results.
+     *
+     *  \tparam T the element type.
+     *  \tparam Op the operator (`Sum`, `Min`, `Max`).
+     */
+    template <typename T, typename Op = Sum>
+    class Reduce
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment
+         *                  the kernels will be built and run in.
+         *  \param[in] wgSize the work-group size. It must be a power of 2.
+         *  \param[in] kernel_filename the file with the reduction kernels.
+         */
+        Reduce (CLEnv &env, CLEnvInfo<1> info = CLEnvInfo<1> (), unsigned int wgSize = 256,
+                const std::string &kernel_filename = "kernels/reduce.cl")
+            : queue (env.getQueue (info.ctxIdx, info.qIdx[0])), wgSize (wgSize)
+        {
+            std::string options = primitiveOptions<T, Op> (wgSize);
+            unsigned int pgIdx = env.getProgramIdx (info.ctxIdx, { kernel_filename }, options.c_str ());
+            kernel = env.getKernel ("reduce", pgIdx);
+
+            // A few work-groups per compute unit keep the device
+            // busy while the second pass stays within a single work-group
+            cl::Device device = queue.getInfo<CL_QUEUE_DEVICE> ();
+            nGroups = std::min (4 * device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS> (), wgSize);
+
+            dPartial = env.getMemoryManager (info.ctxIdx).createBuffer (CL_MEM_READ_WRITE, nGroups * sizeof (T));
+        }
+
+        /*! \brief Reduces the first `n` elements of a buffer.
+         *
+         *  \param[in] in the input buffer, or a view of it.
+         *  \param[in] n the number of elements to reduce.
+         *  \param[out] out a buffer, or a view, whose first element receives the result.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the last kernel execution.
+         */
+        void run (const BufferView &in, unsigned int n, const BufferView &out,
+                  const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            // An empty input reduces to the identity
+            if (n == 0)
+            {
+                queue.enqueueFillBuffer (out.buffer (), Op::template identity<T> (), out.offset (), 
+                                         sizeof (T), events, event);
+                return;
+            }
+
+            unsigned int groups = std::min (nGroups, (n + wgSize - 1) / wgSize);
+
+            kernel.setArg (0, in.buffer ());
+            kernel.setArg (1, in.offset<T> ());
+            kernel.setArg (2, dPartial);
+            kernel.setArg (3, (cl_uint) 0);
+            kernel.setArg (4, n);
+            queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (groups * wgSize),
+                                        cl::NDRange (wgSize), events);
+
+            kernel.setArg (0, dPartial);
+            kernel.setArg (1, (cl_uint) 0);
+            kernel.setArg (2, out.buffer ());
+            kernel.setArg (3, out.offset<T> ());
+            kernel.setArg (4, groups);
+            queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (wgSize),
+                                        cl::NDRange (wgSize), nullptr, event);
+        }
+
+        /*! \brief Reduces the first `n` elements of a buffer,
+         *         and reads back the result.
+         *  \note It blocks until the result is available.
+         *
+         *  \param[in] in the input buffer, or a view of it.
+         *  \param[in] n the number of elements to reduce.
+         *  \param[in] events a wait-list of events.
+         *  \return The result of the reduction.
+         */
+        T run (const BufferView &in, unsigned int n, const std::vector<cl::Event> *events = nullptr)
+        {
+            run (in, n, dPartial, events);
+
+            T result;
+            queue.enqueueReadBuffer (dPartial, CL_TRUE, 0, sizeof (T), &result);
+
+            return result;
+        }
+
+    private:
+        cl::CommandQueue &queue;  /*!< The queue the kernels get enqueued on. */
+        cl::Kernel kernel;  /*!< The reduction kernel. */
+        unsigned int wgSize;  /*!< The work-group size. */
+        unsigned int nGroups;  /*!< The maximum number of work-groups in the first pass. */
+        cl::Buffer dPartial;  /*!< The partial results of the first pass. */
+    };
+
+
+    /*! \brief The types of prefix scans. */
+    enum class ScanType : uint8_t
+    {
+        INCLUSIVE,  /*!< Element i holds the result over elements [0, i]. */
+        EXCLUSIVE   /*!< Element i holds the result over elements [0, i). */
+    };
+
+
+    /*! \brief Performs a prefix scan on a buffer.
+     *  \details It's a multi-pass scan. Every work-group scans a block of
+     *           `4 * wgSize` elements in local memory and writes out the
+     *           block's total. The block totals are scanned recursively,
+     *           and then get added to the blocks of the level below.
+     *           The buffers for the block totals are kept between calls,
+     *           and only get reallocated when a larger input shows up.
+     *
+     *  \tparam T the element type.
+     *  \tparam Op the operator (`Sum`, `Min`, `Max`).
+     */
+    template <typename T, typename Op = Sum>
+    class Scan
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment
+         *                  the kernels will be built and run in.
+         *  \param[in] wgSize the work-group size. It must be a power of 2.
+         *  \param[in] kernel_filename the file with the scan kernels.
+         */
+        Scan (CLEnv &env, CLEnvInfo<1> info = CLEnvInfo<1> (), unsigned int wgSize = 256,
+              const std::string &kernel_filename = "kernels/scan.cl")
+            : memory (env.getMemoryManager (info.ctxIdx)),
+              queue (env.getQueue (info.ctxIdx, info.qIdx[0])),
+              wgSize (wgSize), blockSize (4 * wgSize), capacity (0)
+        {
+            std::string options = primitiveOptions<T, Op> (wgSize);
+            unsigned int pgIdx = env.getProgramIdx (info.ctxIdx, { kernel_filename }, options.c_str ());
+            kernelScan = env.getKernel ("scanBlocks", pgIdx);
+            kernelAdd = env.getKernel ("addOffsets", pgIdx);
+        }
+
+        /*! \brief Scans the first `n` elements of a buffer.
+         *  \note `in` and `out` may be the same buffer, or the same view.
+         *
+         *  \param[in] in the input buffer, or a view of it.
+         *  \param[in] n the number of elements to scan.
+         *  \param[out] out the output buffer, or a view of it.
+         *  \param[in] type the type of the scan.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the last kernel execution.
+         */
+        void run (const BufferView &in, unsigned int n, const BufferView &out,
+                  ScanType type = ScanType::INCLUSIVE,
+                  const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            // There's nothing to scan, but the event still has to follow the wait-list
+            if (n == 0)
+            {
+                queue.enqueueMarkerWithWaitList (events, event);
+                return;
+            }
+
+            reserve (n);
+
+            // Sizes of the levels, starting with the input
+            std::vector<unsigned int> sizes (1, n);
+            while (sizes.back () > blockSize)
+                sizes.push_back (nBlocks (sizes.back ()));
+
+            // Scan the blocks on every level, and keep their totals on the next one.
+            // The totals get an exclusive scan, so they can be used as offsets.
+            for (unsigned int l = 0; l < sizes.size (); ++l)
+            {
+                kernelScan.setArg (0, l == 0 ? in.buffer () : dSums[l - 1]);
+                kernelScan.setArg (1, l == 0 ? in.offset<T> () : 0);
+                kernelScan.setArg (2, l == 0 ? out.buffer () : dSums[l - 1]);
+                kernelScan.setArg (3, l == 0 ? out.offset<T> () : 0);
+                kernelScan.setArg (4, dSums[l]);
+                kernelScan.setArg (5, sizes[l]);
+                kernelScan.setArg (6, (cl_uint) (l == 0 && type == ScanType::INCLUSIVE));
+                queue.enqueueNDRangeKernel (kernelScan, cl::NullRange,
+                                            cl::NDRange (nBlocks (sizes[l]) * wgSize), cl::NDRange (wgSize),
+                                            l == 0 ? events : nullptr, sizes.size () == 1 ? event : nullptr);
+            }
+
+            // Propagate the offsets back down the levels
+            for (int l = sizes.size () - 2; l >= 0; --l)
+            {
+                kernelAdd.setArg (0, l == 0 ? out.buffer () : dSums[l - 1]);
+                kernelAdd.setArg (1, l == 0 ? out.offset<T> () : 0);
+                kernelAdd.setArg (2, dSums[l]);
+                kernelAdd.setArg (3, sizes[l]);
+                queue.enqueueNDRangeKernel (kernelAdd, cl::NullRange,
+                                            cl::NDRange (nBlocks (sizes[l]) * wgSize), cl::NDRange (wgSize),
+                                            nullptr, l == 0 ? event : nullptr);
+            }
+        }
+
+    private:
+        /*! \brief Returns the number of blocks that cover `n` elements. */
+        unsigned int nBlocks (unsigned int n)
+        {
+            return (n + blockSize - 1) / blockSize;
+        }
+
+        /*! \brief Makes sure there are buffers for the block totals
+         *         of every level for an input of `n` elements. */
+        void reserve (unsigned int n)
+        {
+            if (n <= capacity && !dSums.empty ())
+                return;
+
+            dSums.clear ();
+            unsigned int size = n;
+            do
+            {
+                size = nBlocks (size);
+                dSums.push_back (memory.createBuffer (CL_MEM_READ_WRITE, size * sizeof (T)));
+            } while (size > 1);
+
+            capacity = n;
+        }
+
+        MemoryManager &memory;  /*!< The manager the buffers are allocated from. */
+        cl::CommandQueue &queue;  /*!< The queue the kernels get enqueued on. */
+        cl::Kernel kernelScan, kernelAdd;  /*!< The scan kernels. */
+        unsigned int wgSize;  /*!< The work-group size. */
+        unsigned int blockSize;  /*!< The number of elements scanned by a work-group. */
+        unsigned int capacity;  /*!< The input size the buffers are allocated for. */
+        std::vector<cl::Buffer> dSums;  /*!< The block totals for every level. */
+    };
+
+}
+
+#endif  // CLUTILS_PRIMITIVES_HPP
@@ -0,0 +1,385 @@
+/*! \file rect.hpp
+ *  \brief Helpers for transfers of pitched 2D/3D data, 
+ *         and for 2D surfaces backed by images or pitched buffers.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+#ifndef CLUTILS_RECT_HPP
+#define CLUTILS_RECT_HPP
+
+#include <CLUtils.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief The layout of a box in pitched memory.
+     *  \details `x` and the pitches are in bytes, `y` is in rows, and `z` 
+     *           in slices. As in the OpenCL API, a pitch of 0 stands for 
+     *           tightly packed rows or slices.
+     */
+    struct Pitched
+    {
+        /*! \param[in] rowPitch the distance between rows in bytes.
+         *  \param[in] slicePitch the distance between slices in bytes.
+         *  \param[in] x the origin of the box in a row, in bytes.
+         *  \param[in] y the row the box starts on.
+         *  \param[in] z the slice the box starts on.
+         */
+        Pitched (size_t rowPitch = 0, size_t slicePitch = 0, size_t x = 0, size_t y = 0, size_t z = 0)
+            : rowPitch (rowPitch), slicePitch (slicePitch), x (x), y (y), z (z)
+        {
+        }
+
+        /*! \brief Returns the origin as expected by the OpenCL API. */
+        cl::size_t<3> origin () const
+        {
+            cl::size_t<3> o;
+            o[0] = x; o[1] = y; o[2] = z;
+            return o;
+        }
+
+        size_t rowPitch, slicePitch;  /*!< The pitches in bytes. */
+        size_t x, y, z;  /*!< The origin of the box. */
+    };
+
+
+    /*! \brief The size of a box. The width is in bytes, 
+     *         the height in rows, and the depth in slices. */
+    struct Extent
+    {
+        Extent (size_t width, size_t height = 1, size_t depth = 1)
+            : width (width), height (height), depth (depth)
+        {
+        }
+
+        /*! \brief Returns the region as expected by the OpenCL API. */
+        cl::size_t<3> region () const
+        {
+            cl::size_t<3> r;
+            r[0] = width; r[1] = height; r[2] = depth;
+            return r;
+        }
+
+        size_t width, height, depth;  /*!< The size of the box. */
+    };
+
+
+    /*! \brief Writes a box of pitched host data to a pitched buffer, 
+     *         without repacking on the host.
+     *
+     *  \param[in] queue the command queue.
+     *  \param[out] buffer the destination buffer.
+     *  \param[in] bufferLayout the layout of the box in `buffer`.
+     *  \param[in] ptr the host data.
+     *  \param[in] hostLayout the layout of the box in `ptr`.
+     *  \param[in] extent the size of the box.
+     *  \param[in] blocking whether the call returns after the write completes.
+     *  \param[in] events a wait-list of events.
+     *  \param[out] event an event that identifies the write.
+     */
+    inline void writeRect (cl::CommandQueue &queue, const cl::Buffer &buffer, const Pitched &bufferLayout, 
+                           const void *ptr, const Pitched &hostLayout, const Extent &extent, 
+                           cl_bool blocking = CL_FALSE, 
+                           const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+    {
+        queue.enqueueWriteBufferRect (buffer, blocking, bufferLayout.origin (), hostLayout.origin (), 
+                                      extent.region (), bufferLayout.rowPitch, bufferLayout.slicePitch, 
+                                      hostLayout.rowPitch, hostLayout.slicePitch, ptr, events, event);
+    }
+
+
+    /*! \brief Reads a box of a pitched buffer to pitched host memory, 
+     *         without repacking on the host.
+     *
+     *  \param[in] queue the command queue.
+     *  \param[in] buffer the source buffer.
+     *  \param[in] bufferLayout the layout of the box in `buffer`.
+     *  \param[out] ptr the host memory.
+     *  \param[in] hostLayout the layout of the box in `ptr`.
+     *  \param[in] extent the size of the box.
+     *  \param[in] blocking whether the call returns after the read completes.
+     *  \param[in] events a wait-list of events.
+     *  \param[out] event an event that identifies the read.
+     */
+    inline void readRect (cl::CommandQueue &queue, const cl::Buffer &buffer, const Pitched &bufferLayout, 
+                          void *ptr, const Pitched &hostLayout, const Extent &extent, 
+                          cl_bool blocking = CL_TRUE, 
+                          const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+    {
+        queue.enqueueReadBufferRect (buffer, blocking, bufferLayout.origin (), hostLayout.origin (), 
+                                     extent.region (), bufferLayout.rowPitch, bufferLayout.slicePitch, 
+                                     hostLayout.rowPitch, hostLayout.slicePitch, ptr, events, event);
+    }
+
+
+    /*! \brief Copies a box between pitched buffers.
+     *
+     *  \param[in] queue the command queue.
+     *  \param[in] src the source buffer.
+     *  \param[in] srcLayout the layout of the box in `src`.
+     *  \param[out] dst the destination buffer.
+     *  \param[in] dstLayout the layout of the box in `dst`.
+     *  \param[in] extent the size of the box.
+     *  \param[in] events a wait-list of events.
+     *  \param[out] event an event that identifies the copy.
+     */
+    inline void copyRect (cl::CommandQueue &queue, const cl::Buffer &src, const Pitched &srcLayout, 
+                          const cl::Buffer &dst, const Pitched &dstLayout, const Extent &extent, 
+                          const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+    {
+        queue.enqueueCopyBufferRect (src, dst, srcLayout.origin (), dstLayout.origin (), extent.region (), 
+                                     srcLayout.rowPitch, srcLayout.slicePitch, 
+                                     dstLayout.rowPitch, dstLayout.slicePitch, events, event);
+    }
+
+
+    /*! \brief Returns the size of a pixel of an image format in bytes. */
+    inline size_t pixelSize (const cl::ImageFormat &format)
+    {
+        size_t channels;
+        switch (format.image_channel_order)
+        {
+            case CL_RG: case CL_RA: case CL_RGx:
+                channels = 2; break;
+            case CL_RGB: case CL_RGBx:
+                channels = 3; break;
+            case CL_RGBA: case CL_BGRA: case CL_ARGB:
+                channels = 4; break;
+            default:
+                channels = 1;
+        }
+
+        switch (format.image_channel_data_type)
+        {
+            // Packed formats hold all channels in a single word
+            case CL_UNORM_SHORT_565: case CL_UNORM_SHORT_555:
+                return 2;
+            case CL_UNORM_INT_101010:
+                return 4;
+            case CL_SNORM_INT16: case CL_UNORM_INT16: case CL_SIGNED_INT16: 
+            case CL_UNSIGNED_INT16: case CL_HALF_FLOAT:
+                return 2 * channels;
+            case CL_SIGNED_INT32: case CL_UNSIGNED_INT32: case CL_FLOAT:
+                return 4 * channels;
+            default:
+                return channels;
+        }
+    }
+
+
+    /*! \brief Checks whether every device in a context supports 
+     *         2D images of a format.
+     *
+     *  \param[in] context the context.
+     *  \param[in] flags the flags the images would be created with.
+     *  \param[in] format the image format.
+     *  \return Whether the format is supported.
+     */
+    inline bool supportsImageFormat (const cl::Context &context, cl_mem_flags flags, 
+                                     const cl::ImageFormat &format)
+    {
+        for (auto &device : context.getInfo<CL_CONTEXT_DEVICES> ())
+            if (!device.getInfo<CL_DEVICE_IMAGE_SUPPORT> ())
+                return false;
+
+        std::vector<cl::ImageFormat> formats;
+        context.getSupportedImageFormats (flags, CL_MEM_OBJECT_IMAGE2D, &formats);
+        for (auto &f : formats)
+            if (f.image_channel_order == format.image_channel_order && 
+                f.image_channel_data_type == format.image_channel_data_type)
+                return true;
+
+        return false;
+    }
+
+
+    /*! \brief A 2D surface, backed by an image when the devices 
+     *         support its format, and by a pitched buffer otherwise.
+     *  \details Images go through the texture caches, which favor 2D 
+     *           access patterns. The buffer rows are padded to a multiple 
+     *           of both the base address alignment of the devices and the 
+     *           pixel size, so the rows hold whole pixels, and kernels can 
+     *           take the pitch in pixels, even for 3-channel formats. 
+     *           Transfers take the host row pitch, so pitched host data 
+     *           don't need repacking. Kernels that take either kind of 
+     *           surface can be specialized on `isImage ()`.
+     *  \note The buffer is allocated from the `MemoryManager` of the context, 
+     *        and counts against its budget. Images aren't accounted.
+     */
+    class Surface2D
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment 
+         *                  the surface will be allocated in.
+         *  \param[in] flags the memory flags.
+         *  \param[in] format the format of the pixels.
+         *  \param[in] width the width of the surface in pixels.
+         *  \param[in] height the height of the surface in pixels.
+         *  \param[in] preferImage whether an image should be used when possible.
+         */
+        Surface2D (CLEnv &env, CLEnvInfo<1> info, cl_mem_flags flags, const cl::ImageFormat &format, 
+                   size_t width, size_t height, bool preferImage = true)
+            : cols (width), rows (height), pixel (clutils::pixelSize (format)), pitch (0), 
+              useImage (preferImage && supportsImageFormat (env.getContext (info.ctxIdx), flags, format))
+        {
+            cl::Context &context (env.getContext (info.ctxIdx));
+
+            if (useImage)
+                img = cl::Image2D (context, flags, format, width, height);
+            else
+            {
+                // The least common multiple of the alignment and the pixel size
+                size_t align = BufferView::alignment (context), a = align, b = pixel;
+                while (b)
+                {
+                    size_t r = a % b;
+                    a = b;
+                    b = r;
+                }
+                size_t step = align / a * pixel;
+
+                pitch = (width * pixel + step - 1) / step * step;
+                buf = env.getMemoryManager (info.ctxIdx).createBuffer (flags, pitch * height);
+            }
+        }
+
+        /*! \brief Tells whether the surface is backed by an image. */
+        bool isImage () const { return useImage; }
+        /*! \brief The image of the surface (if `isImage ()`). */
+        const cl::Image2D& image () const { return img; }
+        /*! \brief The buffer of the surface (if not `isImage ()`). */
+        const cl::Buffer& buffer () const { return buf; }
+        /*! \brief The row pitch of the buffer in bytes. */
+        size_t rowPitch () const { return pitch; }
+        /*! \brief The size of a pixel in bytes. */
+        size_t pixelSize () const { return pixel; }
+        /*! \brief The width of the surface in pixels. */
+        size_t width () const { return cols; }
+        /*! \brief The height of the surface in pixels. */
+        size_t height () const { return rows; }
+
+        /*! \brief Writes a region of the surface.
+         *
+         *  \param[in] queue the command queue.
+         *  \param[in] x the column the region starts on.
+         *  \param[in] y the row the region starts on.
+         *  \param[in] w the width of the region in pixels.
+         *  \param[in] h the height of the region in pixels.
+         *  \param[in] ptr the host data.
+         *  \param[in] hostRowPitch the row pitch of the host data in bytes. 
+         *                          If 0, the rows are tightly packed.
+         *  \param[in] blocking whether the call returns after the write completes.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the write.
+         */
+        void write (cl::CommandQueue &queue, size_t x, size_t y, size_t w, size_t h, 
+                    const void *ptr, size_t hostRowPitch = 0, cl_bool blocking = CL_TRUE, 
+                    const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            if (useImage)
+                queue.enqueueWriteImage (img, blocking, Pitched (0, 0, x, y).origin (), 
+                                         Extent (w, h).region (), hostRowPitch, 0, 
+                                         const_cast<void *> (ptr), events, event);
+            else
+                writeRect (queue, buf, Pitched (pitch, 0, x * pixel, y), ptr, Pitched (hostRowPitch), 
+                           Extent (w * pixel, h), blocking, events, event);
+        }
+
+        /*! \brief Writes the whole surface. */
+        void write (cl::CommandQueue &queue, const void *ptr, size_t hostRowPitch = 0, cl_bool blocking = CL_TRUE, 
+                    const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            write (queue, 0, 0, cols, rows, ptr, hostRowPitch, blocking, events, event);
+        }
+
+        /*! \brief Reads a region of the surface.
+         *
+         *  \param[in] queue the command queue.
+         *  \param[in] x the column the region starts on.
+         *  \param[in] y the row the region starts on.
+         *  \param[in] w the width of the region in pixels.
+         *  \param[in] h the height of the region in pixels.
+         *  \param[out] ptr the host memory.
+         *  \param[in] hostRowPitch the row pitch of the host memory in bytes. 
+         *                          If 0, the rows are tightly packed.
+         *  \param[in] blocking whether the call returns after the read completes.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the read.
+         */
+        void read (cl::CommandQueue &queue, size_t x, size_t y, size_t w, size_t h, 
+                   void *ptr, size_t hostRowPitch = 0, cl_bool blocking = CL_TRUE, 
+                   const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            if (useImage)
+                queue.enqueueReadImage (img, blocking, Pitched (0, 0, x, y).origin (), 
+                                        Extent (w, h).region (), hostRowPitch, 0, ptr, events, event);
+            else
+                readRect (queue, buf, Pitched (pitch, 0, x * pixel, y), ptr, Pitched (hostRowPitch), 
+                          Extent (w * pixel, h), blocking, events, event);
+        }
+
+        /*! \brief Reads the whole surface. */
+        void read (cl::CommandQueue &queue, void *ptr, size_t hostRowPitch = 0, cl_bool blocking = CL_TRUE, 
+                   const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            read (queue, 0, 0, cols, rows, ptr, hostRowPitch, blocking, events, event);
+        }
+
+        /*! \brief Sets the surface as a kernel argument. A buffer 
+         *         is followed by its row pitch in pixels.
+         *
+         *  \param[in] kernel the kernel.
+         *  \param[in] idx the index of the argument.
+         *  \return The index of the next argument.
+         */
+        cl_uint setArg (cl::Kernel &kernel, cl_uint idx) const
+        {
+            if (useImage)
+            {
+                kernel.setArg (idx, img);
+                return idx + 1;
+            }
+
+            kernel.setArg (idx, buf);
+            kernel.setArg (idx + 1, (cl_uint) (pitch / pixel));
+            return idx + 2;
+        }
+
+    private:
+        size_t cols, rows;  /*!< The size of the surface in pixels. */
+        size_t pixel;  /*!< The size of a pixel in bytes. */
+        size_t pitch;  /*!< The row pitch of the buffer in bytes. */
+        bool useImage;  /*!< Tells whether the surface is backed by an image. */
+        cl::Image2D img;  /*!< The image, when the format is supported. */
+        cl::Buffer buf;  /*!< The pitched buffer, otherwise. */
+    };
+
+}
+
+#endif  // CLUTILS_RECT_HPP
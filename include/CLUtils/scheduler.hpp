@@ -0,0 +1,528 @@
+/*! \file scheduler.hpp
+ *  \brief Declarations of a scheduler that runs jobs of different priority
+ *         classes on dedicated queues of the devices in a context.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+
+#ifndef CLUTILS_SCHEDULER_HPP
+#define CLUTILS_SCHEDULER_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <array>
+#include <memory>
+#include <functional>
+#include <future>
+#include <exception>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+#include <limits>
+#include <iostream>
+#include <iomanip>
+#include <CLUtils.hpp>
+
+// cl_khr_priority_hints and cl_khr_create_command_queue, for headers that predate them
+#ifndef CL_QUEUE_PRIORITY_KHR
+#define CL_QUEUE_PRIORITY_KHR 0x1096
+#define CL_QUEUE_PRIORITY_HIGH_KHR (1 << 0)
+#define CL_QUEUE_PRIORITY_MED_KHR (1 << 1)
+#define CL_QUEUE_PRIORITY_LOW_KHR (1 << 2)
+#endif
+
+
+namespace clutils
+{
+
+    /*! \brief The priority classes of the jobs of a `JobScheduler`. */
+    enum class Priority : uint8_t
+    {
+        INTERACTIVE,  /*!< Small, latency-critical requests. */
+        NORMAL,       /*!< Regular work. */
+        BATCH         /*!< Large, throughput-oriented jobs. */
+    };
+
+
+    /*! \brief A job enqueues its commands on the queue it gets, 
+     *         and returns the event of the last one. */
+    typedef std::function<cl::Event (cl::CommandQueue &queue)> Job;
+
+    /*! \brief A chunked job enqueues the commands for the range 
+     *         `[begin, end)` of its work, and returns the event of the last one. */
+    typedef std::function<cl::Event (cl::CommandQueue &queue, size_t begin, size_t end)> ChunkedJob;
+
+
+    /*! \brief Latency statistics of the jobs of a priority class, in milliseconds. */
+    struct JobStats
+    {
+        size_t count;  /*!< The number of jobs that completed. */
+        double meanWait;  /*!< The mean time from submission until the first command was enqueued. */
+        double p99Wait;  /*!< The 99th percentile of the wait. */
+        double meanLatency;  /*!< The mean time from submission until completion. */
+        double p50Latency;  /*!< The median latency. */
+        double p99Latency;  /*!< The 99th percentile of the latency. */
+        double maxLatency;  /*!< The maximum latency. */
+    };
+
+
+    /*! \brief Runs jobs of different priority classes on the devices of a context.
+     *  \details Every device gets a queue per class. Where the device supports 
+     *           `cl_khr_priority_hints`, the queues are created with the priority 
+     *           of their class, so the device favors the commands of interactive 
+     *           jobs. Otherwise, the classes still have separate queues, so a 
+     *           small job isn't queued in order behind a big one.
+     *           
+     *           A dispatcher thread hands the jobs to the devices, higher classes 
+     *           first, and each job to the device with the fewest jobs in flight. 
+     *           Large jobs can be submitted split in chunks. Only a few chunks of 
+     *           a class are in flight on a device at a time, and the next ones are 
+     *           enqueued as those complete. A job that arrives in the meantime 
+     *           waits, at most, for the chunks in flight, which bounds the tail 
+     *           latency of the interactive jobs under batch load.
+     *           
+     *           Jobs are invoked one at a time on the dispatcher thread, so they 
+     *           can share kernel objects. They should only enqueue commands.
+     */
+    class JobScheduler
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] ctxIdx the index of the context whose devices run the jobs.
+         *  \param[in] chunksInFlight the number of chunks of a class that can be 
+         *                            in flight on a device.
+         */
+        JobScheduler (CLEnv &env, unsigned int ctxIdx = 0, unsigned int chunksInFlight = 2)
+            : context (env.getContext (ctxIdx)), chunksInFlight (std::max (chunksInFlight, 1u)), 
+              hints (false), stop (false), pending (0)
+        {
+            for (auto &device : context.getInfo<CL_CONTEXT_DEVICES> ())
+                devices.push_back (createDevice (device));
+
+            dispatcher = std::thread (&JobScheduler::dispatch, this);
+        }
+
+        /*! \brief Waits for all the jobs, and stops the dispatcher. */
+        ~JobScheduler ()
+        {
+            wait ();
+            {
+                std::lock_guard<std::mutex> lock (mtx);
+                stop = true;
+                cv.notify_all ();
+            }
+            dispatcher.join ();
+        }
+
+        JobScheduler (const JobScheduler&) = delete;
+        JobScheduler& operator= (const JobScheduler&) = delete;
+
+        /*! \brief Submits a job.
+         *
+         *  \param[in] priority the class of the job.
+         *  \param[in] job the job.
+         *  \return A future with the status of the job, `CL_COMPLETE` or a negative error code. 
+         *          If the job throws an exception other than a `cl::Error`, the 
+         *          future rethrows it.
+         */
+        std::shared_future<cl_int> submit (Priority priority, Job job)
+        {
+            return submit (priority, 1, 1, [job] (cl::CommandQueue &queue, size_t, size_t)
+                                           { return job (queue); });
+        }
+
+        /*! \brief Submits a job split in chunks.
+         *
+         *  \param[in] priority the class of the job.
+         *  \param[in] n the size of the work.
+         *  \param[in] chunk the size of a chunk.
+         *  \param[in] job the job, which gets called for every chunk.
+         *  \return A future with the status of the job, `CL_COMPLETE` or a negative error code. 
+         *          If the job throws an exception other than a `cl::Error`, the 
+         *          future rethrows it.
+         */
+        std::shared_future<cl_int> submit (Priority priority, size_t n, size_t chunk, ChunkedJob job)
+        {
+            std::shared_ptr<Entry> entry (new Entry);
+            entry->job = std::move (job);
+            entry->n = n;
+            entry->chunk = std::max (chunk, (size_t) 1);
+            entry->next = 0;
+            entry->remaining = (n + entry->chunk - 1) / entry->chunk;
+            entry->status = CL_COMPLETE;
+            entry->submitted = now ();
+            entry->dispatched = 0.0;
+            std::shared_future<cl_int> result (entry->promise.get_future ());
+
+            if (entry->remaining == 0)
+            {
+                entry->promise.set_value (CL_COMPLETE);
+                return result;
+            }
+
+            std::lock_guard<std::mutex> lock (mtx);
+            classes[index (priority)].queue.push_back (entry);
+            ++pending;
+            cv.notify_all ();
+
+            return result;
+        }
+
+        /*! \brief Blocks until all the submitted jobs have completed. */
+        void wait ()
+        {
+            std::unique_lock<std::mutex> lock (mtx);
+            idle.wait (lock, [this] { return pending == 0; });
+        }
+
+        /*! \brief Tells whether the queues were created with priority hints. */
+        bool usesPriorityHints () const
+        {
+            return hints;
+        }
+
+        /*! \brief Returns the latency statistics of a class. */
+        JobStats stats (Priority priority)
+        {
+            std::lock_guard<std::mutex> lock (mtx);
+            const Class &c (classes[index (priority)]);
+
+            JobStats s = { c.count, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+            if (c.waits.empty ())
+                return s;
+
+            std::vector<double> w (c.waits), l (c.latencies);
+            for (double v : w) s.meanWait += v;
+            for (double v : l) s.meanLatency += v;
+            s.meanWait /= w.size ();
+            s.meanLatency /= l.size ();
+            s.p99Wait = percentile (w, 0.99);
+            s.p50Latency = percentile (l, 0.5);
+            s.p99Latency = percentile (l, 0.99);
+            s.maxLatency = *std::max_element (l.begin (), l.end ());
+
+            return s;
+        }
+
+        /*! \brief Prints the latency statistics of the classes. */
+        void print (const std::string &title = std::string ("Jobs"))
+        {
+            const char *names[] = { "interactive", "normal", "batch" };
+
+            std::ios::fmtflags f (std::cout.flags ());
+            std::cout << std::fixed << std::setprecision (3);
+            std::cout << std::endl << "   " << title << " (ms)" << std::endl;
+            std::cout << std::left << std::setw (14) << " Class" << std::right 
+                      << std::setw (8) << "Jobs" << std::setw (12) << "Wait" << std::setw (12) << "Wait p99" 
+                      << std::setw (12) << "Latency" << std::setw (12) << "p50" 
+                      << std::setw (12) << "p99" << std::setw (12) << "Max" << std::endl;
+            for (unsigned int i = 0; i < nClasses; ++i)
+            {
+                JobStats s (stats ((Priority) i));
+                std::cout << " " << std::left << std::setw (13) << names[i] << std::right 
+                          << std::setw (8) << s.count << std::setw (12) << s.meanWait 
+                          << std::setw (12) << s.p99Wait << std::setw (12) << s.meanLatency 
+                          << std::setw (12) << s.p50Latency << std::setw (12) << s.p99Latency 
+                          << std::setw (12) << s.maxLatency << std::endl;
+            }
+            std::cout.flags (f);
+        }
+
+        /*! \brief Clears the statistics. */
+        void resetStats ()
+        {
+            std::lock_guard<std::mutex> lock (mtx);
+            for (auto &c : classes)
+            {
+                c.count = 0;
+                c.waits.clear ();
+                c.latencies.clear ();
+            }
+        }
+
+    private:
+        static const unsigned int nClasses = 3;
+        /*! \brief The number of latency samples kept per class. */
+        static const size_t nSamples = 1 << 14;
+
+        /*! \brief A submitted job. */
+        struct Entry
+        {
+            ChunkedJob job;
+            size_t n, chunk;
+            size_t next;  /*!< The beginning of the next chunk to dispatch. */
+            size_t remaining;  /*!< The number of chunks that haven't completed. */
+            cl_int status;
+            std::exception_ptr error;  /*!< The first exception from the job, other than a `cl::Error`. */
+            double submitted, dispatched;  /*!< Times in milliseconds. */
+            std::promise<cl_int> promise;
+        };
+
+        /*! \brief The jobs and the statistics of a class. */
+        struct Class
+        {
+            Class () : count (0) {}
+
+            std::deque<std::shared_ptr<Entry>> queue;  /*!< Jobs with chunks to dispatch. */
+            size_t count;
+            std::vector<double> waits, latencies;
+        };
+
+        /*! \brief The queues of a device, one per class. */
+        struct Device
+        {
+            std::array<cl::CommandQueue, nClasses> queues;
+            std::array<unsigned int, nClasses> inFlight;  /*!< Chunks in flight per class. */
+        };
+
+        /*! \brief The completion of a chunk, delivered by an event callback. */
+        struct Completion
+        {
+            JobScheduler *scheduler;
+            std::shared_ptr<Entry> entry;
+            unsigned int device, cls;
+        };
+
+        static unsigned int index (Priority priority)
+        {
+            return static_cast<unsigned int> (priority);
+        }
+
+        /*! \brief Returns the current time in milliseconds. */
+        static double now ()
+        {
+            return std::chrono::duration<double, std::milli> (
+                std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+        }
+
+        static double percentile (std::vector<double> &v, double p)
+        {
+            size_t k = std::min ((size_t) (p * v.size ()), v.size () - 1);
+            std::nth_element (v.begin (), v.begin () + k, v.end ());
+            return v[k];
+        }
+
+        /*! \brief Creates the queues of a device, with priority hints if they are supported. */
+        Device createDevice (const cl::Device &device)
+        {
+            typedef cl_command_queue (CL_API_CALL *CreateQueueFn) 
+                (cl_context, cl_device_id, const cl_ulong*, cl_int*);
+
+            Device d;
+            d.inFlight.fill (0);
+
+            std::string exts = device.getInfo<CL_DEVICE_EXTENSIONS> ();
+            CreateQueueFn create = nullptr;
+            if (exts.find ("cl_khr_priority_hints") != std::string::npos && 
+                exts.find ("cl_khr_create_command_queue") != std::string::npos)
+                create = (CreateQueueFn) clGetExtensionFunctionAddressForPlatform (
+                    device.getInfo<CL_DEVICE_PLATFORM> (), "clCreateCommandQueueWithPropertiesKHR");
+
+            const cl_ulong priorities[nClasses] = 
+                { CL_QUEUE_PRIORITY_HIGH_KHR, CL_QUEUE_PRIORITY_MED_KHR, CL_QUEUE_PRIORITY_LOW_KHR };
+            for (unsigned int c = 0; c < nClasses; ++c)
+            {
+                if (create)
+                {
+                    const cl_ulong props[] = { CL_QUEUE_PRIORITY_KHR, priorities[c], 0 };
+                    cl_int err;
+                    cl_command_queue q = create (context (), device (), props, &err);
+                    if (err == CL_SUCCESS)
+                    {
+                        d.queues[c] = cl::CommandQueue (q);
+                        hints = true;
+                        continue;
+                    }
+                }
+
+                d.queues[c] = cl::CommandQueue (context, device);
+            }
+
+            return d;
+        }
+
+        /*! \brief Picks the next chunk to dispatch, higher classes first.
+         *
+         *  \param[out] cls the class of the chunk.
+         *  \param[out] dev the device to run the chunk on.
+         *  \return The job of the chunk, or `nullptr` if none can be dispatched.
+         */
+        std::shared_ptr<Entry> pick (unsigned int &cls, unsigned int &dev)
+        {
+            for (cls = 0; cls < nClasses; ++cls)
+            {
+                std::deque<std::shared_ptr<Entry>> &q (classes[cls].queue);
+                if (q.empty ())
+                    continue;
+
+                // Jobs that are not split are not held back
+                bool whole = q.front ()->chunk >= q.front ()->n;
+
+                // The device with the fewest jobs in flight
+                unsigned int best = std::numeric_limits<unsigned int>::max ();
+                for (unsigned int d = 0; d < devices.size (); ++d)
+                {
+                    unsigned int load = 0;
+                    for (auto n : devices[d].inFlight) load += n;
+                    if ((whole || devices[d].inFlight[cls] < chunksInFlight) && load < best)
+                    {
+                        best = load;
+                        dev = d;
+                    }
+                }
+                if (best == std::numeric_limits<unsigned int>::max ())
+                    continue;
+
+                std::shared_ptr<Entry> entry (q.front ());
+                if (entry->next + entry->chunk >= entry->n)
+                    q.pop_front ();
+
+                return entry;
+            }
+
+            return nullptr;
+        }
+
+        /*! \brief The loop of the dispatcher thread. */
+        void dispatch ()
+        {
+            std::unique_lock<std::mutex> lock (mtx);
+            for (;;)
+            {
+                unsigned int cls = 0, dev = 0;
+                std::shared_ptr<Entry> entry;
+                cv.wait (lock, [&] { return stop || (entry = pick (cls, dev)) != nullptr; });
+                if (!entry)
+                    return;
+
+                size_t begin = entry->next;
+                size_t end = std::min (begin + entry->chunk, entry->n);
+                entry->next = end;
+                if (begin == 0)
+                    entry->dispatched = now ();
+                ++devices[dev].inFlight[cls];
+
+                // The job only enqueues, but it shouldn't run under the lock.
+                // Nothing it throws may escape the thread, or the chunk would 
+                // never be accounted for, and `wait` would block forever.
+                lock.unlock ();
+                cl_int status = CL_SUCCESS;
+                std::exception_ptr error;
+                try
+                {
+                    std::unique_ptr<Completion> c (new Completion { this, entry, dev, cls });
+                    cl::Event event = entry->job (devices[dev].queues[cls], begin, end);
+                    devices[dev].queues[cls].flush ();
+                    event.setCallback (CL_COMPLETE, &completed, c.get ());
+                    c.release ();  // The callback owns it now
+                }
+                catch (const cl::Error &e)
+                {
+                    status = e.err ();
+                }
+                catch (...)
+                {
+                    status = CL_INVALID_OPERATION;
+                    error = std::current_exception ();
+                }
+                lock.lock ();
+
+                if (status != CL_SUCCESS)
+                {
+                    if (error && !entry->error)
+                        entry->error = error;
+                    finish (*entry, dev, cls, status);
+                }
+            }
+        }
+
+        /*! \brief Accounts for the completion of a chunk. It's called by the runtime. */
+        static void CL_CALLBACK completed (cl_event, cl_int status, void *data)
+        {
+            std::unique_ptr<Completion> c (static_cast<Completion*> (data));
+            JobScheduler *self = c->scheduler;
+
+            std::lock_guard<std::mutex> lock (self->mtx);
+            self->finish (*c->entry, c->device, c->cls, status);
+        }
+
+        /*! \brief Accounts for a chunk that completed, or failed to be enqueued. 
+         *         It's called under the lock.
+         */
+        void finish (Entry &entry, unsigned int dev, unsigned int clsIdx, cl_int status)
+        {
+            --devices[dev].inFlight[clsIdx];
+            if (status < 0 && entry.status == CL_COMPLETE)
+                entry.status = status;
+
+            if (--entry.remaining == 0)
+            {
+                Class &cls (classes[clsIdx]);
+                double t = now ();
+                if (cls.latencies.size () == nSamples)
+                {
+                    cls.waits[cls.count % nSamples] = entry.dispatched - entry.submitted;
+                    cls.latencies[cls.count % nSamples] = t - entry.submitted;
+                }
+                else
+                {
+                    cls.waits.push_back (entry.dispatched - entry.submitted);
+                    cls.latencies.push_back (t - entry.submitted);
+                }
+                ++cls.count;
+
+                if (entry.error)
+                    entry.promise.set_exception (entry.error);
+                else
+                    entry.promise.set_value (entry.status);
+                if (--pending == 0)
+                    idle.notify_all ();
+            }
+
+            cv.notify_all ();
+        }
+
+        cl::Context context;
+        std::vector<Device> devices;
+        std::array<Class, nClasses> classes;
+        unsigned int chunksInFlight;
+        bool hints;
+
+        std::mutex mtx;
+        std::condition_variable cv;  /*!< Wakes the dispatcher. */
+        std::condition_variable idle;  /*!< Signals that all the jobs completed. */
+        bool stop;
+        size_t pending;  /*!< The number of jobs that haven't completed. */
+        std::thread dispatcher;
+    };
+
+}
+
+#endif  // CLUTILS_SCHEDULER_HPP
@@ -0,0 +1,224 @@
+/*! \file sort.hpp
+ *  \brief Declarations of classes for sorting buffers on the device.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef CLUTILS_SORT_HPP
+#define CLUTILS_SORT_HPP
+
+#include <string>
+#include <type_traits>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief Maps a key type to its unsigned counterpart. */
+    template <typename K>
+    struct RadixKey;
+
+    template <> struct RadixKey<cl_uint>  { static const char* unsignedName () { return "uint"; } };
+    template <> struct RadixKey<cl_int>   { static const char* unsignedName () { return "uint"; } };
+    template <> struct RadixKey<cl_ulong> { static const char* unsignedName () { return "ulong"; } };
+    template <> struct RadixKey<cl_long>  { static const char* unsignedName () { return "ulong"; } };
+
+
+    /*! \brief Performs a stable LSD radix sort on a buffer of keys, 
+     *         and optionally on an associated buffer of values.
+     *  \details Every pass sorts on a 4-bit digit, and consists of a histogram, 
+     *           an exclusive scan over the digit counts (`Scan`), and a scatter. 
+     *           Each work-item handles a contiguous chunk of the input, which 
+     *           keeps the sort stable and the memory accesses sequential 
+     *           on CPU devices. The number of passes is even, so the sorted 
+     *           data end up in the buffers provided by the caller.
+     *           The temporary buffers are kept between calls, and only 
+     *           get reallocated when a larger input shows up.
+     *
+     *  \tparam K the key type (`cl_int`, `cl_uint`, `cl_long`, `cl_ulong`).
+     *  \tparam V the value type, or `void` for sorting keys only.
+     */
+    template <typename K, typename V = void>
+    class RadixSort
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment
+         *                  the kernels will be built and run in.
+         *  \param[in] wgSize the work-group size.
+         *  \param[in] kernel_filename the file with the radix sort kernels.
+         */
+        RadixSort (CLEnv &env, CLEnvInfo<1> info = CLEnvInfo<1> (), unsigned int wgSize = 256,
+                   const std::string &kernel_filename = "kernels/radixSort.cl")
+            : memory (env.getMemoryManager (info.ctxIdx)), 
+              queue (env.getQueue (info.ctxIdx, info.qIdx[0])), 
+              scan (env, info, wgSize), capacity (0)
+        {
+            std::string options = std::string ("-D K=") + CLType<K>::name () + 
+                                  " -D UK=" + RadixKey<K>::unsignedName () + 
+                                  " -D KEY_BITS=" + std::to_string (8 * sizeof (K));
+            if (std::is_signed<K>::value)
+                options += " -D SIGNED_KEYS";
+            if (hasValues)
+                options += std::string (" -D HAS_VALUES -D V=") + valueName ();
+
+            unsigned int pgIdx = env.getProgramIdx (info.ctxIdx, { kernel_filename }, options.c_str ());
+            kernelHist = env.getKernel ("histogram", pgIdx);
+            kernelScatter = env.getKernel ("scatter", pgIdx);
+
+            cl::Device device = queue.getInfo<CL_QUEUE_DEVICE> ();
+            nItems = 4 * device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS> () * wgSize;
+            local = wgSize;
+
+            dCounts = memory.createBuffer (CL_MEM_READ_WRITE, radix * nItems * sizeof (cl_uint));
+        }
+
+        /*! \brief Sorts the first `n` keys of a buffer.
+         *
+         *  \param[in,out] keys the buffer of keys, or a view of it.
+         *  \param[in] n the number of keys.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the last kernel execution.
+         */
+        void run (const BufferView &keys, unsigned int n, 
+                  const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            static_assert (!hasValues, "RadixSort with values expects a buffer of values");
+            sort (keys, nullptr, n, events, event);
+        }
+
+        /*! \brief Sorts the first `n` keys of a buffer, 
+         *         and reorders the associated values accordingly.
+         *
+         *  \param[in,out] keys the buffer of keys, or a view of it.
+         *  \param[in,out] values the buffer of values, or a view of it.
+         *  \param[in] n the number of key-value pairs.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the last kernel execution.
+         */
+        void run (const BufferView &keys, const BufferView &values, unsigned int n, 
+                  const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            static_assert (hasValues, "RadixSort without values expects only a buffer of keys");
+            sort (keys, &values, n, events, event);
+        }
+
+    private:
+        static const bool hasValues = !std::is_void<V>::value;
+        static const unsigned int radix = 16;  /*!< Number of buckets (4-bit digits). */
+
+        /*! \brief Returns the OpenCL C name of the value type. */
+        static const char* valueName ()
+        {
+            return CLType<typename std::conditional<hasValues, V, cl_int>::type>::name ();
+        }
+
+        /*! \brief Makes sure the temporary buffers can hold `n` elements. */
+        void reserve (unsigned int n)
+        {
+            if (n <= capacity)
+                return;
+
+            dKeysTmp = memory.createBuffer (CL_MEM_READ_WRITE, n * sizeof (K));
+            if (hasValues)
+                dValuesTmp = memory.createBuffer (CL_MEM_READ_WRITE, n * valueSize ());
+
+            capacity = n;
+        }
+
+        /*! \brief Returns the size of a value. */
+        static size_t valueSize ()
+        {
+            return sizeof (typename std::conditional<hasValues, V, char>::type);
+        }
+
+        /*! \brief Runs the passes of the sort. */
+        void sort (const BufferView &keys, const BufferView *values, unsigned int n, 
+                   const std::vector<cl::Event> *events, cl::Event *event)
+        {
+            reserve (n);
+
+            cl_uint chunk = (n + nItems - 1) / nItems;
+            unsigned int nPasses = 8 * sizeof (K) / 4;
+
+            BufferView kIn = keys, kOut = dKeysTmp;
+            BufferView vIn = values ? *values : dValuesTmp, vOut = dValuesTmp;
+
+            for (unsigned int p = 0; p < nPasses; ++p)
+            {
+                cl_uint shift = 4 * p;
+
+                kernelHist.setArg (0, kIn.buffer ());
+                kernelHist.setArg (1, kIn.offset<K> ());
+                kernelHist.setArg (2, dCounts);
+                kernelHist.setArg (3, n);
+                kernelHist.setArg (4, chunk);
+                kernelHist.setArg (5, shift);
+                queue.enqueueNDRangeKernel (kernelHist, cl::NullRange, cl::NDRange (nItems), 
+                                            cl::NDRange (local), p == 0 ? events : nullptr);
+
+                scan.run (dCounts, radix * nItems, dCounts, ScanType::EXCLUSIVE);
+
+                unsigned int arg = 0;
+                kernelScatter.setArg (arg++, kIn.buffer ());
+                kernelScatter.setArg (arg++, kIn.offset<K> ());
+                kernelScatter.setArg (arg++, kOut.buffer ());
+                kernelScatter.setArg (arg++, kOut.offset<K> ());
+                if (hasValues)
+                {
+                    kernelScatter.setArg (arg++, vIn.buffer ());
+                    kernelScatter.setArg (arg++, (cl_uint) (vIn.offset () / valueSize ()));
+                    kernelScatter.setArg (arg++, vOut.buffer ());
+                    kernelScatter.setArg (arg++, (cl_uint) (vOut.offset () / valueSize ()));
+                }
+                kernelScatter.setArg (arg++, dCounts);
+                kernelScatter.setArg (arg++, n);
+                kernelScatter.setArg (arg++, chunk);
+                kernelScatter.setArg (arg++, shift);
+                queue.enqueueNDRangeKernel (kernelScatter, cl::NullRange, cl::NDRange (nItems), 
+                                            cl::NDRange (local), nullptr, 
+                                            p == nPasses - 1 ? event : nullptr);
+
+                std::swap (kIn, kOut);
+                std::swap (vIn, vOut);
+            }
+        }
+
+        MemoryManager &memory;  /*!< The manager the buffers are allocated from. */
+        cl::CommandQueue &queue;  /*!< The queue the kernels get enqueued on. */
+        cl::Kernel kernelHist, kernelScatter;  /*!< The radix sort kernels. */
+        Scan<cl_uint> scan;  /*!< Scan over the digit counts. */
+        unsigned int nItems;  /*!< The number of work-items in a pass. */
+        unsigned int local;  /*!< The work-group size. */
+        unsigned int capacity;  /*!< The number of elements the buffers are allocated for. */
+        cl::Buffer dCounts;  /*!< The digit counts of every work-item. */
+        cl::Buffer dKeysTmp, dValuesTmp;  /*!< Ping-pong buffers. */
+    };
+
+}
+
+#endif  // CLUTILS_SORT_HPP
@@ -0,0 +1,305 @@
+/*! \file stencil.hpp
+ *  \brief Declarations of classes for 2D convolutions on the device.
+ *  \details The convolution kernels are specialized on the element type, 
+ *           the filter radius, the border handling, and the tile size, 
+ *           through build options, and are built through `CLEnv::getProgramIdx`, 
+ *           so that objects with the same configuration share a single build.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef CLUTILS_STENCIL_HPP
+#define CLUTILS_STENCIL_HPP
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief The ways the elements outside of an image are read. */
+    enum class Border : uint8_t
+    {
+        CLAMP,  /*!< The nearest element on the border of the image. */
+        ZERO    /*!< Zero. */
+    };
+
+
+    /*! \brief Returns the weights of a 1D Gaussian filter, normalized to a sum of 1.
+     *  \details The weights can be given as both the row and column filter 
+     *           of a separable convolution, to perform a Gaussian blur.
+     *
+     *  \param[in] radius the radius of the filter, which has `2 * radius + 1` weights.
+     *  \param[in] sigma the standard deviation of the Gaussian.
+     *  \return The weights.
+     */
+    template <typename T = cl_float>
+    std::vector<T> gaussianFilter (unsigned int radius, double sigma)
+    {
+        std::vector<T> weights (2 * radius + 1);
+        
+        double sum = 0.0;
+        for (int i = -(int) radius; i <= (int) radius; ++i)
+            sum += std::exp (-0.5 * i * i / (sigma * sigma));
+        for (int i = -(int) radius; i <= (int) radius; ++i)
+            weights[i + radius] = (T) (std::exp (-0.5 * i * i / (sigma * sigma)) / sum);
+
+        return weights;
+    }
+
+
+    /*! \brief Convolves images with a filter of a fixed radius.
+     *  \details Every work-group loads a tile of the image, along with a halo 
+     *           of `radius` elements around it, in local memory, and computes 
+     *           the outputs of the tile from there. The tile size is picked 
+     *           at construction, as the largest one whose work-group the device 
+     *           supports and whose buffer fits in half of `CL_DEVICE_LOCAL_MEM_SIZE`, 
+     *           which leaves room for a second work-group per compute unit. 
+     *           When no tile fits, the convolution falls back to a kernel that 
+     *           reads the image straight from global memory.
+     *           
+     *           When the filter is separable, i.e. given as a row and a column 
+     *           filter, the convolution is performed in two passes, with 
+     *           `2 * (2r + 1)` instead of `(2r + 1)^2` operations per element. 
+     *           The intermediate image is kept between calls, and only gets 
+     *           reallocated when a larger image shows up.
+     *  \note The images are in row-major order, without any padding. 
+     *        The filter is applied as a correlation (it isn't flipped).
+     *
+     *  \tparam T the element type.
+     */
+    template <typename T = cl_float>
+    class Convolution
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment 
+         *                  the kernels will be built and run in.
+         *  \param[in] radius the radius of the filter.
+         *  \param[in] border how the elements outside of the images are read.
+         *  \param[in] kernel_filename the file with the convolution kernels.
+         */
+        Convolution (CLEnv &env, CLEnvInfo<1> info = CLEnvInfo<1> (), unsigned int radius = 1, 
+                     Border border = Border::CLAMP, const std::string &kernel_filename = "kernels/stencil.cl")
+            : memory (env.getMemoryManager (info.ctxIdx)), 
+              queue (env.getQueue (info.ctxIdx, info.qIdx[0])), 
+              radius (radius), diameter (2 * radius + 1), tiled (false), separable (false), capacity (0)
+        {
+            cl::Device device = queue.getInfo<CL_QUEUE_DEVICE> ();
+            size_t maxWGSize = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE> ();
+            std::vector<size_t> maxWISizes = device.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES> ();
+            cl_ulong localMem = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE> ();
+
+            // Pick the largest tile that fits, wide tiles first for coalesced rows
+            const unsigned int tiles[][2] = { { 32, 8 }, { 16, 16 }, { 16, 8 }, { 8, 8 }, { 8, 4 } };
+            tileX = 8; tileY = 4;
+            for (auto &tile : tiles)
+            {
+                size_t bytes = (tile[0] + 2 * radius) * (tile[1] + 2 * radius) * sizeof (T);
+                if (tile[0] * tile[1] <= maxWGSize && tile[0] <= maxWISizes[0] && 
+                    tile[1] <= maxWISizes[1] && bytes <= localMem / 2)
+                {
+                    tileX = tile[0]; tileY = tile[1];
+                    tiled = true;
+                    break;
+                }
+            }
+
+            // The tiled kernels are left out of the build when their tiles don't fit
+            std::string options = std::string ("-D T=") + CLType<T>::name () + 
+                                  " -D RADIUS=" + std::to_string (radius) + 
+                                  (border == Border::ZERO ? " -D BORDER_ZERO" : " -D BORDER_CLAMP");
+            if (tiled)
+                options += " -D TILED -D TILE_X=" + std::to_string (tileX) + 
+                           " -D TILE_Y=" + std::to_string (tileY);
+            unsigned int pgIdx = env.getProgramIdx (info.ctxIdx, { kernel_filename }, options.c_str ());
+            kernelNaive = env.getKernel ("convolveNaive", pgIdx);
+            if (tiled)
+            {
+                kernel2D = env.getKernel ("convolve2D", pgIdx);
+                kernelRows = env.getKernel ("convolveRows", pgIdx);
+                kernelCols = env.getKernel ("convolveCols", pgIdx);
+
+                // The compiler might still limit the work-group size below the tile's
+                for (cl::Kernel *k : { &kernel2D, &kernelRows, &kernelCols })
+                    if (k->getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE> (device) < tileX * tileY)
+                        tiled = false;
+            }
+
+            dFilter = memory.createBuffer (CL_MEM_READ_ONLY, (diameter * diameter + 2 * diameter) * sizeof (T));
+        }
+
+        /*! \brief Sets a 2D filter.
+         *  \note It blocks until the weights are written.
+         *
+         *  \param[in] weights the `(2r + 1) x (2r + 1)` weights, in row-major order.
+         */
+        void setFilter (const std::vector<T> &weights)
+        {
+            if (weights.size () != diameter * diameter)
+                throw std::invalid_argument ("Convolution::setFilter: the filter should have (2r + 1)^2 weights");
+
+            queue.enqueueWriteBuffer (dFilter, CL_TRUE, 0, weights.size () * sizeof (T), weights.data ());
+            separable = false;
+        }
+
+        /*! \brief Sets a separable filter, the outer product 
+         *         of a column and a row filter.
+         *  \note It blocks until the weights are written.
+         *
+         *  \param[in] rowWeights the `2r + 1` weights applied along the rows.
+         *  \param[in] colWeights the `2r + 1` weights applied along the columns.
+         */
+        void setFilter (const std::vector<T> &rowWeights, const std::vector<T> &colWeights)
+        {
+            if (rowWeights.size () != diameter || colWeights.size () != diameter)
+                throw std::invalid_argument ("Convolution::setFilter: the filters should have 2r + 1 weights");
+
+            // The 2D filter is kept as well, for the naive kernel
+            std::vector<T> weights (diameter * diameter + 2 * diameter);
+            for (unsigned int j = 0; j < diameter; ++j)
+                for (unsigned int i = 0; i < diameter; ++i)
+                    weights[j * diameter + i] = colWeights[j] * rowWeights[i];
+            std::copy (rowWeights.begin (), rowWeights.end (), weights.begin () + diameter * diameter);
+            std::copy (colWeights.begin (), colWeights.end (), weights.begin () + diameter * (diameter + 1));
+
+            queue.enqueueWriteBuffer (dFilter, CL_TRUE, 0, weights.size () * sizeof (T), weights.data ());
+            separable = true;
+        }
+
+        /*! \brief Convolves an image with the filter.
+         *  \details It picks the separable, the tiled, or the naive 
+         *           kernels, in that order of preference.
+         *  \note `in` and `out` should not overlap.
+         *
+         *  \param[in] in the input image, or a view of it.
+         *  \param[out] out the output image, or a view of it.
+         *  \param[in] width the width of the images.
+         *  \param[in] height the height of the images.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the last kernel execution.
+         */
+        void run (const BufferView &in, const BufferView &out, unsigned int width, unsigned int height, 
+                  const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            if (!tiled)
+                runNaive (in, out, width, height, events, event);
+            else if (separable)
+            {
+                reserve (width * height);
+                enqueue (kernelRows, in, dTemp, diameter * diameter, width, height, events, nullptr);
+                enqueue (kernelCols, dTemp, out, diameter * (diameter + 1), width, height, nullptr, event);
+            }
+            else
+                enqueue (kernel2D, in, out, 0, width, height, events, event);
+        }
+
+        /*! \brief Convolves an image with the filter, reading the 
+         *         image straight from global memory.
+         *  \details It's the baseline of the tiled kernels.
+         *  \note `in` and `out` should not overlap.
+         *
+         *  \param[in] in the input image, or a view of it.
+         *  \param[out] out the output image, or a view of it.
+         *  \param[in] width the width of the images.
+         *  \param[in] height the height of the images.
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the kernel execution.
+         */
+        void runNaive (const BufferView &in, const BufferView &out, unsigned int width, unsigned int height, 
+                       const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            enqueue (kernelNaive, in, out, 0, width, height, events, event);
+        }
+
+        /*! \brief Returns whether the tiled kernels are used. */
+        bool isTiled () const { return tiled; }
+
+        /*! \brief Returns the tile width (the work-group's x size). */
+        unsigned int getTileX () const { return tileX; }
+
+        /*! \brief Returns the tile height (the work-group's y size). */
+        unsigned int getTileY () const { return tileY; }
+
+    private:
+        /*! \brief Sets up the arguments of a convolution kernel, and enqueues it. */
+        void enqueue (cl::Kernel &kernel, const BufferView &in, const BufferView &out, cl_uint filterOffset, 
+                      unsigned int width, unsigned int height, 
+                      const std::vector<cl::Event> *events, cl::Event *event)
+        {
+            kernel.setArg (0, in.buffer ());
+            kernel.setArg (1, in.offset<T> ());
+            kernel.setArg (2, out.buffer ());
+            kernel.setArg (3, out.offset<T> ());
+            kernel.setArg (4, dFilter);
+            kernel.setArg (5, filterOffset);
+            kernel.setArg (6, (cl_int) width);
+            kernel.setArg (7, (cl_int) height);
+
+            // Without tiles, only the naive kernel runs, and the runtime picks its work-groups
+            if (!tiled)
+            {
+                queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (width, height), 
+                                            cl::NullRange, events, event);
+                return;
+            }
+
+            cl::NDRange global ((width + tileX - 1) / tileX * tileX, (height + tileY - 1) / tileY * tileY);
+            queue.enqueueNDRangeKernel (kernel, cl::NullRange, global, cl::NDRange (tileX, tileY), events, event);
+        }
+
+        /*! \brief Makes sure there is an intermediate image of `n` elements. */
+        void reserve (unsigned int n)
+        {
+            if (n <= capacity)
+                return;
+
+            // The old image is let go first, so that both don't count against the budget
+            dTemp = cl::Buffer ();
+            dTemp = memory.createBuffer (CL_MEM_READ_WRITE, n * sizeof (T));
+            capacity = n;
+        }
+
+        MemoryManager &memory;  /*!< The manager the buffers are allocated from. */
+        cl::CommandQueue &queue;  /*!< The queue the kernels get enqueued on. */
+        cl::Kernel kernel2D, kernelRows, kernelCols, kernelNaive;  /*!< The convolution kernels. */
+        unsigned int radius;  /*!< The radius of the filter. */
+        unsigned int diameter;  /*!< The number of weights per dimension. */
+        unsigned int tileX, tileY;  /*!< The tile size (the work-group size). */
+        bool tiled;  /*!< Whether the tile fits on the device. */
+        bool separable;  /*!< Whether the filter is separable. */
+        unsigned int capacity;  /*!< The number of elements of the intermediate image. */
+        cl::Buffer dFilter;  /*!< The 2D filter, followed by the row and column filters. */
+        cl::Buffer dTemp;  /*!< The intermediate image of the separable convolution. */
+    };
+
+}
+
+#endif  // CLUTILS_STENCIL_HPP
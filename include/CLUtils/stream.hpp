@@ -0,0 +1,301 @@
+/*! \file stream.hpp
+ *  \brief Declaration of a class that streams datasets larger 
+ *         than the device memory through a kernel.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+#ifndef CLUTILS_STREAM_HPP
+#define CLUTILS_STREAM_HPP
+
+#include <cstring>
+#include <climits>
+#include <ostream>
+#include <functional>
+#include <CLUtils.hpp>
+#include <CLUtils/pool.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief An input of a stream. It can point to host memory, 
+     *         or to the `data ()` of a `MappedFile`. */
+    struct StreamInput
+    {
+        const void *data;  /*!< The elements. */
+        size_t elementSize;  /*!< The size of an element in bytes. */
+    };
+
+    /*! \brief Receives the results of a stream, in order.
+     *  \details The arguments are the data of a chunk, the offset 
+     *           of the chunk in the output in bytes, and its size in bytes. 
+     *           The data are only valid during the call.
+     */
+    typedef std::function<void (const void *data, size_t offset, size_t bytes)> StreamSink;
+
+    /*! \brief Creates a sink that copies the results to host memory. */
+    inline StreamSink memorySink (void *ptr)
+    {
+        return [ptr] (const void *data, size_t offset, size_t bytes)
+               { ThreadPool::instance ().copy ((char *) ptr + offset, data, bytes); };
+    }
+
+    /*! \brief Creates a sink that writes the results to an output stream. */
+    inline StreamSink ostreamSink (std::ostream &os)
+    {
+        return [&os] (const void *data, size_t, size_t bytes)
+               { os.write ((const char *) data, bytes); };
+    }
+
+
+    /*! \brief Runs a kernel over datasets of arbitrary size.
+     *  \details The inputs are tiled in chunks that fit the device memory. 
+     *           The chunks rotate through a number of slots. Every slot has 
+     *           its own queue, device buffers, and pinned staging buffers, so 
+     *           the upload of a chunk, the kernel on another, and the 
+     *           download of a third can overlap. The host packs the inputs 
+     *           into the pinned buffers and hands the results to the sink 
+     *           while the device works on the other slots.
+     *           
+     *           The kernel maps element `i` of the inputs to element `i` 
+     *           of the output, and takes the arguments 
+     *           `(in_0, ..., in_k-1, out, n)`, where `n` is the number 
+     *           of elements in the chunk. Any other arguments, from 
+     *           index `k + 2` on, should be set before `run`.
+     *           
+     *           \code
+     *           MappedFile fA ("a.bin"), fB ("b.bin");
+     *           StreamProcessor stream (clEnv);
+     *           stream.run (clEnv.getKernel ("vecAddN"), { { fA.data (), 4 }, { fB.data (), 4 } }, 
+     *                       fA.size () / 4, 4, ostreamSink (outFile));
+     *           \endcode
+     */
+    class StreamProcessor
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment. 
+         *                  The slot queues are created for the device of its queue.
+         *  \param[in] depth the number of slots (chunks in flight).
+         *  \param[in] maxChunkBytes an upper bound on the memory of a slot in bytes 
+         *                           (inputs and output). It is bounded further by 
+         *                           `CL_DEVICE_MAX_MEM_ALLOC_SIZE`, and by a quarter 
+         *                           of `CL_DEVICE_GLOBAL_MEM_SIZE`, or of the memory 
+         *                           budget of the context, for all slots.
+         */
+        StreamProcessor (CLEnv &env, CLEnvInfo<1> info = CLEnvInfo<1> (), 
+                         unsigned int depth = 3, size_t maxChunkBytes = 1 << 26)
+            : context (env.getContext (info.ctxIdx)), memory (env.getMemoryManager (info.ctxIdx)), 
+              device (env.getQueue (info.ctxIdx, info.qIdx[0]).getInfo<CL_QUEUE_DEVICE> ()), 
+              slots (std::max (depth, 1u)), maxChunkBytes (maxChunkBytes)
+        {
+            for (auto &slot : slots)
+                slot.queue = cl::CommandQueue (context, device);
+        }
+
+        ~StreamProcessor ()
+        {
+            try
+            {
+                release ();
+            }
+            catch (const cl::Error &error)
+            {
+                std::cerr << "Error[StreamProcessor]: " << error.what () << std::endl;
+            }
+        }
+
+        StreamProcessor (const StreamProcessor&) = delete;
+        StreamProcessor& operator= (const StreamProcessor&) = delete;
+
+        /*! \brief Returns the number of elements in a chunk for a set of inputs.
+         *
+         *  \param[in] inputs the inputs.
+         *  \param[in] outElementSize the size of an output element in bytes.
+         *  \param[in] wgSize the work-group size. The chunks are a multiple of it.
+         */
+        size_t chunkElements (const std::vector<StreamInput> &inputs, size_t outElementSize, 
+                              unsigned int wgSize = 256) const
+        {
+            size_t perElement = outElementSize, largest = outElementSize;
+            for (auto &in : inputs)
+            {
+                perElement += in.elementSize;
+                largest = std::max (largest, in.elementSize);
+            }
+
+            cl_ulong maxAlloc = device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE> ();
+            cl_ulong globalMem = std::min<cl_ulong> (device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE> (), memory.budget ());
+            cl_ulong elements = std::min (maxAlloc / largest, globalMem / 4 / (slots.size () * perElement));
+            elements = std::min<cl_ulong> (elements, maxChunkBytes / perElement);
+            elements = std::min<cl_ulong> (elements, UINT_MAX);
+
+            return std::max<size_t> (elements / wgSize * wgSize, wgSize);
+        }
+
+        /*! \brief Streams `n` elements of the inputs through a kernel.
+         *  \note It blocks until the sink has received all of the results.
+         *
+         *  \param[in] kernel the kernel.
+         *  \param[in] inputs the inputs.
+         *  \param[in] n the number of elements.
+         *  \param[in] outElementSize the size of an output element in bytes.
+         *  \param[in] sink the sink that receives the results.
+         *  \param[in] wgSize the work-group size.
+         */
+        void run (cl::Kernel &kernel, const std::vector<StreamInput> &inputs, size_t n, 
+                  size_t outElementSize, const StreamSink &sink, unsigned int wgSize = 256)
+        {
+            if (n == 0)
+                return;
+
+            size_t chunk = std::min (chunkElements (inputs, outElementSize, wgSize), 
+                                     (n + wgSize - 1) / wgSize * wgSize);
+            reserve (inputs, outElementSize, chunk);
+
+            size_t nChunks = (n + chunk - 1) / chunk;
+            for (size_t c = 0; c < nChunks; ++c)
+            {
+                Slot &slot = slots[c % slots.size ()];
+                if (slot.pending)
+                    drain (slot, sink);
+
+                size_t first = c * chunk;
+                size_t count = std::min (chunk, n - first);
+
+                cl_uint arg = 0;
+                for (unsigned int k = 0; k < inputs.size (); ++k)
+                {
+                    size_t bytes = count * inputs[k].elementSize;
+                    // Pack the chunk on all cores, while the previous chunks are in flight
+                    ThreadPool::instance ().copy (slot.pIn[k], (const char *) inputs[k].data + first * inputs[k].elementSize, bytes);
+                    slot.queue.enqueueWriteBuffer (slot.dIn[k], CL_FALSE, 0, bytes, slot.pIn[k]);
+                    kernel.setArg (arg++, slot.dIn[k]);
+                }
+                kernel.setArg (arg++, slot.dOut);
+                kernel.setArg (arg++, (cl_uint) count);
+                slot.queue.enqueueNDRangeKernel (kernel, cl::NullRange, 
+                                                 cl::NDRange ((count + wgSize - 1) / wgSize * wgSize), 
+                                                 cl::NDRange (wgSize));
+
+                slot.offset = first * outElementSize;
+                slot.bytes = count * outElementSize;
+                slot.queue.enqueueReadBuffer (slot.dOut, CL_FALSE, 0, slot.bytes, slot.pOut, nullptr, &slot.done);
+                slot.queue.flush ();
+                slot.pending = true;
+            }
+
+            // Hand over the last chunks in order
+            for (size_t c = nChunks; c < nChunks + slots.size (); ++c)
+            {
+                Slot &slot = slots[c % slots.size ()];
+                if (slot.pending)
+                    drain (slot, sink);
+            }
+        }
+
+    private:
+        /*! \brief The resources of a chunk in flight. */
+        struct Slot
+        {
+            Slot () : pOut (nullptr), pending (false) {}
+            cl::CommandQueue queue;  /*!< The queue of the slot. */
+            std::vector<cl::Buffer> dIn, hIn;  /*!< The device and pinned buffers of the inputs. */
+            std::vector<void *> pIn;  /*!< The host pointers of the pinned inputs. */
+            cl::Buffer dOut, hOut;  /*!< The device and pinned buffers of the output. */
+            void *pOut;  /*!< The host pointer of the pinned output. */
+            cl::Event done;  /*!< The download of the chunk. */
+            size_t offset, bytes;  /*!< The place of the chunk in the output, in bytes. */
+            bool pending;  /*!< Tells whether the chunk still has to go to the sink. */
+        };
+
+        /*! \brief Waits for the chunk of a slot, and hands it to the sink. */
+        void drain (Slot &slot, const StreamSink &sink)
+        {
+            slot.done.wait ();
+            slot.pending = false;
+            sink (slot.pOut, slot.offset, slot.bytes);
+        }
+
+        /*! \brief Makes sure the buffers of the slots fit chunks of `chunk` elements. */
+        void reserve (const std::vector<StreamInput> &inputs, size_t outElementSize, size_t chunk)
+        {
+            std::vector<size_t> sizes;
+            for (auto &in : inputs)
+                sizes.push_back (chunk * in.elementSize);
+            sizes.push_back (chunk * outElementSize);
+
+            if (sizes == capacity)
+                return;
+
+            release ();
+            for (auto &slot : slots)
+            {
+                for (unsigned int k = 0; k < inputs.size (); ++k)
+                {
+                    slot.dIn.push_back (memory.createBuffer (CL_MEM_READ_ONLY, sizes[k]));
+                    slot.hIn.emplace_back (context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, sizes[k]);
+                    slot.pIn.push_back (slot.queue.enqueueMapBuffer (slot.hIn[k], CL_TRUE, CL_MAP_WRITE, 0, sizes[k]));
+                }
+                slot.dOut = memory.createBuffer (CL_MEM_WRITE_ONLY, sizes.back ());
+                slot.hOut = cl::Buffer (context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, sizes.back ());
+                slot.pOut = slot.queue.enqueueMapBuffer (slot.hOut, CL_TRUE, CL_MAP_READ, 0, sizes.back ());
+            }
+            capacity = sizes;
+        }
+
+        /*! \brief Unmaps and releases the buffers of the slots. */
+        void release ()
+        {
+            for (auto &slot : slots)
+            {
+                for (unsigned int k = 0; k < slot.hIn.size (); ++k)
+                    slot.queue.enqueueUnmapMemObject (slot.hIn[k], slot.pIn[k]);
+                if (slot.pOut)
+                    slot.queue.enqueueUnmapMemObject (slot.hOut, slot.pOut);
+                slot.queue.finish ();
+
+                slot.dIn.clear ();
+                slot.hIn.clear ();
+                slot.pIn.clear ();
+                slot.dOut = slot.hOut = cl::Buffer ();
+                slot.pOut = nullptr;
+            }
+            capacity.clear ();
+        }
+
+        cl::Context context;  /*!< The context the buffers are allocated in. */
+        MemoryManager &memory;  /*!< The manager the device buffers are allocated from. */
+        cl::Device device;  /*!< The device the chunks are processed on. */
+        std::vector<Slot> slots;  /*!< The slots that the chunks rotate through. */
+        size_t maxChunkBytes;  /*!< The upper bound on the memory of a slot. */
+        std::vector<size_t> capacity;  /*!< The sizes of the slot buffers. */
+    };
+
+}
+
+#endif  // CLUTILS_STREAM_HPP
@@ -0,0 +1,407 @@
+/*! \file transfer.hpp
+ *  \brief Declaration of a class that coalesces many small transfers 
+ *         into a handful of commands.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+#ifndef CLUTILS_TRANSFER_HPP
+#define CLUTILS_TRANSFER_HPP
+
+#include <string>
+#include <cstring>
+#include <CLUtils.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief Coalesces many small transfers into a handful of commands.
+     *  \details Every `enqueueWriteBuffer` costs a driver call and a command, 
+     *           which dominates when the transfers are small. `TransferCoalescer` 
+     *           packs the host regions of the queued writes into a pinned 
+     *           staging buffer. On `flush`, the staging buffer goes to the 
+     *           device with a single copy, and is then scattered to the 
+     *           destinations. Reads go the opposite way. The sources are 
+     *           gathered on the device, come back with a single copy, and 
+     *           get unpacked on the host.
+     *           
+     *           The regions of a buffer are handled by one command. That is 
+     *           `enqueueCopyBuffer` for a single region, `enqueueCopyBufferRect` 
+     *           for equally sized regions at a constant stride, and a 
+     *           `copyRegions` kernel otherwise. The table of regions the 
+     *           kernels work with goes along with the staged data.
+     *           
+     *           \code
+     *           TransferCoalescer tc (clEnv);
+     *           for (auto &r : requests)
+     *               tc.write (dPool, r.offset, r.size, r.data);
+     *           tc.read (dResults, 0, sizeof (result), &result);
+     *           tc.flush ();  // 1 write, 1 command per buffer, 1 read
+     *           \endcode
+     *  \note The commands are issued in order, so reads observe the writes of 
+     *        the same flush. The regions of a flush should not overlap.
+     *  \note The coalescer expects an in-order queue.
+     */
+    class TransferCoalescer
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment
+         *                  the transfers will be issued in.
+         *  \param[in] capacity the size of the staging buffers in bytes. 
+         *                      It bounds the data of the writes, and separately 
+         *                      the data of the reads, in a flush. Larger 
+         *                      regions are transferred directly.
+         *  \param[in] maxRegions the maximum number of regions in a flush.
+         *  \param[in] wgSize the work-group size of the scatter/gather kernels.
+         *  \param[in] kernel_filename the file with the scatter/gather kernels.
+         */
+        TransferCoalescer (CLEnv &env, CLEnvInfo<1> info = CLEnvInfo<1> (), 
+                           size_t capacity = 1 << 22, unsigned int maxRegions = 1 << 14, 
+                           unsigned int wgSize = 64, 
+                           const std::string &kernel_filename = "kernels/transfer.cl")
+            : queue (env.getQueue (info.ctxIdx, info.qIdx[0])), 
+              capacity (capacity), maxRegions (maxRegions), wgSize (wgSize), 
+              upUsed (0), downUsed (0), nCommands (0)
+        {
+            unsigned int pgIdx = env.getProgramIdx (info.ctxIdx, { kernel_filename });
+            kernelWords = env.getKernel ("copyRegions", pgIdx);
+            kernelBytes = env.getKernel ("copyRegionsBytes", pgIdx);
+
+            cl::Context &context (env.getContext (info.ctxIdx));
+            size_t upSize = capacity + 16 * (maxRegions + 1);
+
+            // The pinned buffers stay mapped, and only their host pointers 
+            // take part in the transfers, which then run at full bandwidth
+            hUpload = cl::Buffer (context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, upSize);
+            hDownload = cl::Buffer (context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, capacity);
+            pUpload = (char *) queue.enqueueMapBuffer (hUpload, CL_TRUE, CL_MAP_WRITE, 0, upSize);
+            pDownload = (char *) queue.enqueueMapBuffer (hDownload, CL_TRUE, CL_MAP_READ, 0, capacity);
+
+            dStaging = env.getMemoryManager (info.ctxIdx).createBuffer (CL_MEM_READ_ONLY, upSize);
+            dGather = env.getMemoryManager (info.ctxIdx).createBuffer (CL_MEM_WRITE_ONLY, capacity);
+        }
+
+        ~TransferCoalescer ()
+        {
+            try
+            {
+                queue.enqueueUnmapMemObject (hUpload, pUpload);
+                queue.enqueueUnmapMemObject (hDownload, pDownload);
+                queue.finish ();
+            }
+            catch (const cl::Error &error)
+            {
+                std::cerr << "Error[TransferCoalescer]: " << error.what () << std::endl;
+            }
+        }
+
+        TransferCoalescer (const TransferCoalescer&) = delete;
+        TransferCoalescer& operator= (const TransferCoalescer&) = delete;
+
+        /*! \brief Queues a write to a buffer.
+         *  \details The data are copied to the staging buffer right away, 
+         *           so `ptr` can be reused when the function returns. 
+         *           The write is issued on the next `flush`, which 
+         *           happens implicitly when the staging buffer fills up.
+         *
+         *  \param[out] buffer the destination buffer.
+         *  \param[in] offset the offset in `buffer` in bytes.
+         *  \param[in] size the number of bytes to write.
+         *  \param[in] ptr the data to write.
+         */
+        void write (const cl::Buffer &buffer, size_t offset, size_t size, const void *ptr)
+        {
+            if (size > capacity)
+            {
+                flush ();
+                queue.enqueueWriteBuffer (buffer, CL_TRUE, offset, size, ptr);
+                return;
+            }
+
+            if (upUsed + size > capacity || uploads.size () + downloads.size () == maxRegions)
+                flush ();
+            acquire ();
+
+            std::memcpy (pUpload + upUsed, ptr, size);
+            uploads.push_back ({ buffer, offset, size, upUsed, nullptr });
+            upUsed += padded (size);
+        }
+
+        /*! \brief Queues a read from a buffer.
+         *  \details `ptr` receives the data when the `flush` that 
+         *           issues the read returns.
+         *
+         *  \param[in] buffer the source buffer.
+         *  \param[in] offset the offset in `buffer` in bytes.
+         *  \param[in] size the number of bytes to read.
+         *  \param[out] ptr the memory that receives the data.
+         */
+        void read (const cl::Buffer &buffer, size_t offset, size_t size, void *ptr)
+        {
+            if (size > capacity)
+            {
+                flush ();
+                queue.enqueueReadBuffer (buffer, CL_TRUE, offset, size, ptr);
+                return;
+            }
+
+            if (downUsed + size > capacity || uploads.size () + downloads.size () == maxRegions)
+                flush ();
+
+            downloads.push_back ({ buffer, offset, size, downUsed, ptr });
+            downUsed += padded (size);
+        }
+
+        /*! \brief Issues the queued transfers.
+         *  \note If there are reads, it blocks until their data are on the host. 
+         *        The writes complete asynchronously.
+         *
+         *  \param[in] events a wait-list of events.
+         *  \param[out] event an event that identifies the last command.
+         */
+        void flush (const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            nCommands = 0;
+            if (uploads.empty () && downloads.empty ())
+                return;
+
+            acquire ();
+
+            // The table of regions goes right after the staged data
+            size_t tableOffset = (upUsed + 15) / 16 * 16;
+            cl_uint *table = (cl_uint *) (pUpload + tableOffset);
+            std::vector<Batch> upBatches = pack (uploads, true, table, 0);
+            std::vector<Batch> downBatches = pack (downloads, false, table, uploads.size ());
+
+            bool kernels = false;
+            for (auto &b : upBatches) kernels |= (b.type == KERNEL);
+            for (auto &b : downBatches) kernels |= (b.type == KERNEL);
+
+            size_t upSize = kernels ? tableOffset + 16 * (uploads.size () + downloads.size ()) : upUsed;
+            cl::Event last;
+            if (upSize > 0)
+            {
+                queue.enqueueWriteBuffer (dStaging, CL_FALSE, 0, upSize, pUpload, events, &last);
+                uploadEvent = last;
+                events = nullptr;
+                ++nCommands;
+            }
+
+            for (auto &b : upBatches)
+                issue (b, dStaging, b.buffer, tableOffset, events, last);
+            for (auto &b : downBatches)
+                issue (b, b.buffer, dGather, tableOffset, events, last);
+
+            if (!downloads.empty ())
+            {
+                queue.enqueueReadBuffer (dGather, CL_TRUE, 0, downUsed, pDownload, events, &last);
+                ++nCommands;
+
+                for (auto &r : downloads)
+                    std::memcpy (r.ptr, pDownload + r.staged, r.size);
+            }
+
+            if (event)
+                *event = last;
+
+            uploads.clear ();
+            downloads.clear ();
+            upUsed = downUsed = 0;
+        }
+
+        /*! \brief Returns the number of commands the last flush enqueued. */
+        unsigned int commands () const { return nCommands; }
+
+    private:
+        /*! \brief A queued transfer. */
+        struct Region
+        {
+            cl::Buffer buffer;  /*!< The device buffer. */
+            size_t offset;  /*!< The offset in `buffer` in bytes. */
+            size_t size;  /*!< The size in bytes. */
+            size_t staged;  /*!< The offset in the staging buffer in bytes. */
+            void *ptr;  /*!< The host memory that receives a read. */
+        };
+
+        /*! \brief The ways a batch of regions gets copied. */
+        enum BatchType { COPY, RECT, KERNEL_BYTES, KERNEL };
+
+        /*! \brief The regions of a buffer, which get copied with one command. */
+        struct Batch
+        {
+            cl::Buffer buffer;  /*!< The buffer on the device side. */
+            BatchType type;  /*!< How the regions get copied. */
+            unsigned int first;  /*!< The index of the first region in the table. */
+            unsigned int count;  /*!< The number of regions. */
+            size_t src, dst;  /*!< The origins of the copy (`COPY`, `RECT`). */
+            size_t size;  /*!< The size of a region (`COPY`, `RECT`). */
+            size_t srcPitch, dstPitch;  /*!< The distances between the regions (`RECT`). */
+        };
+
+        /*! \brief Rounds a size up to a multiple of 4 bytes. */
+        static size_t padded (size_t size)
+        {
+            return (size + 3) / 4 * 4;
+        }
+
+        /*! \brief Makes sure the last upload has finished 
+         *         with the pinned buffer before it's reused. */
+        void acquire ()
+        {
+            if (uploadEvent () == nullptr)
+                return;
+
+            uploadEvent.wait ();
+            uploadEvent = cl::Event ();
+        }
+
+        /*! \brief Groups the regions by buffer, picks how every group 
+         *         gets copied, and fills in the table of regions.
+         *
+         *  \param[in,out] regions the regions. They get sorted by buffer.
+         *  \param[in] upload whether the regions are writes or reads.
+         *  \param[out] table the table of regions.
+         *  \param[in] first the index in the table for the first region.
+         *  \return The batches.
+         */
+        std::vector<Batch> pack (std::vector<Region> &regions, bool upload, cl_uint *table, unsigned int first)
+        {
+            std::stable_sort (regions.begin (), regions.end (), 
+                [] (const Region &a, const Region &b) { return a.buffer () < b.buffer (); });
+
+            std::vector<Batch> batches;
+            for (unsigned int i = 0, j; i < regions.size (); i = j)
+            {
+                // The group is [i, j)
+                bool words = true, uniform = true;
+                for (j = i; j < regions.size () && regions[j].buffer () == regions[i].buffer (); ++j)
+                {
+                    const Region &r = regions[j];
+                    words &= (r.offset % 4 == 0 && r.size % 4 == 0);
+                    if (j > i + 1)
+                        uniform &= (r.offset - regions[j - 1].offset == regions[i + 1].offset - regions[i].offset);
+                    if (j > i)
+                        uniform &= (r.size == regions[i].size && r.offset > regions[j - 1].offset && 
+                                    r.offset - regions[j - 1].offset >= r.size && 
+                                    r.staged - regions[j - 1].staged == padded (r.size));
+                }
+
+                const Region &r0 = regions[i];
+                Batch batch;
+                batch.buffer = r0.buffer;
+                batch.first = first + i;
+                batch.count = j - i;
+                batch.src = upload ? r0.staged : r0.offset;
+                batch.dst = upload ? r0.offset : r0.staged;
+                batch.size = r0.size;
+                batch.srcPitch = batch.dstPitch = 0;
+                if (batch.count == 1)
+                    batch.type = COPY;
+                else if (uniform)
+                {
+                    batch.type = RECT;
+                    size_t stride = regions[i + 1].offset - r0.offset;
+                    batch.srcPitch = upload ? padded (r0.size) : stride;
+                    batch.dstPitch = upload ? stride : padded (r0.size);
+                }
+                else
+                    batch.type = words ? KERNEL : KERNEL_BYTES;
+
+                size_t unit = (batch.type == KERNEL) ? 4 : 1;
+                for (unsigned int k = i; k < j; ++k)
+                {
+                    cl_uint *entry = table + 4 * (first + k);
+                    entry[0] = (upload ? regions[k].staged : regions[k].offset) / unit;
+                    entry[1] = (upload ? regions[k].offset : regions[k].staged) / unit;
+                    entry[2] = regions[k].size / unit;
+                    entry[3] = 0;
+                }
+
+                batches.push_back (batch);
+            }
+
+            return batches;
+        }
+
+        /*! \brief Enqueues the command that copies a batch of regions.
+         *
+         *  \param[in] batch the batch.
+         *  \param[in] src the buffer to copy from.
+         *  \param[in] dst the buffer to copy to.
+         *  \param[in] tableOffset the offset of the table in `dStaging` in bytes.
+         *  \param[in,out] events a wait-list for the first command. It's reset after use.
+         *  \param[out] last the event of the command.
+         */
+        void issue (const Batch &batch, const cl::Buffer &src, const cl::Buffer &dst, 
+                    size_t tableOffset, const std::vector<cl::Event> *&events, cl::Event &last)
+        {
+            if (batch.type == COPY)
+                queue.enqueueCopyBuffer (src, dst, batch.src, batch.dst, batch.size, events, &last);
+            else if (batch.type == RECT)
+            {
+                cl::size_t<3> srcOrigin, dstOrigin, region;
+                srcOrigin[0] = batch.src; srcOrigin[1] = 0; srcOrigin[2] = 0;
+                dstOrigin[0] = batch.dst; dstOrigin[1] = 0; dstOrigin[2] = 0;
+                region[0] = batch.size; region[1] = batch.count; region[2] = 1;
+                queue.enqueueCopyBufferRect (src, dst, srcOrigin, dstOrigin, region, 
+                                             batch.srcPitch, 0, batch.dstPitch, 0, events, &last);
+            }
+            else
+            {
+                cl::Kernel &kernel (batch.type == KERNEL ? kernelWords : kernelBytes);
+                kernel.setArg (0, src);
+                kernel.setArg (1, dStaging);
+                kernel.setArg (2, (cl_uint) (tableOffset / 16 + batch.first));
+                kernel.setArg (3, dst);
+                kernel.setArg (4, (cl_uint) batch.count);
+                queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (batch.count * wgSize), 
+                                            cl::NDRange (wgSize), events, &last);
+            }
+
+            events = nullptr;
+            ++nCommands;
+        }
+
+        cl::CommandQueue &queue;  /*!< The queue the transfers get enqueued on. */
+        cl::Kernel kernelWords, kernelBytes;  /*!< The scatter/gather kernels. */
+        size_t capacity;  /*!< The size of the staging buffers in bytes. */
+        unsigned int maxRegions;  /*!< The maximum number of regions in a flush. */
+        unsigned int wgSize;  /*!< The work-group size. */
+        cl::Buffer hUpload, hDownload;  /*!< The pinned staging buffers. */
+        char *pUpload, *pDownload;  /*!< The host pointers of the pinned buffers. */
+        cl::Buffer dStaging;  /*!< The device copy of the upload staging buffer. */
+        cl::Buffer dGather;  /*!< The device buffer the reads are gathered in. */
+        std::vector<Region> uploads, downloads;  /*!< The queued transfers. */
+        size_t upUsed, downUsed;  /*!< The bytes in use in the staging buffers. */
+        cl::Event uploadEvent;  /*!< The last upload from the pinned buffer. */
+        unsigned int nCommands;  /*!< The commands enqueued by the last flush. */
+    };
+
+}
+
+#endif  // CLUTILS_TRANSFER_HPP
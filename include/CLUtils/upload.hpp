@@ -0,0 +1,304 @@
+/*! \file upload.hpp
+ *  \brief Declarations of a cache of read-only device buffers, 
+ *         keyed by the contents of the host data they were uploaded from.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef CLUTILS_UPLOAD_HPP
+#define CLUTILS_UPLOAD_HPP
+
+#include <list>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+#include <mutex>
+#include <unordered_map>
+#include <CLUtils.hpp>
+#include <CLUtils/verify.hpp>
+
+
+namespace clutils
+{
+
+    /*! \brief Deduplicates the uploads of host data that get uploaded repeatedly, 
+     *         like lookup tables and weights.
+     *  \details The data are hashed on the host (`host::hash`), and the hash, 
+     *           along with the size, keys a read-only device buffer with the 
+     *           same contents. On a hit, the buffer is returned without a 
+     *           transfer. On a miss, a buffer is allocated from the 
+     *           `MemoryManager` of the context, the data are written to it, 
+     *           and it's added to the cache.
+     *           
+     *           The cache holds up to `capacity` bytes. Past that, the least 
+     *           recently used buffers are dropped from it. The buffers count 
+     *           against the budget of the `MemoryManager`, and the cache is 
+     *           registered as one of its reclaimers, so the manager drops 
+     *           the least recently used buffers, too, when an allocation 
+     *           doesn't fit otherwise. A dropped buffer stays valid for as 
+     *           long as someone holds it, and its device memory counts 
+     *           against the budget until the runtime releases it. Data 
+     *           larger than the capacity are uploaded without being cached.
+     *           
+     *           \code
+     *           UploadCache uploads (clEnv, CLEnvInfo<1> (), 256 << 20);
+     *           cl::Buffer dTable = uploads.upload (hTable.data (), bytes);
+     *           kernel.setArg (0, dTable);
+     *           \endcode
+     *  \note The buffers are meant to be read only. A kernel that writes to 
+     *        one of them changes the contents that every later hit returns.
+     *  \note Every buffer keeps a second 64-bit fingerprint of its contents, 
+     *        which a hit has to match, so a collision of the hashes is taken 
+     *        for a miss. Data whose hashes and fingerprints both collide would 
+     *        still be confused. For debugging, `verify` keeps a copy of the 
+     *        contents of every buffer, and hits compare the data to it in full.
+     *  \note It's safe to use from several threads, and along with anything 
+     *        else that allocates from the same `MemoryManager`, which 
+     *        serializes the allocations and the reclaims.
+     */
+    class UploadCache
+    {
+    public:
+        /*! \param[in] env the OpenCL environment.
+         *  \param[in] info the configuration of the OpenCL environment 
+         *                  the buffers will be allocated and written in.
+         *  \param[in] capacity the maximum size of the cached buffers, in bytes.
+         *  \param[in] verify whether to keep a copy of the contents of every 
+         *                    buffer, and compare the data of a hit to it.
+         */
+        UploadCache (CLEnv &env, CLEnvInfo<1> info = CLEnvInfo<1> (), 
+                     size_t capacity = 64 << 20, bool verify = false)
+            : memory (env.getMemoryManager (info.ctxIdx)), 
+              queue (env.getQueue (info.ctxIdx, info.qIdx[0])), 
+              limit (capacity), cachedBytes (0), verify (verify), 
+              nHits (0), nMisses (0), nCollisions (0), nUploadedBytes (0), nSavedBytes (0)
+        {
+            reclaimer = memory.addReclaimer ([this] () { return reclaim (); });
+        }
+
+        ~UploadCache ()
+        {
+            memory.removeReclaimer (reclaimer);
+        }
+
+        UploadCache (const UploadCache&) = delete;
+        UploadCache& operator= (const UploadCache&) = delete;
+
+        /*! \brief Returns a read-only buffer with the contents of a host buffer, 
+         *         and uploads them only if they aren't cached already.
+         *  \note On a miss, the data are written with a non-blocking write, like 
+         *        `enqueueWriteBuffer`'s, so they have to stay unchanged until 
+         *        `event` completes. On a hit, `event` identifies the write 
+         *        that uploaded the data originally.
+         *
+         *  \param[in] data the host data.
+         *  \param[in] bytes the size of the data in bytes.
+         *  \param[in] events a wait-list of events for the write.
+         *  \param[out] event an event that identifies the write.
+         *  \return The buffer.
+         */
+        cl::Buffer upload (const void *data, size_t bytes, 
+                           const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            if (bytes == 0)
+                throw std::invalid_argument ("UploadCache: empty upload");
+
+            cl_ulong fingerprint;
+            Key key { host::hash (data, bytes, fingerprint), bytes };
+
+            std::lock_guard<std::recursive_mutex> lock (mtx);
+
+            auto it = entries.find (key);
+            if (it != entries.end ())
+            {
+                Entry &e = it->second;
+                if (e.fingerprint == fingerprint && 
+                    (!verify || std::memcmp (e.host.data (), data, bytes) == 0))
+                {
+                    lru.splice (lru.end (), lru, e.use);
+                    ++nHits;
+                    nSavedBytes += bytes;
+                    if (event) *event = e.written;
+
+                    return e.buffer;
+                }
+
+                // The hashes collide, so the data replace the cached ones
+                ++nCollisions;
+                drop (it);
+            }
+
+            // The allocation may call back to `reclaim` on this thread
+            cl::Buffer buffer = memory.createBuffer (CL_MEM_READ_ONLY, bytes);
+            cl::Event written;
+            queue.enqueueWriteBuffer (buffer, CL_FALSE, 0, bytes, data, events, &written);
+            ++nMisses;
+            nUploadedBytes += bytes;
+            if (event) *event = written;
+
+            if (bytes <= limit)
+            {
+                while (cachedBytes + bytes > limit)
+                    drop (entries.find (lru.front ()));
+
+                Entry &e = entries[key];
+                e.buffer = buffer;
+                e.written = written;
+                e.fingerprint = fingerprint;
+                if (verify)
+                    e.host.assign ((const char *) data, (const char *) data + bytes);
+                e.use = lru.insert (lru.end (), key);
+                cachedBytes += bytes;
+            }
+
+            return buffer;
+        }
+
+        /*! \brief Returns a read-only buffer with the contents of a vector, 
+         *         and uploads them only if they aren't cached already.
+         *  \note The same as `upload (v.data (), v.size () * sizeof (T), ...)`.
+         */
+        template <typename T>
+        cl::Buffer upload (const std::vector<T> &v, 
+                           const std::vector<cl::Event> *events = nullptr, cl::Event *event = nullptr)
+        {
+            return upload (v.data (), v.size () * sizeof (T), events, event);
+        }
+
+        /*! \brief Drops all of the buffers from the cache. */
+        void clear ()
+        {
+            std::lock_guard<std::recursive_mutex> lock (mtx);
+            entries.clear ();
+            lru.clear ();
+            cachedBytes = 0;
+        }
+
+        /*! \brief The capacity in bytes. */
+        size_t capacity () const { return limit; }
+        /*! \brief Changes the capacity, and drops buffers down to it. */
+        void setCapacity (size_t bytes)
+        {
+            std::lock_guard<std::recursive_mutex> lock (mtx);
+            limit = bytes;
+            while (cachedBytes > limit)
+                drop (entries.find (lru.front ()));
+        }
+        /*! \brief The size of the cached buffers in bytes. */
+        size_t size () const { std::lock_guard<std::recursive_mutex> lock (mtx); return cachedBytes; }
+        /*! \brief The number of cached buffers. */
+        size_t count () const { std::lock_guard<std::recursive_mutex> lock (mtx); return entries.size (); }
+        /*! \brief The number of uploads that found their data cached. */
+        size_t hits () const { std::lock_guard<std::recursive_mutex> lock (mtx); return nHits; }
+        /*! \brief The number of uploads that wrote their data. */
+        size_t misses () const { std::lock_guard<std::recursive_mutex> lock (mtx); return nMisses; }
+        /*! \brief The number of uploads whose hash matched a buffer with different contents. */
+        size_t collisions () const { std::lock_guard<std::recursive_mutex> lock (mtx); return nCollisions; }
+        /*! \brief The bytes written by the uploads. */
+        size_t uploadedBytes () const { std::lock_guard<std::recursive_mutex> lock (mtx); return nUploadedBytes; }
+        /*! \brief The bytes the hits didn't have to write. */
+        size_t savedBytes () const { std::lock_guard<std::recursive_mutex> lock (mtx); return nSavedBytes; }
+
+    private:
+        /*! \brief The key of a buffer, the hash and the size of its contents. */
+        struct Key
+        {
+            cl_ulong hash;  /*!< The hash of the contents. */
+            size_t size;  /*!< The size of the contents in bytes. */
+
+            bool operator== (const Key &other) const { return hash == other.hash && size == other.size; }
+        };
+
+        /*! \brief Hashes a key for the map. The hash is already well mixed. */
+        struct KeyHash
+        {
+            size_t operator() (const Key &key) const { return (size_t) (key.hash ^ key.size); }
+        };
+
+        /*! \brief A cached buffer. */
+        struct Entry
+        {
+            cl::Buffer buffer;  /*!< The buffer. */
+            cl::Event written;  /*!< The write that uploaded the contents. */
+            cl_ulong fingerprint;  /*!< The fingerprint of the contents. */
+            std::vector<char> host;  /*!< A copy of the contents, when verifying. */
+            std::list<Key>::iterator use;  /*!< The position of the buffer in the LRU list. */
+        };
+
+        typedef std::unordered_map<Key, Entry, KeyHash> Entries;
+
+        /*! \brief Drops a buffer from the cache. */
+        void drop (Entries::iterator it)
+        {
+            lru.erase (it->second.use);
+            cachedBytes -= it->first.size;
+            entries.erase (it);
+        }
+
+        /*! \brief Drops the least recently used buffer for the `MemoryManager`.
+         *  \details The cache is skipped while another thread holds it, since 
+         *           that thread may be waiting on the manager itself. The write 
+         *           that uploaded the buffer is waited for, so that the runtime 
+         *           can release the buffer right away, unless someone holds it.
+         *
+         *  \return The size of the dropped buffer in bytes, or 0 if none was dropped.
+         */
+        size_t reclaim ()
+        {
+            std::unique_lock<std::recursive_mutex> lock (mtx, std::try_to_lock);
+            if (!lock.owns_lock () || lru.empty ())
+                return 0;
+
+            Entries::iterator it = entries.find (lru.front ());
+            size_t bytes = it->first.size;
+            if (it->second.written ())
+                it->second.written.wait ();
+            drop (it);
+
+            return bytes;
+        }
+
+        MemoryManager &memory;  /*!< The manager the buffers are allocated from. */
+        cl::CommandQueue &queue;  /*!< The queue the writes get enqueued on. */
+        /*! \brief Guards the cache.
+         *  \details It's recursive, since the allocation of a buffer during 
+         *           an upload may call back to `reclaim`. */
+        mutable std::recursive_mutex mtx;
+        Entries entries;  /*!< The cached buffers. */
+        std::list<Key> lru;  /*!< The cached buffers from least to most recently used. */
+        size_t limit;  /*!< The capacity in bytes. */
+        size_t cachedBytes;  /*!< The size of the cached buffers. */
+        bool verify;  /*!< Whether the hits compare the data with a copy. */
+        unsigned int reclaimer;  /*!< The id of the cache among the reclaimers of the manager. */
+        size_t nHits;  /*!< The number of hits. */
+        size_t nMisses;  /*!< The number of misses. */
+        size_t nCollisions;  /*!< The number of collisions. */
+        size_t nUploadedBytes;  /*!< The bytes written by the misses. */
+        size_t nSavedBytes;  /*!< The bytes the hits didn't write. */
+    };
+
+}
+
+#endif  // CLUTILS_UPLOAD_HPP
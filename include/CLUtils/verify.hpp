@@ -0,0 +1,416 @@
+/*! \file verify.hpp
+ *  \brief Declarations of the host reference implementations of the primitives,
+ *         and of the comparison of buffers against them.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+
+#ifndef CLUTILS_VERIFY_HPP
+#define CLUTILS_VERIFY_HPP
+
+#include <cstring>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <numeric>
+#include <ostream>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+#include <CLUtils/pool.hpp>
+
+
+namespace clutils
+{
+
+/*! \brief Host reference implementations of the primitives, 
+ *         and comparisons of device results against them.
+ *  \details The kernels use SSE4.1, AVX2 or AVX-512, whichever is the best 
+ *           the CPU supports, and fall back to scalar code elsewhere. 
+ *           The comparisons also spread large buffers over the `ThreadPool`.
+ */
+namespace host
+{
+
+    /*! \brief The instruction sets of the host kernels. */
+    enum class SimdLevel : uint8_t
+    {
+        SCALAR,  /*!< Plain C++. */
+        SSE41,   /*!< SSE4.1, 128-bit vectors. */
+        AVX2,    /*!< AVX2, 256-bit vectors. */
+        AVX512   /*!< AVX-512F, 512-bit vectors. */
+    };
+
+    /*! \brief Returns the name of an instruction set. */
+    const char* simdLevelName (SimdLevel level);
+
+    /*! \brief Returns the best instruction set that both the CPU 
+     *         and the build of the library support. */
+    SimdLevel supportedSimdLevel ();
+
+    /*! \brief Returns the instruction set in use. It starts at the supported one. */
+    SimdLevel simdLevel ();
+
+    /*! \brief Selects the instruction set of the kernels, e.g. for comparing them.
+     *  \note It's capped at the supported level.
+     *
+     *  \param[in] level the instruction set.
+     *  \return The instruction set selected.
+     */
+    SimdLevel setSimdLevel (SimdLevel level);
+
+
+    namespace detail
+    {
+
+        /*! \brief The operators of the primitives, for the dispatched kernels. */
+        enum class OpKind : uint8_t { SUM, MIN, MAX };
+
+        template <typename Op> struct OpKindOf;
+        template <> struct OpKindOf<Sum> { static const OpKind value = OpKind::SUM; };
+        template <> struct OpKindOf<Min> { static const OpKind value = OpKind::MIN; };
+        template <> struct OpKindOf<Max> { static const OpKind value = OpKind::MAX; };
+
+        /*! \brief Reduces elements in order, with an operator of the primitives. */
+        template <typename T, typename Op>
+        T reduceWith (const T *data, size_t n, Op op)
+        {
+            T acc = Op::template identity<T> ();
+            for (size_t i = 0; i < n; ++i)
+                acc = op (acc, data[i]);
+            return acc;
+        }
+
+        /*! \brief Scans elements in order, with an operator of the primitives. */
+        template <typename T, typename Op>
+        void scanWith (const T *in, T *out, size_t n, bool inclusive, Op op)
+        {
+            T acc = Op::template identity<T> ();
+            for (size_t i = 0; i < n; ++i)
+            {
+                T next = op (acc, in[i]);
+                out[i] = inclusive ? next : acc;
+                acc = next;
+            }
+        }
+
+        /*! \brief The scalar reduction, for the types without vector kernels. */
+        template <typename T>
+        T reduce (const T *data, size_t n, OpKind op)
+        {
+            switch (op)
+            {
+                case OpKind::MIN: return reduceWith (data, n, Min ());
+                case OpKind::MAX: return reduceWith (data, n, Max ());
+                default: return reduceWith (data, n, Sum ());
+            }
+        }
+
+        /*! \brief The scalar scan, for the types without vector kernels. */
+        template <typename T>
+        void scan (const T *in, T *out, size_t n, OpKind op, bool inclusive)
+        {
+            switch (op)
+            {
+                case OpKind::MIN: scanWith (in, out, n, inclusive, Min ()); break;
+                case OpKind::MAX: scanWith (in, out, n, inclusive, Max ()); break;
+                default: scanWith (in, out, n, inclusive, Sum ()); break;
+            }
+        }
+
+        /*! \brief The dispatched kernels. */
+        cl_int reduce (const cl_int *data, size_t n, OpKind op);
+        cl_uint reduce (const cl_uint *data, size_t n, OpKind op);
+        cl_float reduce (const cl_float *data, size_t n, OpKind op);
+        void scan (const cl_int *in, cl_int *out, size_t n, OpKind op, bool inclusive);
+        void scan (const cl_uint *in, cl_uint *out, size_t n, OpKind op, bool inclusive);
+        void scan (const cl_float *in, cl_float *out, size_t n, OpKind op, bool inclusive);
+
+        /*! \brief Compares 32-bit or 64-bit elements bitwise.
+         *  \return The number of elements that differ. The indices 
+         *          of the first `maxReports` of them go to `first`.
+         */
+        size_t compare32 (const void *expected, const void *actual, size_t n, 
+                          size_t *first, size_t maxReports);
+        size_t compare64 (const void *expected, const void *actual, size_t n, 
+                          size_t *first, size_t maxReports);
+
+        /*! \brief Compares floats within a distance in ULPs. */
+        size_t compareULP (const cl_float *expected, const cl_float *actual, size_t n, 
+                           cl_uint maxUlps, size_t *first, size_t maxReports);
+
+    }
+
+
+    /*! \brief Performs a vector addition, `c = a + b`, like `vecAdd` in `kernels.cl`. */
+    void vecAdd (const cl_int *a, const cl_int *b, cl_int *c, size_t n);
+
+    /*! \brief Reduces `n` elements, like `Reduce`.
+     *  \note The vector kernels reassociate the float sums, 
+     *        so compare them with `compareULP`.
+     *
+     *  \tparam T the element type.
+     *  \tparam Op the operator (`Sum`, `Min`, `Max`).
+     */
+    template <typename T, typename Op = Sum>
+    T reduce (const T *data, size_t n)
+    {
+        return detail::reduce (data, n, detail::OpKindOf<Op>::value);
+    }
+
+    /*! \brief Scans `n` elements, like `Scan`. The scan can be in-place.
+     *
+     *  \tparam T the element type.
+     *  \tparam Op the operator (`Sum`, `Min`, `Max`).
+     */
+    template <typename T, typename Op = Sum>
+    void scan (const T *in, T *out, size_t n, ScanType type = ScanType::INCLUSIVE)
+    {
+        detail::scan (in, out, n, detail::OpKindOf<Op>::value, type == ScanType::INCLUSIVE);
+    }
+
+    /*! \brief Sorts `n` keys, like `RadixSort`. */
+    template <typename K>
+    void sort (K *keys, size_t n)
+    {
+        std::sort (keys, keys + n);
+    }
+
+    /*! \brief Sorts `n` key-value pairs by key, like `RadixSort`. 
+     *         The sort is stable, so are the values.
+     */
+    template <typename K, typename V>
+    void sort (K *keys, V *values, size_t n)
+    {
+        std::vector<size_t> order (n);
+        std::iota (order.begin (), order.end (), 0);
+        std::stable_sort (order.begin (), order.end (), 
+                          [keys] (size_t a, size_t b) { return keys[a] < keys[b]; });
+
+        std::vector<K> k (n);
+        std::vector<V> v (n);
+        for (size_t i = 0; i < n; ++i)
+        {
+            k[i] = keys[order[i]];
+            v[i] = values[order[i]];
+        }
+        std::copy (k.begin (), k.end (), keys);
+        std::copy (v.begin (), v.end (), values);
+    }
+
+    /*! \brief Multiplies `batch` pairs of float matrices, 
+     *         `C[i] = alpha * A[i] * B[i] + beta * C[i]`, like `Gemm`.
+     *  \details The rows of `C` are spread over the `ThreadPool`. Every row 
+     *           is accumulated over the rows of `B` (i-k-j order), so the 
+     *           inner loop streams through `B` and `C`, and vectorizes.
+     *  \note The matrices are in row-major order, and the matrices of a batch 
+     *        are contiguous. `C` isn't read when `beta` is 0.
+     */
+    inline void gemm (const cl_float *A, const cl_float *B, cl_float *C, 
+                      size_t M, size_t N, size_t K, size_t batch = 1, 
+                      cl_float alpha = 1.f, cl_float beta = 0.f)
+    {
+        ThreadPool::instance ().parallel_for (0, batch * M, [=] (size_t first, size_t last)
+        {
+            std::vector<cl_float> acc (N);
+            for (size_t r = first; r < last; ++r)
+            {
+                const cl_float *a = A + r * K;
+                const cl_float *b = B + r / M * K * N;
+                cl_float *c = C + r * N;
+
+                std::fill (acc.begin (), acc.end (), 0.f);
+                for (size_t k = 0; k < K; ++k)
+                {
+                    const cl_float ak = a[k], *bk = b + k * N;
+                    for (size_t j = 0; j < N; ++j)
+                        acc[j] += ak * bk[j];
+                }
+
+                for (size_t j = 0; j < N; ++j)
+                    c[j] = alpha * acc[j] + (beta != 0.f ? beta * c[j] : 0.f);
+            }
+        });
+    }
+
+
+    /*! \brief An element that differs from the reference. */
+    template <typename T>
+    struct Mismatch
+    {
+        size_t index;  /*!< The index of the element. */
+        T expected;  /*!< The reference value. */
+        T actual;  /*!< The value found. */
+    };
+
+    /*! \brief The result of a comparison against a reference. 
+     *  \details It prints a summary with the first mismatches, 
+     *           e.g. `ASSERT_TRUE (cmp.ok ()) << cmp;`.
+     */
+    template <typename T>
+    struct Comparison
+    {
+        size_t n;  /*!< The number of elements compared. */
+        size_t mismatches;  /*!< The number of elements that differ. */
+        std::vector<Mismatch<T>> first;  /*!< The first elements that differ, in order. */
+
+        /*! \brief Returns whether all of the elements match. */
+        bool ok () const { return mismatches == 0; }
+    };
+
+    template <typename T>
+    std::ostream& operator<< (std::ostream &os, const Comparison<T> &cmp)
+    {
+        if (cmp.ok ())
+            return os << "All " << cmp.n << " elements match";
+
+        std::streamsize precision = os.precision (std::numeric_limits<T>::max_digits10);
+        os << cmp.mismatches << " of " << cmp.n << " elements differ";
+        for (auto &m : cmp.first)
+            os << std::endl << "  [" << m.index << "] expected " << +m.expected << ", got " << +m.actual;
+        os.precision (precision);
+
+        return os;
+    }
+
+    namespace detail
+    {
+
+        /*! \brief Compares blocks of the buffers on the `ThreadPool`, 
+         *         and merges the mismatches of the blocks in order.
+         *
+         *  \param[in] compareBlock compares a block, with the 
+         *                          signature of `compare32`.
+         */
+        template <typename T, typename F>
+        Comparison<T> compareBlocks (const T *expected, const T *actual, size_t n, 
+                                     size_t maxReports, F compareBlock)
+        {
+            const size_t block = 1 << 18;
+            size_t nBlocks = (n + block - 1) / block;
+            std::vector<size_t> counts (nBlocks);
+            std::vector<std::vector<size_t>> firsts (nBlocks, std::vector<size_t> (maxReports));
+
+            ThreadPool::instance ().parallel_for (0, nBlocks, [&] (size_t b0, size_t b1)
+            {
+                for (size_t b = b0; b < b1; ++b)
+                {
+                    size_t begin = b * block;
+                    counts[b] = compareBlock (expected + begin, actual + begin, 
+                                              std::min (block, n - begin), firsts[b].data (), maxReports);
+                }
+            }, 1);
+
+            Comparison<T> cmp { n, 0, std::vector<Mismatch<T>> () };
+            for (size_t b = 0; b < nBlocks; ++b)
+            {
+                for (size_t k = 0; k < std::min (counts[b], maxReports) && cmp.first.size () < maxReports; ++k)
+                {
+                    size_t i = b * block + firsts[b][k];
+                    cmp.first.push_back (Mismatch<T> { i, expected[i], actual[i] });
+                }
+                cmp.mismatches += counts[b];
+            }
+
+            return cmp;
+        }
+
+    }
+
+    /*! \brief Compares `n` elements with a reference, bitwise.
+     *  \note Floats are compared by their bits, so `-0.f` differs from `0.f`, 
+     *        and NaNs match if they have the same bits.
+     *
+     *  \param[in] expected the reference.
+     *  \param[in] actual the elements to check.
+     *  \param[in] n the number of elements.
+     *  \param[in] maxReports the number of mismatches to report.
+     *  \return The number of elements that differ, and the first of them.
+     */
+    template <typename T>
+    Comparison<T> compare (const T *expected, const T *actual, size_t n, size_t maxReports = 8)
+    {
+        if (sizeof (T) == 4)
+            return detail::compareBlocks (expected, actual, n, maxReports, detail::compare32);
+        if (sizeof (T) == 8)
+            return detail::compareBlocks (expected, actual, n, maxReports, detail::compare64);
+
+        return detail::compareBlocks (expected, actual, n, maxReports, 
+            [] (const T *e, const T *a, size_t m, size_t *first, size_t maxFirst)
+            {
+                size_t count = 0;
+                for (size_t i = 0; i < m; ++i)
+                    if (std::memcmp (e + i, a + i, sizeof (T)) != 0 && count++ < maxFirst)
+                        first[count - 1] = i;
+                return count;
+            });
+    }
+
+    /*! \brief Hashes the contents of a host buffer to 64 bits.
+     *  \details It's a non-cryptographic hash, meant for keying host data 
+     *           (e.g. by `UploadCache`). It mixes 64-byte stripes with 32x32-bit 
+     *           multiplications in independent 64-bit lanes, so it runs on the 
+     *           vector kernels, and every instruction set gives the same hash.
+     */
+    cl_ulong hash (const void *data, size_t bytes);
+
+    /*! \brief Hashes the contents of a host buffer to 64 bits, 
+     *         along with a second 64-bit fingerprint.
+     *  \details The data are read once. The hash is the same as `hash`'s, and 
+     *           the fingerprint is folded separately, so it tells apart data 
+     *           whose hashes collide.
+     */
+    cl_ulong hash (const void *data, size_t bytes, cl_ulong &fingerprint);
+
+    /*! \brief Returns the distance between two floats in units in the last place.
+     *  \details `-0.f` and `0.f` are 0 ULPs apart, and any NaN is 
+     *           as far as possible from everything.
+     */
+    cl_uint ulpDistance (cl_float a, cl_float b);
+
+    /*! \brief Compares `n` floats with a reference, within a distance in ULPs.
+     *  \note NaNs only match NaNs.
+     *
+     *  \param[in] expected the reference.
+     *  \param[in] actual the elements to check.
+     *  \param[in] n the number of elements.
+     *  \param[in] maxUlps the largest distance that's considered a match.
+     *  \param[in] maxReports the number of mismatches to report.
+     *  \return The number of elements that differ, and the first of them.
+     */
+    inline Comparison<cl_float> compareULP (const cl_float *expected, const cl_float *actual, size_t n, 
+                                            cl_uint maxUlps, size_t maxReports = 8)
+    {
+        return detail::compareBlocks (expected, actual, n, maxReports, 
+            [maxUlps] (const cl_float *e, const cl_float *a, size_t m, size_t *first, size_t maxFirst)
+            { return detail::compareULP (e, a, m, maxUlps, first, maxFirst); });
+    }
+
+}
+
+}
+
+#endif  // CLUTILS_VERIFY_HPP
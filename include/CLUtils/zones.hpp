@@ -0,0 +1,533 @@
+/*! \file zones.hpp
+ *  \brief Declarations of scoped profiling zones, and of the profiler
+ *         that aggregates them into a call-tree.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+#ifndef CLUTILS_ZONES_HPP
+#define CLUTILS_ZONES_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <CLUtils.hpp>
+
+
+/*! \brief Concatenates two tokens after expanding them. */
+#define CLUTILS_ZONE_CAT_(a, b) a ## b
+#define CLUTILS_ZONE_CAT(a, b) CLUTILS_ZONE_CAT_(a, b)
+
+/*! \brief Opens an anonymous zone that lasts until the end of the enclosing scope. */
+#define CLUTILS_ZONE(name) clutils::Zone CLUTILS_ZONE_CAT(clutilsZone, __LINE__) (name)
+
+
+namespace clutils
+{
+
+    /*! \brief The kinds of records in a zone ring. */
+    enum class ZoneRecordKind : uint8_t
+    {
+        BEGIN,  /*!< A zone opened. */
+        END,    /*!< The innermost zone closed. */
+        EVENT   /*!< A device event was attached to the innermost zone. */
+    };
+
+
+    /*! \brief The ring a thread records its zones in.
+     *  \details A ring has a single producer, its thread, which never waits. 
+     *           When the ring is full, the oldest records are overwritten, 
+     *           and the aggregator counts them as dropped. The aggregator 
+     *           detects records that got overwritten while it was reading 
+     *           them, like a sequence lock. The owner of a slot tells whether 
+     *           its event has yet to be taken, so that exactly one of the 
+     *           producer (when it overwrites the slot) and the aggregator 
+     *           (when it consumes the record) releases it.
+     */
+    class ZoneRing
+    {
+    public:
+        /*! \param[in] capacity the number of records in the ring. */
+        explicit ZoneRing (size_t capacity) 
+            : records (capacity), owners (capacity), reserved (0), head (0), consumed (0), dropped (0)
+        {
+            for (auto &owner : owners)
+                owner.store (none);
+        }
+
+        ~ZoneRing ()
+        {
+            for (size_t i = 0; i < owners.size (); ++i)
+                if (owners[i].load () != none)
+                    clReleaseEvent (records[i].event);
+        }
+
+        ZoneRing (const ZoneRing&) = delete;
+        ZoneRing& operator= (const ZoneRing&) = delete;
+
+        /*! \brief Appends a record. It's called only by the thread of the ring.
+         *
+         *  \param[in] kind the kind of the record.
+         *  \param[in] name the name of the zone, for a `BEGIN`.
+         *  \param[in] event the device event, for an `EVENT`. It gets retained.
+         */
+        void push (ZoneRecordKind kind, const char *name, cl_event event)
+        {
+            uint64_t h = head.load (std::memory_order_relaxed);
+            size_t slot = h % records.size ();
+
+            // Announce the write, so that a concurrent reader of the slot discards it
+            reserved.store (h + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence (std::memory_order_release);
+
+            if (owners[slot].exchange (none, std::memory_order_acq_rel) != none)
+                clReleaseEvent (records[slot].event);
+
+            Record &r (records[slot]);
+            r.kind = kind;
+            r.name = name;
+            r.time = now ();
+            r.event = event;
+            if (event)
+            {
+                clRetainEvent (event);
+                owners[slot].store (h, std::memory_order_release);
+            }
+
+            head.store (h + 1, std::memory_order_release);
+        }
+
+        /*! \brief Returns the current time in nanoseconds. */
+        static uint64_t now ()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds> (
+                std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+        }
+
+    private:
+        friend class ZoneProfiler;
+
+        /*! \brief A record of a zone. */
+        struct Record
+        {
+            ZoneRecordKind kind;  /*!< The kind of the record. */
+            const char *name;  /*!< The name of the zone, for a `BEGIN`. */
+            uint64_t time;  /*!< The time of the record in nanoseconds. */
+            cl_event event;  /*!< The device event, for an `EVENT`. */
+        };
+
+        /*! \brief A zone that is open, as seen by the aggregator. */
+        struct Frame
+        {
+            unsigned int node;  /*!< The node of the zone in the call-tree. */
+            uint64_t start;  /*!< The time the zone opened. */
+            uint64_t children;  /*!< The inclusive time of the zone's children. */
+        };
+
+        /*! \brief Marks a slot without an event to take. */
+        static const uint64_t none = ~(uint64_t) 0;
+
+        std::vector<Record> records;  /*!< The records. */
+        /*! \brief The index of the record whose event is in each slot, or `none`. */
+        std::vector< std::atomic<uint64_t> > owners;
+        std::atomic<uint64_t> reserved;  /*!< One past the record being written. */
+        std::atomic<uint64_t> head;  /*!< One past the last record written. */
+
+        // State of the aggregator
+        uint64_t consumed;  /*!< One past the last record consumed. */
+        uint64_t dropped;  /*!< The number of records lost to overwrites. */
+        std::vector<Frame> stack;  /*!< The zones that are open. */
+    };
+
+
+    /*! \brief The statistics of a zone in the call-tree. Times are in ms. */
+    struct ZoneStats
+    {
+        std::string name;  /*!< The name of the zone. */
+        unsigned int depth;  /*!< The depth of the zone. Top-level zones are at depth 0. */
+        uint64_t calls;  /*!< The number of times the zone closed. */
+        double inclusive;  /*!< The time spent in the zone. */
+        double exclusive;  /*!< The time spent in the zone, but not in its children. */
+        double device;  /*!< The execution time of the device events attached to the zone. */
+        double queued;  /*!< The time the attached events waited before they started executing. */
+    };
+
+
+    /*! \brief Aggregates the zones of all threads into a call-tree.
+     *  \details Zones with the same path (names from the top-level zone down) 
+     *           are merged, across calls and threads. The inclusive time of a 
+     *           zone covers its children, and the exclusive time doesn't. 
+     *           Device events attached to a zone contribute their execution 
+     *           time, and the time they spent queued, so one report shows how 
+     *           the latency of a request splits between the host and the device.
+     *  \note Collecting takes a lock, but recording doesn't. The device 
+     *        events are waited for when they are collected, and their 
+     *        queues need `CL_QUEUE_PROFILING_ENABLE`.
+     */
+    class ZoneProfiler
+    {
+    public:
+        /*! \brief Returns the profiler of the process. */
+        static ZoneProfiler& instance ()
+        {
+            static ZoneProfiler profiler;
+            return profiler;
+        }
+
+        ZoneProfiler (const ZoneProfiler&) = delete;
+        ZoneProfiler& operator= (const ZoneProfiler&) = delete;
+
+        /*! \brief Returns the ring of the calling thread, creating it on first use. */
+        ZoneRing& ring ()
+        {
+            static thread_local ZoneRing *threadRing = nullptr;
+            if (!threadRing)
+            {
+                std::lock_guard<std::mutex> lock (mutex);
+                rings.emplace_back (new ZoneRing (ringCapacity));
+                threadRing = rings.back ().get ();
+            }
+
+            return *threadRing;
+        }
+
+        /*! \brief Sets the number of records in the rings created from now on. */
+        void setRingCapacity (size_t capacity)
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            ringCapacity = capacity;
+        }
+
+        /*! \brief Collects the records of all threads, and returns the 
+         *         statistics of the zones in the call-tree in preorder. */
+        std::vector<ZoneStats> stats ()
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            collect ();
+
+            std::vector<ZoneStats> result;
+            flatten (0, result);
+            return result;
+        }
+
+        /*! \brief Returns the number of records lost to full rings. */
+        uint64_t dropped ()
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            collect ();
+
+            uint64_t total = 0;
+            for (auto &r : rings)
+                total += r->dropped;
+            return total;
+        }
+
+        /*! \brief Discards the call-tree collected so far. 
+         *  \details Zones that are open keep their place in the new tree.
+         */
+        void reset ()
+        {
+            std::lock_guard<std::mutex> lock (mutex);
+            collect ();
+
+            for (auto &node : nodes)
+            {
+                node.calls = node.inclusive = node.exclusive = node.device = node.queued = 0;
+                node.pending.clear ();
+            }
+            for (auto &r : rings)
+                r->dropped = 0;
+        }
+
+        /*! \brief Displays the call-tree.
+         *
+         *  \param[in] title a title for the table of results.
+         */
+        void print (const char *title = nullptr)
+        {
+            std::vector<ZoneStats> zones (stats ());
+
+            std::ios::fmtflags f (std::cout.flags ());
+            std::cout << std::fixed << std::setprecision (3);
+
+            if (title)
+                std::cout << std::endl << " " << title << std::endl << std::endl;
+
+            std::cout << std::left << std::setw (32) << " Zone" << std::right 
+                      << std::setw (10) << "Calls" << std::setw (14) << "Inclusive" 
+                      << std::setw (14) << "Exclusive" << std::setw (14) << "Device" 
+                      << std::setw (14) << "Queued" << std::endl;
+            std::cout << " " << std::string (97, '-') << std::endl;
+
+            for (auto &z : zones)
+            {
+                std::string name (2 * z.depth, ' ');
+                name += z.name;
+                std::cout << " " << std::left << std::setw (31) << name << std::right 
+                          << std::setw (10) << z.calls 
+                          << std::setw (11) << z.inclusive << " ms" 
+                          << std::setw (11) << z.exclusive << " ms" 
+                          << std::setw (11) << z.device << " ms" 
+                          << std::setw (11) << z.queued << " ms" << std::endl;
+            }
+            std::cout << std::endl;
+
+            std::cout.flags (f);
+        }
+
+    private:
+        ZoneProfiler () : ringCapacity (1 << 16), nodes (1)
+        {
+        }
+
+        /*! \brief A zone in the call-tree. Times are in nanoseconds. */
+        struct Node
+        {
+            std::string name;  /*!< The name of the zone. */
+            unsigned int depth;  /*!< The depth of the zone. The root is at depth -1. */
+            std::vector<unsigned int> children;  /*!< The children, in the order they showed up. */
+            std::map<std::string, unsigned int> childIdx;  /*!< Maps names to children. */
+            uint64_t calls = 0;  /*!< The number of times the zone closed. */
+            uint64_t inclusive = 0;  /*!< The time spent in the zone. */
+            uint64_t exclusive = 0;  /*!< The time spent in the zone, but not in its children. */
+            uint64_t device = 0;  /*!< The execution time of the attached events. */
+            uint64_t queued = 0;  /*!< The time the attached events spent queued. */
+            std::vector<cl::Event> pending;  /*!< Attached events that haven't been accounted yet. */
+        };
+
+        /*! \brief Returns the child of a node with some name, creating it if needed. */
+        unsigned int child (unsigned int parent, const char *name)
+        {
+            auto it = nodes[parent].childIdx.find (name);
+            if (it != nodes[parent].childIdx.end ())
+                return it->second;
+
+            unsigned int idx = nodes.size ();
+            nodes.emplace_back ();
+            nodes[idx].name = name;
+            nodes[idx].depth = parent ? nodes[parent].depth + 1 : 0;
+            nodes[parent].children.push_back (idx);
+            nodes[parent].childIdx[name] = idx;
+
+            return idx;
+        }
+
+        /*! \brief Replays the new records of all rings into the call-tree. */
+        void collect ()
+        {
+            for (auto &r : rings)
+                collect (*r);
+
+            for (auto &node : nodes)
+            {
+                for (auto &event : node.pending)
+                {
+                    try
+                    {
+                        event.wait ();
+                        cl_ulong queued = event.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED> ();
+                        cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START> ();
+                        cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END> ();
+                        node.device += end - start;
+                        node.queued += start - queued;
+                    }
+                    catch (const cl::Error &)
+                    {
+                        // The queue doesn't profile, or the command failed
+                    }
+                }
+                node.pending.clear ();
+            }
+        }
+
+        /*! \brief Replays the new records of a ring into the call-tree. */
+        void collect (ZoneRing &ring)
+        {
+            size_t capacity = ring.records.size ();
+            uint64_t h = ring.head.load (std::memory_order_acquire);
+            if (h - ring.consumed > capacity)
+            {
+                ring.dropped += h - capacity - ring.consumed;
+                ring.consumed = h - capacity;
+            }
+
+            for (uint64_t i = ring.consumed; i < h; ++i)
+            {
+                size_t slot = i % capacity;
+                ZoneRing::Record r = ring.records[slot];
+                std::atomic_thread_fence (std::memory_order_acquire);
+                if (ring.reserved.load (std::memory_order_relaxed) > i + capacity)
+                {
+                    ++ring.dropped;  // Overwritten while it was being read
+                    continue;
+                }
+
+                if (r.kind == ZoneRecordKind::BEGIN)
+                {
+                    unsigned int parent = ring.stack.empty () ? 0 : ring.stack.back ().node;
+                    ring.stack.push_back ({ child (parent, r.name), r.time, 0 });
+                }
+                else if (r.kind == ZoneRecordKind::END)
+                {
+                    // The beginning might have been dropped
+                    if (ring.stack.empty ())
+                        continue;
+
+                    ZoneRing::Frame frame = ring.stack.back ();
+                    ring.stack.pop_back ();
+
+                    uint64_t inclusive = r.time - frame.start;
+                    Node &node (nodes[frame.node]);
+                    ++node.calls;
+                    node.inclusive += inclusive;
+                    node.exclusive += inclusive - std::min (inclusive, frame.children);
+                    if (!ring.stack.empty ())
+                        ring.stack.back ().children += inclusive;
+                }
+                else
+                {
+                    // The event is taken only if the producer hasn't reclaimed it
+                    uint64_t expected = i;
+                    if (!ring.owners[slot].compare_exchange_strong (expected, ZoneRing::none))
+                    {
+                        ++ring.dropped;
+                        continue;
+                    }
+
+                    unsigned int node = ring.stack.empty () ? 0 : ring.stack.back ().node;
+                    nodes[node].pending.push_back (cl::Event (r.event));  // Takes over the reference
+                }
+            }
+
+            ring.consumed = h;
+        }
+
+        /*! \brief Appends the statistics of the subtree of a node in preorder. */
+        void flatten (unsigned int idx, std::vector<ZoneStats> &result)
+        {
+            for (unsigned int c : nodes[idx].children)
+            {
+                const Node &n (nodes[c]);
+                result.push_back ({ n.name, n.depth, n.calls, n.inclusive * 1e-6, n.exclusive * 1e-6, 
+                                    n.device * 1e-6, n.queued * 1e-6 });
+                flatten (c, result);
+            }
+        }
+
+        std::mutex mutex;  /*!< Guards the list of rings and the call-tree. */
+        std::vector< std::unique_ptr<ZoneRing> > rings;  /*!< The rings of all threads. */
+        size_t ringCapacity;  /*!< The number of records in new rings. */
+        std::vector<Node> nodes;  /*!< The call-tree. Node 0 is the root. */
+    };
+
+
+#if defined(CLUTILS_ENABLE_ZONES)
+
+    /*! \brief A scoped profiling zone.
+     *  \details A zone records when it opens and closes in the ring of its 
+     *           thread, which costs two clock reads and no locks. Zones 
+     *           nest following the scopes. Device events attached to a zone 
+     *           get correlated with it in the report of `ZoneProfiler`.
+     *           
+     *           \code
+     *           void serve (Request &req)
+     *           {
+     *               CLUTILS_ZONE ("serve");
+     *               {
+     *                   clutils::Zone zone ("upload");
+     *                   cl::Event event;
+     *                   queue.enqueueWriteBuffer (dBuf, CL_FALSE, 0, size, req.data, nullptr, &event);
+     *                   zone.attach (event);
+     *               }
+     *               ...
+     *           }
+     *           
+     *           clutils::ZoneProfiler::instance ().print ("Requests");
+     *           \endcode
+     *  \note Zones are compiled in when `CLUTILS_ENABLE_ZONES` is defined. 
+     *        Otherwise, they do nothing and cost nothing.
+     *  \note The name has to outlive the profiler, e.g. a string literal.
+     */
+    class Zone
+    {
+    public:
+        /*! \param[in] name the name of the zone. */
+        explicit Zone (const char *name) : ring (ZoneProfiler::instance ().ring ())
+        {
+            ring.push (ZoneRecordKind::BEGIN, name, nullptr);
+        }
+
+        ~Zone ()
+        {
+            ring.push (ZoneRecordKind::END, nullptr, nullptr);
+        }
+
+        Zone (const Zone&) = delete;
+        Zone& operator= (const Zone&) = delete;
+
+        /*! \brief Attaches a device event to the zone. */
+        void attach (const cl::Event &event)
+        {
+            ring.push (ZoneRecordKind::EVENT, nullptr, event ());
+        }
+
+        /*! \brief Attaches the event of a `GPUTimer` to the zone. */
+        template <typename period>
+        void attach (GPUTimer<period> &timer)
+        {
+            attach (timer.event ());
+        }
+
+    private:
+        ZoneRing &ring;  /*!< The ring of the thread. */
+    };
+
+#else
+
+    /*! \brief A scoped profiling zone, compiled out. 
+     *         Define `CLUTILS_ENABLE_ZONES` to record zones. */
+    class Zone
+    {
+    public:
+        explicit Zone (const char *) {}
+        Zone (const Zone&) = delete;
+        Zone& operator= (const Zone&) = delete;
+        void attach (const cl::Event &) {}
+        template <typename period>
+        void attach (GPUTimer<period> &) {}
+    };
+
+#endif
+
+}
+
+#endif  // CLUTILS_ZONES_HPP
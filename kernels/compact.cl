@@ -0,0 +1,115 @@
+/*! \file compact.cl
+ *  \brief Kernels for stream compaction.
+ *  \author Nick Lamprianidis
+ *  \version 1.0
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+/*! \note The kernels expect the following define directives:
+ *        - T: the element type (e.g. int, float),
+ *        - PRED_LESS, PRED_LESS_EQUAL, PRED_GREATER, PRED_GREATER_EQUAL, 
+ *          PRED_EQUAL or PRED_NOT_EQUAL: the comparison of the elements with 
+ *          a value that selects them.
+ *        These are provided as command line arguments.
+ *  \note The positions of the selected elements are an exclusive scan 
+ *        (`Scan`) of the flags from `flagSelected`.
+ */
+
+#if defined(PRED_LESS)
+#define PRED(x) ((x) < value)
+#elif defined(PRED_LESS_EQUAL)
+#define PRED(x) ((x) <= value)
+#elif defined(PRED_GREATER)
+#define PRED(x) ((x) > value)
+#elif defined(PRED_GREATER_EQUAL)
+#define PRED(x) ((x) >= value)
+#elif defined(PRED_EQUAL)
+#define PRED(x) ((x) == value)
+#else
+#define PRED(x) ((x) != value)
+#endif
+
+
+/*! \brief Flags the selected elements.
+ *
+ *  \param[in] in input elements.
+ *  \param[in] inOffset offset (in elements) of the input in `in`.
+ *  \param[out] flags 1 for the selected elements, and 0 for the rest.
+ *  \param[in] n number of elements.
+ *  \param[in] value the value the elements are compared with.
+ */
+kernel
+void flagSelected (global const T *in, const uint inOffset, global uint *flags, 
+                   const uint n, const T value)
+{
+    in += inOffset;
+
+    uint i = get_global_id (0);
+    if (i < n)
+        flags[i] = PRED (in[i]) ? 1 : 0;
+}
+
+
+/*! \brief Moves the selected elements to the front of the output, in order. 
+ *         When partitioning, the rest of the elements follow, in order too.
+ *  \details The last work-item writes out the number of selected elements.
+ *
+ *  \param[in] in input elements.
+ *  \param[in] inOffset offset (in elements) of the input in `in`.
+ *  \param[out] out output elements.
+ *  \param[in] outOffset offset (in elements) of the output in `out`.
+ *  \param[in] positions exclusive scan of the flags.
+ *  \param[out] count the number of selected elements.
+ *  \param[in] countOffset offset (in elements) of the number in `count`.
+ *  \param[in] n number of elements.
+ *  \param[in] value the value the elements are compared with.
+ *  \param[in] partition whether to write out the elements that aren't selected.
+ */
+kernel
+void scatterSelected (global const T *in, const uint inOffset, 
+                      global T *out, const uint outOffset, 
+                      global const uint *positions, 
+                      global uint *count, const uint countOffset, 
+                      const uint n, const T value, const uint partition)
+{
+    in += inOffset;
+    out += outOffset;
+
+    uint i = get_global_id (0);
+    if (i >= n)
+        return;
+
+    uint total = positions[n - 1] + (PRED (in[n - 1]) ? 1 : 0);
+
+    T x = in[i];
+    uint p = positions[i];
+    if (PRED (x))
+        out[p] = x;
+    else if (partition)
+        out[total + i - p] = x;
+
+    if (i == n - 1)
+        count[countOffset] = total;
+}
@@ -0,0 +1,208 @@
+/*! \file gemm.cl
+ *  \brief Kernels for (batched) matrix multiplications.
+ *  \author Nick Lamprianidis
+ *  \version 1.0
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+/*! \note The kernels expect the following define directives:
+ *        - T: the element type (float or half),
+ *        - T_HALF: defined when the element type is half,
+ *        - TILE_M, TILE_N, TILE_K: the tile of `C` a work-group computes (TILE_M x TILE_N), 
+ *          and the depth of the tiles of `A` and `B` it loads in local memory per step,
+ *        - WPT_M, WPT_N: the outputs per work-item in each dimension, which are kept in registers.
+ *        These are provided as command line arguments.
+ *  \note The matrices are in row-major order. The products are accumulated in float.
+ *        Half elements are accessed with vload_half/vstore_half, 
+ *        so the devices don't need the cl_khr_fp16 extension.
+ */
+
+#if defined(T_HALF)
+#define LOAD(p, i) vload_half ((i), (p))
+#define STORE(v, i, p) vstore_half ((v), (i), (p))
+#else
+#define LOAD(p, i) (p)[i]
+#define STORE(v, i, p) (p)[i] = (v)
+#endif
+
+/*! \brief The work-group size. */
+#define WG_X (TILE_N / WPT_N)
+#define WG_Y (TILE_M / WPT_M)
+
+
+/*! \brief Writes an element of `C`, `C = alpha * AB + beta * C`.
+ *  \details `C` isn't read when `beta` is 0, so it doesn't need to be initialized.
+ */
+inline void storeC (global T *C, uint idx, float ab, float alpha, float beta)
+{
+    float c = alpha * ab;
+    if (beta != 0.f)
+        c += beta * LOAD (C, idx);
+    STORE (c, idx, C);
+}
+
+
+/*! \brief Computes `C = alpha * A * B + beta * C`, for a batch of matrices.
+ *  \details Every work-group computes a TILE_M x TILE_N tile of `C`. It steps 
+ *           over `K` by TILE_K, loading TILE_M x TILE_K elements of `A` and 
+ *           TILE_K x TILE_N elements of `B` in local memory. Every work-item 
+ *           accumulates WPT_M x WPT_N outputs in registers, strided by the 
+ *           work-group size, so that neighboring work-items access neighboring 
+ *           elements. The elements outside of the matrices are read as 0.
+ *  \note The global workspace should be (ceil (N / TILE_N) * WG_X, 
+ *        ceil (M / TILE_M) * WG_Y, batch), and the local workspace (WG_X, WG_Y, 1).
+ *        The matrices of a batch are contiguous.
+ *
+ *  \param[in] A the M x K matrices.
+ *  \param[in] aOffset offset (in elements) of the first matrix in `A`.
+ *  \param[in] B the K x N matrices.
+ *  \param[in] bOffset offset (in elements) of the first matrix in `B`.
+ *  \param[in,out] C the M x N matrices.
+ *  \param[in] cOffset offset (in elements) of the first matrix in `C`.
+ *  \param[in] M the rows of `A` and `C`.
+ *  \param[in] N the columns of `B` and `C`.
+ *  \param[in] K the columns of `A` and rows of `B`.
+ *  \param[in] alpha the factor of the product.
+ *  \param[in] beta the factor of `C`.
+ */
+kernel
+void gemm (global const T *A, const uint aOffset, 
+           global const T *B, const uint bOffset, 
+           global T *C, const uint cOffset, 
+           const uint M, const uint N, const uint K, 
+           const float alpha, const float beta)
+{
+    // A is stored transposed, and padded, so that storing a row 
+    // of A and reading a column of it are both free of bank conflicts
+    local float As[TILE_K][TILE_M + 1];
+    local float Bs[TILE_K][TILE_N];
+
+    uint b = get_global_id (2);
+    A += aOffset + b * M * K;
+    B += bOffset + b * K * N;
+    C += cOffset + b * M * N;
+
+    uint lx = get_local_id (0), ly = get_local_id (1);
+    uint tid = ly * WG_X + lx;
+    uint m0 = get_group_id (1) * TILE_M;
+    uint n0 = get_group_id (0) * TILE_N;
+
+    float acc[WPT_M][WPT_N];
+    #pragma unroll
+    for (uint wm = 0; wm < WPT_M; ++wm)
+        #pragma unroll
+        for (uint wn = 0; wn < WPT_N; ++wn)
+            acc[wm][wn] = 0.f;
+
+    for (uint k0 = 0; k0 < K; k0 += TILE_K)
+    {
+        for (uint i = tid; i < TILE_M * TILE_K; i += WG_X * WG_Y)
+        {
+            uint r = i / TILE_K, c = i % TILE_K;
+            As[c][r] = (m0 + r < M && k0 + c < K) ? LOAD (A, (m0 + r) * K + k0 + c) : 0.f;
+        }
+        for (uint i = tid; i < TILE_K * TILE_N; i += WG_X * WG_Y)
+        {
+            uint r = i / TILE_N, c = i % TILE_N;
+            Bs[r][c] = (k0 + r < K && n0 + c < N) ? LOAD (B, (k0 + r) * N + n0 + c) : 0.f;
+        }
+
+        barrier (CLK_LOCAL_MEM_FENCE);
+
+        #pragma unroll
+        for (uint k = 0; k < TILE_K; ++k)
+        {
+            float a[WPT_M], bv[WPT_N];
+            #pragma unroll
+            for (uint wm = 0; wm < WPT_M; ++wm)
+                a[wm] = As[k][ly + wm * WG_Y];
+            #pragma unroll
+            for (uint wn = 0; wn < WPT_N; ++wn)
+                bv[wn] = Bs[k][lx + wn * WG_X];
+
+            #pragma unroll
+            for (uint wm = 0; wm < WPT_M; ++wm)
+                #pragma unroll
+                for (uint wn = 0; wn < WPT_N; ++wn)
+                    acc[wm][wn] = mad (a[wm], bv[wn], acc[wm][wn]);
+        }
+
+        barrier (CLK_LOCAL_MEM_FENCE);
+    }
+
+    #pragma unroll
+    for (uint wm = 0; wm < WPT_M; ++wm)
+    {
+        uint m = m0 + ly + wm * WG_Y;
+        #pragma unroll
+        for (uint wn = 0; wn < WPT_N; ++wn)
+        {
+            uint n = n0 + lx + wn * WG_X;
+            if (m < M && n < N)
+                storeC (C, m * N + n, acc[wm][wn], alpha, beta);
+        }
+    }
+}
+
+
+/*! \brief Computes `C = alpha * A * B + beta * C`, for a batch of matrices, 
+ *         reading the matrices straight from global memory.
+ *  \details It's the baseline of the tiled kernel. Every work-item computes an element of `C`.
+ *  \note The global workspace should cover (N, M, batch).
+ *
+ *  \param[in] A the M x K matrices.
+ *  \param[in] aOffset offset (in elements) of the first matrix in `A`.
+ *  \param[in] B the K x N matrices.
+ *  \param[in] bOffset offset (in elements) of the first matrix in `B`.
+ *  \param[in,out] C the M x N matrices.
+ *  \param[in] cOffset offset (in elements) of the first matrix in `C`.
+ *  \param[in] M the rows of `A` and `C`.
+ *  \param[in] N the columns of `B` and `C`.
+ *  \param[in] K the columns of `A` and rows of `B`.
+ *  \param[in] alpha the factor of the product.
+ *  \param[in] beta the factor of `C`.
+ */
+kernel
+void gemmNaive (global const T *A, const uint aOffset, 
+                global const T *B, const uint bOffset, 
+                global T *C, const uint cOffset, 
+                const uint M, const uint N, const uint K, 
+                const float alpha, const float beta)
+{
+    uint b = get_global_id (2);
+    A += aOffset + b * M * K;
+    B += bOffset + b * K * N;
+    C += cOffset + b * M * N;
+
+    uint n = get_global_id (0), m = get_global_id (1);
+    if (m >= M || n >= N)
+        return;
+
+    float acc = 0.f;
+    for (uint k = 0; k < K; ++k)
+        acc = mad (LOAD (A, m * K + k), LOAD (B, k * N + n), acc);
+
+    storeC (C, m * N + n, acc, alpha, beta);
+}
@@ -0,0 +1,159 @@
+/*! \file histogram.cl
+ *  \brief Kernels for histograms, privatized in local memory.
+ *  \author Nick Lamprianidis
+ *  \version 1.0
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+/*! \note The kernels expect the following define directives:
+ *        - T: the element type (int, uint, float),
+ *        - T_FLOAT: defined when the element type is float,
+ *        - N_BINS: the number of bins,
+ *        - REPLICAS: the number of copies of the histogram in local memory 
+ *          per work-group, to spread the atomics on a popular bin (power of 2), 
+ *          or 0 when the histogram doesn't fit in local memory,
+ *        - WG_SIZE: the work-group size.
+ *        These are provided as command line arguments.
+ *  \note The bins split [lo, hi) evenly. The elements outside of it are ignored.
+ */
+
+/*! \brief Maps an element to its bin, or to N_BINS when it's outside of [lo, hi). */
+#if defined(T_FLOAT)
+#define BIN(x) ((x) >= lo && (x) < hi ? min ((uint) (((x) - lo) * scale), (uint) N_BINS - 1) : N_BINS)
+#else
+#define BIN(x) ((x) >= lo && (x) < hi ? \
+    (uint) (((ulong) ((long) (x) - (long) lo) * N_BINS) / (ulong) ((long) hi - (long) lo)) : N_BINS)
+#endif
+
+
+#if REPLICAS > 0
+
+/*! \brief Computes a histogram for every work-group, in local memory.
+ *  \details Every work-item updates the copy `lid % REPLICAS` of the histogram, 
+ *           and the copies are interleaved, so that neighboring work-items 
+ *           hitting the same bin use different memory banks. The copies are 
+ *           summed when the work-group writes out its histogram.
+ *
+ *  \param[in] in input elements.
+ *  \param[in] inOffset offset (in elements) of the input in `in`.
+ *  \param[out] partial the histograms of the work-groups, `N_BINS * get_num_groups (0)` elements.
+ *  \param[in] n number of elements.
+ *  \param[in] lo the lower bound of the first bin.
+ *  \param[in] hi the upper bound (exclusive) of the last bin.
+ *  \param[in] scale the number of bins per unit, `N_BINS / (hi - lo)` (T_FLOAT only).
+ */
+kernel
+void histogramLocal (global const T *in, const uint inOffset, global uint *partial, 
+                     const uint n, const T lo, const T hi, const float scale)
+{
+    local uint hist[REPLICAS * N_BINS];
+
+    in += inOffset;
+    uint lid = get_local_id (0);
+
+    for (uint b = lid; b < REPLICAS * N_BINS; b += WG_SIZE)
+        hist[b] = 0;
+
+    barrier (CLK_LOCAL_MEM_FENCE);
+
+    uint r = lid % REPLICAS;
+    for (uint i = get_global_id (0); i < n; i += get_global_size (0))
+    {
+        uint bin = BIN (in[i]);
+        if (bin < N_BINS)
+            atomic_inc (&hist[bin * REPLICAS + r]);
+    }
+
+    barrier (CLK_LOCAL_MEM_FENCE);
+
+    partial += get_group_id (0) * N_BINS;
+    for (uint b = lid; b < N_BINS; b += WG_SIZE)
+    {
+        uint count = 0;
+        for (uint c = 0; c < REPLICAS; ++c)
+            count += hist[b * REPLICAS + c];
+        partial[b] = count;
+    }
+}
+
+#endif  // REPLICAS > 0
+
+
+/*! \brief Computes a histogram for every work-group, in global memory.
+ *  \details It's the fallback for histograms that don't fit in local memory.
+ *
+ *  \param[in] in input elements.
+ *  \param[in] inOffset offset (in elements) of the input in `in`.
+ *  \param[out] partial the histograms of the work-groups, `N_BINS * get_num_groups (0)` elements.
+ *  \param[in] n number of elements.
+ *  \param[in] lo the lower bound of the first bin.
+ *  \param[in] hi the upper bound (exclusive) of the last bin.
+ *  \param[in] scale the number of bins per unit, `N_BINS / (hi - lo)` (T_FLOAT only).
+ */
+kernel
+void histogramGlobal (global const T *in, const uint inOffset, global uint *partial, 
+                      const uint n, const T lo, const T hi, const float scale)
+{
+    in += inOffset;
+    partial += get_group_id (0) * N_BINS;
+    uint lid = get_local_id (0);
+
+    for (uint b = lid; b < N_BINS; b += WG_SIZE)
+        partial[b] = 0;
+
+    barrier (CLK_GLOBAL_MEM_FENCE);
+
+    for (uint i = get_global_id (0); i < n; i += get_global_size (0))
+    {
+        uint bin = BIN (in[i]);
+        if (bin < N_BINS)
+            atomic_inc (&partial[bin]);
+    }
+}
+
+
+/*! \brief Sums the histograms of the work-groups.
+ *  \note The global workspace should cover N_BINS.
+ *
+ *  \param[in] partial the histograms of the work-groups.
+ *  \param[in] nGroups the number of histograms in `partial`.
+ *  \param[out] counts the histogram.
+ *  \param[in] countsOffset offset (in elements) of the histogram in `counts`.
+ */
+kernel
+void mergeHistograms (global const uint *partial, const uint nGroups, 
+                      global uint *counts, const uint countsOffset)
+{
+    counts += countsOffset;
+
+    uint b = get_global_id (0);
+    if (b >= N_BINS)
+        return;
+
+    uint count = 0;
+    for (uint g = 0; g < nGroups; ++g)
+        count += partial[g * N_BINS + b];
+    counts[b] = count;
+}
@@ -1,5 +1,5 @@
 /*! \file kernels.cl
- *  \brief It contains a kernel that performs a vector addition.
+ *  \brief It contains kernels that perform a vector addition.
  *  \author Nick Lamprianidis
  *  \version 1.0
  *  \date 2014-2015
@@ -27,6 +27,9 @@
  */
 
 
+#include "vector.h"
+
+
 /*! \brief It performs a vector addition.
  *  \param[in] A first operand (buffer) to the vector addition.
  *  \param[in] B second operand (buffer) to the vector addition.
@@ -38,3 +41,61 @@ void vecAdd (global int *A, global int *B, global int *C)
     size_t idx = get_global_id (0);
     C[idx] = A[idx] + B[idx];
 }
+
+
+/*! \brief It performs a vector addition on the first `n` elements.
+ *  \details The global workspace can be larger than `n`, e.g. when 
+ *           it's rounded up to a multiple of the work-group size.
+ *  \param[in] A first operand (buffer) to the vector addition.
+ *  \param[in] B second operand (buffer) to the vector addition.
+ *  \param[out] C holds the result (buffer) of the vector addition.
+ *  \param[in] n number of elements in the buffers.
+ */
+kernel
+void vecAddN (global int *A, global int *B, global int *C, const uint n)
+{
+    uint idx = get_global_id (0);
+    if (idx < n)
+        C[idx] = A[idx] + B[idx];
+}
+
+
+/*! \brief It performs a vector addition with `VEC_WIDTH` elements per work-item.
+ *  \details The global workspace should cover `ceil (n / VEC_WIDTH)` work-items. 
+ *           The work-item at the tail handles the remaining elements one by one.
+ *  \param[in] A first operand (buffer) to the vector addition.
+ *  \param[in] B second operand (buffer) to the vector addition.
+ *  \param[out] C holds the result (buffer) of the vector addition.
+ *  \param[in] n number of elements in the buffers.
+ */
+kernel
+void vecAddVec (global int *A, global int *B, global int *C, const uint n)
+{
+    uint idx = get_global_id (0);
+    uint base = idx * VEC_WIDTH;
+
+    if (base + VEC_WIDTH <= n)
+    {
+        INTN a = VLOAD (idx, A);
+        INTN b = VLOAD (idx, B);
+        VSTORE (a + b, idx, C);
+    }
+    else
+    {
+        for (uint i = base; i < n; ++i)
+            C[i] = A[i] + B[i];
+    }
+}
+
+
+/*! \brief It increments every channel of a surface of 3-channel 8-bit pixels.
+ *  \details The global workspace should be the width and the height of the surface.
+ *  \param[in,out] S the pitched buffer of the surface (`Surface2D`).
+ *  \param[in] pitch the row pitch of the buffer in pixels.
+ */
+kernel
+void incrementRGB8 (global uchar *S, const uint pitch)
+{
+    size_t idx = get_global_id (1) * pitch + get_global_id (0);
+    vstore3 (vload3 (idx, S) + (uchar3) (1), idx, S);
+}
@@ -1,5 +1,5 @@
 /*! \file kernels2.cl
- *  \brief It contains a kernel for buffer initialization.
+ *  \brief It contains kernels for buffer initialization.
  *  \author Nick Lamprianidis
  *  \version 1.0
  *  \date 2014-2015
@@ -27,6 +27,9 @@
  */
 
 
+#include "vector.h"
+
+
 /*! \brief It initializes a buffer.
  *  \note The kernel expects a define directive (INIT_NUM).
  *        This is provided as a command line argument.
@@ -38,3 +41,25 @@ void initRand (global int *A)
     size_t idx = get_global_id (0);
     A[idx] = INIT_NUM;
 }
+
+
+/*! \brief It initializes a buffer with `VEC_WIDTH` elements per work-item.
+ *  \note The kernel expects a define directive (INIT_NUM).
+ *        This is provided as a command line argument.
+ *  \details The global workspace should cover `ceil (n / VEC_WIDTH)` work-items. 
+ *           The work-item at the tail handles the remaining elements one by one.
+ *  \param[in] A a buffer to initialize.
+ *  \param[in] n number of elements in the buffer.
+ */
+kernel
+void initRandVec (global int *A, const uint n)
+{
+    uint idx = get_global_id (0);
+    uint base = idx * VEC_WIDTH;
+
+    if (base + VEC_WIDTH <= n)
+        VSTORE ((INTN) (INIT_NUM), idx, A);
+    else
+        for (uint i = base; i < n; ++i)
+            A[i] = INIT_NUM;
+}
@@ -0,0 +1,144 @@
+/*! \file radixSort.cl
+ *  \brief Kernels for an LSD radix sort (histogram, scatter).
+ *  \author Nick Lamprianidis
+ *  \version 1.0
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+/*! \note The kernels expect the following define directives:
+ *        - K: the key type (int, uint, long, ulong),
+ *        - UK: the unsigned type of the same size as K,
+ *        - KEY_BITS: the number of bits in a key,
+ *        - SIGNED_KEYS: if the keys are signed,
+ *        - V: the value type, if there are values (HAS_VALUES).
+ *        These are provided as command line arguments.
+ *  \note Every work-item sorts a contiguous chunk of the input. The 
+ *        digit counts are laid out digit-major, `counts[d * nItems + t]`, 
+ *        so that an exclusive scan over them gives every work-item the 
+ *        position of its first element with digit `d` in the output, 
+ *        and the sort is stable.
+ */
+
+/*! \brief Number of bits in a digit. */
+#define RADIX_BITS 4
+/*! \brief Number of buckets. */
+#define RADIX (1 << RADIX_BITS)
+#define RADIX_MASK (RADIX - 1)
+
+#ifdef SIGNED_KEYS
+#define SIGN_MASK ((UK) 1 << (KEY_BITS - 1))
+#else
+#define SIGN_MASK ((UK) 0)
+#endif
+
+/*! \brief Extracts a digit from a key. Flipping the sign bit 
+ *         puts negative keys before positive ones. */
+#define DIGIT(key, shift) (uint) ((((UK) (key) ^ SIGN_MASK) >> (shift)) & RADIX_MASK)
+
+
+/*! \brief Counts the digits in every work-item's chunk.
+ *
+ *  \param[in] keys input keys.
+ *  \param[in] keysOffset offset (in elements) of the keys in `keys`.
+ *  \param[out] counts digit counts, `RADIX * get_global_size (0)` elements.
+ *  \param[in] n number of keys.
+ *  \param[in] chunk number of keys per work-item.
+ *  \param[in] shift position of the digit in the key.
+ */
+kernel
+void histogram (global const K *keys, const uint keysOffset, global uint *counts, 
+                const uint n, const uint chunk, const uint shift)
+{
+    keys += keysOffset;
+
+    uint gid = get_global_id (0);
+    uint nItems = get_global_size (0);
+
+    uint cnt[RADIX];
+    for (uint d = 0; d < RADIX; ++d)
+        cnt[d] = 0;
+
+    uint begin = gid * chunk;
+    uint end = min (begin + chunk, n);
+    for (uint i = begin; i < end; ++i)
+        cnt[DIGIT (keys[i], shift)]++;
+
+    for (uint d = 0; d < RADIX; ++d)
+        counts[d * nItems + gid] = cnt[d];
+}
+
+
+/*! \brief Moves the keys (and values) of every 
+ *         work-item's chunk to their sorted positions.
+ *
+ *  \param[in] keysIn input keys.
+ *  \param[in] keysInOffset offset (in elements) of the keys in `keysIn`.
+ *  \param[out] keysOut output keys.
+ *  \param[in] keysOutOffset offset (in elements) of the keys in `keysOut`.
+ *  \param[in] valuesIn input values (if HAS_VALUES).
+ *  \param[in] valuesInOffset offset (in elements) of the values in `valuesIn`.
+ *  \param[out] valuesOut output values (if HAS_VALUES).
+ *  \param[in] valuesOutOffset offset (in elements) of the values in `valuesOut`.
+ *  \param[in] offsets exclusive scan of the digit counts.
+ *  \param[in] n number of keys.
+ *  \param[in] chunk number of keys per work-item.
+ *  \param[in] shift position of the digit in the key.
+ */
+kernel
+void scatter (global const K *keysIn, const uint keysInOffset, 
+              global K *keysOut, const uint keysOutOffset, 
+#ifdef HAS_VALUES
+              global const V *valuesIn, const uint valuesInOffset, 
+              global V *valuesOut, const uint valuesOutOffset, 
+#endif
+              global const uint *offsets, 
+              const uint n, const uint chunk, const uint shift)
+{
+    keysIn += keysInOffset;
+    keysOut += keysOutOffset;
+#ifdef HAS_VALUES
+    valuesIn += valuesInOffset;
+    valuesOut += valuesOutOffset;
+#endif
+
+    uint gid = get_global_id (0);
+    uint nItems = get_global_size (0);
+
+    uint pos[RADIX];
+    for (uint d = 0; d < RADIX; ++d)
+        pos[d] = offsets[d * nItems + gid];
+
+    uint begin = gid * chunk;
+    uint end = min (begin + chunk, n);
+    for (uint i = begin; i < end; ++i)
+    {
+        K key = keysIn[i];
+        uint p = pos[DIGIT (key, shift)]++;
+        keysOut[p] = key;
+#ifdef HAS_VALUES
+        valuesOut[p] = valuesIn[i];
+#endif
+    }
+}
@@ -0,0 +1,92 @@
+/*! \file reduce.cl
+ *  \brief Kernels for parallel reductions.
+ *  \author Nick Lamprianidis
+ *  \version 1.0
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+/*! \note The kernels expect the following define directives:
+ *        - T: the element type (e.g. int, float),
+ *        - T_MIN, T_MAX: the limits of the element type,
+ *        - OP_SUM, OP_MIN or OP_MAX: the reduction operator,
+ *        - WG_SIZE: the work-group size (power of 2).
+ *        These are provided as command line arguments.
+ */
+
+#if defined(OP_MIN)
+#define OP(a, b) min (a, b)
+#define IDENTITY T_MAX
+#elif defined(OP_MAX)
+#define OP(a, b) max (a, b)
+#define IDENTITY T_MIN
+#else
+#define OP(a, b) ((a) + (b))
+#define IDENTITY ((T) 0)
+#endif
+
+
+/*! \brief Performs a reduction on a buffer.
+ *  \details Every work-item accumulates a grid-strided sequence of elements, 
+ *           and then the work-group reduces the work-items' results in 
+ *           local memory. Launched with a single work-group, it 
+ *           reduces the partial results of a previous launch.
+ *  \note The global workspace should be a multiple of WG_SIZE.
+ *
+ *  \param[in] in input buffer.
+ *  \param[in] inOffset offset (in elements) of the input in `in`.
+ *  \param[out] out output buffer. It receives one element per work-group.
+ *  \param[in] outOffset offset (in elements) of the output in `out`.
+ *  \param[in] n number of elements in the input.
+ */
+kernel
+void reduce (global const T *in, const uint inOffset, 
+             global T *out, const uint outOffset, const uint n)
+{
+    local T data[WG_SIZE];
+
+    in += inOffset;
+    out += outOffset;
+
+    uint lid = get_local_id (0);
+    uint gid = get_global_id (0);
+    uint gsize = get_global_size (0);
+
+    T acc = IDENTITY;
+    for (uint i = gid; i < n; i += gsize)
+        acc = OP (acc, in[i]);
+
+    data[lid] = acc;
+    barrier (CLK_LOCAL_MEM_FENCE);
+
+    for (uint s = WG_SIZE >> 1; s > 0; s >>= 1)
+    {
+        if (lid < s)
+            data[lid] = OP (data[lid], data[lid + s]);
+        barrier (CLK_LOCAL_MEM_FENCE);
+    }
+
+    if (lid == 0)
+        out[get_group_id (0)] = data[0];
+}
@@ -0,0 +1,158 @@
+/*! \file scan.cl
+ *  \brief Kernels for multi-pass prefix scans.
+ *  \author Nick Lamprianidis
+ *  \version 1.0
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+/*! \note The kernels expect the following define directives:
+ *        - T: the element type (e.g. int, float),
+ *        - T_MIN, T_MAX: the limits of the element type,
+ *        - OP_SUM, OP_MIN or OP_MAX: the scan operator,
+ *        - WG_SIZE: the work-group size (power of 2).
+ *        These are provided as command line arguments.
+ */
+
+#if defined(OP_MIN)
+#define OP(a, b) min (a, b)
+#define IDENTITY T_MAX
+#elif defined(OP_MAX)
+#define OP(a, b) max (a, b)
+#define IDENTITY T_MIN
+#else
+#define OP(a, b) ((a) + (b))
+#define IDENTITY ((T) 0)
+#endif
+
+/*! \brief Number of elements processed by a work-item. */
+#define ITEMS 4
+/*! \brief Number of elements processed by a work-group. */
+#define BLOCK_SIZE (ITEMS * WG_SIZE)
+
+
+/*! \brief Scans blocks of BLOCK_SIZE elements.
+ *  \details The block is loaded (coalesced) into local memory. Every 
+ *           work-item scans ITEMS consecutive elements sequentially, 
+ *           the work-items' totals are scanned in local memory, and the 
+ *           results are combined and written back (coalesced).
+ *  \note `in` and `out` may refer to the same buffer.
+ *
+ *  \param[in] in input buffer.
+ *  \param[in] inOffset offset (in elements) of the input in `in`.
+ *  \param[out] out output buffer.
+ *  \param[in] outOffset offset (in elements) of the output in `out`.
+ *  \param[out] sums receives the total of every block.
+ *  \param[in] n number of elements in the input.
+ *  \param[in] inclusive 1 for an inclusive scan, 0 for an exclusive scan.
+ */
+kernel
+void scanBlocks (global const T *in, const uint inOffset, 
+                 global T *out, const uint outOffset, 
+                 global T *sums, const uint n, const uint inclusive)
+{
+    local T tile[BLOCK_SIZE];
+    local T data[WG_SIZE];
+
+    in += inOffset;
+    out += outOffset;
+
+    uint lid = get_local_id (0);
+    uint offset = get_group_id (0) * BLOCK_SIZE;
+
+    for (uint k = 0; k < ITEMS; ++k)
+    {
+        uint i = offset + k * WG_SIZE + lid;
+        tile[k * WG_SIZE + lid] = (i < n) ? in[i] : IDENTITY;
+    }
+    barrier (CLK_LOCAL_MEM_FENCE);
+
+    // Inclusive scan of the work-item's elements
+    local T *items = tile + lid * ITEMS;
+    T acc = IDENTITY;
+    for (uint k = 0; k < ITEMS; ++k)
+    {
+        acc = OP (acc, items[k]);
+        items[k] = acc;
+    }
+
+    // Inclusive scan of the work-items' totals (Hillis-Steele)
+    data[lid] = acc;
+    barrier (CLK_LOCAL_MEM_FENCE);
+
+    for (uint s = 1; s < WG_SIZE; s <<= 1)
+    {
+        T v = (lid >= s) ? data[lid - s] : IDENTITY;
+        barrier (CLK_LOCAL_MEM_FENCE);
+        data[lid] = OP (v, data[lid]);
+        barrier (CLK_LOCAL_MEM_FENCE);
+    }
+
+    // Combine with the totals of the preceding work-items
+    T prefix = (lid > 0) ? data[lid - 1] : IDENTITY;
+    for (int k = ITEMS - 1; k >= 0; --k)
+    {
+        if (inclusive)
+            items[k] = OP (prefix, items[k]);
+        else
+            items[k] = (k > 0) ? OP (prefix, items[k - 1]) : prefix;
+    }
+    barrier (CLK_LOCAL_MEM_FENCE);
+
+    for (uint k = 0; k < ITEMS; ++k)
+    {
+        uint i = offset + k * WG_SIZE + lid;
+        if (i < n)
+            out[i] = tile[k * WG_SIZE + lid];
+    }
+
+    if (lid == 0)
+        sums[get_group_id (0)] = data[WG_SIZE - 1];
+}
+
+
+/*! \brief Combines the blocks of a scan with the scanned block totals.
+ *
+ *  \param[in,out] out buffer with the scanned blocks.
+ *  \param[in] outOffset offset (in elements) of the scanned blocks in `out`.
+ *  \param[in] offsets the exclusive scan of the block totals.
+ *  \param[in] n number of elements in the scanned blocks.
+ */
+kernel
+void addOffsets (global T *out, const uint outOffset, 
+                 global const T *offsets, const uint n)
+{
+    out += outOffset;
+
+    uint lid = get_local_id (0);
+    uint offset = get_group_id (0) * BLOCK_SIZE;
+    T prefix = offsets[get_group_id (0)];
+
+    for (uint k = 0; k < ITEMS; ++k)
+    {
+        uint i = offset + k * WG_SIZE + lid;
+        if (i < n)
+            out[i] = OP (prefix, out[i]);
+    }
+}
@@ -0,0 +1,251 @@
+/*! \file stencil.cl
+ *  \brief Kernels for 2D convolutions and stencils, tiled in local memory.
+ *  \author Nick Lamprianidis
+ *  \version 1.0
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+/*! \note The kernels expect the following define directives:
+ *        - T: the element type (e.g. float),
+ *        - RADIUS: the radius of the filter, which spans 2 * RADIUS + 1 elements per dimension,
+ *        - TILED: enables the tiled kernels, when their tiles fit in local memory,
+ *        - TILE_X, TILE_Y: the work-group size, and the outputs of a tile (with TILED),
+ *        - BORDER_CLAMP or BORDER_ZERO: how the elements outside the image are read.
+ *        These are provided as command line arguments. Without TILED, only 
+ *        `convolveNaive` is built, so that the static local arrays of the 
+ *        tiled kernels don't fail the build of the program.
+ *  \note The filters are applied as correlations (they aren't flipped), 
+ *        and their weights are in row-major order.
+ */
+
+#define DIAMETER (2 * RADIUS + 1)
+
+
+/*! \brief Reads an element of the image, handling the elements outside of it. */
+inline T fetch (global const T *in, int x, int y, int width, int height)
+{
+#if defined(BORDER_ZERO)
+    return (x >= 0 && x < width && y >= 0 && y < height) ? in[y * width + x] : (T) 0;
+#else
+    return in[clamp (y, 0, height - 1) * width + clamp (x, 0, width - 1)];
+#endif
+}
+
+
+#if defined(TILED)
+
+/*! \brief Convolves an image with a 2D filter.
+ *  \details A work-group loads a tile of the image, along with a halo 
+ *           of RADIUS elements around it, in local memory, and every 
+ *           work-item computes an output from the tile.
+ *  \note The global workspace should be the image size, rounded up to 
+ *        multiples of TILE_X and TILE_Y, and the local workspace should 
+ *        be TILE_X x TILE_Y.
+ *
+ *  \param[in] in input image.
+ *  \param[in] inOffset offset (in elements) of the input in `in`.
+ *  \param[out] out output image.
+ *  \param[in] outOffset offset (in elements) of the output in `out`.
+ *  \param[in] filter the DIAMETER x DIAMETER weights.
+ *  \param[in] filterOffset offset (in elements) of the weights in `filter`.
+ *  \param[in] width the width of the images.
+ *  \param[in] height the height of the images.
+ */
+kernel
+void convolve2D (global const T *in, const uint inOffset, 
+                 global T *out, const uint outOffset, 
+                 constant T *filter, const uint filterOffset, 
+                 const int width, const int height)
+{
+    local T tile[TILE_Y + 2 * RADIUS][TILE_X + 2 * RADIUS];
+
+    in += inOffset;
+    out += outOffset;
+    filter += filterOffset;
+
+    int lx = get_local_id (0), ly = get_local_id (1);
+    int x0 = get_group_id (0) * TILE_X - RADIUS;
+    int y0 = get_group_id (1) * TILE_Y - RADIUS;
+
+    for (int y = ly; y < TILE_Y + 2 * RADIUS; y += TILE_Y)
+        for (int x = lx; x < TILE_X + 2 * RADIUS; x += TILE_X)
+            tile[y][x] = fetch (in, x0 + x, y0 + y, width, height);
+
+    barrier (CLK_LOCAL_MEM_FENCE);
+
+    int gx = get_global_id (0), gy = get_global_id (1);
+    if (gx >= width || gy >= height)
+        return;
+
+    T acc = (T) 0;
+    #pragma unroll
+    for (int j = 0; j < DIAMETER; ++j)
+        #pragma unroll
+        for (int i = 0; i < DIAMETER; ++i)
+            acc += filter[j * DIAMETER + i] * tile[ly + j][lx + i];
+
+    out[gy * width + gx] = acc;
+}
+
+
+/*! \brief Convolves the rows of an image with a 1D filter, 
+ *         the first pass of a separable convolution.
+ *  \details A work-group loads TILE_Y rows of TILE_X elements, 
+ *           with a halo of RADIUS elements on either side.
+ *  \note The global workspace should be the image size, rounded up to 
+ *        multiples of TILE_X and TILE_Y, and the local workspace should 
+ *        be TILE_X x TILE_Y.
+ *
+ *  \param[in] in input image.
+ *  \param[in] inOffset offset (in elements) of the input in `in`.
+ *  \param[out] out output image.
+ *  \param[in] outOffset offset (in elements) of the output in `out`.
+ *  \param[in] filter the DIAMETER weights.
+ *  \param[in] filterOffset offset (in elements) of the weights in `filter`.
+ *  \param[in] width the width of the images.
+ *  \param[in] height the height of the images.
+ */
+kernel
+void convolveRows (global const T *in, const uint inOffset, 
+                   global T *out, const uint outOffset, 
+                   constant T *filter, const uint filterOffset, 
+                   const int width, const int height)
+{
+    local T tile[TILE_Y][TILE_X + 2 * RADIUS];
+
+    in += inOffset;
+    out += outOffset;
+    filter += filterOffset;
+
+    int lx = get_local_id (0), ly = get_local_id (1);
+    int x0 = get_group_id (0) * TILE_X - RADIUS;
+    int gx = get_global_id (0), gy = get_global_id (1);
+
+    for (int x = lx; x < TILE_X + 2 * RADIUS; x += TILE_X)
+        tile[ly][x] = fetch (in, x0 + x, gy, width, height);
+
+    barrier (CLK_LOCAL_MEM_FENCE);
+
+    if (gx >= width || gy >= height)
+        return;
+
+    T acc = (T) 0;
+    #pragma unroll
+    for (int i = 0; i < DIAMETER; ++i)
+        acc += filter[i] * tile[ly][lx + i];
+
+    out[gy * width + gx] = acc;
+}
+
+
+/*! \brief Convolves the columns of an image with a 1D filter, 
+ *         the second pass of a separable convolution.
+ *  \details A work-group loads TILE_X columns of TILE_Y elements, 
+ *           with a halo of RADIUS elements above and below.
+ *  \note The global workspace should be the image size, rounded up to 
+ *        multiples of TILE_X and TILE_Y, and the local workspace should 
+ *        be TILE_X x TILE_Y.
+ *
+ *  \param[in] in input image.
+ *  \param[in] inOffset offset (in elements) of the input in `in`.
+ *  \param[out] out output image.
+ *  \param[in] outOffset offset (in elements) of the output in `out`.
+ *  \param[in] filter the DIAMETER weights.
+ *  \param[in] filterOffset offset (in elements) of the weights in `filter`.
+ *  \param[in] width the width of the images.
+ *  \param[in] height the height of the images.
+ */
+kernel
+void convolveCols (global const T *in, const uint inOffset, 
+                   global T *out, const uint outOffset, 
+                   constant T *filter, const uint filterOffset, 
+                   const int width, const int height)
+{
+    local T tile[TILE_Y + 2 * RADIUS][TILE_X];
+
+    in += inOffset;
+    out += outOffset;
+    filter += filterOffset;
+
+    int lx = get_local_id (0), ly = get_local_id (1);
+    int y0 = get_group_id (1) * TILE_Y - RADIUS;
+    int gx = get_global_id (0), gy = get_global_id (1);
+
+    for (int y = ly; y < TILE_Y + 2 * RADIUS; y += TILE_Y)
+        tile[y][lx] = fetch (in, gx, y0 + y, width, height);
+
+    barrier (CLK_LOCAL_MEM_FENCE);
+
+    if (gx >= width || gy >= height)
+        return;
+
+    T acc = (T) 0;
+    #pragma unroll
+    for (int j = 0; j < DIAMETER; ++j)
+        acc += filter[j] * tile[ly + j][lx];
+
+    out[gy * width + gx] = acc;
+}
+
+#endif  // TILED
+
+
+/*! \brief Convolves an image with a 2D filter, reading the image 
+ *         straight from global memory.
+ *  \details It's the baseline of the tiled kernels, and the fallback 
+ *           when their tiles don't fit in local memory.
+ *  \note The global workspace should cover the image. 
+ *        It works with any local workspace.
+ *
+ *  \param[in] in input image.
+ *  \param[in] inOffset offset (in elements) of the input in `in`.
+ *  \param[out] out output image.
+ *  \param[in] outOffset offset (in elements) of the output in `out`.
+ *  \param[in] filter the DIAMETER x DIAMETER weights.
+ *  \param[in] filterOffset offset (in elements) of the weights in `filter`.
+ *  \param[in] width the width of the images.
+ *  \param[in] height the height of the images.
+ */
+kernel
+void convolveNaive (global const T *in, const uint inOffset, 
+                    global T *out, const uint outOffset, 
+                    constant T *filter, const uint filterOffset, 
+                    const int width, const int height)
+{
+    in += inOffset;
+    out += outOffset;
+    filter += filterOffset;
+
+    int gx = get_global_id (0), gy = get_global_id (1);
+    if (gx >= width || gy >= height)
+        return;
+
+    T acc = (T) 0;
+    for (int j = 0; j < DIAMETER; ++j)
+        for (int i = 0; i < DIAMETER; ++i)
+            acc += filter[j * DIAMETER + i] * fetch (in, gx + i - RADIUS, gy + j - RADIUS, width, height);
+
+    out[gy * width + gx] = acc;
+}
@@ -0,0 +1,81 @@
+/*! \file transfer.cl
+ *  \brief Kernels that scatter and gather coalesced transfers.
+ *  \author Nick Lamprianidis
+ *  \version 1.0
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+/*! \brief Copies a list of regions between two buffers.
+ *  \details Every region is described by a `uint4` that holds the offset 
+ *           of the region in `src`, its offset in `dst`, and its size, all 
+ *           in elements. Work-groups take regions in a grid-strided 
+ *           fashion, and the work-items of a group copy the elements 
+ *           of a region. It scatters a packed staging buffer to its 
+ *           destinations, and gathers sources to a staging buffer.
+ *
+ *  \param[in] src source buffer.
+ *  \param[in] regions table of regions.
+ *  \param[in] regionsOffset offset (in regions) of the table in `regions`.
+ *  \param[out] dst destination buffer.
+ *  \param[in] n number of regions.
+ */
+kernel
+void copyRegions (global const uint *src, global const uint4 *regions, const uint regionsOffset, 
+                  global uint *dst, const uint n)
+{
+    regions += regionsOffset;
+
+    for (uint r = get_group_id (0); r < n; r += get_num_groups (0))
+    {
+        uint4 region = regions[r];
+        for (uint i = get_local_id (0); i < region.z; i += get_local_size (0))
+            dst[region.y + i] = src[region.x + i];
+    }
+}
+
+
+/*! \brief Copies a list of regions between two buffers, byte by byte.
+ *  \details It's the same as `copyRegions`, for regions whose 
+ *           offsets or sizes are not multiples of 4 bytes.
+ *
+ *  \param[in] src source buffer.
+ *  \param[in] regions table of regions (offsets and sizes in bytes).
+ *  \param[in] regionsOffset offset (in regions) of the table in `regions`.
+ *  \param[out] dst destination buffer.
+ *  \param[in] n number of regions.
+ */
+kernel
+void copyRegionsBytes (global const uchar *src, global const uint4 *regions, const uint regionsOffset, 
+                       global uchar *dst, const uint n)
+{
+    regions += regionsOffset;
+
+    for (uint r = get_group_id (0); r < n; r += get_num_groups (0))
+    {
+        uint4 region = regions[r];
+        for (uint i = get_local_id (0); i < region.z; i += get_local_size (0))
+            dst[region.y + i] = src[region.x + i];
+    }
+}
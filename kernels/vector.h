@@ -0,0 +1,60 @@
+/*! \file vector.h
+ *  \brief It contains the vector types and accessors of the vectorized kernels.
+ *  \details The kernel files include it with `#include "vector.h"`. CLEnv adds 
+ *           the directories of the kernel files to the include path.
+ *  \author Nick Lamprianidis
+ *  \version 1.0
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef CLUTILS_VECTOR_H
+#define CLUTILS_VECTOR_H
+
+
+/*! \brief Vector width of the vectorized kernels.
+ *  \details Defaults to the preferred int vector width of the device, 
+ *           which CLEnv provides as a build option. It can be overridden 
+ *           with a `-D VEC_WIDTH=<1|2|4|8|16>` build option.
+ */
+#ifndef VEC_WIDTH
+#ifdef CLUTILS_PREFERRED_VECTOR_WIDTH_INT
+#define VEC_WIDTH CLUTILS_PREFERRED_VECTOR_WIDTH_INT
+#else
+#define VEC_WIDTH 1
+#endif
+#endif
+
+#define CAT_(a, b) a ## b
+#define CAT(a, b) CAT_(a, b)
+#if VEC_WIDTH == 1
+#define INTN int
+#define VLOAD(idx, p) (p)[idx]
+#define VSTORE(v, idx, p) (p)[idx] = (v)
+#else
+#define INTN CAT(int, VEC_WIDTH)
+#define VLOAD(idx, p) CAT(vload, VEC_WIDTH) (idx, p)
+#define VSTORE(v, idx, p) CAT(vstore, VEC_WIDTH) (v, idx, p)
+#endif
+
+#endif  // CLUTILS_VECTOR_H
@@ -34,14 +34,28 @@
 #include <fstream>
 #include <sstream>
 #include <chrono>
+#include <limits>
+#include <cstdlib>
 #include <CLUtils.hpp>
 
 #if defined(_WIN32)
 #include <windows.h>
 #elif defined(__linux__)
 #include <GL/glx.h>
+#include <unistd.h>
 #elif defined(__APPLE__) || defined(__MACOSX)
 #include <OpenGL/OpenGL.h>
+#include <unistd.h>
+#endif
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(CLUTILS_HAS_TSC) && !defined(_MSC_VER)
+#include <cpuid.h>
 #endif
 
 
@@ -227,6 +241,90 @@ namespace clutils
     }
 
 
+    /*! \details Kernel files can then include headers that sit next to them, 
+     *           like `kernels/vector.h`. Directories with spaces are quoted.
+     *
+     *  \param[in] kernel_filenames a vector of strings with 
+     *                              the names of the kernel files (.cl).
+     *  \return A string with an include directive for every distinct directory.
+     */
+    std::string includeOptions (const std::vector<std::string> &kernel_filenames)
+    {
+        std::vector<std::string> dirs;
+        for (auto &fName : kernel_filenames)
+        {
+            size_t pos = fName.find_last_of ("/\\");
+            std::string dir = (pos == std::string::npos) ? "." : fName.substr (0, std::max<size_t> (pos, 1));
+            if (std::find (dirs.begin (), dirs.end (), dir) == dirs.end ())
+                dirs.push_back (dir);
+        }
+
+        std::ostringstream options;
+        for (auto &dir : dirs)
+        {
+            if (dir.find (' ') == std::string::npos)
+                options << " -I " << dir;
+            else
+                options << " -I \"" << dir << "\"";
+        }
+
+        return options.str ();
+    }
+
+
+    /*! \details The widths are reported by the devices through 
+     *           `CL_DEVICE_PREFERRED_VECTOR_WIDTH_*` and `CL_DEVICE_NATIVE_VECTOR_WIDTH_*`, 
+     *           and are turned into the defines `CLUTILS_PREFERRED_VECTOR_WIDTH_<TYPE>` 
+     *           and `CLUTILS_NATIVE_VECTOR_WIDTH_<TYPE>`, with TYPE one of CHAR, 
+     *           SHORT, INT, LONG, FLOAT, DOUBLE. When a program targets many 
+     *           devices, the smallest width among them is used.
+     *
+     *  \param[in] devs the devices a program is going to be built for.
+     *  \return A string with the define directives.
+     */
+    std::string vectorWidthOptions (const std::vector<cl::Device> &devs)
+    {
+        const char *types[] = { "CHAR", "SHORT", "INT", "LONG", "FLOAT", "DOUBLE" };
+        cl_uint preferred[6], native[6];
+        std::fill (preferred, preferred + 6, 16);
+        std::fill (native, native + 6, 16);
+
+        for (auto &device : devs)
+        {
+            cl_uint p[6] = {
+                device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_CHAR> (),
+                device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_SHORT> (),
+                device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_INT> (),
+                device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_LONG> (),
+                device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_FLOAT> (),
+                device.getInfo<CL_DEVICE_PREFERRED_VECTOR_WIDTH_DOUBLE> ()
+            };
+            cl_uint n[6] = {
+                device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_CHAR> (),
+                device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_SHORT> (),
+                device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_INT> (),
+                device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_LONG> (),
+                device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT> (),
+                device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_DOUBLE> ()
+            };
+            for (int t = 0; t < 6; ++t)
+            {
+                preferred[t] = std::min (preferred[t], p[t]);
+                native[t] = std::min (native[t], n[t]);
+            }
+        }
+
+        std::ostringstream options;
+        for (int t = 0; t < 6; ++t)
+        {
+            options << " -D CLUTILS_PREFERRED_VECTOR_WIDTH_" << types[t] << "=" << preferred[t];
+            options << " -D CLUTILS_NATIVE_VECTOR_WIDTH_" << types[t] << "=" << native[t];
+        }
+
+        return options.str ();
+    }
+
+
     /*! \param[in] str string containing the tokens.
      *  \param[in] delim delimiter on which to split the string.
      *  \param[out] names a vector of all the tokens.
@@ -255,90 +353,393 @@ namespace clutils
     }
 
 
+    /*! \details The score is a rough estimate of the peak throughput, the 
+     *           product of the compute units, the clock frequency, and the 
+     *           native float vector width. Compute units of GPUs and 
+     *           accelerators are weighted higher, since they run many more 
+     *           lanes than a CPU core. Devices that are unavailable, or 
+     *           have no compiler, score 0. Different runtimes for the same 
+     *           hardware score the same, so `calibrationScore` is needed 
+     *           to tell them apart.
+     *
+     *  \param[in] device the device to score.
+     *  \return The score of the device.
+     */
+    double propertyScore (const cl::Device &device)
+    {
+        if (!device.getInfo<CL_DEVICE_AVAILABLE> () || 
+            !device.getInfo<CL_DEVICE_COMPILER_AVAILABLE> ())
+            return 0.0;
+
+        double score = (double) device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS> () * 
+                       device.getInfo<CL_DEVICE_MAX_CLOCK_FREQUENCY> () * 
+                       std::max (device.getInfo<CL_DEVICE_NATIVE_VECTOR_WIDTH_FLOAT> (), 1u);
+
+        if (device.getInfo<CL_DEVICE_TYPE> () & (CL_DEVICE_TYPE_GPU | CL_DEVICE_TYPE_ACCELERATOR))
+            score *= 16;
+
+        return score;
+    }
+
+
+    /*! \details It measures the launch latency as the round trip of an empty 
+     *           kernel, and the time of a kernel that copies a 16MB buffer. 
+     *           The score is the bandwidth of the copy when the launch latency 
+     *           is taken into account, so it reflects both small and large 
+     *           workloads. It takes a few tens of milliseconds.
+     *
+     *  \param[in] device the device to score.
+     *  \return The effective bandwidth of the copy in GB/s.
+     */
+    double calibrationScore (const cl::Device &device)
+    {
+        const char *source = 
+            "kernel void copy (global const float4 *in, global float4 *out)\n"
+            "{\n"
+            "    out[get_global_id (0)] = in[get_global_id (0)];\n"
+            "}\n"
+            "kernel void empty () {}\n";
+
+        std::vector<cl::Device> devs { device };
+        cl::Context context (devs);
+        cl::CommandQueue queue (context, device, CL_QUEUE_PROFILING_ENABLE);
+        cl::Program program (context, std::string (source));
+        program.build (devs);
+        cl::Kernel copy (program, "copy"), empty (program, "empty");
+
+        // 16MB, or less on devices that can't allocate that much
+        size_t bytes = std::min (cl_ulong (1 << 24), device.getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE> ());
+        bytes -= bytes % 1024;
+
+        cl::Buffer dIn (context, CL_MEM_READ_ONLY, bytes);
+        cl::Buffer dOut (context, CL_MEM_WRITE_ONLY, bytes);
+        copy.setArg (0, dIn);
+        copy.setArg (1, dOut);
+
+        const int nRepeat = 5;
+        CPUTimer<double, std::micro> timer;
+
+        // Warm up
+        queue.enqueueNDRangeKernel (empty, cl::NullRange, cl::NDRange (1));
+        queue.enqueueNDRangeKernel (copy, cl::NullRange, cl::NDRange (bytes / 16));
+        queue.finish ();
+
+        double latency = std::numeric_limits<double>::max ();
+        for (int i = 0; i < nRepeat; ++i)
+        {
+            timer.start ();
+            queue.enqueueNDRangeKernel (empty, cl::NullRange, cl::NDRange (1));
+            queue.finish ();
+            latency = std::min (latency, timer.stop ());
+        }
+
+        double copyTime = std::numeric_limits<double>::max ();
+        for (int i = 0; i < nRepeat; ++i)
+        {
+            cl::Event event;
+            queue.enqueueNDRangeKernel (copy, cl::NullRange, cl::NDRange (bytes / 16), 
+                                        cl::NullRange, nullptr, &event);
+            event.wait ();
+            cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START> ();
+            cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END> ();
+            copyTime = std::min (copyTime, (end - start) * 1e-3);
+        }
+
+        // Bytes per us to GB/s
+        return 2.0 * bytes / (copyTime + latency) * 1e-3;
+    }
+
+
+    /*! \details The file is `$CLUTILS_DEVICE_CACHE` if that is set. Otherwise, 
+     *           it's `clutils-devices.txt` in the user's cache directory 
+     *           (`$XDG_CACHE_HOME`, `~/.cache`, or `%LOCALAPPDATA%` on Windows).
+     *           Every line holds a score, followed by a tab and the identity 
+     *           of the device (host, platform, device, and driver version).
+     *
+     *  \return The path of the file.
+     */
+    std::string deviceCacheFile ()
+    {
+        if (const char *file = std::getenv ("CLUTILS_DEVICE_CACHE"))
+            return file;
+
+        #if defined(_WIN32)
+        const char *dir = std::getenv ("LOCALAPPDATA");
+        return std::string (dir ? dir : ".") + "\\clutils-devices.txt";
+        #else
+        const char *xdg = std::getenv ("XDG_CACHE_HOME");
+        const char *home = std::getenv ("HOME");
+        std::string dir = xdg ? xdg : (home ? std::string (home) + "/.cache" : ".");
+        return dir + "/clutils-devices.txt";
+        #endif
+    }
+
+
+    /*! \brief Returns a string that identifies a device on this host.
+     *  \details A home directory can be shared between hosts, 
+     *           so the host name is part of the identity.
+     *
+     *  \param[in] platform the platform of the device.
+     *  \param[in] device the device.
+     *  \return The identity of the device.
+     */
+    static std::string deviceIdentity (const cl::Platform &platform, const cl::Device &device)
+    {
+        #if defined(_WIN32)
+        const char *env = std::getenv ("COMPUTERNAME");
+        std::string host (env ? env : "");
+        #else
+        char name[256] = { 0 };
+        gethostname (name, sizeof (name) - 1);
+        std::string host (name);
+        #endif
+
+        return host + " | " + platform.getInfo<CL_PLATFORM_NAME> () + " | " + 
+               device.getInfo<CL_DEVICE_NAME> () + " | " + device.getInfo<CL_DRIVER_VERSION> ();
+    }
+
+
+    /*! \brief Reads in the cached calibration scores.
+     *  \details A missing or malformed file results in no (or fewer) scores.
+     *
+     *  \param[out] cache the scores, keyed by device identity.
+     */
+    static void loadDeviceCache (std::unordered_map<std::string, double> &cache)
+    {
+        std::ifstream file (deviceCacheFile ());
+        std::string line;
+        while (std::getline (file, line))
+        {
+            size_t tab = line.find ('\t');
+            if (tab == std::string::npos)
+                continue;
+
+            std::istringstream score (line.substr (0, tab));
+            double value;
+            if (score >> value)
+                cache[line.substr (tab + 1)] = value;
+        }
+    }
+
+
+    /*! \brief Writes out the calibration scores.
+     *  \details Failing to write the file only means 
+     *           that the calibration will run again.
+     *
+     *  \param[in] cache the scores, keyed by device identity.
+     */
+    static void saveDeviceCache (const std::unordered_map<std::string, double> &cache)
+    {
+        std::ofstream file (deviceCacheFile ());
+        file << std::setprecision (10);
+        for (auto &entry : cache)
+            file << entry.second << '\t' << entry.first << '\n';
+    }
+
+
+    /*! \details Ties keep the order the devices got returned in by the 
+     *           OpenCL runtime, so `DeviceSelection::FIRST` leaves the 
+     *           devices in their original order. With 
+     *           `DeviceSelection::CALIBRATION`, devices that are missing from 
+     *           the cache get calibrated, and the cache gets updated. 
+     *           Devices that fail to calibrate score 0.
+     *
+     *  \param[in] platforms the platforms with the devices to rank.
+     *  \param[in] selection the policy that scores the devices.
+     *  \return The scores of the devices, from best to worst.
+     */
+    std::vector<DeviceScore> rankDevices (const std::vector<cl::Platform> &platforms, 
+                                          DeviceSelection selection)
+    {
+        std::unordered_map<std::string, double> cache;
+        bool updated = false;
+        if (selection == DeviceSelection::CALIBRATION)
+            loadDeviceCache (cache);
+
+        std::vector<DeviceScore> scores;
+        for (unsigned int p = 0; p < platforms.size (); ++p)
+        {
+            std::vector<cl::Device> devs;
+            try
+            {
+                platforms[p].getDevices (CL_DEVICE_TYPE_ALL, &devs);
+            }
+            catch (const cl::Error &error)
+            {
+                continue;  // A platform without devices
+            }
+
+            for (unsigned int d = 0; d < devs.size (); ++d)
+            {
+                double score = 0.0;
+
+                if (selection == DeviceSelection::PROPERTIES)
+                {
+                    score = propertyScore (devs[d]);
+                }
+                else if (selection == DeviceSelection::CALIBRATION)
+                {
+                    std::string id = deviceIdentity (platforms[p], devs[d]);
+                    auto it = cache.find (id);
+                    if (it != cache.end ())
+                        score = it->second;
+                    else
+                    {
+                        try
+                        {
+                            score = calibrationScore (devs[d]);
+                        }
+                        catch (const cl::Error &error)
+                        {
+                        }
+                        cache[id] = score;
+                        updated = true;
+                    }
+                }
+
+                scores.push_back ({ p, d, score });
+            }
+        }
+
+        std::stable_sort (scores.begin (), scores.end (), 
+            [] (const DeviceScore &a, const DeviceScore &b) { return a.score > b.score; });
+
+        if (updated)
+            saveDeviceCache (cache);
+
+        return scores;
+    }
+
+
     /*! It initializes the OpenCL environment. If a `kernel_filenames` argument 
-     *  is provided, it creates a context for all the devices in the first 
-     *  platform, and a command queue for the first device in that platform. 
-     *  It also builds a program object from all the requested kernel files, 
-     *  and extracts all kernels in that program.
+     *  is provided, it picks the best device according to the selection policy 
+     *  (see `rankDevices`). It creates a context for all the devices in the 
+     *  platform of that device, and a command queue for the device. The device 
+     *  is moved to the front of `devices[0]`, so that it has index 0 in the 
+     *  context. It also builds a program object from all the requested kernel files, 
+     *  for all the devices in the context, and extracts all kernels in that program. 
+     *  With `lazy_build`, the program is only built for the device with the queue, 
+     *  and it gets rebuilt for the rest of the devices when queues are created 
+     *  for them (see `buildForDevice`). Without a `kernel_filenames` argument, 
+     *  nothing is queried from the OpenCL runtime until a context is requested.
      *
      *  \param[in] kernel_filenames a vector of strings with 
      *                              the names of the kernel files (.cl).
      *  \param[in] build_options options that are forwarded to the OpenCL compiler.
+     *  \param[in] selection the policy for picking the device.
+     *  \param[in] lazy_build whether programs get built only for 
+     *                        the devices that have a queue.
      */
     CLEnv::CLEnv (const std::vector<std::string> &kernel_filenames, 
-                  const char *build_options)
+                  const char *build_options, DeviceSelection selection, bool lazy_build)
+        : lazyBuild (lazy_build)
     {
-        // Get the list of platforms
-        cl::Platform::get (&platforms);
-
         if (!kernel_filenames.empty ())
         {
-            // Get the list of devices in platform 0
+            // Get the list of platforms
+            initPlatforms ();
+
+            DeviceScore best { 0, 0, 0.0 };
+            if (selection != DeviceSelection::FIRST)
+                best = rankDevices (platforms, selection).at (0);
+
+            // Get the list of devices in the platform of the best device,
+            // and move the best device to the front
             devices.emplace_back ();
-            platforms[0].getDevices (CL_DEVICE_TYPE_ALL, &devices[0]);
+            platforms.at (best.pIdx).getDevices (CL_DEVICE_TYPE_ALL, &devices[0]);
+            std::rotate (devices[0].begin (), devices[0].begin () + best.dIdx, 
+                         devices[0].begin () + best.dIdx + 1);
 
-            // Create a context for those devices (in platform 0)
+            // Create a context for those devices
             contexts.emplace_back (devices[0]);
 
-            // Create a command queue for device 0 in platform 0
+            // Create a command queue for the best device
             queues.emplace_back ();
             queues[0].emplace_back (contexts[0], devices[0][0]);
 
             // Read in the program sources
             std::vector<std::string> sourceCodes;
             readSource (kernel_filenames, sourceCodes);
+            std::string options = (build_options ? build_options : "") + includeOptions (kernel_filenames);
 
-            // Create a sources object with all kernel files
-            cl::Program::Sources sources (sourceCodes.size ());
-            std::transform (sourceCodes.begin (), sourceCodes.end (), 
-                            sources.begin (), make_kernel_pair);
+            // Create a program for device 0 in context 0
+            createProgram (0, sourceCodes, options.c_str ());
+        }
+    }
 
-            // Create a program object from the source codes, targeting context 0
-            programs.emplace_back (contexts[0], sources);
 
-            try
-            {
-                // Build the program for all devices in context 0 (platform 0)
-                programs[0].build (devices[0], build_options);
-            }
-            catch (const cl::Error &error)
-            {
-                std::cerr << error.what ()
-                          << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
-                          << ")"  << std::endl << std::endl;
-                
-                std::string log = programs[0].getBuildInfo<CL_PROGRAM_BUILD_LOG> (devices[0][0]);
-                std::cout << log << std::endl;
-
-                exit (EXIT_FAILURE);
-            }
+    /*! \brief Delegating constructor
+     *
+     *  \param[in] kernel_filename a string with the name of the kernel file (.cl).
+     *  \param[in] build_options options that are forwarded to the OpenCL compiler.
+     *  \param[in] selection the policy for picking the device.
+     *  \param[in] lazy_build whether programs get built only for 
+     *                        the devices that have a queue.
+     */
+    CLEnv::CLEnv (const std::string &kernel_filename, const char *build_options, 
+                  DeviceSelection selection, bool lazy_build)
+        : CLEnv (std::vector<std::string> { kernel_filename }, build_options, selection, lazy_build)
+    {
+    }
+
+
+    /*! \details The build options are extended with the vector widths 
+     *           of the targeted devices (see `vectorWidthOptions`). 
+     *           On a build failure, it prints the build log and exits.
+     *
+     *  \param[in] pgIdx the index of the program to build.
+     *  \param[in] devs the devices to build the program for.
+     *  \param[in] build_options options that are forwarded to the OpenCL compiler.
+     *  \return The names of the kernels in the program.
+     */
+    std::vector<std::string> CLEnv::buildProgram (unsigned int pgIdx, 
+                                                  const std::vector<cl::Device> &devs, 
+                                                  const char *build_options)
+    {
+        std::string options = (build_options ? build_options : "") + vectorWidthOptions (devs);
 
-            // Get the kernel names
-            // Note: getInfo returns a ';' delimited string.
-            std::string namesString = programs[0].getInfo<CL_PROGRAM_KERNEL_NAMES> ();
-            std::vector<std::string> kernel_names;
-            clutils::split (namesString, ';', kernel_names);
+        try
+        {
+            programs[pgIdx].build (devs, options.c_str ());
+        }
+        catch (const cl::Error &error)
+        {
+            std::cerr << error.what ()
+                      << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
+                      << ")"  << std::endl << std::endl;
             
-            // Retrieve the kernels from program 0
+            std::string log = programs[pgIdx].getBuildInfo<CL_PROGRAM_BUILD_LOG> (devs[0]);
+            std::cout << log << std::endl;
+
+            exit (EXIT_FAILURE);
+        }
+
+        // Get the kernel names
+        // Note: getInfo returns a ';' delimited string.
+        std::string namesString = programs[pgIdx].getInfo<CL_PROGRAM_KERNEL_NAMES> ();
+        std::vector<std::string> kernel_names;
+        clutils::split (namesString, ';', kernel_names);
+        
+        // Retrieve the kernels from the program
+        if (pgIdx == kernels.size ())
+        {
             kernels.emplace_back ();
             kernelIdx.emplace_back ();
             for (unsigned int idx = 0; idx < kernel_names.size (); ++idx)
             {
-                kernels[0].emplace_back (programs[0], kernel_names[idx].c_str ());
-                kernelIdx[0][kernel_names[idx]] = idx;
+                kernels[pgIdx].emplace_back (programs[pgIdx], kernel_names[idx].c_str ());
+                kernelIdx[pgIdx][kernel_names[idx]] = idx;
             }
         }
-    }
-
+        // On a rebuild, the kernels are replaced in place, 
+        // so that references to them stay valid
+        else
+        {
+            for (auto &name : kernel_names)
+                kernels[pgIdx][kernelIdx[pgIdx].at (name)] = cl::Kernel (programs[pgIdx], name.c_str ());
+        }
 
-    /*! \brief Delegating constructor
-     *
-     *  \param[in] kernel_filename a string with the name of the kernel file (.cl).
-     *  \param[in] build_options options that are forwarded to the OpenCL compiler.
-     */
-    CLEnv::CLEnv (const std::string &kernel_filename, const char *build_options)
-        : CLEnv (std::vector<std::string> { kernel_filename }, build_options)
-    {
+        return kernel_names;
     }
 
 
@@ -436,6 +837,8 @@ namespace clutils
     {
         try
         {
+            initPlatforms ();
+
             int idx = devices.size ();
             devices.emplace_back ();
             platforms.at (pIdx).getDevices (CL_DEVICE_TYPE_ALL, &devices[idx]);
@@ -505,7 +908,13 @@ namespace clutils
     }
 
 
-    /*! \param[in] ctxIdx the index of the context the device is handled by. 
+    /*! \details Programs are built for all the devices in their context, so 
+     *           the existing kernels, and their arguments, keep working on the 
+     *           new queue. With lazy builds (see `setLazyBuild`), the programs 
+     *           that weren't built for the device get rebuilt to include it 
+     *           (see `buildForDevice`).
+     *
+     *  \param[in] ctxIdx the index of the context the device is handled by. 
      *                    Indices follow the order the contexts were created in.
      *  \param[in] dIdx the index of the device among those handled by the 
      *                  specified context. Indices follow the order the devices 
@@ -527,6 +936,8 @@ namespace clutils
             int qIdx = queues[ctxIdx].size ();            
             queues[ctxIdx].emplace_back (contexts[ctxIdx], devs.at (dIdx), props);
 
+            buildForDevice (ctxIdx, devs[dIdx]);
+
             return queues[ctxIdx][qIdx];
         }
         catch (const std::out_of_range &error)
@@ -538,7 +949,10 @@ namespace clutils
     }
 
 
-    /*! \param[in] ctxIdx the index of the context the GL-shared device is handled by. 
+    /*! \details With lazy builds, the programs that weren't built for the 
+     *           device get rebuilt to include it (see `addQueue`).
+     *
+     *  \param[in] ctxIdx the index of the context the GL-shared device is handled by. 
      *                    Indices follow the order the contexts were created in.
      *  \param[in] props bitfield to enable command queue properties.
      *  \return A reference to the created queue.
@@ -565,6 +979,8 @@ namespace clutils
             int qIdx = queues[ctxIdx].size ();
             queues[ctxIdx].emplace_back (contexts[ctxIdx], device, props);
 
+            buildForDevice (ctxIdx, device);
+
             return queues[ctxIdx][qIdx];
         }
         catch (const std::out_of_range &error)
@@ -576,6 +992,38 @@ namespace clutils
     }
 
 
+    /*! \details The manager evicts and restores buffers on the first 
+     *           queue of the context, which must exist by the first call.
+     *
+     *  \param[in] ctxIdx the index of the context. 
+     *                    Indices follow the order the contexts were created in.
+     *  \param[in] budget the budget in bytes, when the manager gets created. 
+     *                    By default, it's the smallest `CL_DEVICE_GLOBAL_MEM_SIZE` 
+     *                    among the devices in the context.
+     *  \return The memory manager of the context.
+     */
+    MemoryManager& CLEnv::getMemoryManager (unsigned int ctxIdx, size_t budget)
+    {
+        try
+        {
+            cl::CommandQueue &queue (queues.at (ctxIdx).at (0));
+            if (memoryManagers.size () < contexts.size ())
+                memoryManagers.resize (contexts.size ());
+
+            if (!memoryManagers[ctxIdx])
+                memoryManagers[ctxIdx].reset (new MemoryManager (contexts[ctxIdx], queue, budget));
+
+            return *memoryManagers[ctxIdx];
+        }
+        catch (const std::out_of_range &error)
+        {
+            std::cerr << "Out of Range error: " << error.what () 
+                      << " (" << __FILE__ << ":" << __LINE__ << ")" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+    }
+
+
     /*! \param[in] ctxIdx the index of the context the program is associated with. 
      *                    Indices follow the order the contexts were created in.
      *  \param[in] kernel_filenames a vector of strings with 
@@ -594,51 +1042,11 @@ namespace clutils
             // Read in the program sources
             std::vector<std::string> sourceCodes;
             readSource (kernel_filenames, sourceCodes);
+            std::string options = (build_options ? build_options : "") + includeOptions (kernel_filenames);
 
-            // Create a sources object with all kernel files
-            cl::Program::Sources sources (sourceCodes.size ());
-            std::transform (sourceCodes.begin (), sourceCodes.end (), 
-                            sources.begin (), make_kernel_pair);
-
-            // Create a program object from the source codes, 
-            // targeting the requested context
-            programs.emplace_back (contexts.at (ctxIdx), sources);
-
-            // Build the program for all devices in the requested context
-            std::vector<cl::Device> devs = contexts[ctxIdx].getInfo<CL_CONTEXT_DEVICES> ();
+            std::vector<std::string> kernel_names = createProgram (ctxIdx, sourceCodes, options.c_str ());
             int pgIdx = programs.size () - 1;
 
-            try
-            {
-                programs[pgIdx].build (devs, build_options);
-            }
-            catch (const cl::Error &error)
-            {
-                std::cerr << error.what ()
-                          << " (" << clutils::getOpenCLErrorCodeString (error.err ()) 
-                          << ")"  << std::endl << std::endl;
-                
-                std::string log = programs[pgIdx].getBuildInfo<CL_PROGRAM_BUILD_LOG> (devs[0]);
-                std::cout << log << std::endl;
-
-                exit (EXIT_FAILURE);
-            }
-
-            // Get the kernel names
-            // Note: getInfo returns a ';' delimited string.
-            std::string namesString = programs[pgIdx].getInfo<CL_PROGRAM_KERNEL_NAMES> ();
-            std::vector<std::string> kernel_names;
-            clutils::split (namesString, ';', kernel_names);
-            
-            // Retrieve the kernels from the newly created program
-            kernels.emplace_back ();
-            kernelIdx.emplace_back ();
-            for (unsigned int idx = 0; idx < kernel_names.size (); ++idx)
-            {
-                kernels[pgIdx].emplace_back (programs[pgIdx], kernel_names[idx].c_str ());
-                kernelIdx[pgIdx][kernel_names[idx]] = idx;
-            }
-
             if (kernel_name == nullptr)
                 return getKernel (kernel_names.at (0).c_str (), pgIdx);
             else
@@ -653,6 +1061,108 @@ namespace clutils
     }
 
 
+    /*! \details The program is built for all the devices in the context. With 
+     *           lazy builds, it's only built for the devices that have a queue 
+     *           in the context, or for all of them, if there are no queues yet.
+     *
+     *  \param[in] ctxIdx the index of the context the program is associated with. 
+     *                    Indices follow the order the contexts were created in.
+     *  \param[in] sourceCodes the source codes of the program.
+     *  \param[in] build_options options that are forwarded to the OpenCL compiler.
+     *  \return The names of the kernels in the program.
+     */
+    std::vector<std::string> CLEnv::createProgram (unsigned int ctxIdx, 
+                                                   const std::vector<std::string> &sourceCodes, 
+                                                   const char *build_options)
+    {
+        // Create a sources object with all source codes
+        cl::Program::Sources sources (sourceCodes.size ());
+        std::transform (sourceCodes.begin (), sourceCodes.end (), 
+                        sources.begin (), make_kernel_pair);
+
+        // Create a program object from the source codes, 
+        // targeting the requested context
+        programs.emplace_back (contexts.at (ctxIdx), sources);
+
+        std::vector<cl::Device> devs;
+        if (lazyBuild)
+            devs = queuedDevices (ctxIdx);
+        if (devs.empty ())
+            devs = contexts[ctxIdx].getInfo<CL_CONTEXT_DEVICES> ();
+
+        programSources.push_back ({ ctxIdx, sourceCodes, 
+                                    build_options ? build_options : "", devs });
+
+        return buildProgram (programs.size () - 1, devs, build_options);
+    }
+
+
+    /*! \details Only programs created with lazy builds can miss a device. 
+     *           Kernels can't be attached to a program that gets built again, 
+     *           so every affected program is created anew from its sources, 
+     *           and is built for its previous devices along with the new one. 
+     *           The kernels are replaced in place, and references to them 
+     *           stay valid, but their arguments have to be set again. 
+     *           Copies of the old kernels, like the ones the primitives keep, 
+     *           only work on the old devices.
+     *
+     *  \param[in] ctxIdx the index of the context the device is handled by. 
+     *                    Indices follow the order the contexts were created in.
+     *  \param[in] device the device that got a queue.
+     */
+    void CLEnv::buildForDevice (unsigned int ctxIdx, const cl::Device &device)
+    {
+        auto same = [&device] (const cl::Device &d) { return d () == device (); };
+
+        for (unsigned int pgIdx = 0; pgIdx < programs.size (); ++pgIdx)
+        {
+            ProgramSource &ps = programSources[pgIdx];
+            if (ps.ctxIdx != ctxIdx || 
+                std::any_of (ps.devices.begin (), ps.devices.end (), same))
+                continue;
+
+            ps.devices.push_back (device);
+
+            cl::Program::Sources sources (ps.sourceCodes.size ());
+            std::transform (ps.sourceCodes.begin (), ps.sourceCodes.end (), 
+                            sources.begin (), make_kernel_pair);
+            programs[pgIdx] = cl::Program (contexts[ctxIdx], sources);
+
+            buildProgram (pgIdx, ps.devices, ps.options.c_str ());
+        }
+    }
+
+
+    /*! \details Platform enumeration is postponed until the first 
+     *           platform is needed, which keeps an empty `CLEnv` cheap.
+     */
+    void CLEnv::initPlatforms ()
+    {
+        if (platforms.empty ())
+            cl::Platform::get (&platforms);
+    }
+
+
+    /*! \param[in] ctxIdx the index of the context. 
+     *                    Indices follow the order the contexts were created in.
+     *  \return The distinct devices of the queues in the context, 
+     *          in the order the queues were created in.
+     */
+    std::vector<cl::Device> CLEnv::queuedDevices (unsigned int ctxIdx)
+    {
+        std::vector<cl::Device> devs;
+        for (auto &queue : queues.at (ctxIdx))
+        {
+            cl::Device device = queue.getInfo<CL_QUEUE_DEVICE> ();
+            auto same = [&device] (const cl::Device &d) { return d () == device (); };
+            if (std::none_of (devs.begin (), devs.end (), same))
+                devs.push_back (device);
+        }
+
+        return devs;
+    }
+
+
     /*! \param[in] ctxIdx the index of the context the program is associated with. 
      *                    Indices follow the order the contexts were created in.
      *  \param[in] kernel_filename a string with the name of the kernel file (.cl).
@@ -670,4 +1180,753 @@ namespace clutils
                            kernel_name, build_options);
     }
 
+
+    /*! \details Programs created through this method are cached by their 
+     *           context index, kernel files and build options, so that 
+     *           classes which specialize their kernels with build options 
+     *           can share a single build of each variant.
+     *  
+     *  \param[in] ctxIdx the index of the context the program is associated with. 
+     *                    Indices follow the order the contexts were created in.
+     *  \param[in] kernel_filenames a vector of strings with 
+     *                              the names of the kernel files (.cl).
+     *  \param[in] build_options options that are forwarded to the OpenCL compiler.
+     *  \return The index of the requested program.
+     */
+    unsigned int CLEnv::getProgramIdx (unsigned int ctxIdx, 
+                                       const std::vector<std::string> &kernel_filenames, 
+                                       const char *build_options)
+    {
+        std::ostringstream signature;
+        signature << ctxIdx << ';';
+        for (auto &fName : kernel_filenames)
+            signature << fName << ';';
+        if (build_options)
+            signature << build_options;
+
+        auto it = programIdx.find (signature.str ());
+        if (it != programIdx.end ())
+            return it->second;
+
+        addProgram (ctxIdx, kernel_filenames, nullptr, build_options);
+        unsigned int pgIdx = programs.size () - 1;
+        programIdx[signature.str ()] = pgIdx;
+
+        return pgIdx;
+    }
+
+
+    /*! \details It is meant for kernels that are generated at runtime.
+     *  
+     *  \param[in] ctxIdx the index of the context the program is associated with. 
+     *                    Indices follow the order the contexts were created in.
+     *  \param[in] source a string with the source code of the program.
+     *  \param[in] kernel_name the name of a requested kernel.
+     *  \param[in] build_options options that are forwarded to the OpenCL compiler.
+     *  \return The requested kernel. If kernel_name is NULL, the first kernel 
+     *          of the program gets returned.
+     */
+    cl::Kernel& CLEnv::addProgramSource (unsigned int ctxIdx, 
+                                         const std::string &source, 
+                                         const char *kernel_name, const char *build_options)
+    {
+        try
+        {
+            std::vector<std::string> kernel_names = 
+                createProgram (ctxIdx, std::vector<std::string> { source }, build_options);
+            int pgIdx = programs.size () - 1;
+
+            if (kernel_name == nullptr)
+                return getKernel (kernel_names.at (0).c_str (), pgIdx);
+            else
+                return getKernel (kernel_name, pgIdx);
+        }
+        catch (const std::out_of_range &error)
+        {
+            std::cerr << "Out of Range error: " << error.what () 
+                      << " (" << __FILE__ << ":" << __LINE__ << ")" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+    }
+
+
+    /*! \details Programs created through this method are cached by their 
+     *           context index, signature and build options. The source code 
+     *           is only compiled the first time a signature is encountered, 
+     *           so the caller has to make sure that a signature identifies 
+     *           a single source code.
+     *  
+     *  \param[in] ctxIdx the index of the context the program is associated with. 
+     *                    Indices follow the order the contexts were created in.
+     *  \param[in] signature a string that identifies the source code.
+     *  \param[in] source a string with the source code of the program.
+     *  \param[in] build_options options that are forwarded to the OpenCL compiler.
+     *  \return The index of the requested program.
+     */
+    unsigned int CLEnv::getSourceProgramIdx (unsigned int ctxIdx, 
+                                             const std::string &signature, 
+                                             const std::string &source, 
+                                             const char *build_options)
+    {
+        // The leading '#' keeps source signatures apart from file signatures
+        std::ostringstream key;
+        key << ctxIdx << ";#" << signature << ';';
+        if (build_options)
+            key << build_options;
+
+        auto it = programIdx.find (key.str ());
+        if (it != programIdx.end ())
+            return it->second;
+
+        addProgramSource (ctxIdx, source, nullptr, build_options);
+        unsigned int pgIdx = programs.size () - 1;
+        programIdx[key.str ()] = pgIdx;
+
+        return pgIdx;
+    }
+
+
+    /*! \param[in] buffer the buffer.
+     */
+    BufferView::BufferView (const cl::Buffer &buffer) : 
+        buf (buffer), off (0), len (0), whole (true), sub (false)
+    {
+    }
+
+
+    /*! \details If `buffer` is itself a sub-buffer, the region is expressed 
+     *           on its parent, since sub-buffers can't be nested. A sub-buffer 
+     *           is only created when `origin` (on the parent) is a multiple of 
+     *           `alignment ()`. Otherwise, the view holds the parent buffer 
+     *           and `origin` as an offset, and `flags` are ignored.
+     *
+     *  \param[in] buffer the buffer.
+     *  \param[in] origin the offset of the region in `buffer`, in bytes.
+     *  \param[in] size the size of the region in bytes.
+     *  \param[in] flags the access flags of the sub-buffer. If 0, 
+     *                   they are inherited from the parent buffer.
+     */
+    BufferView::BufferView (const cl::Buffer &buffer, size_t origin, size_t size, cl_mem_flags flags) : 
+        buf (buffer), off (origin), len (size), whole (false), sub (false)
+    {
+        cl::Memory parent = buffer.getInfo<CL_MEM_ASSOCIATED_MEMOBJECT> ();
+        if (parent () != nullptr)
+        {
+            off += buffer.getInfo<CL_MEM_OFFSET> ();
+            clRetainMemObject (parent ());
+            buf = cl::Buffer (parent ());
+        }
+
+        if (off + len > buf.getInfo<CL_MEM_SIZE> ())
+            throw cl::Error (CL_INVALID_VALUE, "BufferView: region out of bounds");
+
+        if (len == 0 || off % alignment (buf.getInfo<CL_MEM_CONTEXT> ()) != 0)
+            return;
+
+        try
+        {
+            cl_buffer_region region = { off, len };
+            buf = buf.createSubBuffer (flags, CL_BUFFER_CREATE_TYPE_REGION, &region);
+            off = 0;
+            sub = true;
+        }
+        catch (const cl::Error &error)
+        {
+            // The offset is enough for the kernels to work with
+            if (error.err () != CL_MISALIGNED_SUB_BUFFER_OFFSET)
+                throw;
+        }
+    }
+
+
+    /*! \param[in] origin the offset of the region in the view, in bytes.
+     *  \param[in] size the size of the region in bytes.
+     *  \param[in] flags the access flags of the sub-buffer.
+     *  \return The view of the region.
+     */
+    BufferView BufferView::slice (size_t origin, size_t size, cl_mem_flags flags) const
+    {
+        return BufferView (buf, off + origin, size, flags);
+    }
+
+
+    /*! \return The size of the view in bytes.
+     */
+    size_t BufferView::size () const
+    {
+        return whole ? buf.getInfo<CL_MEM_SIZE> () : len;
+    }
+
+
+    /*! \details `CL_DEVICE_MEM_BASE_ADDR_ALIGN` is reported in bits. 
+     *           A sub-buffer has to satisfy every device in the context.
+     *
+     *  \param[in] context the context.
+     *  \return The alignment in bytes.
+     */
+    size_t BufferView::alignment (const cl::Context &context)
+    {
+        size_t align = 1;
+        for (auto &device : context.getInfo<CL_CONTEXT_DEVICES> ())
+            align = std::max (align, (size_t) device.getInfo<CL_DEVICE_MEM_BASE_ADDR_ALIGN> () / 8);
+
+        return align;
+    }
+
+
+    /*! \details The boundaries between the parts are rounded up to the 
+     *           alignment of the buffer's context, so every part starts 
+     *           on a sub-buffer. The parts are as equal as the alignment 
+     *           allows, and trailing parts may turn out empty when `n` is small.
+     *
+     *  \param[in] buffer the buffer.
+     *  \param[in] n the number of elements to split.
+     *  \param[in] elementSize the size of the elements in bytes.
+     *  \param[in] parts the number of parts.
+     *  \return The views of the parts.
+     */
+    std::vector<BufferView> partition (const cl::Buffer &buffer, size_t n, 
+                                       size_t elementSize, unsigned int parts)
+    {
+        // The smallest number of elements that spans a multiple of the alignment
+        size_t align = BufferView::alignment (buffer.getInfo<CL_MEM_CONTEXT> ());
+        size_t a = align, b = elementSize;
+        while (b != 0)
+        {
+            size_t t = a % b;
+            a = b;
+            b = t;
+        }
+        size_t step = align / a;
+
+        std::vector<BufferView> views;
+        size_t begin = 0;
+        for (unsigned int p = 1; p <= parts; ++p)
+        {
+            size_t end = (n * p / parts + step - 1) / step * step;
+            end = std::max (begin, std::min (end, n));
+            views.emplace_back (buffer, begin * elementSize, (end - begin) * elementSize);
+            begin = end;
+        }
+
+        return views;
+    }
+
+
+    /*! \brief Marks the absence of a cached buffer to keep from eviction. */
+    static const unsigned int noEntry = std::numeric_limits<unsigned int>::max ();
+
+    /*! \brief What the destructor callback of a buffer from 
+     *         `MemoryManager::createBuffer` needs. */
+    struct LibraryBuffer
+    {
+        std::shared_ptr< std::atomic<size_t> > bytes;  /*!< The counter of the manager. */
+        size_t size;  /*!< The size of the buffer in bytes. */
+    };
+
+    /*! \brief Takes a released buffer out of the accounting of its manager. */
+    static void CL_CALLBACK releaseLibraryBuffer (cl_mem, void *data)
+    {
+        LibraryBuffer *buffer = static_cast<LibraryBuffer *> (data);
+        *buffer->bytes -= buffer->size;
+        delete buffer;
+    }
+
+
+    /*! \param[in] context the context of the buffers.
+     *  \param[in] queue an in-order queue for the evictions and restorations.
+     *  \param[in] budget the budget in bytes. By default, it's the smallest 
+     *                    `CL_DEVICE_GLOBAL_MEM_SIZE` among the devices in the context.
+     */
+    MemoryManager::MemoryManager (const cl::Context &context, const cl::CommandQueue &queue, size_t budget)
+        : context (context), queue (queue), limit (budget), cachedBytes (0), 
+          libraryBytes (std::make_shared< std::atomic<size_t> > (0)), 
+          nEvictions (0), nRestorations (0), nextReclaimer (0)
+    {
+        if (limit == 0)
+        {
+            limit = std::numeric_limits<size_t>::max ();
+            for (auto &device : context.getInfo<CL_CONTEXT_DEVICES> ())
+                limit = std::min (limit, (size_t) device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE> ());
+        }
+    }
+
+
+    MemoryManager::~MemoryManager ()
+    {
+        try
+        {
+            // Pending transfers may still work on the backing stores
+            queue.finish ();
+        }
+        catch (const cl::Error &error)
+        {
+            std::cerr << "Error[MemoryManager]: " << error.what () << std::endl;
+        }
+    }
+
+
+    /*! \details Cached buffers are evicted, or dropped by the reclaimers, 
+     *           to make room for the buffer. Buffers in host memory (`CL_MEM_USE_HOST_PTR`, 
+     *           `CL_MEM_ALLOC_HOST_PTR`) are not accounted.
+     *
+     *  \param[in] flags the flags of the buffer.
+     *  \param[in] size the size of the buffer in bytes.
+     *  \return The buffer.
+     *  \throw cl::Error `CL_MEM_OBJECT_ALLOCATION_FAILURE`, when the 
+     *         buffer doesn't fit even after evicting all it can.
+     */
+    cl::Buffer MemoryManager::createBuffer (cl_mem_flags flags, size_t size)
+    {
+        if (flags & (CL_MEM_USE_HOST_PTR | CL_MEM_ALLOC_HOST_PTR))
+            return cl::Buffer (context, flags, size);
+
+        std::lock_guard<std::mutex> guard (mtx);
+
+        if (!makeRoom (size, noEntry))
+            throw cl::Error (CL_MEM_OBJECT_ALLOCATION_FAILURE, "MemoryManager::createBuffer");
+
+        cl::Buffer buffer (allocate (flags, size, noEntry));
+        *libraryBytes += size;
+        buffer.setDestructorCallback (releaseLibraryBuffer, new LibraryBuffer { libraryBytes, size });
+
+        return buffer;
+    }
+
+
+    /*! \details The device memory gets allocated on the first `acquire`.
+     *
+     *  \param[in] flags the flags of the buffer.
+     *  \param[in] size the size of the buffer in bytes.
+     *  \param[in] ptr the initial contents of the buffer, 
+     *                 which get copied to the backing store.
+     *  \return The index of the buffer.
+     */
+    unsigned int MemoryManager::cache (cl_mem_flags flags, size_t size, const void *ptr)
+    {
+        std::lock_guard<std::mutex> guard (mtx);
+
+        unsigned int idx;
+        if (freeEntries.empty ())
+        {
+            idx = entries.size ();
+            entries.emplace_back ();
+        }
+        else
+        {
+            idx = freeEntries.back ();
+            freeEntries.pop_back ();
+        }
+
+        Entry &e (entries[idx]);
+        e.flags = flags;
+        e.size = size;
+        e.valid = ptr != nullptr;
+        e.resident = false;
+        e.live = true;
+        e.locks = 0;
+        if (ptr)
+            e.host.assign ((const char *) ptr, (const char *) ptr + size);
+        e.use = lru.insert (lru.end (), idx);
+
+        return idx;
+    }
+
+
+    /*! \details The buffer becomes the most recently used one. 
+     *           If it isn't on the device, room is made for it, and 
+     *           its contents are written back from the backing store.
+     *
+     *  \param[in] idx the index of the buffer.
+     *  \return The buffer.
+     *  \throw cl::Error `CL_MEM_OBJECT_ALLOCATION_FAILURE`, when the 
+     *         buffer doesn't fit even after evicting all it can.
+     */
+    const cl::Buffer& MemoryManager::acquire (unsigned int idx)
+    {
+        std::lock_guard<std::mutex> guard (mtx);
+
+        Entry &e (entry (idx));
+        lru.splice (lru.end (), lru, e.use);
+
+        if (!e.resident)
+        {
+            if (!makeRoom (e.size, idx))
+                throw cl::Error (CL_MEM_OBJECT_ALLOCATION_FAILURE, "MemoryManager::acquire");
+
+            e.buffer = allocate (e.flags, e.size, idx);
+            if (e.valid)
+            {
+                queue.enqueueWriteBuffer (e.buffer, CL_FALSE, 0, e.size, e.host.data (), nullptr, &e.pending);
+                ++nRestorations;
+            }
+
+            e.resident = true;
+            cachedBytes += e.size;
+        }
+
+        return e.buffer;
+    }
+
+
+    /*! \details Locks nest, and a buffer can be evicted 
+     *           once every lock has been undone.
+     *
+     *  \param[in] idx the index of the buffer.
+     */
+    void MemoryManager::lock (unsigned int idx)
+    {
+        std::lock_guard<std::mutex> guard (mtx);
+        ++entry (idx).locks;
+    }
+
+
+    /*! \param[in] idx the index of the buffer.
+     */
+    void MemoryManager::unlock (unsigned int idx)
+    {
+        std::lock_guard<std::mutex> guard (mtx);
+        Entry &e (entry (idx));
+        if (e.locks)
+            --e.locks;
+    }
+
+
+    /*! \details The index may be reused by a later `cache`.
+     *
+     *  \param[in] idx the index of the buffer.
+     */
+    void MemoryManager::release (unsigned int idx)
+    {
+        std::lock_guard<std::mutex> guard (mtx);
+
+        Entry &e (entry (idx));
+        if (e.pending ())
+            e.pending.wait ();
+
+        if (e.resident)
+            cachedBytes -= e.size;
+        lru.erase (e.use);
+
+        e.buffer = cl::Buffer ();
+        e.pending = cl::Event ();
+        std::vector<char> ().swap (e.host);
+        e.resident = false;
+        e.live = false;
+        freeEntries.push_back (idx);
+    }
+
+
+    /*! \param[in] idx the index of the buffer.
+     *  \return Whether the buffer is on the device.
+     */
+    bool MemoryManager::isResident (unsigned int idx) const
+    {
+        std::lock_guard<std::mutex> guard (mtx);
+        return idx < entries.size () && entries[idx].live && entries[idx].resident;
+    }
+
+
+    /*! \details Locked buffers, and the buffers from `createBuffer` that 
+     *           no reclaimer drops, can't be evicted, so the usage may stay 
+     *           above the budget.
+     *
+     *  \param[in] bytes the new budget in bytes.
+     */
+    void MemoryManager::setBudget (size_t bytes)
+    {
+        std::lock_guard<std::mutex> guard (mtx);
+        limit = bytes;
+        makeRoom (0, noEntry);
+    }
+
+
+    /*! \details A reclaimer drops one of the buffers its cache holds, and 
+     *           returns its size in bytes, or 0 when it has none to drop. 
+     *           It's called when evicting the cached buffers of the manager 
+     *           isn't enough for a request, from within `createBuffer`, 
+     *           `acquire` and `setBudget`. The dropped buffer stops counting 
+     *           against the budget once the runtime releases it.
+     *  \note A reclaimer is called with the manager locked, so it must not 
+     *        call back into the manager, and it must not block on a lock 
+     *        that another thread may hold while it waits on the manager.
+     *
+     *  \param[in] reclaimer the function that drops a buffer.
+     *  \return The id of the reclaimer, for `removeReclaimer`.
+     */
+    unsigned int MemoryManager::addReclaimer (std::function<size_t ()> reclaimer)
+    {
+        std::lock_guard<std::mutex> guard (mtx);
+        reclaimers[nextReclaimer] = std::move (reclaimer);
+        return nextReclaimer++;
+    }
+
+
+    /*! \details The reclaimer is never called again once this returns.
+     *
+     *  \param[in] id the id from `addReclaimer`.
+     */
+    void MemoryManager::removeReclaimer (unsigned int id)
+    {
+        std::lock_guard<std::mutex> guard (mtx);
+        reclaimers.erase (id);
+    }
+
+
+    /*! \details The contents of the buffer are read back to the backing store 
+     *           without blocking. The runtime keeps the device memory until 
+     *           the read completes.
+     *
+     *  \param[in] keep the index of a buffer that must stay on the device.
+     *  \return Whether a buffer was evicted.
+     */
+    bool MemoryManager::evictOne (unsigned int keep)
+    {
+        for (unsigned int idx : lru)
+        {
+            Entry &e (entries[idx]);
+            if (idx == keep || !e.resident || e.locks)
+                continue;
+
+            e.host.resize (e.size);
+            queue.enqueueReadBuffer (e.buffer, CL_FALSE, 0, e.size, e.host.data (), nullptr, &e.pending);
+            e.buffer = cl::Buffer ();
+            e.valid = true;
+            e.resident = false;
+            cachedBytes -= e.size;
+            ++nEvictions;
+
+            return true;
+        }
+
+        return false;
+    }
+
+
+    /*! \details The reclaimers are asked in turn, until one drops a buffer. 
+     *           The buffer may still be held by someone, or have commands 
+     *           pending on it, so what counts is the memory the runtime 
+     *           actually releases. If the accounting doesn't fall right away, 
+     *           the queue is finished, as `allocate` does, and it's checked 
+     *           once more.
+     *
+     *  \return The bytes released, or 0 when dropping made no progress.
+     */
+    size_t MemoryManager::reclaim ()
+    {
+        for (auto &r : reclaimers)
+        {
+            size_t before = *libraryBytes;
+            if (r.second () == 0)
+                continue;
+
+            if (*libraryBytes >= before)
+                queue.finish ();
+
+            size_t after = *libraryBytes;
+            return after < before ? before - after : 0;
+        }
+
+        return 0;
+    }
+
+
+    /*! \details The cached buffers of the manager are evicted first, 
+     *           and the reclaimers are asked to drop buffers after that. 
+     *           It gives up as soon as a reclaimer makes no progress, so 
+     *           a request that can't fit doesn't drain every cache.
+     *
+     *  \param[in] size the number of bytes to make room for.
+     *  \param[in] keep the index of a buffer that must stay on the device.
+     *  \return Whether the bytes fit in the budget.
+     */
+    bool MemoryManager::makeRoom (size_t size, unsigned int keep)
+    {
+        while (usedBytes () + size > limit)
+            if (!evictOne (keep) && reclaim () == 0)
+                return false;
+
+        return true;
+    }
+
+
+    /*! \details The budget may overestimate the memory that is actually 
+     *           available. When the runtime fails the allocation, buffers 
+     *           are evicted, or dropped, one at a time, and the allocation 
+     *           is retried.
+     *
+     *  \param[in] flags the flags of the buffer.
+     *  \param[in] size the size of the buffer in bytes.
+     *  \param[in] keep the index of a buffer that must stay on the device.
+     *  \return The buffer.
+     */
+    cl::Buffer MemoryManager::allocate (cl_mem_flags flags, size_t size, unsigned int keep)
+    {
+        while (true)
+        {
+            try
+            {
+                return cl::Buffer (context, flags, size);
+            }
+            catch (const cl::Error &error)
+            {
+                if ((error.err () != CL_MEM_OBJECT_ALLOCATION_FAILURE && 
+                     error.err () != CL_OUT_OF_RESOURCES) || (!evictOne (keep) && reclaim () == 0))
+                    throw;
+
+                // Let the device memory of the evicted or dropped buffer go
+                queue.finish ();
+            }
+        }
+    }
+
+
+    /*! \param[in] idx the index of the buffer.
+     *  \return The entry of the buffer.
+     */
+    MemoryManager::Entry& MemoryManager::entry (unsigned int idx)
+    {
+        try
+        {
+            Entry &e (entries.at (idx));
+            if (!e.live)
+                throw "The buffer has been released";
+
+            return e;
+        }
+        catch (const std::out_of_range &error)
+        {
+            std::cerr << "Out of Range error: " << error.what () 
+                      << " (" << __FILE__ << ":" << __LINE__ << ")" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+        catch (const char *error)
+        {
+            std::cerr << "Error[MemoryManager]: " << error << std::endl;
+            exit (EXIT_FAILURE);
+        }
+    }
+
+
+    /*! \param[in] filename the name of the file.
+     */
+    MappedFile::MappedFile (const std::string &filename) : ptr (nullptr), len (0)
+    {
+        bool ok = false;
+
+        #if defined(_WIN32)
+        mapping = nullptr;
+        file = CreateFileA (filename.c_str (), GENERIC_READ, FILE_SHARE_READ, nullptr, 
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER fileSize;
+        if (file != INVALID_HANDLE_VALUE && GetFileSizeEx (file, &fileSize))
+        {
+            len = fileSize.QuadPart;
+            ok = (len == 0);
+            if (len > 0 && (mapping = CreateFileMappingA (file, nullptr, PAGE_READONLY, 0, 0, nullptr)))
+                ok = (ptr = MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0)) != nullptr;
+        }
+        #else
+        struct stat st;
+        fd = open (filename.c_str (), O_RDONLY);
+        if (fd >= 0 && fstat (fd, &st) == 0)
+        {
+            len = st.st_size;
+            ok = (len == 0);
+            if (len > 0 && (ptr = mmap (nullptr, len, PROT_READ, MAP_SHARED, fd, 0)) != MAP_FAILED)
+            {
+                // The file is expected to be read front to back
+                madvise (ptr, len, MADV_SEQUENTIAL);
+                ok = true;
+            }
+            else if (len > 0)
+                ptr = nullptr;
+        }
+        #endif
+
+        if (!ok)
+        {
+            std::cerr << "Error when mapping file: " << filename 
+                      << " (" << __FILE__ << ":" << __LINE__ << ")" << std::endl;
+            exit (EXIT_FAILURE);
+        }
+    }
+
+
+    MappedFile::~MappedFile ()
+    {
+        #if defined(_WIN32)
+        if (ptr) UnmapViewOfFile (ptr);
+        if (mapping) CloseHandle (mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle (file);
+        #else
+        if (ptr) munmap (ptr, len);
+        if (fd >= 0) close (fd);
+        #endif
+    }
+
+
+    /*! \details The TSC is read on both ends of a 2ms window of `steady_clock`. 
+     *           The reads of the two clocks on each end are bracketed by two 
+     *           reads of the TSC, and the sample with the narrowest bracket out 
+     *           of a few is kept, which limits the error a preemption can cause.
+     */
+    TSCClock::Calibration TSCClock::calibrate ()
+    {
+        Calibration c = { false, 0, 0.0, 0 };
+
+        #if defined(CLUTILS_HAS_TSC)
+        unsigned int regs[4] = { 0, 0, 0, 0 };
+        #if defined(_MSC_VER)
+        int info[4];
+        __cpuid (info, 0x80000000);
+        if ((unsigned int) info[0] >= 0x80000007)
+        {
+            __cpuid (info, 0x80000007);
+            regs[3] = (unsigned int) info[3];
+        }
+        #else
+        if (__get_cpuid_max (0x80000000, nullptr) >= 0x80000007)
+            __get_cpuid (0x80000007, &regs[0], &regs[1], &regs[2], &regs[3]);
+        #endif
+        // Invariant TSC: EDX bit 8 of leaf 0x80000007
+        if (!(regs[3] & (1 << 8)))
+            return c;
+
+        typedef std::chrono::steady_clock steady;
+        auto sample = [] (uint64_t &tsc, steady::time_point &t)
+        {
+            uint64_t best = std::numeric_limits<uint64_t>::max ();
+            for (int i = 0; i < 5; ++i)
+            {
+                uint64_t t0 = readTSC ();
+                steady::time_point now = steady::now ();
+                uint64_t t1 = readTSC ();
+                if (t1 - t0 < best)
+                {
+                    best = t1 - t0;
+                    tsc = t0 + (t1 - t0) / 2;
+                    t = now;
+                }
+            }
+        };
+
+        uint64_t tsc0, tsc1;
+        steady::time_point t0, t1;
+        sample (tsc0, t0);
+        while (steady::now () - t0 < std::chrono::milliseconds (2));
+        sample (tsc1, t1);
+
+        if (tsc1 <= tsc0)
+            return c;
+
+        c.available = true;
+        c.base = tsc1;
+        c.nsPerTick = std::chrono::duration<double, std::nano> (t1 - t0).count () / (double) (tsc1 - tsc0);
+        c.offset = std::chrono::duration_cast<std::chrono::nanoseconds> (t1.time_since_epoch ()).count ();
+        #endif
+
+        return c;
+    }
+
 }
@@ -0,0 +1,369 @@
+/*! \file verify.cpp
+ *  \brief Definitions of the host reference implementations, and of the
+ *         dispatch of their kernels to the instruction set of the CPU.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <atomic>
+#include <CLUtils/verify.hpp>
+#include "verify_kernels.hpp"
+
+
+namespace clutils
+{
+
+namespace host
+{
+
+    namespace detail
+    {
+
+        static_assert ((uint8_t) OpKind::SUM == opSum && (uint8_t) OpKind::MIN == opMin && 
+                       (uint8_t) OpKind::MAX == opMax, "The kernels number the operators as OpKind");
+
+
+        /*! \brief The scalar kernels, which are also the reference of the vector ones. */
+        namespace scalar
+        {
+
+            void vecAdd (const cl_int *a, const cl_int *b, cl_int *c, size_t n)
+            {
+                for (size_t i = 0; i < n; ++i)
+                    c[i] = (cl_int) ((cl_uint) a[i] + (cl_uint) b[i]);
+            }
+
+            cl_int reduceInt (const cl_int *data, size_t n, uint8_t op)
+            {
+                if (op == opSum)
+                    return (cl_int) detail::reduce<cl_uint> ((const cl_uint *) data, n, OpKind::SUM);
+                return detail::reduce<cl_int> (data, n, (OpKind) op);
+            }
+
+            cl_uint reduceUInt (const cl_uint *data, size_t n, uint8_t op)
+            {
+                return detail::reduce<cl_uint> (data, n, (OpKind) op);
+            }
+
+            cl_float reduceFloat (const cl_float *data, size_t n, uint8_t op)
+            {
+                return detail::reduce<cl_float> (data, n, (OpKind) op);
+            }
+
+            void scanInt (const cl_int *in, cl_int *out, size_t n, uint8_t op, bool inclusive)
+            {
+                if (op == opSum)
+                    detail::scan<cl_uint> ((const cl_uint *) in, (cl_uint *) out, n, OpKind::SUM, inclusive);
+                else
+                    detail::scan<cl_int> (in, out, n, (OpKind) op, inclusive);
+            }
+
+            void scanUInt (const cl_uint *in, cl_uint *out, size_t n, uint8_t op, bool inclusive)
+            {
+                detail::scan<cl_uint> (in, out, n, (OpKind) op, inclusive);
+            }
+
+            void scanFloat (const cl_float *in, cl_float *out, size_t n, uint8_t op, bool inclusive)
+            {
+                detail::scan<cl_float> (in, out, n, (OpKind) op, inclusive);
+            }
+
+            template <typename T>
+            size_t compareBits (const void *expected, const void *actual, size_t n, 
+                                size_t *first, size_t maxReports)
+            {
+                const T *e = (const T *) expected, *a = (const T *) actual;
+                size_t count = 0, reported = 0;
+                for (size_t i = 0; i < n; ++i)
+                    if (e[i] != a[i])
+                        report (1, i, count, first, reported, maxReports);
+
+                return count;
+            }
+
+            size_t compareULP (const cl_float *expected, const cl_float *actual, size_t n, 
+                               cl_uint maxUlps, size_t *first, size_t maxReports)
+            {
+                size_t count = 0, reported = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    int32_t x, y;
+                    std::memcpy (&x, expected + i, sizeof (x));
+                    std::memcpy (&y, actual + i, sizeof (y));
+                    bool nanX = isNaNBits (x), nanY = isNaNBits (y);
+                    if (nanX != nanY || (!nanX && ulpDistanceBits (x, y) > maxUlps))
+                        report (1, i, count, first, reported, maxReports);
+                }
+
+                return count;
+            }
+
+            void hashBlocks (uint64_t *acc, const uint8_t *data, size_t nBlocks)
+            {
+                for (size_t b = 0; b < nBlocks; ++b, data += hashBlock)
+                {
+                    for (size_t j = 0; j < hashStripesPerBlock; ++j)
+                        hashStripeScalar (acc, data + j * hashStripe, hashSecret + j);
+                    hashScrambleScalar (acc);
+                }
+            }
+
+        }
+
+        const Kernels scalarKernels = {
+            scalar::vecAdd, scalar::reduceInt, scalar::reduceUInt, scalar::reduceFloat, 
+            scalar::scanInt, scalar::scanUInt, scalar::scanFloat, 
+            scalar::compareBits<uint32_t>, scalar::compareBits<uint64_t>, scalar::compareULP, 
+            scalar::hashBlocks };
+
+
+        /*! \brief Returns the level in use. */
+        std::atomic<SimdLevel>& currentLevel ()
+        {
+            static std::atomic<SimdLevel> level (supportedSimdLevel ());
+            return level;
+        }
+
+        /*! \brief Returns the kernels of the level in use. */
+        const Kernels& kernels ()
+        {
+            switch (currentLevel ().load (std::memory_order_relaxed))
+            {
+#ifdef CLUTILS_HAVE_X86_SIMD
+                case SimdLevel::AVX512: return avx512Kernels;
+                case SimdLevel::AVX2: return avx2Kernels;
+                case SimdLevel::SSE41: return sse41Kernels;
+#endif
+                default: return scalarKernels;
+            }
+        }
+
+
+        cl_int reduce (const cl_int *data, size_t n, OpKind op)
+        {
+            return kernels ().reduceInt (data, n, (uint8_t) op);
+        }
+
+        cl_uint reduce (const cl_uint *data, size_t n, OpKind op)
+        {
+            return kernels ().reduceUInt (data, n, (uint8_t) op);
+        }
+
+        cl_float reduce (const cl_float *data, size_t n, OpKind op)
+        {
+            return kernels ().reduceFloat (data, n, (uint8_t) op);
+        }
+
+        void scan (const cl_int *in, cl_int *out, size_t n, OpKind op, bool inclusive)
+        {
+            kernels ().scanInt (in, out, n, (uint8_t) op, inclusive);
+        }
+
+        void scan (const cl_uint *in, cl_uint *out, size_t n, OpKind op, bool inclusive)
+        {
+            kernels ().scanUInt (in, out, n, (uint8_t) op, inclusive);
+        }
+
+        void scan (const cl_float *in, cl_float *out, size_t n, OpKind op, bool inclusive)
+        {
+            kernels ().scanFloat (in, out, n, (uint8_t) op, inclusive);
+        }
+
+        size_t compare32 (const void *expected, const void *actual, size_t n, 
+                          size_t *first, size_t maxReports)
+        {
+            return kernels ().compare32 (expected, actual, n, first, maxReports);
+        }
+
+        size_t compare64 (const void *expected, const void *actual, size_t n, 
+                          size_t *first, size_t maxReports)
+        {
+            return kernels ().compare64 (expected, actual, n, first, maxReports);
+        }
+
+        size_t compareULP (const cl_float *expected, const cl_float *actual, size_t n, 
+                           cl_uint maxUlps, size_t *first, size_t maxReports)
+        {
+            return kernels ().compareULP (expected, actual, n, maxUlps, first, maxReports);
+        }
+
+    }
+
+
+    const char* simdLevelName (SimdLevel level)
+    {
+        switch (level)
+        {
+            case SimdLevel::SSE41: return "sse4.1";
+            case SimdLevel::AVX2: return "avx2";
+            case SimdLevel::AVX512: return "avx512";
+            default: return "scalar";
+        }
+    }
+
+
+    /*! \details The vector kernels are built only for x86, and 
+     *           the CPU features are read with the GCC/Clang builtins, 
+     *           which also check that the OS saves the wide registers.
+     */
+    SimdLevel supportedSimdLevel ()
+    {
+#ifdef CLUTILS_HAVE_X86_SIMD
+        __builtin_cpu_init ();
+        if (__builtin_cpu_supports ("avx512f"))
+            return SimdLevel::AVX512;
+        if (__builtin_cpu_supports ("avx2"))
+            return SimdLevel::AVX2;
+        if (__builtin_cpu_supports ("sse4.1"))
+            return SimdLevel::SSE41;
+#endif
+        return SimdLevel::SCALAR;
+    }
+
+
+    SimdLevel simdLevel ()
+    {
+        return detail::currentLevel ().load ();
+    }
+
+
+    SimdLevel setSimdLevel (SimdLevel level)
+    {
+        level = std::min (level, supportedSimdLevel ());
+        detail::currentLevel ().store (level);
+        return level;
+    }
+
+
+    void vecAdd (const cl_int *a, const cl_int *b, cl_int *c, size_t n)
+    {
+        detail::kernels ().vecAdd (a, b, c, n);
+    }
+
+
+    namespace detail
+    {
+
+        /*! \brief Mixes the contents of a host buffer into the accumulators of the hash.
+         *  \details The whole blocks go through the kernels, and the rest 
+         *           of the data, zero-padded to whole stripes, through the scalar code.
+         */
+        static void hashAccumulate (uint64_t *acc, const void *data, size_t bytes)
+        {
+            static const uint64_t init[8] = { 
+                0x00000000C2B2AE3Dull, 0x9E3779B185EBCA87ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 
+                0x85EBCA77C2B2AE63ull, 0x0000000085EBCA77ull, 0x27D4EB2F165667C5ull, 0x000000009E3779B1ull };
+            std::memcpy (acc, init, sizeof (init));
+
+            const uint8_t *p = (const uint8_t *) data;
+            size_t nBlocks = bytes / hashBlock;
+            kernels ().hashBlocks (acc, p, nBlocks);
+            p += nBlocks * hashBlock;
+
+            size_t rest = bytes - nBlocks * hashBlock, j = 0;
+            for (; (j + 1) * hashStripe <= rest; ++j)
+                hashStripeScalar (acc, p + j * hashStripe, hashSecret + j);
+            if (rest % hashStripe)
+            {
+                uint8_t last[hashStripe] = {};
+                std::memcpy (last, p + j * hashStripe, rest % hashStripe);
+                hashStripeScalar (acc, last, hashSecret + j);
+            }
+        }
+
+        /*! \brief Avalanches the bits of a folded hash. */
+        static inline uint64_t hashAvalanche (uint64_t h)
+        {
+            h ^= h >> 37;
+            h *= 0x165667919E3779F9ull;
+            h ^= h >> 32;
+
+            return h;
+        }
+
+    }
+
+
+    /*! \details The accumulators are folded in pairs with 128-bit 
+     *           products, along with the size, and the result is avalanched.
+     */
+    cl_ulong hash (const void *data, size_t bytes)
+    {
+        using namespace detail;
+
+        uint64_t acc[8];
+        hashAccumulate (acc, data, bytes);
+
+        uint64_t h = bytes * 0x9E3779B185EBCA87ull;
+        for (size_t i = 0; i < 8; i += 2)
+            h += hashMulFold (acc[i] ^ hashSecret[8 + i], acc[i + 1] ^ hashSecret[9 + i]);
+
+        return hashAvalanche (h);
+    }
+
+
+    /*! \details The fingerprint folds the same accumulators as the hash, 
+     *           but pairs them up differently, with the keys of the scramble 
+     *           and another multiplier for the size. Two buffers whose hashes 
+     *           collide, then, are very unlikely to have the same fingerprint, 
+     *           unless their accumulators are the same, and the data are 
+     *           read only once.
+     */
+    cl_ulong hash (const void *data, size_t bytes, cl_ulong &fingerprint)
+    {
+        using namespace detail;
+
+        uint64_t acc[8];
+        hashAccumulate (acc, data, bytes);
+
+        uint64_t h = bytes * 0x9E3779B185EBCA87ull;
+        uint64_t f = bytes * 0xC2B2AE3D27D4EB4Full;
+        for (size_t i = 0; i < 8; i += 2)
+        {
+            h += hashMulFold (acc[i] ^ hashSecret[8 + i], acc[i + 1] ^ hashSecret[9 + i]);
+            f += hashMulFold (acc[i] ^ hashSecret[16 + i], acc[i ^ 3] ^ hashSecret[17 + i]);
+        }
+        fingerprint = hashAvalanche (f);
+
+        return hashAvalanche (h);
+    }
+
+
+    cl_uint ulpDistance (cl_float a, cl_float b)
+    {
+        if (std::isnan (a) || std::isnan (b))
+            return UINT32_MAX;
+
+        int32_t x, y;
+        std::memcpy (&x, &a, sizeof (x));
+        std::memcpy (&y, &b, sizeof (y));
+        return detail::ulpDistanceBits (x, y);
+    }
+
+}
+
+}
@@ -0,0 +1,675 @@
+/*! \file verify_kernels.hpp
+ *  \brief Declarations of the tables of the host kernels, and their vector
+ *         implementations, compiled once per instruction set by `verify_<isa>.cpp`.
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+
+
+#ifndef CLUTILS_VERIFY_KERNELS_HPP
+#define CLUTILS_VERIFY_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+namespace clutils
+{
+
+namespace host
+{
+
+    namespace detail
+    {
+
+        /*! \brief The operators of the kernels, numbered as in `OpKind`. */
+        const uint8_t opSum = 0, opMin = 1, opMax = 2;
+
+        /*! \brief The kernels of an instruction set.
+         *  \note The kernels don't include `CLUtils.hpp`, so that none of its 
+         *        inline functions is built for a wider instruction set. 
+         *        The linker could keep that copy for the whole program.
+         */
+        struct Kernels
+        {
+            void (*vecAdd) (const int32_t *a, const int32_t *b, int32_t *c, size_t n);
+            int32_t (*reduceInt) (const int32_t *data, size_t n, uint8_t op);
+            uint32_t (*reduceUInt) (const uint32_t *data, size_t n, uint8_t op);
+            float (*reduceFloat) (const float *data, size_t n, uint8_t op);
+            void (*scanInt) (const int32_t *in, int32_t *out, size_t n, uint8_t op, bool inclusive);
+            void (*scanUInt) (const uint32_t *in, uint32_t *out, size_t n, uint8_t op, bool inclusive);
+            void (*scanFloat) (const float *in, float *out, size_t n, uint8_t op, bool inclusive);
+            size_t (*compare32) (const void *expected, const void *actual, size_t n, 
+                                 size_t *first, size_t maxReports);
+            size_t (*compare64) (const void *expected, const void *actual, size_t n, 
+                                 size_t *first, size_t maxReports);
+            size_t (*compareULP) (const float *expected, const float *actual, size_t n, 
+                                  uint32_t maxUlps, size_t *first, size_t maxReports);
+            void (*hashBlocks) (uint64_t *acc, const uint8_t *data, size_t nBlocks);
+        };
+
+#ifdef CLUTILS_HAVE_X86_SIMD
+        extern const Kernels sse41Kernels;
+        extern const Kernels avx2Kernels;
+        extern const Kernels avx512Kernels;
+#endif
+
+        /*! \brief Records the mismatches in a bitmask of lanes.
+         *  \note The helpers are static, so that every instruction set has its own copy.
+         */
+        static inline void report (uint64_t bits, size_t base, size_t &count, 
+                                   size_t *first, size_t &reported, size_t maxReports)
+        {
+            count += __builtin_popcountll (bits);
+            for (; bits && reported < maxReports; bits &= bits - 1)
+                first[reported++] = base + __builtin_ctzll (bits);
+        }
+
+        /*! \brief Returns the distance in ULPs between the bits of two floats.
+         *  \details The bits are mapped to integers in the order of the floats, 
+         *           with both zeros at 0.
+         */
+        static inline uint32_t ulpDistanceBits (int32_t x, int32_t y)
+        {
+            int64_t ox = x < 0 ? (int64_t) INT32_MIN - x : x;
+            int64_t oy = y < 0 ? (int64_t) INT32_MIN - y : y;
+            return (uint32_t) (ox > oy ? ox - oy : oy - ox);
+        }
+
+        /*! \brief Returns whether the bits of a float are a NaN. */
+        static inline bool isNaNBits (int32_t x)
+        {
+            return (x & 0x7FFFFFFF) > 0x7F800000;
+        }
+
+
+        /*! \brief The layout of the content hash.
+         *  \details The hash keeps 8 64-bit accumulators. The data are consumed 
+         *           in 64-byte stripes, every lane of which gets mixed with a key 
+         *           that depends on the position of the stripe in its block. 
+         *           Every block of 16 stripes ends with a scramble of the 
+         *           accumulators, which makes the hash depend on the order of 
+         *           the blocks. The lanes are independent, so the vector kernels 
+         *           produce the same hash as the scalar one.
+         */
+        const size_t hashStripe = 64, hashStripesPerBlock = 16;
+        const size_t hashBlock = hashStripe * hashStripesPerBlock;
+        const uint64_t hashPrime32 = 0x9E3779B1ull;
+
+        /*! \brief The keys of the hash. Stripe `j` of a block uses `[j, j + 8)`, 
+         *         and the scramble uses `[16, 24)`. */
+        alignas (64) static const uint64_t hashSecret[24] = {
+            0xc0e16b163a85a4dcull, 0x890acd8dd443c47cull, 0xb3889d8a6dc47761ull, 0x6a0398e528f0ae6aull,
+            0x048344ece48a855eull, 0xf175cfea21871330ull, 0x391ceef02702c2fdull, 0x4baf8cac4784cb12ull,
+            0x3547744583a3f88eull, 0xd9cf2b15c6b6c90eull, 0x961facc76d5fe21cull, 0x0094ab49d50f11f9ull,
+            0xe3211e37bdbeb6dcull, 0x62fe6c274ff3511aull, 0x5ac30b329fdf0574ull, 0x1450582c6b65b406ull,
+            0x7a30fcc7888eb791ull, 0x5540f5ba6a15576eull, 0x16cef0559096d3e9ull, 0x2cf8f14b06874899ull,
+            0xc9c9263b6e2ce103ull, 0xd6ff920b0a9faa6dull, 0x53192697db998dc1ull, 0x73ea9b9bc7cd18d7ull };
+
+        /*! \brief Mixes a stripe into the accumulators. */
+        static inline void hashStripeScalar (uint64_t *acc, const uint8_t *data, const uint64_t *key)
+        {
+            for (size_t i = 0; i < 8; ++i)
+            {
+                uint64_t d;
+                std::memcpy (&d, data + 8 * i, sizeof (d));
+                uint64_t dk = d ^ key[i];
+                acc[i ^ 1] += d;
+                acc[i] += (dk & 0xFFFFFFFF) * (dk >> 32);
+            }
+        }
+
+        /*! \brief Scrambles the accumulators at the end of a block. */
+        static inline void hashScrambleScalar (uint64_t *acc)
+        {
+            for (size_t i = 0; i < 8; ++i)
+                acc[i] = (acc[i] ^ (acc[i] >> 47) ^ hashSecret[16 + i]) * hashPrime32;
+        }
+
+        /*! \brief Returns the low half of the 128-bit product of two values, 
+         *         xor the high half.
+         *  \details The product is built from 32-bit halves, since not every 
+         *           target (e.g. 32-bit x86) has a 128-bit integer type.
+         */
+        static inline uint64_t hashMulFold (uint64_t a, uint64_t b)
+        {
+            uint64_t lolo = (a & 0xFFFFFFFF) * (b & 0xFFFFFFFF);
+            uint64_t hilo = (a >> 32) * (b & 0xFFFFFFFF);
+            uint64_t lohi = (a & 0xFFFFFFFF) * (b >> 32);
+            uint64_t hihi = (a >> 32) * (b >> 32);
+
+            // It can't overflow: at most (2^32 - 1) * (2^32 + 1)
+            uint64_t cross = (lolo >> 32) + (hilo & 0xFFFFFFFF) + lohi;
+            uint64_t hi = (hilo >> 32) + (cross >> 32) + hihi;
+            uint64_t lo = (cross << 32) | (lolo & 0xFFFFFFFF);
+
+            return lo ^ hi;
+        }
+
+    }
+
+}
+
+}
+
+#endif  // CLUTILS_VERIFY_KERNELS_HPP
+
+
+#ifdef CLUTILS_SIMD_NS
+
+#include <cstring>
+#include <cfloat>
+#include <immintrin.h>
+
+
+namespace clutils
+{
+
+namespace host
+{
+
+namespace detail
+{
+
+namespace CLUTILS_SIMD_NS
+{
+
+#if defined (CLUTILS_SIMD_SSE41)
+
+    /*! \brief The vector operations on SSE4.1. */
+    struct V
+    {
+        typedef __m128i I;
+        typedef __m128i M;  /*!< A mask of lanes. */
+        static const size_t W = 4;  /*!< The 32-bit lanes. */
+
+        static I load (const void *p) { return _mm_loadu_si128 ((const __m128i *) p); }
+        static void store (void *p, I a) { _mm_storeu_si128 ((__m128i *) p, a); }
+        static I set1 (int32_t x) { return _mm_set1_epi32 (x); }
+        static I add (I a, I b) { return _mm_add_epi32 (a, b); }
+        static I sub (I a, I b) { return _mm_sub_epi32 (a, b); }
+        static I mins (I a, I b) { return _mm_min_epi32 (a, b); }
+        static I maxs (I a, I b) { return _mm_max_epi32 (a, b); }
+        static I minu (I a, I b) { return _mm_min_epu32 (a, b); }
+        static I maxu (I a, I b) { return _mm_max_epu32 (a, b); }
+        static I addf (I a, I b) { return _mm_castps_si128 (_mm_add_ps (_mm_castsi128_ps (a), _mm_castsi128_ps (b))); }
+        static I minf (I a, I b) { return _mm_castps_si128 (_mm_min_ps (_mm_castsi128_ps (a), _mm_castsi128_ps (b))); }
+        static I maxf (I a, I b) { return _mm_castps_si128 (_mm_max_ps (_mm_castsi128_ps (a), _mm_castsi128_ps (b))); }
+        static I and_ (I a, I b) { return _mm_and_si128 (a, b); }
+        static I andnot (I a, I b) { return _mm_andnot_si128 (a, b); }
+        static I or_ (I a, I b) { return _mm_or_si128 (a, b); }
+        static I srai31 (I a) { return _mm_srai_epi32 (a, 31); }
+        static M eq (I a, I b) { return _mm_cmpeq_epi32 (a, b); }
+        static M gt (I a, I b) { return _mm_cmpgt_epi32 (a, b); }
+        static M mand (M a, M b) { return _mm_and_si128 (a, b); }
+        static M mor (M a, M b) { return _mm_or_si128 (a, b); }
+        static M mandnot (M a, M b) { return _mm_andnot_si128 (a, b); }
+        static uint64_t bits (M m) { return _mm_movemask_ps (_mm_castsi128_ps (m)); }
+        static uint64_t eqBits64 (I a, I b) { return _mm_movemask_pd (_mm_castsi128_pd (_mm_cmpeq_epi64 (a, b))); }
+        static I xor_ (I a, I b) { return _mm_xor_si128 (a, b); }
+        static I set1_64 (uint64_t x) { return _mm_set1_epi64x (x); }
+        static I add64 (I a, I b) { return _mm_add_epi64 (a, b); }
+        static I mul32 (I a, I b) { return _mm_mul_epu32 (a, b); }  /*!< The low halves of the 64-bit lanes. */
+        template <int N> static I srli64 (I a) { return _mm_srli_epi64 (a, N); }
+        template <int N> static I slli64 (I a) { return _mm_slli_epi64 (a, N); }
+        static I swap64 (I a) { return _mm_shuffle_epi32 (a, _MM_SHUFFLE (1, 0, 3, 2)); }  /*!< Swaps the pairs of 64-bit lanes. */
+    };
+
+#elif defined (CLUTILS_SIMD_AVX2)
+
+    /*! \brief The vector operations on AVX2. */
+    struct V
+    {
+        typedef __m256i I;
+        typedef __m256i M;  /*!< A mask of lanes. */
+        static const size_t W = 8;  /*!< The 32-bit lanes. */
+
+        static I load (const void *p) { return _mm256_loadu_si256 ((const __m256i *) p); }
+        static void store (void *p, I a) { _mm256_storeu_si256 ((__m256i *) p, a); }
+        static I set1 (int32_t x) { return _mm256_set1_epi32 (x); }
+        static I add (I a, I b) { return _mm256_add_epi32 (a, b); }
+        static I sub (I a, I b) { return _mm256_sub_epi32 (a, b); }
+        static I mins (I a, I b) { return _mm256_min_epi32 (a, b); }
+        static I maxs (I a, I b) { return _mm256_max_epi32 (a, b); }
+        static I minu (I a, I b) { return _mm256_min_epu32 (a, b); }
+        static I maxu (I a, I b) { return _mm256_max_epu32 (a, b); }
+        static I addf (I a, I b) { return _mm256_castps_si256 (_mm256_add_ps (_mm256_castsi256_ps (a), _mm256_castsi256_ps (b))); }
+        static I minf (I a, I b) { return _mm256_castps_si256 (_mm256_min_ps (_mm256_castsi256_ps (a), _mm256_castsi256_ps (b))); }
+        static I maxf (I a, I b) { return _mm256_castps_si256 (_mm256_max_ps (_mm256_castsi256_ps (a), _mm256_castsi256_ps (b))); }
+        static I and_ (I a, I b) { return _mm256_and_si256 (a, b); }
+        static I andnot (I a, I b) { return _mm256_andnot_si256 (a, b); }
+        static I or_ (I a, I b) { return _mm256_or_si256 (a, b); }
+        static I srai31 (I a) { return _mm256_srai_epi32 (a, 31); }
+        static M eq (I a, I b) { return _mm256_cmpeq_epi32 (a, b); }
+        static M gt (I a, I b) { return _mm256_cmpgt_epi32 (a, b); }
+        static M mand (M a, M b) { return _mm256_and_si256 (a, b); }
+        static M mor (M a, M b) { return _mm256_or_si256 (a, b); }
+        static M mandnot (M a, M b) { return _mm256_andnot_si256 (a, b); }
+        static uint64_t bits (M m) { return (uint32_t) _mm256_movemask_ps (_mm256_castsi256_ps (m)); }
+        static uint64_t eqBits64 (I a, I b) { return _mm256_movemask_pd (_mm256_castsi256_pd (_mm256_cmpeq_epi64 (a, b))); }
+        static I xor_ (I a, I b) { return _mm256_xor_si256 (a, b); }
+        static I set1_64 (uint64_t x) { return _mm256_set1_epi64x (x); }
+        static I add64 (I a, I b) { return _mm256_add_epi64 (a, b); }
+        static I mul32 (I a, I b) { return _mm256_mul_epu32 (a, b); }  /*!< The low halves of the 64-bit lanes. */
+        template <int N> static I srli64 (I a) { return _mm256_srli_epi64 (a, N); }
+        template <int N> static I slli64 (I a) { return _mm256_slli_epi64 (a, N); }
+        static I swap64 (I a) { return _mm256_shuffle_epi32 (a, _MM_SHUFFLE (1, 0, 3, 2)); }  /*!< Swaps the pairs of 64-bit lanes. */
+    };
+
+#elif defined (CLUTILS_SIMD_AVX512)
+
+    /*! \brief The vector operations on AVX-512F. The masks live in mask registers. */
+    struct V
+    {
+        typedef __m512i I;
+        typedef __mmask16 M;  /*!< A mask of lanes. */
+        static const size_t W = 16;  /*!< The 32-bit lanes. */
+
+        static I load (const void *p) { return _mm512_loadu_si512 (p); }
+        static void store (void *p, I a) { _mm512_storeu_si512 (p, a); }
+        static I set1 (int32_t x) { return _mm512_set1_epi32 (x); }
+        static I add (I a, I b) { return _mm512_add_epi32 (a, b); }
+        static I sub (I a, I b) { return _mm512_sub_epi32 (a, b); }
+        static I mins (I a, I b) { return _mm512_min_epi32 (a, b); }
+        static I maxs (I a, I b) { return _mm512_max_epi32 (a, b); }
+        static I minu (I a, I b) { return _mm512_min_epu32 (a, b); }
+        static I maxu (I a, I b) { return _mm512_max_epu32 (a, b); }
+        static I addf (I a, I b) { return _mm512_castps_si512 (_mm512_add_ps (_mm512_castsi512_ps (a), _mm512_castsi512_ps (b))); }
+        static I minf (I a, I b) { return _mm512_castps_si512 (_mm512_min_ps (_mm512_castsi512_ps (a), _mm512_castsi512_ps (b))); }
+        static I maxf (I a, I b) { return _mm512_castps_si512 (_mm512_max_ps (_mm512_castsi512_ps (a), _mm512_castsi512_ps (b))); }
+        static I and_ (I a, I b) { return _mm512_and_si512 (a, b); }
+        static I andnot (I a, I b) { return _mm512_andnot_si512 (a, b); }
+        static I or_ (I a, I b) { return _mm512_or_si512 (a, b); }
+        static I srai31 (I a) { return _mm512_srai_epi32 (a, 31); }
+        static M eq (I a, I b) { return _mm512_cmpeq_epi32_mask (a, b); }
+        static M gt (I a, I b) { return _mm512_cmpgt_epi32_mask (a, b); }
+        static M mand (M a, M b) { return a & b; }
+        static M mor (M a, M b) { return a | b; }
+        static M mandnot (M a, M b) { return ~a & b; }
+        static uint64_t bits (M m) { return m; }
+        static uint64_t eqBits64 (I a, I b) { return _mm512_cmpeq_epi64_mask (a, b); }
+        static I xor_ (I a, I b) { return _mm512_xor_si512 (a, b); }
+        static I set1_64 (uint64_t x) { return _mm512_set1_epi64 (x); }
+        static I add64 (I a, I b) { return _mm512_add_epi64 (a, b); }
+        static I mul32 (I a, I b) { return _mm512_mul_epu32 (a, b); }  /*!< The low halves of the 64-bit lanes. */
+        template <int N> static I srli64 (I a) { return _mm512_srli_epi64 (a, N); }
+        template <int N> static I slli64 (I a) { return _mm512_slli_epi64 (a, N); }
+        static I swap64 (I a) { return _mm512_shuffle_epi32 (a, _MM_PERM_BADC); }  /*!< Swaps the pairs of 64-bit lanes. */
+    };
+
+#endif
+
+    typedef V::I I;
+
+    /*! \brief The lanes of a vector, all set. */
+    const uint64_t allLanes = (uint64_t (1) << V::W) - 1;
+
+
+    /*! \brief The limits of the element types. */
+    template <typename T> struct Limits;
+    template <> struct Limits<int32_t> { static int32_t max () { return INT32_MAX; } static int32_t lowest () { return INT32_MIN; } };
+    template <> struct Limits<uint32_t> { static uint32_t max () { return UINT32_MAX; } static uint32_t lowest () { return 0; } };
+    template <> struct Limits<float> { static float max () { return FLT_MAX; } static float lowest () { return -FLT_MAX; } };
+
+    /*! \brief The operators on elements. They mirror `Sum`, `Min` and `Max`, 
+     *         which are left out for the same reason as `CLUtils.hpp`. */
+    template <typename T> struct AddOp
+    {
+        static T identity () { return 0; }
+        T operator() (T a, T b) const { return a + b; }
+    };
+
+    template <typename T> struct MinOp
+    {
+        static T identity () { return Limits<T>::max (); }
+        T operator() (T a, T b) const { return b < a ? b : a; }
+    };
+
+    template <typename T> struct MaxOp
+    {
+        static T identity () { return Limits<T>::lowest (); }
+        T operator() (T a, T b) const { return a < b ? b : a; }
+    };
+
+    void vecAdd (const int32_t *a, const int32_t *b, int32_t *c, size_t n)
+    {
+        size_t i = 0;
+        for (; i + V::W <= n; i += V::W)
+            V::store (c + i, V::add (V::load (a + i), V::load (b + i)));
+        for (; i < n; ++i)
+            c[i] = (int32_t) ((uint32_t) a[i] + (uint32_t) b[i]);
+    }
+
+
+    /*! \brief Reduces in two accumulators of vectors, and then across their lanes.
+     *
+     *  \param[in] vop the operator on vectors.
+     *  \param[in] op the operator on elements.
+     */
+    template <typename T, typename VOp, typename Op>
+    T reduceWith (const T *data, size_t n, VOp vop, Op op)
+    {
+        T identity = Op::identity ();
+        int32_t bits;
+        std::memcpy (&bits, &identity, sizeof (T));
+
+        I acc0 = V::set1 (bits), acc1 = acc0;
+        size_t i = 0;
+        for (; i + 2 * V::W <= n; i += 2 * V::W)
+        {
+            acc0 = vop (acc0, V::load (data + i));
+            acc1 = vop (acc1, V::load (data + i + V::W));
+        }
+        for (; i + V::W <= n; i += V::W)
+            acc0 = vop (acc0, V::load (data + i));
+        acc0 = vop (acc0, acc1);
+
+        T lanes[V::W];
+        V::store (lanes, acc0);
+        T result = identity;
+        for (size_t k = 0; k < V::W; ++k)
+            result = op (result, lanes[k]);
+        for (; i < n; ++i)
+            result = op (result, data[i]);
+
+        return result;
+    }
+
+    int32_t reduceInt (const int32_t *data, size_t n, uint8_t op)
+    {
+        switch (op)
+        {
+            case opMin: return reduceWith (data, n, [] (I a, I b) { return V::mins (a, b); }, MinOp<int32_t> ());
+            case opMax: return reduceWith (data, n, [] (I a, I b) { return V::maxs (a, b); }, MaxOp<int32_t> ());
+            default: return (int32_t) reduceWith ((const uint32_t *) data, n, [] (I a, I b) { return V::add (a, b); }, AddOp<uint32_t> ());
+        }
+    }
+
+    uint32_t reduceUInt (const uint32_t *data, size_t n, uint8_t op)
+    {
+        switch (op)
+        {
+            case opMin: return reduceWith (data, n, [] (I a, I b) { return V::minu (a, b); }, MinOp<uint32_t> ());
+            case opMax: return reduceWith (data, n, [] (I a, I b) { return V::maxu (a, b); }, MaxOp<uint32_t> ());
+            default: return reduceWith (data, n, [] (I a, I b) { return V::add (a, b); }, AddOp<uint32_t> ());
+        }
+    }
+
+    float reduceFloat (const float *data, size_t n, uint8_t op)
+    {
+        switch (op)
+        {
+            case opMin: return reduceWith (data, n, [] (I a, I b) { return V::minf (a, b); }, MinOp<float> ());
+            case opMax: return reduceWith (data, n, [] (I a, I b) { return V::maxf (a, b); }, MaxOp<float> ());
+            default: return reduceWith (data, n, [] (I a, I b) { return V::addf (a, b); }, AddOp<float> ());
+        }
+    }
+
+
+    /*! \brief Scans 4 elements at a time in a 128-bit register, in 2 steps 
+     *         of shifting in the identity, and carries the last lane over.
+     *  \details The scan is bound by the latency of the carry, so the wider 
+     *           instruction sets don't help. They use their encoding of it.
+     *
+     *  \param[in] vop the operator on 128-bit vectors.
+     *  \param[in] op the operator on elements.
+     */
+    template <typename T, typename VOp, typename Op>
+    void scanWith (const T *in, T *out, size_t n, bool inclusive, VOp vop, Op op)
+    {
+        T identity = Op::identity ();
+        int32_t bits;
+        std::memcpy (&bits, &identity, sizeof (T));
+
+        __m128i id = _mm_set1_epi32 (bits), carry = id;
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4)
+        {
+            __m128i x = _mm_loadu_si128 ((const __m128i *) (in + i));
+            x = vop (x, _mm_alignr_epi8 (x, id, 12));
+            x = vop (x, _mm_alignr_epi8 (x, id, 8));
+            __m128i incl = vop (carry, x);
+            _mm_storeu_si128 ((__m128i *) (out + i), inclusive ? incl : _mm_alignr_epi8 (incl, carry, 12));
+            carry = _mm_shuffle_epi32 (incl, 0xFF);
+        }
+
+        T acc;
+        bits = _mm_cvtsi128_si32 (carry);
+        std::memcpy (&acc, &bits, sizeof (T));
+        for (; i < n; ++i)
+        {
+            T next = op (acc, in[i]);
+            out[i] = inclusive ? next : acc;
+            acc = next;
+        }
+    }
+
+    void scanInt (const int32_t *in, int32_t *out, size_t n, uint8_t op, bool inclusive)
+    {
+        switch (op)
+        {
+            case opMin:
+                scanWith (in, out, n, inclusive, [] (__m128i a, __m128i b) { return _mm_min_epi32 (a, b); }, MinOp<int32_t> ());
+                break;
+            case opMax:
+                scanWith (in, out, n, inclusive, [] (__m128i a, __m128i b) { return _mm_max_epi32 (a, b); }, MaxOp<int32_t> ());
+                break;
+            default:
+                scanWith ((const uint32_t *) in, (uint32_t *) out, n, inclusive, 
+                          [] (__m128i a, __m128i b) { return _mm_add_epi32 (a, b); }, AddOp<uint32_t> ());
+        }
+    }
+
+    void scanUInt (const uint32_t *in, uint32_t *out, size_t n, uint8_t op, bool inclusive)
+    {
+        switch (op)
+        {
+            case opMin:
+                scanWith (in, out, n, inclusive, [] (__m128i a, __m128i b) { return _mm_min_epu32 (a, b); }, MinOp<uint32_t> ());
+                break;
+            case opMax:
+                scanWith (in, out, n, inclusive, [] (__m128i a, __m128i b) { return _mm_max_epu32 (a, b); }, MaxOp<uint32_t> ());
+                break;
+            default:
+                scanWith (in, out, n, inclusive, [] (__m128i a, __m128i b) { return _mm_add_epi32 (a, b); }, AddOp<uint32_t> ());
+        }
+    }
+
+    /*! \brief Wraps a float operator on 128-bit vectors, for `scanWith`. */
+#define CLUTILS_SIMD_FLOATS(op) \
+    [] (__m128i a, __m128i b) { return _mm_castps_si128 (op (_mm_castsi128_ps (a), _mm_castsi128_ps (b))); }
+
+    void scanFloat (const float *in, float *out, size_t n, uint8_t op, bool inclusive)
+    {
+        switch (op)
+        {
+            case opMin:
+                scanWith (in, out, n, inclusive, CLUTILS_SIMD_FLOATS (_mm_min_ps), MinOp<float> ());
+                break;
+            case opMax:
+                scanWith (in, out, n, inclusive, CLUTILS_SIMD_FLOATS (_mm_max_ps), MaxOp<float> ());
+                break;
+            default:
+                scanWith (in, out, n, inclusive, CLUTILS_SIMD_FLOATS (_mm_add_ps), AddOp<float> ());
+        }
+    }
+
+
+    /*! \brief Compares 4 vectors at a time, and only looks 
+     *         at the lanes when any of them differ. */
+    size_t compare32 (const void *expected, const void *actual, size_t n, 
+                      size_t *first, size_t maxReports)
+    {
+        const uint32_t *e = (const uint32_t *) expected, *a = (const uint32_t *) actual;
+        size_t count = 0, reported = 0, i = 0;
+        for (; i + 4 * V::W <= n; i += 4 * V::W)
+        {
+            V::M m0 = V::eq (V::load (e + i), V::load (a + i));
+            V::M m1 = V::eq (V::load (e + i + V::W), V::load (a + i + V::W));
+            V::M m2 = V::eq (V::load (e + i + 2 * V::W), V::load (a + i + 2 * V::W));
+            V::M m3 = V::eq (V::load (e + i + 3 * V::W), V::load (a + i + 3 * V::W));
+            if (V::bits (V::mand (V::mand (m0, m1), V::mand (m2, m3))) == allLanes)
+                continue;
+
+            report (~V::bits (m0) & allLanes, i, count, first, reported, maxReports);
+            report (~V::bits (m1) & allLanes, i + V::W, count, first, reported, maxReports);
+            report (~V::bits (m2) & allLanes, i + 2 * V::W, count, first, reported, maxReports);
+            report (~V::bits (m3) & allLanes, i + 3 * V::W, count, first, reported, maxReports);
+        }
+        for (; i + V::W <= n; i += V::W)
+            report (~V::bits (V::eq (V::load (e + i), V::load (a + i))) & allLanes, 
+                    i, count, first, reported, maxReports);
+        for (; i < n; ++i)
+            if (e[i] != a[i])
+                report (1, i, count, first, reported, maxReports);
+
+        return count;
+    }
+
+    size_t compare64 (const void *expected, const void *actual, size_t n, 
+                      size_t *first, size_t maxReports)
+    {
+        const uint64_t *e = (const uint64_t *) expected, *a = (const uint64_t *) actual;
+        const size_t W = V::W / 2;
+        const uint64_t lanes = (uint64_t (1) << W) - 1;
+
+        size_t count = 0, reported = 0, i = 0;
+        for (; i + W <= n; i += W)
+        {
+            uint64_t bits = ~V::eqBits64 (V::load (e + i), V::load (a + i)) & lanes;
+            if (bits)
+                report (bits, i, count, first, reported, maxReports);
+        }
+        for (; i < n; ++i)
+            if (e[i] != a[i])
+                report (1, i, count, first, reported, maxReports);
+
+        return count;
+    }
+
+    /*! \brief Maps the bits of floats to integers in the order of the floats,
+     *         with both zeros at 0. */
+    inline I ordered (I x)
+    {
+        I sign = V::srai31 (x);
+        return V::or_ (V::and_ (sign, V::sub (V::set1 (INT32_MIN), x)), V::andnot (sign, x));
+    }
+
+    /*! \brief Compares vectors bitwise first, and only works 
+     *         out the distances when any of the lanes differ. */
+    size_t compareULP (const float *expected, const float *actual, size_t n, 
+                       uint32_t maxUlps, size_t *first, size_t maxReports)
+    {
+        const I limit = V::set1 ((int32_t) maxUlps);
+        const I abs = V::set1 (0x7FFFFFFF), inf = V::set1 (0x7F800000);
+
+        size_t count = 0, reported = 0, i = 0;
+        for (; i + V::W <= n; i += V::W)
+        {
+            I x = V::load (expected + i), y = V::load (actual + i);
+            if (V::bits (V::eq (x, y)) == allLanes)
+                continue;
+
+            // The distance as unsigned, and whether it's within the limit
+            I ox = ordered (x), oy = ordered (y);
+            I d = V::sub (V::maxs (ox, oy), V::mins (ox, oy));
+            V::M within = V::eq (V::minu (d, limit), d);
+
+            V::M nanX = V::gt (V::and_ (x, abs), inf), nanY = V::gt (V::and_ (y, abs), inf);
+            V::M match = V::mor (V::mandnot (V::mor (nanX, nanY), within), V::mand (nanX, nanY));
+            uint64_t bits = ~V::bits (match) & allLanes;
+            if (bits)
+                report (bits, i, count, first, reported, maxReports);
+        }
+        for (; i < n; ++i)
+        {
+            int32_t x, y;
+            std::memcpy (&x, expected + i, sizeof (x));
+            std::memcpy (&y, actual + i, sizeof (y));
+            bool nanX = isNaNBits (x), nanY = isNaNBits (y);
+            if (nanX != nanY || (!nanX && ulpDistanceBits (x, y) > maxUlps))
+                report (1, i, count, first, reported, maxReports);
+        }
+
+        return count;
+    }
+
+
+    /*! \brief Mixes blocks into the accumulators of the hash, like 
+     *         `hashStripeScalar` and `hashScrambleScalar` do. The 8 
+     *         accumulators span `16 / V::W` vectors.
+     */
+    void hashBlocks (uint64_t *acc, const uint8_t *data, size_t nBlocks)
+    {
+        const size_t nv = 16 / V::W, lanes = V::W / 2;
+        const I prime = V::set1_64 (hashPrime32);
+
+        I a[nv];
+        for (size_t v = 0; v < nv; ++v)
+            a[v] = V::load (acc + v * lanes);
+
+        for (size_t b = 0; b < nBlocks; ++b, data += hashBlock)
+        {
+            for (size_t j = 0; j < hashStripesPerBlock; ++j)
+            {
+                for (size_t v = 0; v < nv; ++v)
+                {
+                    I d = V::load (data + j * hashStripe + v * 4 * V::W);
+                    I dk = V::xor_ (d, V::load (hashSecret + j + v * lanes));
+                    a[v] = V::add64 (a[v], V::swap64 (d));
+                    a[v] = V::add64 (a[v], V::mul32 (dk, V::srli64<32> (dk)));
+                }
+            }
+
+            for (size_t v = 0; v < nv; ++v)
+            {
+                I x = V::xor_ (V::xor_ (a[v], V::srli64<47> (a[v])), V::load (hashSecret + 16 + v * lanes));
+                a[v] = V::add64 (V::mul32 (x, prime), V::slli64<32> (V::mul32 (V::srli64<32> (x), prime)));
+            }
+        }
+
+        for (size_t v = 0; v < nv; ++v)
+            V::store (acc + v * lanes, a[v]);
+    }
+
+}
+
+}
+
+}
+
+}
+
+/*! \brief The table of the kernels of the instruction set. */
+#define CLUTILS_SIMD_TABLE(name) \
+    const clutils::host::detail::Kernels clutils::host::detail::name = { \
+        CLUTILS_SIMD_NS::vecAdd, CLUTILS_SIMD_NS::reduceInt, CLUTILS_SIMD_NS::reduceUInt, \
+        CLUTILS_SIMD_NS::reduceFloat, CLUTILS_SIMD_NS::scanInt, CLUTILS_SIMD_NS::scanUInt, \
+        CLUTILS_SIMD_NS::scanFloat, CLUTILS_SIMD_NS::compare32, CLUTILS_SIMD_NS::compare64, \
+        CLUTILS_SIMD_NS::compareULP, CLUTILS_SIMD_NS::hashBlocks }
+
+#endif  // CLUTILS_SIMD_NS
@@ -0,0 +1,120 @@
+/*! \file compact.cpp
+ *  \brief Google Test Unit Tests for stream compaction
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/compact.hpp>
+
+
+/*! A size that doesn't align with the work-group size, and 
+ *  is large enough to require three levels in the scan.
+ */
+const unsigned int n_comp = (1 << 20) + 37;
+
+static std::default_random_engine c_generator (17);
+
+
+/*! \brief Selects the positive elements of a buffer, and partitions it on them, 
+ *         and compares against `std::copy_if` and `std::stable_partition`.
+ */
+TEST (Compact, SelectPartition)
+{
+    std::uniform_int_distribution<cl_int> distribution (-1000, 1000);
+    std::vector<cl_int> hIn (n_comp), hOut (n_comp);
+    for (auto &v : hIn) v = distribution (c_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, n_comp * sizeof (cl_int));
+    cl::Buffer dOut (context, CL_MEM_READ_WRITE, n_comp * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n_comp * sizeof (cl_int), hIn.data ());
+
+    auto positive = [] (cl_int v) { return v > 0; };
+    std::vector<cl_int> ref;
+    std::copy_if (hIn.begin (), hIn.end (), std::back_inserter (ref), positive);
+
+    clutils::Compact<cl_int, clutils::Predicate::GREATER> compact (clEnv);
+    unsigned int count = compact.select (dIn, n_comp, dOut, 0);
+    ASSERT_EQ (ref.size (), count);
+    queue.enqueueReadBuffer (dOut, CL_TRUE, 0, count * sizeof (cl_int), hOut.data ());
+    ASSERT_TRUE (std::equal (ref.begin (), ref.end (), hOut.begin ()));
+
+    ref = hIn;
+    std::stable_partition (ref.begin (), ref.end (), positive);
+    ASSERT_EQ (count, compact.partition (dIn, n_comp, dOut, 0));
+    queue.enqueueReadBuffer (dOut, CL_TRUE, 0, n_comp * sizeof (cl_int), hOut.data ());
+    ASSERT_EQ (ref, hOut);
+
+    // Nothing to select
+    ASSERT_EQ (0u, compact.select (dIn, n_comp, dOut, 1000));
+    ASSERT_EQ (0u, compact.select (dIn, 0, dOut, 0));
+}
+
+
+/*! \brief Drops the zeros of a sparse float buffer, with views, 
+ *         and keeps the count on the device.
+ */
+TEST (Compact, Views)
+{
+    const unsigned int offset = 16;
+    std::uniform_real_distribution<cl_float> distribution (0.f, 1.f);
+    std::vector<cl_float> hIn (n_comp), hOut (n_comp);
+    for (auto &v : hIn) 
+    {
+        v = distribution (c_generator);
+        if (v < 0.9f) v = 0.f;
+    }
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    size_t bytes = n_comp * sizeof (cl_float), off = offset * sizeof (cl_float);
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, off + bytes);
+    cl::Buffer dOut (context, CL_MEM_READ_WRITE, off + bytes);
+    cl::Buffer dCount (context, CL_MEM_READ_WRITE, 2 * sizeof (cl_uint));
+    queue.enqueueWriteBuffer (dIn, CL_TRUE, off, bytes, hIn.data ());
+
+    clutils::Compact<cl_float> compact (clEnv);
+    compact.select (clutils::BufferView (dIn, off, bytes), n_comp, clutils::BufferView (dOut, off, bytes), 
+                    0.f, clutils::BufferView (dCount, sizeof (cl_uint), sizeof (cl_uint)));
+
+    cl_uint count;
+    queue.enqueueReadBuffer (dCount, CL_TRUE, sizeof (cl_uint), sizeof (cl_uint), &count);
+    std::vector<cl_float> ref;
+    std::copy_if (hIn.begin (), hIn.end (), std::back_inserter (ref), [] (cl_float v) { return v != 0.f; });
+    ASSERT_EQ (ref.size (), count);
+
+    queue.enqueueReadBuffer (dOut, CL_TRUE, off, count * sizeof (cl_float), hOut.data ());
+    ASSERT_TRUE (std::equal (ref.begin (), ref.end (), hOut.begin ()));
+}
@@ -0,0 +1,177 @@
+/*! \file coro.cpp
+ *  \brief Google Test Unit Tests for the coroutine tasks and awaitables
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/coro.hpp>
+
+namespace coro = clutils::coro;
+
+
+coro::Task<int> square (int x)
+{
+    co_return x * x;
+}
+
+
+coro::Task<int> sumOfSquares (int n)
+{
+    int sum = 0;
+    for (int i = 1; i <= n; ++i)
+        sum += co_await square (i);
+    co_return sum;
+}
+
+
+coro::Task<> fail ()
+{
+    throw std::runtime_error ("fail");
+    co_return;
+}
+
+
+/*! \brief Checks that nested tasks return their values, and that the 
+ *         exceptions of spawned tasks reach `wait`.
+ */
+TEST (Coroutines, Tasks)
+{
+    std::atomic<int> total (0);
+    coro::Executor executor (2);
+
+    auto task = [&total] (int n) -> coro::Task<>
+    {
+        total += co_await sumOfSquares (n);
+    };
+    for (int n = 1; n <= 100; ++n)
+        executor.spawn (task (n));
+    executor.wait ();
+
+    int expected = 0;
+    for (int n = 1; n <= 100; ++n)
+        expected += n * (n + 1) * (2 * n + 1) / 6;
+    ASSERT_EQ (total.load (), expected);
+
+    executor.spawn (fail ());
+    ASSERT_THROW (executor.wait (), std::runtime_error);
+}
+
+
+/*! \brief Checks that a coroutine suspends on an event, and resumes on 
+ *         its executor when the event completes, or throws if it fails.
+ */
+TEST (Coroutines, Events)
+{
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+
+    const unsigned int n = 1000;
+    std::vector<cl::UserEvent> events;
+    for (unsigned int i = 0; i < n; ++i)
+        events.push_back (cl::UserEvent (context));
+
+    coro::Executor executor (4);
+    std::atomic<unsigned int> resumed (0), onExecutor (0), failed (0);
+    auto task = [&] (unsigned int i) -> coro::Task<>
+    {
+        try
+        {
+            co_await coro::EventAwaiter (events[i]);
+            ++resumed;
+        }
+        catch (const cl::Error &)
+        {
+            ++failed;
+        }
+        if (coro::Executor::current () == &executor) ++onExecutor;
+    };
+    for (unsigned int i = 0; i < n; ++i)
+        executor.spawn (task (i));
+
+    // None can proceed until its event completes
+    std::this_thread::sleep_for (std::chrono::milliseconds (10));
+    ASSERT_EQ (resumed.load () + failed.load (), 0u);
+
+    std::thread completer ([&events] ()
+    {
+        for (unsigned int i = 0; i < n; ++i)
+            events[i].setStatus (i % 10 ? CL_COMPLETE : -1);
+    });
+    executor.wait ();
+    completer.join ();
+
+    ASSERT_EQ (resumed.load (), n - n / 10);
+    ASSERT_EQ (failed.load (), n / 10);
+    ASSERT_EQ (onExecutor.load (), n);
+}
+
+
+/*! \brief Runs many write-kernel-read pipelines concurrently on a single queue. */
+TEST (Coroutines, Pipelines)
+{
+    const unsigned int nPipelines = 64, n = 1 << 12;
+
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    cl::Context &context (clEnv.getContext ());
+    cl::CommandQueue &queue (clEnv.getQueue ());
+
+    std::vector<std::vector<cl_int>> hIn (nPipelines, std::vector<cl_int> (n)), hOut (hIn);
+    std::vector<cl::Buffer> dIn, dOut;
+    std::vector<cl::Kernel> kernels;
+    for (unsigned int p = 0; p < nPipelines; ++p)
+    {
+        for (unsigned int i = 0; i < n; ++i)
+            hIn[p][i] = p * n + i;
+        dIn.push_back (cl::Buffer (context, CL_MEM_READ_ONLY, n * sizeof (cl_int)));
+        dOut.push_back (cl::Buffer (context, CL_MEM_WRITE_ONLY, n * sizeof (cl_int)));
+        kernels.push_back (cl::Kernel (clEnv.getProgram (0), "vecAddN"));
+        kernels[p].setArg (0, dIn[p]);
+        kernels[p].setArg (1, dIn[p]);
+        kernels[p].setArg (2, dOut[p]);
+        kernels[p].setArg (3, n);
+    }
+
+    auto pipeline = [&] (unsigned int p) -> coro::Task<>
+    {
+        co_await coro::write (queue, dIn[p], 0, n * sizeof (cl_int), hIn[p].data ());
+        co_await coro::kernel (queue, kernels[p], cl::NDRange (n));
+        co_await coro::read (queue, dOut[p], 0, n * sizeof (cl_int), hOut[p].data ());
+    };
+
+    coro::Executor executor (2);
+    for (unsigned int p = 0; p < nPipelines; ++p)
+        executor.spawn (pipeline (p));
+    executor.wait ();
+
+    for (unsigned int p = 0; p < nPipelines; ++p)
+        for (unsigned int i = 0; i < n; ++i)
+            ASSERT_EQ (hOut[p][i], 2 * hIn[p][i]);
+}
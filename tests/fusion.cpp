@@ -0,0 +1,137 @@
+/*! \file fusion.cpp
+ *  \brief Google Test Unit Tests for the elementwise kernel fusion
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/fusion.hpp>
+
+
+/*! A size that doesn't align with the work-group size */
+const unsigned int n_fus = (1 << 16) + 13;
+
+static auto f_seed = std::chrono::system_clock::now ().time_since_epoch ().count ();
+static std::default_random_engine f_generator (f_seed);
+
+
+/*! \brief Evaluates `max ((A + B) * k, 0)` in one kernel, 
+ *         and compares against the host.
+ */
+TEST (Elementwise, FusedChain)
+{
+    std::uniform_real_distribution<cl_float> distribution (-100.f, 100.f);
+    std::vector<cl_float> hA (n_fus), hB (n_fus), hE (n_fus);
+    for (auto &v : hA) v = distribution (f_generator);
+    for (auto &v : hB) v = distribution (f_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dA (context, CL_MEM_READ_ONLY, n_fus * sizeof (cl_float));
+    cl::Buffer dB (context, CL_MEM_READ_ONLY, n_fus * sizeof (cl_float));
+    cl::Buffer dE (context, CL_MEM_WRITE_ONLY, n_fus * sizeof (cl_float));
+    queue.enqueueWriteBuffer (dA, CL_FALSE, 0, n_fus * sizeof (cl_float), hA.data ());
+    queue.enqueueWriteBuffer (dB, CL_FALSE, 0, n_fus * sizeof (cl_float), hB.data ());
+
+    using namespace clutils::expr;
+    clutils::Elementwise<cl_float> ew (clEnv);
+    auto A = vec<cl_float> (dA), B = vec<cl_float> (dB);
+
+    // The scalar is a kernel argument, so the same kernel serves both values
+    for (cl_float k : { 0.5f, -2.f })
+    {
+        ew.run (dE, max ((A + B) * k, 0), n_fus);
+        queue.enqueueReadBuffer (dE, CL_TRUE, 0, n_fus * sizeof (cl_float), hE.data ());
+
+        for (unsigned int i = 0; i < n_fus; ++i)
+            ASSERT_FLOAT_EQ (std::max ((hA[i] + hB[i]) * k, 0.f), hE[i]);
+    }
+}
+
+
+/*! \brief Evaluates an integer expression in place, 
+ *         with an operand that appears twice.
+ */
+TEST (Elementwise, InPlace)
+{
+    std::uniform_int_distribution<cl_int> distribution (-1000, 1000);
+    std::vector<cl_int> hA (n_fus), hB (n_fus), hRes (n_fus);
+    for (auto &v : hA) v = distribution (f_generator);
+    for (auto &v : hB) v = distribution (f_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, n_fus * sizeof (cl_int));
+    cl::Buffer dB (context, CL_MEM_READ_ONLY, n_fus * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dA, CL_FALSE, 0, n_fus * sizeof (cl_int), hA.data ());
+    queue.enqueueWriteBuffer (dB, CL_FALSE, 0, n_fus * sizeof (cl_int), hB.data ());
+
+    using namespace clutils::expr;
+    clutils::Elementwise<cl_int> ew (clEnv);
+    auto A = vec<cl_int> (dA), B = vec<cl_int> (dB);
+
+    ew.run (dA, min (-A, B - A / 3) + 7, n_fus);
+    queue.enqueueReadBuffer (dA, CL_TRUE, 0, n_fus * sizeof (cl_int), hRes.data ());
+
+    for (unsigned int i = 0; i < n_fus; ++i)
+        ASSERT_EQ (std::min (-hA[i], hB[i] - hA[i] / 3) + 7, hRes[i]);
+
+    // An empty range leaves the output alone
+    ew.run (dA, A + 1, 0);
+    queue.enqueueReadBuffer (dA, CL_TRUE, 0, sizeof (cl_int), hA.data ());
+    ASSERT_EQ (hRes[0], hA[0]);
+}
+
+
+/*! \brief Checks that an expression type is built once per context.
+ */
+TEST (Elementwise, ProgramCache)
+{
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    clEnv.addQueue (0, 0);
+
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, 64 * sizeof (cl_float));
+
+    using namespace clutils::expr;
+    typedef decltype (vec<cl_float> (dA) * 2.f) Expr;
+    const std::pair<std::string, std::string> &kernel = kernelOf<Expr> ();
+
+    unsigned int pgIdx = clEnv.getSourceProgramIdx (0, kernel.first, kernel.second);
+    ASSERT_EQ (pgIdx, clEnv.getSourceProgramIdx (0, kernel.first, kernel.second));
+
+    clutils::Elementwise<cl_float> ew (clEnv);
+    ASSERT_EQ (&clEnv.getKernel ("fused", pgIdx), &ew.getKernel<Expr> ());
+}
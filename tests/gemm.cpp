@@ -0,0 +1,185 @@
+/*! \file gemm.cpp
+ *  \brief Google Test Unit Tests for the matrix multiplications
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/gemm.hpp>
+#include <CLUtils/verify.hpp>
+
+
+static std::default_random_engine g_generator (11);
+
+
+/*! \brief Multiplies matrices whose sizes don't align with any tile, 
+ *         with the tiled and the naive kernels, and compares against `host::gemm`.
+ */
+TEST (Gemm, Float)
+{
+    const unsigned int M = 131, N = 75, K = 203;
+    std::uniform_real_distribution<float> distribution (-1.f, 1.f);
+    std::vector<cl_float> hA (M * K), hB (K * N), hC (M * N), hRef (M * N), hOut (M * N);
+    for (auto &v : hA) v = distribution (g_generator);
+    for (auto &v : hB) v = distribution (g_generator);
+    for (auto &v : hC) v = distribution (g_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dA (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, hA.size () * sizeof (cl_float), hA.data ());
+    cl::Buffer dB (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, hB.size () * sizeof (cl_float), hB.data ());
+    cl::Buffer dC (context, CL_MEM_READ_WRITE, hC.size () * sizeof (cl_float));
+
+    clutils::Gemm<cl_float> gemm (clEnv);
+    clutils::GemmTile tile = gemm.getTile ();
+    ASSERT_EQ (0u, tile.m % tile.wptM);
+    ASSERT_EQ (0u, tile.n % tile.wptN);
+
+    // C = A * B
+    hRef = hC;
+    clutils::host::gemm (hA.data (), hB.data (), hRef.data (), M, N, K);
+    gemm.run (dA, dB, dC, M, N, K);
+    queue.enqueueReadBuffer (dC, CL_TRUE, 0, hOut.size () * sizeof (cl_float), hOut.data ());
+    for (unsigned int i = 0; i < M * N; ++i)
+        ASSERT_NEAR (hRef[i], hOut[i], 1e-4f) << "at " << i;
+
+    // C = 0.5 * A * B - 2 * C
+    hRef = hC;
+    clutils::host::gemm (hA.data (), hB.data (), hRef.data (), M, N, K, 1, 0.5f, -2.f);
+    for (int naive = 0; naive < 2; ++naive)
+    {
+        queue.enqueueWriteBuffer (dC, CL_TRUE, 0, hC.size () * sizeof (cl_float), hC.data ());
+        if (naive)
+            gemm.runNaive (dA, dB, dC, M, N, K, 1, 0.5f, -2.f);
+        else
+            gemm.run (dA, dB, dC, M, N, K, 0.5f, -2.f);
+        queue.enqueueReadBuffer (dC, CL_TRUE, 0, hOut.size () * sizeof (cl_float), hOut.data ());
+        for (unsigned int i = 0; i < M * N; ++i)
+            ASSERT_NEAR (hRef[i], hOut[i], 1e-4f) << (naive ? "naive" : "tiled") << ", at " << i;
+    }
+}
+
+
+/*! \brief Multiplies a batch of small matrices in a single launch, 
+ *         with views that start at an offset.
+ */
+TEST (Gemm, Batched)
+{
+    const unsigned int M = 7, N = 12, K = 9, batch = 500, offset = 16;
+    std::uniform_real_distribution<float> distribution (-1.f, 1.f);
+    std::vector<cl_float> hA (batch * M * K), hB (batch * K * N), hRef (batch * M * N), hOut (batch * M * N);
+    for (auto &v : hA) v = distribution (g_generator);
+    for (auto &v : hB) v = distribution (g_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    size_t bytesA = hA.size () * sizeof (cl_float), bytesB = hB.size () * sizeof (cl_float);
+    size_t bytesC = hOut.size () * sizeof (cl_float), off = offset * sizeof (cl_float);
+    cl::Buffer dA (context, CL_MEM_READ_ONLY, off + bytesA);
+    cl::Buffer dB (context, CL_MEM_READ_ONLY, off + bytesB);
+    cl::Buffer dC (context, CL_MEM_READ_WRITE, off + bytesC);
+    queue.enqueueWriteBuffer (dA, CL_FALSE, off, bytesA, hA.data ());
+    queue.enqueueWriteBuffer (dB, CL_FALSE, off, bytesB, hB.data ());
+
+    clutils::Gemm<cl_float> gemm (clEnv);
+    gemm.runBatched (clutils::BufferView (dA, off, bytesA), clutils::BufferView (dB, off, bytesB), 
+                     clutils::BufferView (dC, off, bytesC), M, N, K, batch);
+    queue.enqueueReadBuffer (dC, CL_TRUE, off, bytesC, hOut.data ());
+
+    clutils::host::gemm (hA.data (), hB.data (), hRef.data (), M, N, K, batch);
+    for (unsigned int i = 0; i < hRef.size (); ++i)
+        ASSERT_NEAR (hRef[i], hOut[i], 1e-5f) << "at " << i;
+}
+
+
+/*! \brief Multiplies half matrices, and compares against `host::gemm` 
+ *         on the same values as floats.
+ */
+TEST (Gemm, Half)
+{
+    const unsigned int M = 64, N = 33, K = 100;
+    std::uniform_real_distribution<float> distribution (-1.f, 1.f);
+    std::vector<cl_half> hA (M * K), hB (K * N), hOut (M * N);
+    std::vector<cl_float> fA (M * K), fB (K * N), hRef (M * N);
+    for (unsigned int i = 0; i < hA.size (); ++i)
+    {
+        hA[i] = clutils::floatToHalf (distribution (g_generator));
+        fA[i] = clutils::halfToFloat (hA[i]);
+    }
+    for (unsigned int i = 0; i < hB.size (); ++i)
+    {
+        hB[i] = clutils::floatToHalf (distribution (g_generator));
+        fB[i] = clutils::halfToFloat (hB[i]);
+    }
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dA (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, hA.size () * sizeof (cl_half), hA.data ());
+    cl::Buffer dB (context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, hB.size () * sizeof (cl_half), hB.data ());
+    cl::Buffer dC (context, CL_MEM_READ_WRITE, hOut.size () * sizeof (cl_half));
+
+    clutils::Gemm<cl_half> gemm (clEnv);
+    gemm.run (dA, dB, dC, M, N, K);
+    queue.enqueueReadBuffer (dC, CL_TRUE, 0, hOut.size () * sizeof (cl_half), hOut.data ());
+
+    // The products are accumulated in float, so only the final rounding to half differs
+    clutils::host::gemm (fA.data (), fB.data (), hRef.data (), M, N, K);
+    for (unsigned int i = 0; i < hRef.size (); ++i)
+        ASSERT_NEAR (hRef[i], clutils::halfToFloat (hOut[i]), 1e-3f * std::abs (hRef[i]) + 1e-4f) << "at " << i;
+}
+
+
+/*! \brief Converts between float and half on the host. */
+TEST (Gemm, HalfConversions)
+{
+    ASSERT_EQ (0x3c00, clutils::floatToHalf (1.f));
+    ASSERT_EQ (0xc000, clutils::floatToHalf (-2.f));
+    ASSERT_EQ (0x7bff, clutils::floatToHalf (65504.f));
+    ASSERT_EQ (0x7c00, clutils::floatToHalf (65520.f));
+    ASSERT_EQ (0x0001, clutils::floatToHalf (std::ldexp (1.f, -24)));
+    ASSERT_EQ (0x0000, clutils::floatToHalf (std::ldexp (1.f, -25)));  // A tie, rounds to even
+    ASSERT_EQ (0x3c00, clutils::floatToHalf (1.f + std::ldexp (1.f, -11)));  // A tie, rounds to even
+    ASSERT_EQ (0x3c02, clutils::floatToHalf (1.f + 3 * std::ldexp (1.f, -11)));  // A tie, rounds to even
+    ASSERT_TRUE (std::isnan (clutils::halfToFloat (clutils::floatToHalf (std::numeric_limits<float>::quiet_NaN ()))));
+
+    // Every half survives a round trip
+    for (cl_uint h = 0; h < 0x10000; ++h)
+    {
+        if ((h & 0x7c00) == 0x7c00 && (h & 0x3ff))
+            continue;  // NaN
+        ASSERT_EQ (h, clutils::floatToHalf (clutils::halfToFloat ((cl_half) h))) << std::hex << h;
+    }
+}
@@ -0,0 +1,228 @@
+/*! \file hazards.cpp
+ *  \brief Google Test Unit Tests for the hazard tracking of out-of-order queues
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/hazards.hpp>
+
+
+/*! \brief Creates an out-of-order queue, or an in-order one if the device doesn't support it. */
+cl::CommandQueue& addTrackedQueue (clutils::CLEnv &clEnv)
+{
+    cl::Context &context (clEnv.addContext (0));
+    cl::Device device (context.getInfo<CL_CONTEXT_DEVICES> ()[0]);
+    cl_command_queue_properties props = 
+        device.getInfo<CL_DEVICE_QUEUE_PROPERTIES> () & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+
+    return clEnv.addQueue (0, 0, props);
+}
+
+
+/*! \brief Runs a chain of dependent kernels, which are correct only if 
+ *         every RAW and WAR dependency is respected.
+ */
+TEST (HazardTracker, Chain)
+{
+    const unsigned int n = 1 << 16, steps = 10;
+
+    clutils::CLEnv clEnv;
+    cl::CommandQueue &queue (addTrackedQueue (clEnv));
+    cl::Kernel &kernel (clEnv.addProgram (0, "kernels/kernels.cl", "vecAddN"));
+    cl::Context &context (clEnv.getContext (0));
+
+    std::vector<cl_int> hA (n);
+    for (unsigned int i = 0; i < n; ++i)
+        hA[i] = i % 1000;
+
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+    cl::Buffer dB (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+
+    clutils::HazardTracker tracker (queue);
+    tracker.enqueueWrite (dA, 0, n * sizeof (cl_int), hA.data ());
+
+    // A + A -> B, B + B -> A, ...
+    for (unsigned int s = 0; s < steps; ++s)
+    {
+        cl::Buffer &in (s % 2 ? dB : dA), &out (s % 2 ? dA : dB);
+        tracker.setArg (kernel, 0, in, clutils::Access::READ);
+        tracker.setArg (kernel, 1, in, clutils::Access::READ);
+        tracker.setArg (kernel, 2, out, clutils::Access::WRITE);
+        tracker.setArg (kernel, 3, n);
+        tracker.enqueueKernel (kernel, cl::NDRange (n));
+
+        // Only for the previous command, which already waits for the ones before it
+        ASSERT_EQ (tracker.waitList ().size (), 1u);
+    }
+
+    std::vector<cl_int> hOut (n);
+    tracker.enqueueRead (steps % 2 ? dB : dA, 0, n * sizeof (cl_int), hOut.data (), true);
+    for (unsigned int i = 0; i < n; ++i)
+        ASSERT_EQ (hOut[i], hA[i] << steps);
+}
+
+
+/*! \brief Checks that kernels on disjoint regions of a buffer don't wait for each other. */
+TEST (HazardTracker, Partitions)
+{
+    clutils::CLEnv clEnv;
+    cl::CommandQueue &queue (addTrackedQueue (clEnv));
+    clEnv.addProgram (0, "kernels/kernels.cl");
+    cl::Context &context (clEnv.getContext (0));
+
+    // The parts are made large enough for their origins to be aligned for sub-buffers
+    const unsigned int parts = 4;
+    const unsigned int m = std::max<size_t> (1 << 14, clutils::BufferView::alignment (context) / sizeof (cl_int));
+    const unsigned int n = parts * m;
+
+    std::vector<cl_int> hA (n);
+    for (unsigned int i = 0; i < n; ++i)
+        hA[i] = i;
+
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+    cl::Buffer dB (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+
+    clutils::HazardTracker tracker (queue);
+    cl::Event write = tracker.enqueueWrite (dA, 0, n * sizeof (cl_int), hA.data ());
+
+    std::vector<cl::Kernel> kernels;
+    std::vector<cl::Event> events;
+    for (unsigned int p = 0; p < parts; ++p)
+    {
+        clutils::BufferView in (dA, p * m * sizeof (cl_int), m * sizeof (cl_int));
+        clutils::BufferView out (dB, p * m * sizeof (cl_int), m * sizeof (cl_int));
+        ASSERT_TRUE (in.isSubBuffer ());
+        ASSERT_TRUE (out.isSubBuffer ());
+
+        kernels.push_back (cl::Kernel (clEnv.getProgram (0), "vecAddN"));
+        tracker.setArg (kernels[p], 0, in, clutils::Access::READ);
+        tracker.setArg (kernels[p], 1, in, clutils::Access::READ);
+        tracker.setArg (kernels[p], 2, out, clutils::Access::WRITE);
+        tracker.setArg (kernels[p], 3, m);
+        events.push_back (tracker.enqueueKernel (kernels[p], cl::NDRange (m)));
+
+        // Only the write of the input
+        ASSERT_EQ (tracker.waitList ().size (), 1u);
+        ASSERT_EQ (tracker.waitList ()[0] (), write ());
+    }
+
+    // A read of the whole output waits for all the parts
+    std::vector<cl_int> hB (n);
+    tracker.enqueueRead (dB, 0, n * sizeof (cl_int), hB.data (), true);
+    ASSERT_EQ (tracker.waitList ().size (), parts);
+    for (unsigned int i = 0; i < n; ++i)
+        ASSERT_EQ (hB[i], 2 * hA[i]);
+}
+
+
+/*! \brief Checks that a write waits for an earlier write to the same bytes (WAW). */
+TEST (HazardTracker, WriteAfterWrite)
+{
+    const unsigned int n = 1 << 16;
+
+    clutils::CLEnv clEnv;
+    cl::CommandQueue &queue (addTrackedQueue (clEnv));
+    cl::Context &context (clEnv.getContext (0));
+
+    std::vector<cl_int> hA (n), hB (n);
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        hA[i] = i;
+        hB[i] = n - i;
+    }
+
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+
+    clutils::HazardTracker tracker (queue);
+    cl::Event first = tracker.enqueueWrite (dA, 0, n * sizeof (cl_int), hA.data ());
+    ASSERT_TRUE (tracker.waitList ().empty ());
+
+    // Overlaps with the second half of the first write
+    tracker.enqueueWrite (dA, n / 2 * sizeof (cl_int), n / 2 * sizeof (cl_int), hB.data () + n / 2);
+    ASSERT_EQ (tracker.waitList ().size (), 1u);
+    ASSERT_EQ (tracker.waitList ()[0] (), first ());
+
+    std::vector<cl_int> hOut (n);
+    tracker.enqueueRead (dA, 0, n * sizeof (cl_int), hOut.data (), true);
+    for (unsigned int i = 0; i < n; ++i)
+        ASSERT_EQ (hOut[i], i < n / 2 ? hA[i] : hB[i]);
+}
+
+
+/*! \brief Checks that a write skips an earlier writer that a later reader 
+ *         of the same bytes already waits for, and only that writer.
+ */
+TEST (HazardTracker, CoveredByReader)
+{
+    const unsigned int n = 1 << 16;
+    const size_t bytes = n * sizeof (cl_int);
+
+    clutils::CLEnv clEnv;
+    cl::CommandQueue &queue (addTrackedQueue (clEnv));
+    cl::Context &context (clEnv.getContext (0));
+
+    std::vector<cl_int> hA (n), hB (n);
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        hA[i] = i;
+        hB[i] = n - i;
+    }
+
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, bytes);
+    cl::Buffer dB (context, CL_MEM_READ_WRITE, bytes);
+    cl::Buffer dC (context, CL_MEM_READ_WRITE, bytes);
+
+    clutils::HazardTracker tracker (queue);
+
+    // The copy reads all the bytes of the write, so the next write waits only for the copy
+    tracker.enqueueWrite (dA, 0, bytes, hA.data ());
+    cl::Event copy = tracker.enqueueCopy (dA, dB, 0, 0, bytes);
+    tracker.enqueueWrite (dA, 0, bytes, hB.data ());
+    ASSERT_EQ (tracker.waitList ().size (), 1u);
+    ASSERT_EQ (tracker.waitList ()[0] (), copy ());
+
+    // The copy reads only half of the write, so the next write waits for both
+    cl::Event write = tracker.enqueueWrite (dA, 0, bytes, hA.data ());
+    copy = tracker.enqueueCopy (dA, dC, 0, 0, bytes / 2);
+    tracker.enqueueWrite (dA, 0, bytes, hB.data ());
+    ASSERT_EQ (tracker.waitList ().size (), 2u);
+    ASSERT_EQ (tracker.waitList ()[0] (), write ());
+    ASSERT_EQ (tracker.waitList ()[1] (), copy ());
+
+    std::vector<cl_int> hOut (n);
+    tracker.enqueueRead (dB, 0, bytes, hOut.data (), true);
+    for (unsigned int i = 0; i < n; ++i)
+        ASSERT_EQ (hOut[i], hA[i]);
+    tracker.enqueueRead (dC, 0, bytes / 2, hOut.data (), true);
+    for (unsigned int i = 0; i < n / 2; ++i)
+        ASSERT_EQ (hOut[i], hA[i]);
+    tracker.enqueueRead (dA, 0, bytes, hOut.data (), true);
+    for (unsigned int i = 0; i < n; ++i)
+        ASSERT_EQ (hOut[i], hB[i]);
+}
@@ -0,0 +1,120 @@
+/*! \file histogram.cpp
+ *  \brief Google Test Unit Tests for the histograms
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <random>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/histogram.hpp>
+
+
+/*! A size that doesn't align with the work-group size. */
+const unsigned int n_hist = (1 << 20) + 37;
+
+static std::default_random_engine h_generator (13);
+
+
+/*! \brief Counts uniform and skewed integers, some of them outside of 
+ *         the range, and compares against counts on the host.
+ */
+TEST (Histogram, Int)
+{
+    const unsigned int nBins = 100;
+    const cl_int lo = -50, hi = 250;
+    std::uniform_int_distribution<cl_int> uniform (-100, 300);
+    std::geometric_distribution<cl_int> skewed (0.05);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, n_hist * sizeof (cl_int));
+    clutils::Histogram<cl_int> hist (clEnv, clutils::CLEnvInfo<1> (), nBins, lo, hi);
+
+    for (int isSkewed = 0; isSkewed < 2; ++isSkewed)
+    {
+        std::vector<cl_int> hIn (n_hist);
+        std::vector<cl_uint> ref (nBins);
+        for (auto &v : hIn)
+        {
+            v = isSkewed ? skewed (h_generator) : uniform (h_generator);
+            if (v >= lo && v < hi)
+                ref[(v - lo) * nBins / (hi - lo)]++;
+        }
+        queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n_hist * sizeof (cl_int), hIn.data ());
+
+        ASSERT_EQ (ref, hist.run (dIn, n_hist)) << (isSkewed ? "skewed" : "uniform");
+    }
+
+    // Fewer elements than a work-group
+    std::vector<cl_uint> counts = hist.run (dIn, 0);
+    for (auto c : counts)
+        ASSERT_EQ (0u, c);
+}
+
+
+/*! \brief Counts floats into a view of a larger buffer, 
+ *         with more bins than fit in local memory.
+ */
+TEST (Histogram, Float)
+{
+    std::uniform_real_distribution<cl_float> distribution (-0.25f, 1.25f);
+    std::vector<cl_float> hIn (n_hist);
+    for (auto &v : hIn) v = distribution (h_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, n_hist * sizeof (cl_float));
+    queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n_hist * sizeof (cl_float), hIn.data ());
+
+    cl_ulong localMem = queue.getInfo<CL_QUEUE_DEVICE> ().getInfo<CL_DEVICE_LOCAL_MEM_SIZE> ();
+    for (unsigned int nBins : { 256u, (unsigned int) (localMem / sizeof (cl_uint)) })
+    {
+        std::vector<cl_uint> ref (nBins);
+        float scale = (float) (nBins / 1.0);
+        for (auto v : hIn)
+            if (v >= 0.f && v < 1.f)
+                ref[std::min ((unsigned int) (v * scale), nBins - 1)]++;
+
+        clutils::Histogram<cl_float> hist (clEnv, clutils::CLEnvInfo<1> (), nBins, 0.f, 1.f);
+        if (nBins > 256)
+        {
+            ASSERT_EQ (0u, hist.getReplicas ());
+        }
+
+        const unsigned int offset = 8;
+        cl::Buffer dCounts (context, CL_MEM_READ_WRITE, (offset + nBins) * sizeof (cl_uint));
+        hist.run (dIn, n_hist, clutils::BufferView (dCounts, offset * sizeof (cl_uint), nBins * sizeof (cl_uint)));
+
+        std::vector<cl_uint> counts (nBins);
+        queue.enqueueReadBuffer (dCounts, CL_TRUE, offset * sizeof (cl_uint), nBins * sizeof (cl_uint), counts.data ());
+        ASSERT_EQ (ref, counts) << nBins << " bins";
+    }
+}
@@ -0,0 +1,151 @@
+/*! \file memory.cpp
+ *  \brief Google Test Unit Tests for the device memory budget
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+
+
+/*! The number of elements in a cached buffer. */
+const unsigned int n_cached = 1 << 12;
+/*! The size of a cached buffer. */
+const size_t s_cached = n_cached * sizeof (cl_int);
+
+
+/*! \brief Cycles kernels over a working set twice the size of the budget,
+ *         and checks that the contents survive the evictions.
+ */
+TEST (MemoryManager, EvictsAndRestores)
+{
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    cl::CommandQueue &queue (clEnv.getQueue ());
+    cl::Kernel &kernel (clEnv.getKernel ("vecAddN"));
+
+    const unsigned int nBuffers = 8;
+    clutils::MemoryManager memory (clEnv.getContext (), queue, nBuffers / 2 * s_cached);
+
+    std::vector<cl_int> hOnes (n_cached, 1);
+    unsigned int idxOnes = memory.cache (CL_MEM_READ_ONLY, s_cached, hOnes.data ());
+
+    std::vector<unsigned int> idx;
+    std::vector< std::vector<cl_int> > expected (nBuffers, std::vector<cl_int> (n_cached));
+    for (unsigned int b = 0; b < nBuffers; ++b)
+    {
+        for (unsigned int i = 0; i < n_cached; ++i)
+            expected[b][i] = b * n_cached + i;
+        idx.push_back (memory.cache (CL_MEM_READ_WRITE, s_cached, expected[b].data ()));
+    }
+
+    for (unsigned int r = 0; r < 3; ++r)
+    {
+        for (unsigned int b = 0; b < nBuffers; ++b)
+        {
+            // The buffers of a launch are locked, so they can't evict each other
+            memory.lock (idxOnes);
+            kernel.setArg (0, memory.acquire (idxOnes));
+            const cl::Buffer &dB (memory.acquire (idx[b]));
+            kernel.setArg (1, dB);
+            kernel.setArg (2, dB);
+            kernel.setArg (3, n_cached);
+            queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (n_cached), cl::NDRange (256));
+            memory.unlock (idxOnes);
+
+            for (auto &x : expected[b])
+                ++x;
+
+            ASSERT_LE (memory.used (), memory.budget ());
+        }
+    }
+
+    EXPECT_GT (memory.evictions (), 0u);
+    EXPECT_GT (memory.restorations (), nBuffers);
+
+    for (unsigned int b = 0; b < nBuffers; ++b)
+    {
+        std::vector<cl_int> hB (n_cached);
+        queue.enqueueReadBuffer (memory.acquire (idx[b]), CL_TRUE, 0, s_cached, hB.data ());
+        EXPECT_EQ (expected[b], hB);
+    }
+}
+
+
+/*! \brief Checks that the least recently used buffers get evicted, 
+ *         and that locked buffers stay on the device.
+ */
+TEST (MemoryManager, EvictsLeastRecentlyUsed)
+{
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    clutils::MemoryManager memory (clEnv.getContext (), clEnv.getQueue (), 3 * s_cached);
+
+    std::vector<unsigned int> idx;
+    for (unsigned int b = 0; b < 4; ++b)
+        idx.push_back (memory.cache (CL_MEM_READ_WRITE, s_cached));
+
+    memory.lock (idx[0]);
+    for (unsigned int b = 0; b < 4; ++b)
+        memory.acquire (idx[b]);
+
+    EXPECT_TRUE (memory.isResident (idx[0]));
+    EXPECT_FALSE (memory.isResident (idx[1]));
+    EXPECT_TRUE (memory.isResident (idx[2]));
+    EXPECT_TRUE (memory.isResident (idx[3]));
+
+    memory.unlock (idx[0]);
+    memory.acquire (idx[1]);
+    EXPECT_FALSE (memory.isResident (idx[0]));
+
+    memory.setBudget (s_cached);
+    EXPECT_EQ (s_cached, memory.used ());
+    EXPECT_TRUE (memory.isResident (idx[1]));
+
+    // The buffers of a single launch have to fit in the budget
+    EXPECT_THROW (memory.createBuffer (CL_MEM_READ_WRITE, 2 * s_cached), cl::Error);
+
+    memory.release (idx[1]);
+    EXPECT_EQ (0u, memory.used ());
+}
+
+
+/*! \brief Checks that the buffers the library allocates 
+ *         count against the budget of their context.
+ */
+TEST (MemoryManager, AccountsLibraryBuffers)
+{
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    clutils::MemoryManager &memory (clEnv.getMemoryManager ());
+    EXPECT_EQ (&memory, &clEnv.getMemoryManager ());
+
+    size_t used = memory.used ();
+    clutils::Reduce<cl_int> reduce (clEnv);
+    EXPECT_GT (memory.used (), used);
+
+    used = memory.used ();
+    cl::Buffer dHost (memory.createBuffer (CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, s_cached));
+    EXPECT_EQ (used, memory.used ());
+}
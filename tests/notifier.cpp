@@ -0,0 +1,248 @@
+/*! \file notifier.cpp
+ *  \brief Google Test Unit Tests for the completion notifier
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <set>
+#include <thread>
+#include <atomic>
+#include <sys/epoll.h>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/notifier.hpp>
+
+
+/*! \brief Runs an event loop on the notifier until it collects a number 
+ *         of completions, or nothing completes for a second.
+ */
+void collect (int epfd, clutils::CompletionNotifier &notifier, 
+              std::vector<clutils::Completion> &out, size_t count)
+{
+    epoll_event ev;
+    while (out.size () < count && epoll_wait (epfd, &ev, 1, 1000) > 0)
+        notifier.drain ([&out] (const clutils::Completion &c) { out.push_back (c); });
+}
+
+
+/*! \brief Checks that user events are delivered with their tags and status, 
+ *         only after they complete.
+ */
+TEST (CompletionNotifier, UserEvents)
+{
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+
+    clutils::CompletionNotifier notifier;
+    int epfd = epoll_create1 (0);
+    epoll_event ev = { EPOLLIN, { 0 } };
+    ASSERT_EQ (epoll_ctl (epfd, EPOLL_CTL_ADD, notifier.fd (), &ev), 0);
+
+    cl::UserEvent a (context), b (context);
+    notifier.watch (a, 1);
+    notifier.watch (b, 2);
+    ASSERT_EQ (notifier.pending (), 2u);
+
+    // Nothing completed yet
+    ASSERT_EQ (epoll_wait (epfd, &ev, 1, 0), 0);
+
+    std::vector<clutils::Completion> completions;
+    b.setStatus (CL_COMPLETE);
+    collect (epfd, notifier, completions, 1);
+    ASSERT_EQ (completions.size (), 1u);
+    ASSERT_EQ (completions[0].tag, 2u);
+    ASSERT_EQ (completions[0].status, CL_COMPLETE);
+
+    a.setStatus (-1);  // A failed command
+    collect (epfd, notifier, completions, 2);
+    ASSERT_EQ (completions.size (), 2u);
+    ASSERT_EQ (completions[1].tag, 1u);
+    ASSERT_LT (completions[1].status, 0);
+    ASSERT_EQ (notifier.pending (), 0u);
+
+    close (epfd);
+}
+
+
+/*! \brief Completes user events from many threads, and checks that 
+ *         a single reactor thread collects all of them exactly once.
+ */
+TEST (CompletionNotifier, Threads)
+{
+    const unsigned int nThreads = 4, nEvents = 2000;
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+
+    clutils::CompletionNotifier notifier;
+    int epfd = epoll_create1 (0);
+    epoll_event ev = { EPOLLIN, { 0 } };
+    ASSERT_EQ (epoll_ctl (epfd, EPOLL_CTL_ADD, notifier.fd (), &ev), 0);
+
+    std::vector<cl::UserEvent> events;
+    for (unsigned int i = 0; i < nThreads * nEvents; ++i)
+    {
+        events.push_back (cl::UserEvent (context));
+        notifier.watch (events.back (), i);
+    }
+
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < nThreads; ++t)
+        threads.push_back (std::thread ([&events, t] ()
+        {
+            for (unsigned int i = t * nEvents; i < (t + 1) * nEvents; ++i)
+                events[i].setStatus (CL_COMPLETE);
+        }));
+
+    std::vector<clutils::Completion> completions;
+    collect (epfd, notifier, completions, nThreads * nEvents);
+
+    for (auto &thread : threads)
+        thread.join ();
+
+    ASSERT_EQ (completions.size (), nThreads * nEvents);
+    std::set<uint64_t> tags;
+    for (auto &c : completions)
+    {
+        ASSERT_EQ (c.status, CL_COMPLETE);
+        tags.insert (c.tag);
+    }
+    ASSERT_EQ (tags.size (), nThreads * nEvents);
+
+    close (epfd);
+}
+
+
+/*! \brief Completes user events from many threads in bursts, while the reactor 
+ *         drains as fast as it can, so that drains overlap with callbacks that 
+ *         are in the middle of queuing their completions. Every tag has to arrive, 
+ *         without a wakeup getting lost along the way.
+ */
+TEST (CompletionNotifier, ConcurrentDrain)
+{
+    const unsigned int nThreads = 8, nEvents = 5000, nRounds = 4;
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+
+    clutils::CompletionNotifier notifier;
+    int epfd = epoll_create1 (0);
+    epoll_event ev = { EPOLLIN, { 0 } };
+    ASSERT_EQ (epoll_ctl (epfd, EPOLL_CTL_ADD, notifier.fd (), &ev), 0);
+
+    for (unsigned int r = 0; r < nRounds; ++r)
+    {
+        std::vector<cl::UserEvent> events;
+        for (unsigned int i = 0; i < nThreads * nEvents; ++i)
+        {
+            events.push_back (cl::UserEvent (context));
+            notifier.watch (events.back (), i);
+        }
+
+        std::atomic<unsigned int> ready (0);
+        std::vector<std::thread> threads;
+        for (unsigned int t = 0; t < nThreads; ++t)
+            threads.push_back (std::thread ([&events, &ready, t] ()
+            {
+                // Start together, to maximize the contention on the queue
+                ready.fetch_add (1);
+                while (ready.load () < nThreads);
+                for (unsigned int i = t; i < nThreads * nEvents; i += nThreads)
+                    events[i].setStatus (CL_COMPLETE);
+            }));
+
+        std::vector<clutils::Completion> completions;
+        collect (epfd, notifier, completions, nThreads * nEvents);
+
+        for (auto &thread : threads)
+            thread.join ();
+
+        ASSERT_EQ (completions.size (), nThreads * nEvents) << "round " << r;
+        std::set<uint64_t> tags;
+        for (auto &c : completions)
+            tags.insert (c.tag);
+        ASSERT_EQ (tags.size (), nThreads * nEvents) << "round " << r;
+        ASSERT_EQ (notifier.pending (), 0u);
+    }
+
+    close (epfd);
+}
+
+
+/*! \brief Drives kernels to completion from an event loop, 
+ *         along with a marker that covers the whole queue.
+ */
+TEST (CompletionNotifier, Kernels)
+{
+    const unsigned int n = 1 << 16, nLaunches = 64;
+
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    cl::Context &context (clEnv.getContext ());
+    cl::CommandQueue &queue (clEnv.getQueue ());
+    cl::Kernel &kernel (clEnv.getKernel ("vecAddN"));
+
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+    cl::Buffer dC (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+    queue.enqueueFillBuffer (dA, (cl_int) 1, 0, n * sizeof (cl_int));
+    kernel.setArg (0, dA);
+    kernel.setArg (1, dA);
+    kernel.setArg (2, dC);
+    kernel.setArg (3, n);
+
+    clutils::CompletionNotifier notifier;
+    int epfd = epoll_create1 (0);
+    epoll_event ev = { EPOLLIN, { 0 } };
+    ASSERT_EQ (epoll_ctl (epfd, EPOLL_CTL_ADD, notifier.fd (), &ev), 0);
+
+    for (unsigned int i = 0; i < nLaunches; ++i)
+    {
+        cl::Event event;
+        queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (n), cl::NullRange, nullptr, &event);
+        notifier.watch (event, i);
+    }
+    notifier.watch (queue, nLaunches);
+    queue.flush ();
+
+    std::vector<clutils::Completion> completions;
+    collect (epfd, notifier, completions, nLaunches + 1);
+
+    ASSERT_EQ (completions.size (), nLaunches + 1);
+    ASSERT_EQ (notifier.pending (), 0u);
+    std::set<uint64_t> tags;
+    for (auto &c : completions)
+    {
+        ASSERT_EQ (c.status, CL_COMPLETE);
+        tags.insert (c.tag);
+    }
+    ASSERT_EQ (tags.size (), nLaunches + 1);
+
+    std::vector<cl_int> hC (n);
+    queue.enqueueReadBuffer (dC, CL_TRUE, 0, n * sizeof (cl_int), hC.data ());
+    for (auto c : hC)
+        ASSERT_EQ (c, 2);
+
+    close (epfd);
+}
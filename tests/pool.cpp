@@ -0,0 +1,164 @@
+/*! \file pool.cpp
+ *  \brief Google Test Unit Tests for the work-stealing pool of host threads
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/pool.hpp>
+
+
+/*! \brief Checks that the subranges cover the range exactly once, 
+ *         and that they run on more than one thread.
+ */
+TEST (ThreadPool, ParallelFor)
+{
+    clutils::ThreadPool pool (4);
+    ASSERT_EQ (4u, pool.size ());
+
+    const size_t n = (1 << 20) + 3;
+    std::vector<int> v (n, 0);
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+
+    pool.parallel_for (5, n, [&] (size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            v[i] += i;
+
+        std::lock_guard<std::mutex> lock (mutex);
+        threads.insert (std::this_thread::get_id ());
+        std::this_thread::sleep_for (std::chrono::milliseconds (1));
+    }, 1 << 12);
+
+    for (size_t i = 0; i < n; ++i)
+        ASSERT_EQ (i < 5 ? 0 : (int) i, v[i]);
+    ASSERT_GT (threads.size (), 1u);
+
+    // The pointer overload hands over subranges of the elements
+    pool.parallel_for (v.data (), v.data () + n, [] (int *first, int *last)
+    {
+        for (int *p = first; p != last; ++p)
+            *p = -*p;
+    });
+
+    for (size_t i = 0; i < n; ++i)
+        ASSERT_EQ (i < 5 ? 0 : -(int) i, v[i]);
+
+    // Empty ranges don't call the function
+    pool.parallel_for (7, 7, [] (size_t, size_t) { FAIL (); });
+}
+
+
+/*! \brief Checks nested loops, exceptions, and tasks. */
+TEST (ThreadPool, NestedAndTasks)
+{
+    clutils::ThreadPool pool (3);
+
+    std::atomic<size_t> count (0);
+    pool.parallel_for (0, 64, [&] (size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            pool.parallel_for (0, 1000, [&] (size_t b, size_t e) { count += e - b; }, 10);
+    }, 1);
+    ASSERT_EQ (64000u, count.load ());
+
+    ASSERT_THROW (pool.parallel_for (0, 10000, [] (size_t, size_t end)
+    {
+        if (end > 5000)
+            throw std::runtime_error ("failed");
+    }, 10), std::runtime_error);
+
+    std::future<int> answer = pool.submit ([] { return 42; });
+    std::future<void> error = pool.submit ([] { throw std::runtime_error ("failed"); });
+    ASSERT_EQ (42, answer.get ());
+    ASSERT_THROW (error.get (), std::runtime_error);
+
+    std::vector<char> src ((5 << 20) + 7), dst (src.size ());
+    for (size_t i = 0; i < src.size (); ++i)
+        src[i] = (char) (i * 7);
+    pool.copy (dst.data (), src.data (), src.size ());
+    ASSERT_TRUE (src == dst);
+}
+
+
+/*! \brief Fills and verifies a mapped staging buffer in chunks, 
+ *         while the device adds the previous chunks.
+ */
+TEST (ThreadPool, Staging)
+{
+    const size_t n = 1 << 20, chunks = 4, chunk = n / chunks;
+    clutils::ThreadPool &pool = clutils::ThreadPool::instance ();
+
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    cl::Context &context (clEnv.getContext ());
+    cl::CommandQueue &queue (clEnv.getQueue ());
+    cl::Kernel &kernel (clEnv.getKernel ("vecAdd"));
+
+    cl::Buffer hBuffer (context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, n * sizeof (cl_int));
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+    cl::Buffer dC (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+    kernel.setArg (0, dA);
+    kernel.setArg (1, dA);
+    kernel.setArg (2, dC);
+
+    for (size_t k = 0; k < chunks; ++k)
+    {
+        size_t offset = k * chunk * sizeof (cl_int), bytes = chunk * sizeof (cl_int);
+        cl_int *ptr = (cl_int *) queue.enqueueMapBuffer (hBuffer, CL_TRUE, CL_MAP_WRITE, offset, bytes);
+        pool.parallel_for (ptr, ptr + chunk, [&] (cl_int *first, cl_int *last)
+        {
+            for (cl_int *p = first; p != last; ++p)
+                *p = k * chunk + (p - ptr);
+        });
+        queue.enqueueUnmapMemObject (hBuffer, ptr);
+        queue.enqueueCopyBuffer (hBuffer, dA, offset, offset, bytes);
+
+        queue.enqueueNDRangeKernel (kernel, cl::NDRange (k * chunk), cl::NDRange (chunk), cl::NDRange (256));
+        queue.flush ();
+    }
+
+    queue.enqueueCopyBuffer (dC, hBuffer, 0, 0, n * sizeof (cl_int));
+    cl_int *C = (cl_int *) queue.enqueueMapBuffer (hBuffer, CL_TRUE, CL_MAP_READ, 0, n * sizeof (cl_int));
+
+    std::atomic<size_t> mismatches (0);
+    pool.parallel_for (0, n, [&] (size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+            if (C[i] != 2 * (cl_int) i)
+                ++mismatches;
+    });
+    queue.enqueueUnmapMemObject (hBuffer, C);
+    queue.finish ();
+
+    ASSERT_EQ (0u, mismatches.load ());
+}
@@ -0,0 +1,148 @@
+/*! \file primitives.cpp
+ *  \brief Google Test Unit Tests for the parallel primitives
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <numeric>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+
+
+/*! A size that doesn't align with the work-group size, and 
+ *  is large enough to require three levels in the scan.
+ */
+const unsigned int n_prim = (1 << 20) + 37;
+
+static auto p_seed = std::chrono::system_clock::now ().time_since_epoch ().count ();
+static std::default_random_engine p_generator (p_seed);
+
+
+/*! \brief Reduces a buffer with every supported operator, 
+ *         and compares against `std::accumulate`.
+ */
+TEST (Reduce, Operators)
+{
+    std::uniform_int_distribution<cl_int> distribution (-1000, 1000);
+    std::vector<cl_int> hBuf (n_prim);
+    for (auto &v : hBuf) v = distribution (p_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dBuf (context, CL_MEM_READ_ONLY, n_prim * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dBuf, CL_TRUE, 0, n_prim * sizeof (cl_int), hBuf.data ());
+
+    clutils::Reduce<cl_int, clutils::Sum> rSum (clEnv);
+    clutils::Reduce<cl_int, clutils::Min> rMin (clEnv);
+    clutils::Reduce<cl_int, clutils::Max> rMax (clEnv);
+
+    ASSERT_EQ (std::accumulate (hBuf.begin (), hBuf.end (), 0), rSum.run (dBuf, n_prim));
+    ASSERT_EQ (*std::min_element (hBuf.begin (), hBuf.end ()), rMin.run (dBuf, n_prim));
+    ASSERT_EQ (*std::max_element (hBuf.begin (), hBuf.end ()), rMax.run (dBuf, n_prim));
+
+    // Fewer elements than a work-group
+    ASSERT_EQ (std::accumulate (hBuf.begin (), hBuf.begin () + 5, 0), rSum.run (dBuf, 5));
+
+    // An empty input reduces to the identity
+    ASSERT_EQ (0, rSum.run (dBuf, 0));
+    ASSERT_EQ (clutils::Min::identity<cl_int> (), rMin.run (dBuf, 0));
+    ASSERT_EQ (clutils::Max::identity<cl_int> (), rMax.run (dBuf, 0));
+}
+
+
+/*! \brief Performs inclusive and exclusive scans, 
+ *         and compares against `std::partial_sum`.
+ */
+TEST (Scan, InclusiveExclusive)
+{
+    std::uniform_int_distribution<cl_int> distribution (0, 32);
+    std::vector<cl_int> hIn (n_prim), hOut (n_prim), hRef (n_prim);
+    for (auto &v : hIn) v = distribution (p_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, n_prim * sizeof (cl_int));
+    cl::Buffer dOut (context, CL_MEM_READ_WRITE, n_prim * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n_prim * sizeof (cl_int), hIn.data ());
+
+    clutils::Scan<cl_int> scan (clEnv);
+
+    scan.run (dIn, n_prim, dOut, clutils::ScanType::INCLUSIVE);
+    queue.enqueueReadBuffer (dOut, CL_TRUE, 0, n_prim * sizeof (cl_int), hOut.data ());
+    std::partial_sum (hIn.begin (), hIn.end (), hRef.begin ());
+    for (unsigned int i = 0; i < n_prim; ++i)
+        ASSERT_EQ (hRef[i], hOut[i]);
+
+    scan.run (dIn, n_prim, dOut, clutils::ScanType::EXCLUSIVE);
+    queue.enqueueReadBuffer (dOut, CL_TRUE, 0, n_prim * sizeof (cl_int), hOut.data ());
+    ASSERT_EQ (0, hOut[0]);
+    for (unsigned int i = 1; i < n_prim; ++i)
+        ASSERT_EQ (hRef[i - 1], hOut[i]);
+
+    // An empty scan leaves the output alone, on a fresh object too
+    clutils::Scan<cl_int> empty (clEnv);
+    cl::Event event;
+    empty.run (dIn, 0, dOut, clutils::ScanType::INCLUSIVE, nullptr, &event);
+    event.wait ();
+    queue.enqueueReadBuffer (dOut, CL_TRUE, 0, sizeof (cl_int), hOut.data ());
+    ASSERT_EQ (0, hOut[0]);
+}
+
+
+/*! \brief Performs an in-place inclusive max-scan on floats.
+ */
+TEST (Scan, MaxInPlace)
+{
+    std::uniform_real_distribution<cl_float> distribution (-100.f, 100.f);
+    const unsigned int n = 5000;
+    std::vector<cl_float> hIn (n), hOut (n);
+    for (auto &v : hIn) v = distribution (p_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dBuf (context, CL_MEM_READ_WRITE, n * sizeof (cl_float));
+    queue.enqueueWriteBuffer (dBuf, CL_TRUE, 0, n * sizeof (cl_float), hIn.data ());
+
+    clutils::Scan<cl_float, clutils::Max> scan (clEnv);
+    scan.run (dBuf, n, dBuf);
+    queue.enqueueReadBuffer (dBuf, CL_TRUE, 0, n * sizeof (cl_float), hOut.data ());
+
+    cl_float acc = clutils::Max::identity<cl_float> ();
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        acc = std::max (acc, hIn[i]);
+        ASSERT_EQ (acc, hOut[i]);
+    }
+}
@@ -0,0 +1,184 @@
+/*! \file rect.cpp
+ *  \brief Google Test Unit Tests for the pitched transfers and surfaces
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/rect.hpp>
+
+
+/*! \brief Moves a 2D box between pitched host memory and pitched buffers, 
+ *         and checks that nothing outside of the box is touched.
+ */
+TEST (Rect, Pitched2D)
+{
+    const size_t hPitch = 128, hRows = 60;  // Host layout in ints
+    const size_t dPitch = 64, dRows = 40;  // Device layout in ints
+    const size_t w = 40, h = 30;  // The box
+
+    std::vector<cl_int> hIn (hPitch * hRows), hOut (hPitch * hRows, -1), hDev (dPitch * dRows);
+    for (size_t i = 0; i < hIn.size (); ++i) hIn[i] = i;
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, dPitch * dRows * sizeof (cl_int));
+    cl::Buffer dB (context, CL_MEM_READ_WRITE, dPitch * dRows * sizeof (cl_int));
+    std::vector<cl_int> zeros (dPitch * dRows, 0);
+    queue.enqueueWriteBuffer (dA, CL_FALSE, 0, zeros.size () * sizeof (cl_int), zeros.data ());
+
+    // Host box at (10, 5) goes to (8, 2) on the device
+    clutils::writeRect (queue, dA, clutils::Pitched (dPitch * sizeof (cl_int), 0, 8 * sizeof (cl_int), 2), 
+                        hIn.data (), clutils::Pitched (hPitch * sizeof (cl_int), 0, 10 * sizeof (cl_int), 5), 
+                        clutils::Extent (w * sizeof (cl_int), h));
+    queue.enqueueReadBuffer (dA, CL_TRUE, 0, hDev.size () * sizeof (cl_int), hDev.data ());
+
+    for (size_t y = 0; y < dRows; ++y)
+        for (size_t x = 0; x < dPitch; ++x)
+        {
+            bool inBox = x >= 8 && x < 8 + w && y >= 2 && y < 2 + h;
+            ASSERT_EQ (inBox ? hIn[(y - 2 + 5) * hPitch + x - 8 + 10] : 0, hDev[y * dPitch + x]);
+        }
+
+    // Move the box to the origin of another buffer, and read it back to (1, 1)
+    clutils::copyRect (queue, dA, clutils::Pitched (dPitch * sizeof (cl_int), 0, 8 * sizeof (cl_int), 2), 
+                       dB, clutils::Pitched (dPitch * sizeof (cl_int)), clutils::Extent (w * sizeof (cl_int), h));
+    clutils::readRect (queue, dB, clutils::Pitched (dPitch * sizeof (cl_int)), 
+                       hOut.data (), clutils::Pitched (hPitch * sizeof (cl_int), 0, sizeof (cl_int), 1), 
+                       clutils::Extent (w * sizeof (cl_int), h));
+
+    for (size_t y = 0; y < hRows; ++y)
+        for (size_t x = 0; x < hPitch; ++x)
+        {
+            bool inBox = x >= 1 && x < 1 + w && y >= 1 && y < 1 + h;
+            ASSERT_EQ (inBox ? hIn[(y - 1 + 5) * hPitch + x - 1 + 10] : -1, hOut[y * hPitch + x]);
+        }
+}
+
+
+/*! \brief Reads a 3D box out of a volume.
+ */
+TEST (Rect, Box3D)
+{
+    const size_t nx = 32, ny = 16, nz = 8;
+    std::vector<cl_float> hVol (nx * ny * nz), hBox (4 * 5 * 6);
+    for (size_t i = 0; i < hVol.size (); ++i) hVol[i] = (cl_float) i;
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dVol (context, CL_MEM_READ_ONLY, hVol.size () * sizeof (cl_float));
+    queue.enqueueWriteBuffer (dVol, CL_FALSE, 0, hVol.size () * sizeof (cl_float), hVol.data ());
+
+    clutils::readRect (queue, dVol, clutils::Pitched (nx * sizeof (cl_float), nx * ny * sizeof (cl_float), 
+                                                      3 * sizeof (cl_float), 2, 1), 
+                       hBox.data (), clutils::Pitched (), clutils::Extent (4 * sizeof (cl_float), 5, 6));
+
+    for (size_t z = 0; z < 6; ++z)
+        for (size_t y = 0; y < 5; ++y)
+            for (size_t x = 0; x < 4; ++x)
+                ASSERT_EQ (hVol[(z + 1) * nx * ny + (y + 2) * nx + x + 3], hBox[(z * 5 + y) * 4 + x]);
+}
+
+
+/*! \brief Writes pitched host data to a surface, backed by 
+ *         an image and by a buffer, and reads back a region.
+ */
+TEST (Surface2D, ImageAndBuffer)
+{
+    const size_t w = 37, h = 23, hPitch = 40;  // In pixels
+    std::vector<cl_float> hIn (4 * hPitch * h), hOut (4 * 16 * 8, -1.f);
+    for (size_t i = 0; i < hIn.size (); ++i) hIn[i] = (cl_float) i;
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    for (bool preferImage : { true, false })
+    {
+        clutils::Surface2D surface (clEnv, clutils::CLEnvInfo<1> (), CL_MEM_READ_WRITE, 
+                                    cl::ImageFormat (CL_RGBA, CL_FLOAT), w, h, preferImage);
+        if (!preferImage)
+        {
+            ASSERT_FALSE (surface.isImage ());
+            ASSERT_EQ (0u, surface.rowPitch () % clutils::BufferView::alignment (context));
+            ASSERT_GE (surface.rowPitch (), w * 4 * sizeof (cl_float));
+        }
+        ASSERT_EQ (4 * sizeof (cl_float), surface.pixelSize ());
+
+        // A 12x7 region at (20, 10) goes to a host buffer with a pitch of 16 pixels
+        surface.write (queue, hIn.data (), hPitch * surface.pixelSize ());
+        surface.read (queue, 20, 10, 12, 7, hOut.data (), 16 * surface.pixelSize ());
+
+        for (size_t y = 0; y < 7; ++y)
+            for (size_t x = 0; x < 12 * 4; ++x)
+                ASSERT_EQ (hIn[(y + 10) * hPitch * 4 + 20 * 4 + x], hOut[y * 16 * 4 + x]);
+        for (size_t x = 12 * 4; x < 16 * 4; ++x)
+            ASSERT_EQ (-1.f, hOut[x]);
+    }
+}
+
+
+/*! \brief Checks that the rows of a buffer-backed surface with 3-byte 
+ *         pixels hold whole pixels, and that a kernel can walk them with 
+ *         the pitch it gets from `setArg`.
+ */
+TEST (Surface2D, ThreeChannelPitch)
+{
+    const size_t w = 37, h = 23;
+    std::vector<cl_uchar> hIn (3 * w * h), hOut (3 * w * h);
+    for (size_t i = 0; i < hIn.size (); ++i) hIn[i] = (cl_uchar) (i * 7);
+
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    cl::Context &context (clEnv.getContext ());
+    cl::CommandQueue &queue (clEnv.getQueue ());
+    cl::Kernel &kernel (clEnv.getKernel ("incrementRGB8"));
+
+    for (cl_channel_type type : { CL_UNORM_INT8, CL_UNSIGNED_INT16, CL_FLOAT })
+    {
+        clutils::Surface2D surface (clEnv, clutils::CLEnvInfo<1> (), CL_MEM_READ_WRITE, 
+                                    cl::ImageFormat (CL_RGB, type), w, h, false);
+        ASSERT_EQ (0u, surface.rowPitch () % surface.pixelSize ());
+        ASSERT_EQ (0u, surface.rowPitch () % clutils::BufferView::alignment (context));
+        ASSERT_GE (surface.rowPitch (), w * surface.pixelSize ());
+    }
+
+    clutils::Surface2D surface (clEnv, clutils::CLEnvInfo<1> (), CL_MEM_READ_WRITE, 
+                                cl::ImageFormat (CL_RGB, CL_UNORM_INT8), w, h, false);
+    ASSERT_EQ (3u, surface.pixelSize ());
+    surface.write (queue, hIn.data ());
+
+    ASSERT_EQ (2u, surface.setArg (kernel, 0));
+    queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (w, h));
+    surface.read (queue, hOut.data ());
+
+    for (size_t i = 0; i < hIn.size (); ++i)
+        ASSERT_EQ ((cl_uchar) (hIn[i] + 1), hOut[i]) << "byte " << i;
+}
@@ -0,0 +1,189 @@
+/*! \file scheduler.cpp
+ *  \brief Google Test Unit Tests for the priority job scheduler
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <future>
+#include <stdexcept>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/scheduler.hpp>
+
+
+/*! \brief Runs small jobs, and checks their results and statistics. */
+TEST (JobScheduler, Jobs)
+{
+    const unsigned int n = 1 << 12, nJobs = 100;
+
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    cl::Context &context (clEnv.getContext ());
+    cl::CommandQueue &queue (clEnv.getQueue ());
+    cl::Kernel &kernel (clEnv.getKernel ("vecAddN"));
+
+    std::vector<cl_int> hA (n);
+    for (unsigned int i = 0; i < n; ++i)
+        hA[i] = i;
+    cl::Buffer dA (context, CL_MEM_READ_ONLY, n * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dA, CL_TRUE, 0, n * sizeof (cl_int), hA.data ());
+
+    std::vector<cl::Buffer> dOut;
+    for (unsigned int j = 0; j < nJobs; ++j)
+        dOut.push_back (cl::Buffer (context, CL_MEM_WRITE_ONLY, n * sizeof (cl_int)));
+
+    clutils::JobScheduler scheduler (clEnv);
+    std::vector<std::shared_future<cl_int>> results;
+    for (unsigned int j = 0; j < nJobs; ++j)
+        results.push_back (scheduler.submit (clutils::Priority::INTERACTIVE, [&, j] (cl::CommandQueue &q)
+        {
+            cl::Event event;
+            kernel.setArg (0, dA);
+            kernel.setArg (1, dA);
+            kernel.setArg (2, dOut[j]);
+            kernel.setArg (3, n);
+            q.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (n), cl::NullRange, nullptr, &event);
+            return event;
+        }));
+
+    for (auto &r : results)
+        ASSERT_EQ (r.get (), CL_COMPLETE);
+    scheduler.wait ();
+
+    std::vector<cl_int> hOut (n);
+    for (unsigned int j = 0; j < nJobs; j += 33)
+    {
+        queue.enqueueReadBuffer (dOut[j], CL_TRUE, 0, n * sizeof (cl_int), hOut.data ());
+        for (unsigned int i = 0; i < n; ++i)
+            ASSERT_EQ (hOut[i], 2 * hA[i]);
+    }
+
+    clutils::JobStats stats (scheduler.stats (clutils::Priority::INTERACTIVE));
+    ASSERT_EQ (stats.count, nJobs);
+    ASSERT_LE (stats.p50Latency, stats.maxLatency);
+    ASSERT_EQ (scheduler.stats (clutils::Priority::BATCH).count, 0u);
+}
+
+
+/*! \brief Runs a batch job in chunks, while interactive jobs arrive, 
+ *         and checks that they don't wait for the whole batch.
+ */
+TEST (JobScheduler, BatchChunks)
+{
+    const unsigned int n = 1 << 22, chunk = 1 << 18, nJobs = 20;
+
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    cl::Context &context (clEnv.getContext ());
+    cl::CommandQueue &queue (clEnv.getQueue ());
+    cl::Kernel &batchKernel (clEnv.getKernel ("vecAddN"));
+    cl::Kernel smallKernel (clEnv.getProgram (0), "vecAddN");
+
+    std::vector<cl_int> hA (n);
+    for (unsigned int i = 0; i < n; ++i)
+        hA[i] = i % 4096;
+    cl::Buffer dA (context, CL_MEM_READ_ONLY, n * sizeof (cl_int));
+    cl::Buffer dB (context, CL_MEM_WRITE_ONLY, n * sizeof (cl_int));
+    cl::Buffer dSmall (context, CL_MEM_WRITE_ONLY, 256 * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dA, CL_TRUE, 0, n * sizeof (cl_int), hA.data ());
+
+    batchKernel.setArg (0, dA);
+    batchKernel.setArg (1, dA);
+    batchKernel.setArg (2, dB);
+    batchKernel.setArg (3, n);
+    smallKernel.setArg (0, dA);
+    smallKernel.setArg (1, dA);
+    smallKernel.setArg (2, dSmall);
+    smallKernel.setArg (3, 256u);
+
+    clutils::JobScheduler scheduler (clEnv);
+    std::shared_future<cl_int> batch = scheduler.submit (clutils::Priority::BATCH, n, chunk, 
+        [&] (cl::CommandQueue &q, size_t begin, size_t end)
+        {
+            cl::Event event;
+            q.enqueueNDRangeKernel (batchKernel, cl::NDRange (begin), cl::NDRange (end - begin), 
+                                    cl::NullRange, nullptr, &event);
+            return event;
+        });
+
+    for (unsigned int j = 0; j < nJobs; ++j)
+        scheduler.submit (clutils::Priority::INTERACTIVE, [&] (cl::CommandQueue &q)
+        {
+            cl::Event event;
+            q.enqueueNDRangeKernel (smallKernel, cl::NullRange, cl::NDRange (256), cl::NullRange, nullptr, &event);
+            return event;
+        });
+
+    ASSERT_EQ (batch.get (), CL_COMPLETE);
+    scheduler.wait ();
+
+    std::vector<cl_int> hB (n);
+    queue.enqueueReadBuffer (dB, CL_TRUE, 0, n * sizeof (cl_int), hB.data ());
+    for (unsigned int i = 0; i < n; ++i)
+        ASSERT_EQ (hB[i], 2 * hA[i]);
+
+    clutils::JobStats interactive (scheduler.stats (clutils::Priority::INTERACTIVE));
+    clutils::JobStats batchStats (scheduler.stats (clutils::Priority::BATCH));
+    ASSERT_EQ (interactive.count, nJobs);
+    ASSERT_EQ (batchStats.count, 1u);
+    ASSERT_LT (interactive.meanLatency, batchStats.maxLatency);
+}
+
+
+/*! \brief Checks that jobs that throw don't take down the dispatcher, 
+ *         and that their futures report the failure.
+ */
+TEST (JobScheduler, Exceptions)
+{
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    clutils::JobScheduler scheduler (clEnv);
+
+    std::shared_future<cl_int> thrown = scheduler.submit (clutils::Priority::NORMAL, 
+        [] (cl::CommandQueue&) -> cl::Event { throw std::runtime_error ("job"); });
+    std::shared_future<cl_int> clError = scheduler.submit (clutils::Priority::NORMAL, 
+        [] (cl::CommandQueue&) -> cl::Event { throw cl::Error (CL_OUT_OF_RESOURCES, "job"); });
+
+    // One chunk out of four throws
+    std::shared_future<cl_int> chunked = scheduler.submit (clutils::Priority::BATCH, 4, 1, 
+        [] (cl::CommandQueue &q, size_t begin, size_t) -> cl::Event
+        {
+            if (begin == 2) throw std::logic_error ("chunk");
+            cl::Event event;
+            q.enqueueMarkerWithWaitList (nullptr, &event);
+            return event;
+        });
+
+    std::shared_future<cl_int> fine = scheduler.submit (clutils::Priority::NORMAL, [] (cl::CommandQueue &q)
+    {
+        cl::Event event;
+        q.enqueueMarkerWithWaitList (nullptr, &event);
+        return event;
+    });
+
+    scheduler.wait ();
+    EXPECT_THROW (thrown.get (), std::runtime_error);
+    EXPECT_EQ (CL_OUT_OF_RESOURCES, clError.get ());
+    EXPECT_THROW (chunked.get (), std::logic_error);
+    EXPECT_EQ (CL_COMPLETE, fine.get ());
+}
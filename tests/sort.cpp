@@ -0,0 +1,113 @@
+/*! \file sort.cpp
+ *  \brief Google Test Unit Tests for the radix sort
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/sort.hpp>
+
+
+const unsigned int n_sort = (1 << 18) + 13;
+
+static auto s_seed = std::chrono::system_clock::now ().time_since_epoch ().count ();
+static std::default_random_engine s_generator (s_seed);
+
+
+/*! \brief Sorts unsigned 32-bit keys, twice with the 
+ *         same object, and compares against `std::sort`.
+ */
+TEST (RadixSort, UnsignedKeys)
+{
+    std::uniform_int_distribution<cl_uint> distribution;
+    std::vector<cl_uint> hKeys (n_sort), hOut (n_sort);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+    cl::Buffer dKeys (context, CL_MEM_READ_WRITE, n_sort * sizeof (cl_uint));
+
+    clutils::RadixSort<cl_uint> sort (clEnv);
+
+    for (unsigned int n : { n_sort, n_sort / 3 })
+    {
+        for (auto &k : hKeys) k = distribution (s_generator);
+        queue.enqueueWriteBuffer (dKeys, CL_FALSE, 0, n * sizeof (cl_uint), hKeys.data ());
+
+        sort.run (dKeys, n);
+        queue.enqueueReadBuffer (dKeys, CL_TRUE, 0, n * sizeof (cl_uint), hOut.data ());
+
+        std::sort (hKeys.begin (), hKeys.begin () + n);
+        for (unsigned int i = 0; i < n; ++i)
+            ASSERT_EQ (hKeys[i], hOut[i]);
+    }
+}
+
+
+/*! \brief Sorts signed 64-bit keys with values, and checks 
+ *         the order and stability against `std::stable_sort`.
+ */
+TEST (RadixSort, SignedKeyValue)
+{
+    std::uniform_int_distribution<cl_long> distribution (-5000, 5000);
+    std::vector<cl_long> hKeys (n_sort);
+    std::vector<cl_uint> hValues (n_sort);
+    std::vector< std::pair<cl_long, cl_uint> > hRef (n_sort);
+    for (unsigned int i = 0; i < n_sort; ++i)
+    {
+        hKeys[i] = distribution (s_generator);
+        hValues[i] = i;
+        hRef[i] = std::make_pair (hKeys[i], i);
+    }
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+    cl::Buffer dKeys (context, CL_MEM_READ_WRITE, n_sort * sizeof (cl_long));
+    cl::Buffer dValues (context, CL_MEM_READ_WRITE, n_sort * sizeof (cl_uint));
+    queue.enqueueWriteBuffer (dKeys, CL_FALSE, 0, n_sort * sizeof (cl_long), hKeys.data ());
+    queue.enqueueWriteBuffer (dValues, CL_FALSE, 0, n_sort * sizeof (cl_uint), hValues.data ());
+
+    clutils::RadixSort<cl_long, cl_uint> sort (clEnv);
+    sort.run (dKeys, dValues, n_sort);
+
+    queue.enqueueReadBuffer (dKeys, CL_FALSE, 0, n_sort * sizeof (cl_long), hKeys.data ());
+    queue.enqueueReadBuffer (dValues, CL_TRUE, 0, n_sort * sizeof (cl_uint), hValues.data ());
+
+    std::stable_sort (hRef.begin (), hRef.end (), 
+        [] (const std::pair<cl_long, cl_uint> &a, const std::pair<cl_long, cl_uint> &b) 
+        { return a.first < b.first; });
+
+    for (unsigned int i = 0; i < n_sort; ++i)
+    {
+        ASSERT_EQ (hRef[i].first, hKeys[i]);
+        ASSERT_EQ (hRef[i].second, hValues[i]);
+    }
+}
@@ -0,0 +1,214 @@
+/*! \file stencil.cpp
+ *  \brief Google Test Unit Tests for the 2D convolutions
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <cmath>
+#include <random>
+#include <algorithm>
+#include <iostream>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/stencil.hpp>
+
+
+/*! An image size that doesn't align with any tile size. */
+const unsigned int s_width = 301, s_height = 97;
+
+static std::default_random_engine s_generator (7);
+
+
+/*! \brief Reads an element of an image, like the kernels do. */
+static float s_fetch (const std::vector<float> &img, int x, int y, clutils::Border border)
+{
+    if (border == clutils::Border::ZERO)
+        return (x < 0 || x >= (int) s_width || y < 0 || y >= (int) s_height) ? 0.f : img[y * s_width + x];
+    x = std::min (std::max (x, 0), (int) s_width - 1);
+    y = std::min (std::max (y, 0), (int) s_height - 1);
+    return img[y * s_width + x];
+}
+
+
+/*! \brief Convolves an image with a 2D filter on the host. */
+static std::vector<float> s_convolve (const std::vector<float> &img, const std::vector<float> &filter, 
+                                      int radius, clutils::Border border)
+{
+    int d = 2 * radius + 1;
+    std::vector<float> out (img.size ());
+    for (int y = 0; y < (int) s_height; ++y)
+        for (int x = 0; x < (int) s_width; ++x)
+        {
+            double acc = 0.0;
+            for (int j = 0; j < d; ++j)
+                for (int i = 0; i < d; ++i)
+                    acc += filter[j * d + i] * s_fetch (img, x + i - radius, y + j - radius, border);
+            out[y * s_width + x] = (float) acc;
+        }
+    return out;
+}
+
+
+/*! \brief Runs the tiled and the naive kernels with a few radii and 
+ *         both border modes, and compares against a host convolution.
+ */
+TEST (Convolution, Tiled)
+{
+    const unsigned int n = s_width * s_height;
+    std::uniform_real_distribution<float> distribution (-1.f, 1.f);
+    std::vector<float> hIn (n), hOut (n);
+    for (auto &v : hIn) v = distribution (s_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, n * sizeof (float));
+    cl::Buffer dOut (context, CL_MEM_WRITE_ONLY, n * sizeof (float));
+    queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n * sizeof (float), hIn.data ());
+
+    for (unsigned int radius : { 1u, 3u, 7u })
+    {
+        for (auto border : { clutils::Border::CLAMP, clutils::Border::ZERO })
+        {
+            unsigned int d = 2 * radius + 1;
+            std::vector<float> filter (d * d);
+            for (auto &v : filter) v = distribution (s_generator);
+            std::vector<float> ref = s_convolve (hIn, filter, radius, border);
+
+            clutils::Convolution<cl_float> conv (clEnv, clutils::CLEnvInfo<1> (), radius, border);
+            conv.setFilter (filter);
+
+            conv.run (dIn, dOut, s_width, s_height);
+            queue.enqueueReadBuffer (dOut, CL_TRUE, 0, n * sizeof (float), hOut.data ());
+            for (unsigned int i = 0; i < n; ++i)
+                ASSERT_NEAR (ref[i], hOut[i], 1e-4f * d * d) << "radius " << radius << ", at " << i;
+
+            conv.runNaive (dIn, dOut, s_width, s_height);
+            queue.enqueueReadBuffer (dOut, CL_TRUE, 0, n * sizeof (float), hOut.data ());
+            for (unsigned int i = 0; i < n; ++i)
+                ASSERT_NEAR (ref[i], hOut[i], 1e-4f * d * d) << "radius " << radius << ", at " << i;
+        }
+    }
+}
+
+
+/*! \brief Runs a separable Gaussian blur, and compares against 
+ *         a host convolution with the equivalent 2D filter. 
+ *         The images are views with offsets into larger buffers.
+ */
+TEST (Convolution, Separable)
+{
+    const unsigned int n = s_width * s_height, offset = 64, radius = 4;
+    std::uniform_real_distribution<float> distribution (0.f, 255.f);
+    std::vector<float> hIn (n), hOut (n);
+    for (auto &v : hIn) v = distribution (s_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dIn (context, CL_MEM_READ_WRITE, (offset + n) * sizeof (float));
+    cl::Buffer dOut (context, CL_MEM_READ_WRITE, (offset + n) * sizeof (float));
+    queue.enqueueWriteBuffer (dIn, CL_TRUE, offset * sizeof (float), n * sizeof (float), hIn.data ());
+    clutils::BufferView vIn (dIn, offset * sizeof (float), n * sizeof (float));
+    clutils::BufferView vOut (dOut, offset * sizeof (float), n * sizeof (float));
+
+    std::vector<float> g = clutils::gaussianFilter<cl_float> (radius, 1.5);
+    float sum = 0.f;
+    for (auto w : g) sum += w;
+    ASSERT_NEAR (1.f, sum, 1e-5f);
+
+    std::vector<float> filter (g.size () * g.size ());
+    for (unsigned int j = 0; j < g.size (); ++j)
+        for (unsigned int i = 0; i < g.size (); ++i)
+            filter[j * g.size () + i] = g[j] * g[i];
+    std::vector<float> ref = s_convolve (hIn, filter, radius, clutils::Border::CLAMP);
+
+    clutils::Convolution<cl_float> conv (clEnv, clutils::CLEnvInfo<1> (), radius);
+    conv.setFilter (g, g);
+
+    conv.run (vIn, vOut, s_width, s_height);
+    queue.enqueueReadBuffer (dOut, CL_TRUE, offset * sizeof (float), n * sizeof (float), hOut.data ());
+    for (unsigned int i = 0; i < n; ++i)
+        ASSERT_NEAR (ref[i], hOut[i], 1e-3f) << "at " << i;
+
+    // The naive kernel gets the outer product of the two filters
+    conv.runNaive (vIn, vOut, s_width, s_height);
+    queue.enqueueReadBuffer (dOut, CL_TRUE, offset * sizeof (float), n * sizeof (float), hOut.data ());
+    for (unsigned int i = 0; i < n; ++i)
+        ASSERT_NEAR (ref[i], hOut[i], 1e-3f) << "at " << i;
+
+    ASSERT_THROW (conv.setFilter (std::vector<float> (3)), std::invalid_argument);
+}
+
+
+/*! \brief Picks a radius whose tiles don't fit in local memory, and checks 
+ *         that the convolution falls back to the naive kernel, which still builds.
+ */
+TEST (Convolution, Fallback)
+{
+    const unsigned int n = s_width * s_height;
+    std::uniform_real_distribution<float> distribution (-1.f, 1.f);
+    std::vector<float> hIn (n), hOut (n);
+    for (auto &v : hIn) v = distribution (s_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+    cl::Device device = queue.getInfo<CL_QUEUE_DEVICE> ();
+    cl_ulong localMem = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE> ();
+    cl_ulong constantMem = device.getInfo<CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE> ();
+
+    // The smallest tile (8 x 4) with its halo has to exceed half of local memory
+    unsigned int radius = 1;
+    while ((8 + 2 * radius) * (4 + 2 * radius) * sizeof (float) <= localMem / 2)
+        ++radius;
+    unsigned int d = 2 * radius + 1;
+    if ((d * d + 2 * d) * sizeof (float) > constantMem)
+    {
+        std::cout << " The filter of radius " << radius << " doesn't fit in constant memory. "
+                  << "Skipping the test." << std::endl;
+        return;
+    }
+
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, n * sizeof (float));
+    cl::Buffer dOut (context, CL_MEM_WRITE_ONLY, n * sizeof (float));
+    queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n * sizeof (float), hIn.data ());
+
+    std::vector<float> filter (d * d);
+    for (auto &v : filter) v = distribution (s_generator) / (d * d);
+    std::vector<float> ref = s_convolve (hIn, filter, radius, clutils::Border::ZERO);
+
+    clutils::Convolution<cl_float> conv (clEnv, clutils::CLEnvInfo<1> (), radius, clutils::Border::ZERO);
+    ASSERT_FALSE (conv.isTiled ());
+    conv.setFilter (filter);
+
+    conv.run (dIn, dOut, s_width, s_height);
+    queue.enqueueReadBuffer (dOut, CL_TRUE, 0, n * sizeof (float), hOut.data ());
+    for (unsigned int i = 0; i < n; ++i)
+        ASSERT_NEAR (ref[i], hOut[i], 1e-3f) << "radius " << radius << ", at " << i;
+}
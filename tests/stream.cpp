@@ -0,0 +1,109 @@
+/*! \file stream.cpp
+ *  \brief Google Test Unit Tests for the out-of-core streaming
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/stream.hpp>
+
+
+/*! A size that doesn't align with the chunks or the work-group size. */
+const size_t n_stream = (1 << 20) + 3;
+
+
+/*! \brief Streams a vector addition with one input in a mapped file, 
+ *         and with chunks much smaller than the input.
+ */
+TEST (StreamProcessor, MappedFileToMemory)
+{
+    std::vector<cl_int> hA (n_stream), hB (n_stream), hC (n_stream, -1);
+    for (size_t i = 0; i < n_stream; ++i) { hA[i] = i; hB[i] = 2 * i; }
+
+    const char *filename = "clutils-stream-test.bin";
+    std::ofstream file (filename, std::ios::binary);
+    file.write ((const char *) hA.data (), n_stream * sizeof (cl_int));
+    file.close ();
+
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    {
+        clutils::MappedFile fA (filename);
+        ASSERT_EQ (n_stream * sizeof (cl_int), fA.size ());
+
+        // 3 slots of 64KB
+        clutils::StreamProcessor stream (clEnv, clutils::CLEnvInfo<1> (), 3, 1 << 16);
+        std::vector<clutils::StreamInput> inputs { { fA.data (), sizeof (cl_int) }, { hB.data (), sizeof (cl_int) } };
+        size_t chunk = stream.chunkElements (inputs, sizeof (cl_int));
+        ASSERT_LT (chunk, n_stream);
+        ASSERT_EQ (0u, chunk % 256);
+
+        // The chunks arrive in order
+        size_t expected = 0;
+        clutils::StreamSink toMemory = clutils::memorySink (hC.data ());
+        stream.run (clEnv.getKernel ("vecAddN"), inputs, n_stream, sizeof (cl_int), 
+            [&] (const void *data, size_t offset, size_t bytes)
+            {
+                ASSERT_EQ (expected, offset);
+                expected += bytes;
+                toMemory (data, offset, bytes);
+            });
+        ASSERT_EQ (n_stream * sizeof (cl_int), expected);
+    }
+    std::remove (filename);
+
+    for (size_t i = 0; i < n_stream; ++i)
+        ASSERT_EQ (3 * (cl_int) i, hC[i]);
+}
+
+
+/*! \brief Streams host ranges to an output stream, 
+ *         reusing the slots across runs of different sizes.
+ */
+TEST (StreamProcessor, HostRangeToStream)
+{
+    std::vector<cl_int> hA (n_stream), hB (n_stream);
+    for (size_t i = 0; i < n_stream; ++i) { hA[i] = -(cl_int) i; hB[i] = 5; }
+
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    clutils::StreamProcessor stream (clEnv, clutils::CLEnvInfo<1> (), 2, 1 << 18);
+    std::vector<clutils::StreamInput> inputs { { hA.data (), sizeof (cl_int) }, { hB.data (), sizeof (cl_int) } };
+
+    for (size_t n : { n_stream, (size_t) 1000, (size_t) 0 })
+    {
+        std::ostringstream os;
+        stream.run (clEnv.getKernel ("vecAddN"), inputs, n, sizeof (cl_int), clutils::ostreamSink (os));
+
+        std::string out = os.str ();
+        ASSERT_EQ (n * sizeof (cl_int), out.size ());
+        const cl_int *hC = (const cl_int *) out.data ();
+        for (size_t i = 0; i < n; ++i)
+            ASSERT_EQ (5 - (cl_int) i, hC[i]);
+    }
+}
@@ -32,6 +32,9 @@
 #include <random>
 #include <cmath>
 #include <thread>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
 #include <gtest/gtest.h>
 #include <CLUtils.hpp>
 
@@ -113,6 +116,177 @@ TEST (CLEnv, AddMoreCLObjects)
 }
 
 
+/*! \brief Runs the vectorized kernels, which get their vector width from 
+ *         the build options injected by CLEnv, on a size that leaves a tail.
+ */
+TEST (CLEnv, VectorizedKernels)
+{
+    int num = rNum ();
+    const std::string options = "-D INIT_NUM=" + std::to_string (num);
+    const unsigned int n = n_elements + 3;
+
+    clutils::CLEnv clEnv (kernel_filenames, options.c_str ());
+    cl::Context &context (clEnv.getContext ());
+    cl::CommandQueue &queue (clEnv.getQueue ());
+    cl::Kernel &kernel_init (clEnv.getKernel ("initRandVec"));
+    cl::Kernel &kernel_add (clEnv.getKernel ("vecAddVec"));
+
+    // Enough work-items for any vector width
+    cl::NDRange global ((n + 255) / 256 * 256), local (256);
+
+    cl::Buffer dBufA (context, CL_MEM_READ_WRITE, n * sizeof (int));
+    cl::Buffer dBufC (context, CL_MEM_WRITE_ONLY, n * sizeof (int));
+
+    kernel_init.setArg (0, dBufA);
+    kernel_init.setArg (1, n);
+    queue.enqueueNDRangeKernel (kernel_init, cl::NullRange, global, local);
+
+    kernel_add.setArg (0, dBufA);
+    kernel_add.setArg (1, dBufA);
+    kernel_add.setArg (2, dBufC);
+    kernel_add.setArg (3, n);
+    queue.enqueueNDRangeKernel (kernel_add, cl::NullRange, global, local);
+
+    std::vector<int> hBufC (n);
+    queue.enqueueReadBuffer (dBufC, CL_TRUE, 0, n * sizeof (int), hBufC.data ());
+
+    for (int elmt : hBufC)
+        ASSERT_EQ (2*num, elmt);
+}
+
+
+/*! \brief Checks that platforms are enumerated on demand, and that programs 
+ *         are only built for the devices with queues until another device 
+ *         gets a queue.
+ */
+TEST (CLEnv, LazyBuild)
+{
+    int num = rNum ();
+    const std::string options = "-D INIT_NUM=" + std::to_string (num);
+
+    clutils::CLEnv clEnv;
+    clEnv.setLazyBuild (true);
+    ASSERT_TRUE (clEnv.platforms.empty ());
+
+    cl::Context &context (clEnv.addContext (0));
+    ASSERT_FALSE (clEnv.platforms.empty ());
+
+    clEnv.addQueue (0, 0);
+    cl::Kernel &kernel (clEnv.addProgram (0, kernel_filename2, "initRand", options.c_str ()));
+    cl::Program &program (clEnv.getProgram (0));
+    std::vector<cl::Device> &devs (clEnv.devices[0]);
+    ASSERT_EQ (CL_BUILD_SUCCESS, program.getBuildInfo<CL_PROGRAM_BUILD_STATUS> (devs[0]));
+
+    if (devs.size () < 2)
+        return;
+
+    ASSERT_EQ (CL_BUILD_NONE, program.getBuildInfo<CL_PROGRAM_BUILD_STATUS> (devs[1]));
+
+    // The program gets rebuilt, and the kernel is replaced in place
+    cl::CommandQueue &queue (clEnv.addQueue (0, 1));
+    ASSERT_EQ (CL_BUILD_SUCCESS, program.getBuildInfo<CL_PROGRAM_BUILD_STATUS> (devs[1]));
+
+    cl::Buffer dBufA (context, CL_MEM_WRITE_ONLY, n_elements * sizeof (int));
+    kernel.setArg (0, dBufA);
+    queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (n_elements), cl::NDRange (256));
+
+    std::vector<int> hBufA (n_elements);
+    queue.enqueueReadBuffer (dBufA, CL_TRUE, 0, n_elements * sizeof (int), hBufA.data ());
+
+    for (int elmt : hBufA)
+        ASSERT_EQ (num, elmt);
+}
+
+
+/*! \brief Checks that a queue for another device keeps the existing kernels, 
+ *         their arguments, and their copies valid on every device.
+ *  \note With a single device, the second queue goes to the same device.
+ */
+TEST (CLEnv, AddQueueKeepsKernels)
+{
+    int num = rNum ();
+    const std::string options = "-D INIT_NUM=" + std::to_string (num);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    clEnv.addQueue (0, 0);
+    cl::Kernel &kernel (clEnv.addProgram (0, kernel_filename2, "initRand", options.c_str ()));
+    cl::Kernel copy (kernel);  // As the primitives keep them
+
+    cl::Buffer dBufA (context, CL_MEM_WRITE_ONLY, n_elements * sizeof (int));
+    cl::Buffer dBufB (context, CL_MEM_WRITE_ONLY, n_elements * sizeof (int));
+    kernel.setArg (0, dBufA);
+
+    unsigned int dIdx = std::min<size_t> (1, clEnv.devices[0].size () - 1);
+    clEnv.addQueue (0, dIdx);
+    ASSERT_EQ (CL_BUILD_SUCCESS, clEnv.getProgram (0).getBuildInfo<CL_PROGRAM_BUILD_STATUS> (clEnv.devices[0][dIdx]));
+
+    // The argument survives, and both the kernel and its copy run on both devices
+    for (unsigned int qIdx = 0; qIdx < 2; ++qIdx)
+    {
+        cl::CommandQueue &queue (clEnv.getQueue (0, qIdx));
+        std::vector<int> hBufA (n_elements, 0), hBufB (n_elements, 0);
+        queue.enqueueWriteBuffer (dBufA, CL_FALSE, 0, n_elements * sizeof (int), hBufA.data ());
+        queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (n_elements));
+        queue.enqueueReadBuffer (dBufA, CL_TRUE, 0, n_elements * sizeof (int), hBufA.data ());
+
+        copy.setArg (0, dBufB);
+        queue.enqueueNDRangeKernel (copy, cl::NullRange, cl::NDRange (n_elements));
+        queue.enqueueReadBuffer (dBufB, CL_TRUE, 0, n_elements * sizeof (int), hBufB.data ());
+        copy.setArg (0, dBufA);
+
+        for (unsigned int i = 0; i < n_elements; ++i)
+        {
+            ASSERT_EQ (num, hBufA[i]);
+            ASSERT_EQ (num, hBufB[i]);
+        }
+    }
+}
+
+
+/*! \brief Checks that the devices get ranked, that the environment binds 
+ *         to the best one, and that calibration scores get cached.
+ */
+TEST (CLEnv, DeviceSelection)
+{
+    std::vector<cl::Platform> platforms;
+    cl::Platform::get (&platforms);
+
+    std::vector<clutils::DeviceScore> scores = clutils::rankDevices (platforms);
+    ASSERT_FALSE (scores.empty ());
+    for (unsigned int i = 1; i < scores.size (); ++i)
+        ASSERT_GE (scores[i - 1].score, scores[i].score);
+
+    std::vector<cl::Device> devs;
+    platforms[scores[0].pIdx].getDevices (CL_DEVICE_TYPE_ALL, &devs);
+    cl::Device best = devs[scores[0].dIdx];
+
+    clutils::CLEnv clEnv (kernel_filename2, "-D INIT_NUM=1");
+    cl::Device device = clEnv.getQueue ().getInfo<CL_QUEUE_DEVICE> ();
+    ASSERT_EQ (best (), device ());
+    ASSERT_EQ (best (), clEnv.devices[0][0] ());
+
+    // The second ranking reads the scores from the cache
+    const char *cache = "clutils-devices-test.txt";
+    setenv ("CLUTILS_DEVICE_CACHE", cache, 1);
+    std::remove (cache);
+
+    auto calibrated = clutils::rankDevices (platforms, clutils::DeviceSelection::CALIBRATION);
+    ASSERT_GT (calibrated[0].score, 0.0);
+    std::ifstream file (cache);
+    ASSERT_TRUE (file.good ());
+    file.close ();
+
+    auto cached = clutils::rankDevices (platforms, clutils::DeviceSelection::CALIBRATION);
+    ASSERT_EQ (calibrated.size (), cached.size ());
+    for (unsigned int i = 0; i < cached.size (); ++i)
+        ASSERT_NEAR (calibrated[i].score, cached[i].score, 1e-3 * calibrated[i].score);
+
+    std::remove (cache);
+    unsetenv ("CLUTILS_DEVICE_CACHE");
+}
+
+
 /*! \brief Tests functionality on 2 vectors of 10 floats and compares them.
  */
 TEST (ProfilingInfo, BasicFunctionality)
@@ -136,6 +310,17 @@ TEST (ProfilingInfo, BasicFunctionality)
     // Check the max
     ASSERT_EQ (pInfo.max (), 2.0);
 
+    // Check the median
+    ASSERT_EQ (pInfo.median (), 1.5);
+
+    // Check the median absolute deviation
+    ASSERT_EQ (pInfo.mad (), 0.5);
+
+    // The median ignores an outlier
+    pInfo[nRepeat - 1] = 100.0;
+    ASSERT_EQ (pInfo.median (), 1.5);
+    pInfo[nRepeat - 1] = 2.0;
+
     // Create a second to benchmark
     clutils::ProfilingInfo<nRepeat, float> pInfo2 ("Test2");
 
@@ -171,6 +356,52 @@ TEST (CPUTimer, BasicFunctionality)
 }
 
 
+/*! \brief Tests the TSC clock, and a timer on it.
+ *  \details Where the TSC is not available, the clock falls back to 
+ *           `steady_clock`, and the test still applies.
+ */
+TEST (CPUTimer, TSCClock)
+{
+    typedef clutils::TSCClock clock;
+    typedef std::chrono::steady_clock steady;
+
+    // Check that the clock is monotonic
+    clock::time_point prev = clock::now ();
+    for (int i = 0; i < 100000; ++i)
+    {
+        clock::time_point now = clock::now ();
+        ASSERT_GE (now.time_since_epoch ().count (), prev.time_since_epoch ().count ());
+        prev = now;
+    }
+
+    // Check that the clock agrees with steady_clock
+    steady::time_point s0 = steady::now ();
+    clock::time_point c0 = clock::now ();
+    std::this_thread::sleep_for (std::chrono::milliseconds (50));
+    steady::time_point s1 = steady::now ();
+    clock::time_point c1 = clock::now ();
+    double ds = std::chrono::duration<double, std::micro> (s1 - s0).count ();
+    double dc = std::chrono::duration<double, std::micro> (c1 - c0).count ();
+    ASSERT_NEAR (dc, ds, 50);  // 0.1% tolerance
+
+    if (clock::available ())
+    {
+        ASSERT_GT (clock::frequency (), 0);
+    }
+
+    // Check that the timer works on the clock
+    clutils::CPUTimer<double, std::micro, clock> timer (10);
+    ASSERT_EQ (timer.duration (), 10);
+    timer.reset ();
+    ASSERT_EQ (timer.duration (), 0);
+
+    timer.start ();
+    std::this_thread::sleep_for (std::chrono::duration<int64_t, std::milli> (100));  // 100 ms
+    timer.stop ();
+    ASSERT_LE (timer.duration () - 100000, 1000);  // 1 ms (OS scheduling) tolerance
+}
+
+
 /*! \brief Tests functionality on a ~12 us execution time kernel.
  */
 TEST (GPUTimer, BasicFunctionality)
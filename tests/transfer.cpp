@@ -0,0 +1,138 @@
+/*! \file transfer.cpp
+ *  \brief Google Test Unit Tests for the transfer coalescer
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/transfer.hpp>
+
+
+static auto t_seed = std::chrono::system_clock::now ().time_since_epoch ().count ();
+static std::default_random_engine t_generator (t_seed);
+
+
+/*! \brief Scatters writes over a few buffers with every kind of 
+ *         batch (single region, strided regions, word and byte regions), 
+ *         gathers them back, and checks the number of commands.
+ */
+TEST (TransferCoalescer, ScatterGather)
+{
+    const size_t bufSize = 1 << 16;
+    std::uniform_int_distribution<int> distribution (0, 255);
+    std::vector<unsigned char> hData (bufSize);
+    for (auto &v : hData) v = distribution (t_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    std::vector<cl::Buffer> dBufs;
+    std::vector<unsigned char> zeros (bufSize, 0);
+    for (unsigned int b = 0; b < 4; ++b)
+    {
+        dBufs.emplace_back (context, CL_MEM_READ_WRITE, bufSize);
+        queue.enqueueWriteBuffer (dBufs[b], CL_FALSE, 0, bufSize, zeros.data ());
+    }
+
+    // Regions as (offset, size) for every buffer
+    std::vector<std::vector<std::pair<size_t, size_t>>> regions (4);
+    regions[0].emplace_back (128, 1000);  // A single region
+    for (size_t i = 0; i < 50; ++i)
+        regions[1].emplace_back (64 + 256 * i, 100);  // Constant stride
+    for (size_t i = 0, off = 0; i < 200; ++i, off += 4 * (i % 13) + 32)
+        regions[2].emplace_back (off, 4 * (i % 7) + 4);  // Word aligned
+    for (size_t i = 0, off = 3; i < 200; ++i, off += (i % 11) + 30)
+        regions[3].emplace_back (off, (i % 17) + 1);  // Unaligned
+
+    clutils::TransferCoalescer tc (clEnv);
+
+    // The strided regions are staged back to back, and the rest 
+    // are interleaved across the buffers to exercise the grouping
+    for (auto &r : regions[1])
+        tc.write (dBufs[1], r.first, r.second, hData.data () + r.first);
+    for (size_t i = 0; i < 200; ++i)
+        for (unsigned int b : { 0, 2, 3 })
+            if (i < regions[b].size ())
+                tc.write (dBufs[b], regions[b][i].first, regions[b][i].second, 
+                          hData.data () + regions[b][i].first);
+    tc.flush ();
+    ASSERT_EQ (5u, tc.commands ());  // 1 upload and 1 command per buffer
+
+    // Check the writes with plain reads
+    std::vector<unsigned char> hOut (bufSize);
+    for (unsigned int b = 0; b < 4; ++b)
+    {
+        queue.enqueueReadBuffer (dBufs[b], CL_TRUE, 0, bufSize, hOut.data ());
+        std::vector<unsigned char> hRef (bufSize, 0);
+        for (auto &r : regions[b])
+            std::copy (hData.begin () + r.first, hData.begin () + r.first + r.second, hRef.begin () + r.first);
+        for (size_t i = 0; i < bufSize; ++i)
+            ASSERT_EQ (hRef[i], hOut[i]);
+    }
+
+    // Gather the regions back
+    std::vector<std::vector<unsigned char>> hBack (4, std::vector<unsigned char> (bufSize, 0));
+    for (unsigned int b = 0; b < 4; ++b)
+        for (auto &r : regions[b])
+            tc.read (dBufs[b], r.first, r.second, hBack[b].data () + r.first);
+    tc.flush ();
+    ASSERT_EQ (6u, tc.commands ());  // Table upload, 1 command per buffer, 1 download
+
+    for (unsigned int b = 0; b < 4; ++b)
+        for (auto &r : regions[b])
+            for (size_t i = r.first; i < r.first + r.second; ++i)
+                ASSERT_EQ (hData[i], hBack[b][i]);
+}
+
+
+/*! \brief Checks the implicit flushes when the staging buffer fills up, 
+ *         and the direct path for regions larger than the staging buffer.
+ */
+TEST (TransferCoalescer, Capacity)
+{
+    const size_t bufSize = 1 << 14;
+    std::vector<cl_uint> hData (bufSize), hOut (bufSize);
+    for (size_t i = 0; i < bufSize; ++i) hData[i] = i;
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    clEnv.addQueue (0, 0);
+
+    cl::Buffer dBuf (context, CL_MEM_READ_WRITE, bufSize * sizeof (cl_uint));
+    clutils::TransferCoalescer tc (clEnv, clutils::CLEnvInfo<1> (), 1024, 16);
+
+    // 64 bytes at a time through a 1KB staging buffer and 16 regions per flush
+    for (size_t i = 0; i < bufSize; i += 16)
+        tc.write (dBuf, i * sizeof (cl_uint), 16 * sizeof (cl_uint), hData.data () + i);
+    tc.read (dBuf, 0, bufSize * sizeof (cl_uint), hOut.data ());
+
+    for (size_t i = 0; i < bufSize; ++i)
+        ASSERT_EQ (hData[i], hOut[i]);
+}
@@ -0,0 +1,190 @@
+/*! \file upload.cpp
+ *  \brief Google Test Unit Tests for the upload cache
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <numeric>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/upload.hpp>
+
+
+/*! A size that isn't a multiple of the hash block. */
+const unsigned int n_upload = (1 << 16) + 7;
+
+
+/*! \brief Checks that repeated uploads of the same data return the same 
+ *         buffer, and that the buffer holds the data.
+ */
+TEST (UploadCache, Deduplicates)
+{
+    clutils::CLEnv clEnv;
+    clEnv.addContext (0);
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    std::vector<cl_int> hTable (n_upload), hOut (n_upload);
+    std::iota (hTable.begin (), hTable.end (), -1000);
+
+    clutils::UploadCache uploads (clEnv);
+
+    cl::Event written;
+    cl::Buffer dFirst = uploads.upload (hTable, nullptr, &written);
+    written.wait ();
+    cl::Buffer dSecond = uploads.upload (hTable);
+
+    EXPECT_EQ (dFirst (), dSecond ());
+    EXPECT_EQ (1u, uploads.misses ());
+    EXPECT_EQ (1u, uploads.hits ());
+    EXPECT_EQ (n_upload * sizeof (cl_int), uploads.uploadedBytes ());
+    EXPECT_EQ (n_upload * sizeof (cl_int), uploads.savedBytes ());
+
+    queue.enqueueReadBuffer (dSecond, CL_TRUE, 0, n_upload * sizeof (cl_int), hOut.data ());
+    for (unsigned int i = 0; i < n_upload; ++i)
+        ASSERT_EQ (hTable[i], hOut[i]);
+
+    // The contents are hashed, so a copy hits, and a change misses
+    std::vector<cl_int> hCopy (hTable);
+    EXPECT_EQ (dFirst (), uploads.upload (hCopy) ());
+    hCopy.back () += 1;
+    cl::Buffer dChanged = uploads.upload (hCopy);
+    EXPECT_NE (dFirst (), dChanged ());
+    EXPECT_EQ (2u, uploads.misses ());
+    EXPECT_EQ (2u, uploads.count ());
+
+    // A prefix of the data has a different size, so it misses
+    uploads.upload (hTable.data (), sizeof (cl_int));
+    EXPECT_EQ (3u, uploads.misses ());
+
+    EXPECT_THROW (uploads.upload (hTable.data (), 0), std::invalid_argument);
+}
+
+
+/*! \brief Checks that the least recently used buffers get dropped, 
+ *         and that the dropped buffers remain valid.
+ */
+TEST (UploadCache, EvictsLeastRecentlyUsed)
+{
+    clutils::CLEnv clEnv;
+    clEnv.addContext (0);
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    const size_t bytes = n_upload * sizeof (cl_int);
+    std::vector< std::vector<cl_int> > hTables (4, std::vector<cl_int> (n_upload));
+    for (size_t t = 0; t < hTables.size (); ++t)
+        std::iota (hTables[t].begin (), hTables[t].end (), (cl_int) (t * n_upload));
+
+    clutils::UploadCache uploads (clEnv, clutils::CLEnvInfo<1> (), 3 * bytes);
+
+    cl::Buffer dFirst = uploads.upload (hTables[0]);
+    uploads.upload (hTables[1]);
+    uploads.upload (hTables[2]);
+    uploads.upload (hTables[0]);  // Makes table 1 the least recently used
+    uploads.upload (hTables[3]);  // Drops table 1
+
+    EXPECT_EQ (3u, uploads.count ());
+    EXPECT_EQ (3 * bytes, uploads.size ());
+    EXPECT_EQ (4u, uploads.misses ());
+
+    uploads.upload (hTables[0]);
+    uploads.upload (hTables[2]);
+    EXPECT_EQ (4u, uploads.misses ());
+    uploads.upload (hTables[1]);
+    EXPECT_EQ (5u, uploads.misses ());
+
+    // Data larger than the capacity are uploaded without being cached
+    std::vector<cl_int> hLarge (4 * n_upload, 7);
+    uploads.upload (hLarge);
+    uploads.upload (hLarge);
+    EXPECT_EQ (7u, uploads.misses ());
+    EXPECT_EQ (3u, uploads.count ());
+
+    // A dropped buffer stays valid for its holders
+    uploads.clear ();
+    EXPECT_EQ (0u, uploads.count ());
+    EXPECT_EQ (0u, uploads.size ());
+
+    std::vector<cl_int> hOut (n_upload);
+    queue.enqueueReadBuffer (dFirst, CL_TRUE, 0, bytes, hOut.data ());
+    for (unsigned int i = 0; i < n_upload; ++i)
+        ASSERT_EQ (hTables[0][i], hOut[i]);
+
+    uploads.setCapacity (bytes);
+    uploads.upload (hTables[0]);
+    uploads.upload (hTables[1]);
+    EXPECT_EQ (1u, uploads.count ());
+    EXPECT_EQ (bytes, uploads.size ());
+}
+
+
+/*! \brief Checks that the memory manager drops cached buffers 
+ *         when an allocation doesn't fit in its budget otherwise.
+ */
+TEST (UploadCache, ReclaimsForTheMemoryManager)
+{
+    clutils::CLEnv clEnv;
+    clEnv.addContext (0);
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+    clutils::MemoryManager &memory (clEnv.getMemoryManager ());
+
+    const size_t bytes = n_upload * sizeof (cl_int);
+    std::vector< std::vector<cl_int> > hTables (3, std::vector<cl_int> (n_upload));
+    for (size_t t = 0; t < hTables.size (); ++t)
+        std::iota (hTables[t].begin (), hTables[t].end (), (cl_int) (t * n_upload));
+
+    clutils::UploadCache uploads (clEnv, clutils::CLEnvInfo<1> (), 8 * bytes, true);
+    memory.setBudget (memory.used () + 3 * bytes);
+
+    for (auto &hTable : hTables)
+        uploads.upload (hTable);
+    uploads.upload (hTables[0]);  // Makes table 1 the least recently used
+    queue.finish ();
+    EXPECT_EQ (3u, uploads.count ());
+    EXPECT_EQ (1u, uploads.hits ());
+
+    // The cache is full of idle buffers, which give way to the allocation
+    cl::Buffer dScratch = memory.createBuffer (CL_MEM_READ_WRITE, 2 * bytes);
+    EXPECT_NE (nullptr, dScratch ());
+    EXPECT_EQ (1u, uploads.count ());
+    EXPECT_EQ (bytes, uploads.size ());
+
+    uploads.upload (hTables[0]);
+    EXPECT_EQ (2u, uploads.hits ());
+    EXPECT_EQ (0u, uploads.collisions ());
+
+    // A buffer that is still held doesn't get released, so a request 
+    // that can't fit gives up, without draining the cache
+    dScratch = cl::Buffer ();
+    cl::Buffer dHeld = uploads.upload (hTables[1]);
+    uploads.upload (hTables[2]);
+    queue.finish ();
+    EXPECT_NE (nullptr, dHeld ());
+    EXPECT_THROW (memory.createBuffer (CL_MEM_READ_WRITE, 2 * bytes), cl::Error);
+    EXPECT_EQ (1u, uploads.count ());
+
+    memory.setBudget (0);
+    EXPECT_EQ (0u, uploads.count ());
+}
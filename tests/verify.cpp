@@ -0,0 +1,306 @@
+/*! \file verify.cpp
+ *  \brief Google Test Unit Tests for the host reference implementations and comparisons
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <sstream>
+#include <numeric>
+#include <random>
+#include <set>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+#include <CLUtils/verify.hpp>
+
+using clutils::host::SimdLevel;
+
+
+/*! A size that exercises the tails of the vector loops. */
+const size_t n_verify = (1 << 16) + 37;
+
+
+/*! \brief Calls `f` on every supported instruction set, and restores the current one. */
+template <typename F>
+void forEachSimdLevel (F f)
+{
+    SimdLevel current = clutils::host::simdLevel ();
+    for (int l = 0; l <= (int) clutils::host::supportedSimdLevel (); ++l)
+    {
+        SimdLevel level = clutils::host::setSimdLevel ((SimdLevel) l);
+        SCOPED_TRACE (clutils::host::simdLevelName (level));
+        f ();
+    }
+    clutils::host::setSimdLevel (current);
+}
+
+
+/*! \brief Checks the reference kernels against plain loops on every instruction set.
+ *  \details The float sums are of small integers, so they're exact in any order.
+ */
+TEST (Verify, Kernels)
+{
+    std::default_random_engine generator (7);
+    std::uniform_int_distribution<cl_int> distribution (-1000, 1000);
+    std::vector<cl_int> a (n_verify), b (n_verify), c (n_verify), ref (n_verify);
+    std::vector<cl_uint> u (n_verify), uOut (n_verify), uRef (n_verify);
+    std::vector<cl_float> f (n_verify), fOut (n_verify), fRef (n_verify);
+    for (size_t i = 0; i < n_verify; ++i)
+    {
+        a[i] = distribution (generator);
+        b[i] = distribution (generator);
+        u[i] = a[i] + 1000;
+        f[i] = (cl_float) (b[i] % 32);
+    }
+
+    forEachSimdLevel ([&]
+    {
+        clutils::host::vecAdd (a.data (), b.data (), c.data (), n_verify);
+        for (size_t i = 0; i < n_verify; ++i)
+            ASSERT_EQ (a[i] + b[i], c[i]);
+
+        ASSERT_EQ (std::accumulate (a.begin (), a.end (), 0), clutils::host::reduce (a.data (), n_verify));
+        ASSERT_EQ (*std::min_element (a.begin (), a.end ()), (clutils::host::reduce<cl_int, clutils::Min> (a.data (), n_verify)));
+        ASSERT_EQ (*std::max_element (u.begin (), u.end ()), (clutils::host::reduce<cl_uint, clutils::Max> (u.data (), n_verify)));
+        ASSERT_EQ (std::accumulate (f.begin (), f.end (), 0.f), clutils::host::reduce (f.data (), n_verify));
+        ASSERT_EQ (*std::min_element (f.begin (), f.end ()), (clutils::host::reduce<cl_float, clutils::Min> (f.data (), n_verify)));
+        ASSERT_EQ (0, clutils::host::reduce (a.data (), 0));
+
+        clutils::host::scan (a.data (), c.data (), n_verify);
+        std::partial_sum (a.begin (), a.end (), ref.begin ());
+        ASSERT_TRUE (clutils::host::compare (ref.data (), c.data (), n_verify).ok ());
+
+        clutils::host::scan<cl_uint, clutils::Min> (u.data (), uOut.data (), n_verify, clutils::ScanType::EXCLUSIVE);
+        cl_uint acc = clutils::Min::identity<cl_uint> ();
+        for (size_t i = 0; i < n_verify; ++i)
+        {
+            ASSERT_EQ (acc, uOut[i]);
+            acc = std::min (acc, u[i]);
+        }
+
+        fOut = f;
+        clutils::host::scan (fOut.data (), fOut.data (), n_verify);
+        std::partial_sum (f.begin (), f.end (), fRef.begin ());
+        ASSERT_TRUE (clutils::host::compare (fRef.data (), fOut.data (), n_verify).ok ());
+
+        clutils::host::scan<cl_float, clutils::Max> (f.data (), fOut.data (), n_verify);
+        cl_float facc = clutils::Max::identity<cl_float> ();
+        for (size_t i = 0; i < n_verify; ++i)
+        {
+            facc = std::max (facc, f[i]);
+            ASSERT_EQ (facc, fOut[i]);
+        }
+    });
+}
+
+
+/*! \brief Injects mismatches across the blocks of the comparison, 
+ *         and checks their count and order on every instruction set.
+ */
+TEST (Verify, Compare)
+{
+    const size_t n = (1 << 20) + 5;
+    const std::vector<size_t> wrong { 3, 70001, 300000, 786431, n - 1 };
+    std::vector<cl_int> expected (n), actual (n);
+    std::vector<cl_ulong> expected64 (n), actual64 (n);
+    for (size_t i = 0; i < n; ++i)
+        expected[i] = actual[i] = expected64[i] = actual64[i] = i;
+    for (size_t i : wrong)
+    {
+        actual[i] = -1;
+        actual64[i] ^= cl_ulong (1) << 40;
+    }
+
+    forEachSimdLevel ([&]
+    {
+        clutils::host::Comparison<cl_int> cmp = clutils::host::compare (expected.data (), actual.data (), n);
+        ASSERT_FALSE (cmp.ok ());
+        ASSERT_EQ (wrong.size (), cmp.mismatches);
+        ASSERT_EQ (wrong.size (), cmp.first.size ());
+        for (size_t k = 0; k < wrong.size (); ++k)
+        {
+            ASSERT_EQ (wrong[k], cmp.first[k].index);
+            ASSERT_EQ ((cl_int) wrong[k], cmp.first[k].expected);
+            ASSERT_EQ (-1, cmp.first[k].actual);
+        }
+
+        cmp = clutils::host::compare (expected.data (), actual.data (), n, 2);
+        ASSERT_EQ (wrong.size (), cmp.mismatches);
+        ASSERT_EQ (2u, cmp.first.size ());
+        ASSERT_EQ (wrong[1], cmp.first[1].index);
+
+        clutils::host::Comparison<cl_ulong> cmp64 = clutils::host::compare (expected64.data (), actual64.data (), n);
+        ASSERT_EQ (wrong.size (), cmp64.mismatches);
+        ASSERT_EQ (wrong.back (), cmp64.first.back ().index);
+
+        ASSERT_TRUE (clutils::host::compare (expected.data (), expected.data (), n).ok ());
+    });
+
+    std::ostringstream os;
+    os << clutils::host::compare (expected.data (), actual.data (), n, 1);
+    ASSERT_EQ ("5 of 1048581 elements differ\n  [3] expected 3, got -1", os.str ());
+}
+
+
+/*! \brief Checks the distances in ULPs, and the tolerant 
+ *         comparison on every instruction set.
+ */
+TEST (Verify, ULP)
+{
+    const cl_float denorm = std::numeric_limits<cl_float>::denorm_min ();
+    const cl_float nan = std::numeric_limits<cl_float>::quiet_NaN ();
+    const cl_float inf = std::numeric_limits<cl_float>::infinity ();
+    ASSERT_EQ (0u, clutils::host::ulpDistance (0.f, -0.f));
+    ASSERT_EQ (2u, clutils::host::ulpDistance (-denorm, denorm));
+    ASSERT_EQ (1u, clutils::host::ulpDistance (1.f, std::nextafter (1.f, 2.f)));
+    ASSERT_EQ (1u, clutils::host::ulpDistance (inf, std::numeric_limits<cl_float>::max ()));
+    ASSERT_EQ (std::numeric_limits<cl_uint>::max (), clutils::host::ulpDistance (nan, nan));
+
+    const size_t n = 1000;
+    std::vector<cl_float> expected (n), actual (n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        expected[i] = std::sin ((cl_float) i) * 1000.f;
+        actual[i] = expected[i];
+        // Moves every 10th element by (i / 10) % 4 ULPs
+        if (i % 10 == 0)
+            for (size_t k = 0; k < (i / 10) % 4; ++k)
+                actual[i] = std::nextafter (actual[i], inf);
+    }
+    expected[5] = -0.f; actual[5] = 0.f;
+    expected[6] = nan; actual[6] = nan;
+    expected[7] = 1.f; actual[7] = nan;
+    expected[8] = -inf; actual[8] = inf;
+
+    forEachSimdLevel ([&]
+    {
+        clutils::host::Comparison<cl_float> cmp = clutils::host::compareULP (expected.data (), actual.data (), n, 2, n);
+        // The 3 ULP moves, and elements 7 and 8
+        ASSERT_EQ (n / 40 + 2, cmp.mismatches);
+        ASSERT_EQ (7u, cmp.first[0].index);
+        ASSERT_EQ (8u, cmp.first[1].index);
+        for (size_t k = 2; k < cmp.first.size (); ++k)
+            ASSERT_EQ (3u, clutils::host::ulpDistance (cmp.first[k].expected, cmp.first[k].actual));
+
+        ASSERT_EQ (n / 40 * 2 + 2, clutils::host::compareULP (expected.data (), actual.data (), n, 1).mismatches);
+        ASSERT_EQ (2u, clutils::host::compareULP (expected.data (), actual.data (), n, 3).mismatches);
+    });
+}
+
+
+/*! \brief Hashes buffers of many sizes and alignments on every instruction 
+ *         set, and checks that single-bit flips, swapped blocks, and 
+ *         trailing zeros change the hash.
+ */
+TEST (Verify, Hash)
+{
+    std::vector<uint8_t> data (3 * 4096 + 64);
+    for (size_t i = 0; i < data.size (); ++i)
+        data[i] = (uint8_t) ((i * 2654435761u) >> 13);
+
+    std::vector<cl_ulong> ref;
+    SimdLevel current = clutils::host::simdLevel ();
+    clutils::host::setSimdLevel (SimdLevel::SCALAR);
+    for (size_t bytes = 0; bytes <= 3 * 4096; bytes += 61)
+        ref.push_back (clutils::host::hash (data.data () + bytes % 7, bytes));
+    clutils::host::setSimdLevel (current);
+
+    forEachSimdLevel ([&]
+    {
+        for (size_t bytes = 0, k = 0; bytes <= 3 * 4096; bytes += 61, ++k)
+            ASSERT_EQ (ref[k], clutils::host::hash (data.data () + bytes % 7, bytes)) << bytes << " bytes";
+    });
+
+    const size_t bytes = 4096;
+    std::set<cl_ulong> hashes;
+    hashes.insert (clutils::host::hash (data.data (), bytes));
+    for (size_t bit = 0; bit < 8 * bytes; bit += 7)
+    {
+        data[bit / 8] ^= 1 << (bit % 8);
+        hashes.insert (clutils::host::hash (data.data (), bytes));
+        data[bit / 8] ^= 1 << (bit % 8);
+    }
+    ASSERT_EQ (1 + (8 * bytes + 6) / 7, hashes.size ());
+
+    // Swapping the first two blocks
+    cl_ulong h = clutils::host::hash (data.data (), bytes);
+    std::swap_ranges (data.begin (), data.begin () + 1024, data.begin () + 1024);
+    ASSERT_NE (h, clutils::host::hash (data.data (), bytes));
+
+    std::vector<uint8_t> zeros (100);
+    ASSERT_NE (clutils::host::hash (zeros.data (), 99), clutils::host::hash (zeros.data (), 100));
+
+    // The fingerprint comes with the same hash, on every instruction set, 
+    // and changes along with the data
+    cl_ulong fingerprint;
+    h = clutils::host::hash (data.data (), bytes);
+    ASSERT_EQ (h, clutils::host::hash (data.data (), bytes, fingerprint));
+    ASSERT_NE (h, fingerprint);
+    forEachSimdLevel ([&]
+    {
+        cl_ulong f;
+        ASSERT_EQ (h, clutils::host::hash (data.data (), bytes, f));
+        ASSERT_EQ (fingerprint, f);
+    });
+
+    std::set<cl_ulong> fingerprints;
+    for (size_t bit = 0; bit < 8 * bytes; bit += 7)
+    {
+        data[bit / 8] ^= 1 << (bit % 8);
+        clutils::host::hash (data.data (), bytes, fingerprint);
+        fingerprints.insert (fingerprint);
+        data[bit / 8] ^= 1 << (bit % 8);
+    }
+    ASSERT_EQ ((8 * bytes + 6) / 7, fingerprints.size ());
+}
+
+
+/*! \brief Checks a device scan against the host reference.
+ */
+TEST (Verify, DeviceScan)
+{
+    std::vector<cl_int> hIn (n_verify), hOut (n_verify), hRef (n_verify);
+    for (size_t i = 0; i < n_verify; ++i)
+        hIn[i] = (i * 2654435761u) % 64;
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, n_verify * sizeof (cl_int));
+    cl::Buffer dOut (context, CL_MEM_READ_WRITE, n_verify * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dIn, CL_TRUE, 0, n_verify * sizeof (cl_int), hIn.data ());
+
+    clutils::Scan<cl_int, clutils::Max> scan (clEnv);
+    scan.run (dIn, n_verify, dOut, clutils::ScanType::EXCLUSIVE);
+    queue.enqueueReadBuffer (dOut, CL_TRUE, 0, n_verify * sizeof (cl_int), hOut.data ());
+
+    clutils::host::scan<cl_int, clutils::Max> (hIn.data (), hRef.data (), n_verify, clutils::ScanType::EXCLUSIVE);
+    clutils::host::Comparison<cl_int> cmp = clutils::host::compare (hRef.data (), hOut.data (), n_verify);
+    ASSERT_TRUE (cmp.ok ()) << cmp;
+}
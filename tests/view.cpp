@@ -0,0 +1,227 @@
+/*! \file view.cpp
+ *  \brief Google Test Unit Tests for the buffer views
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <vector>
+#include <chrono>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/primitives.hpp>
+#include <CLUtils/sort.hpp>
+#include <CLUtils/fusion.hpp>
+
+
+/*! Number of elements in the views, and a pad that 
+ *  puts their origin off the sub-buffer alignment.
+ */
+const unsigned int n_view = (1 << 16) + 11;
+const unsigned int pad = 3;
+
+static auto v_seed = std::chrono::system_clock::now ().time_since_epoch ().count ();
+static std::default_random_engine v_generator (v_seed);
+
+
+/*! \brief Checks that aligned views are sub-buffers, that unaligned 
+ *         views fall back to an offset, and that views of views 
+ *         resolve to the parent buffer.
+ */
+TEST (BufferView, SubBufferAndOffset)
+{
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    clEnv.addQueue (0, 0);
+
+    size_t align = clutils::BufferView::alignment (context);
+    ASSERT_GT (align, sizeof (cl_int));
+
+    cl::Buffer dBuf (context, CL_MEM_READ_WRITE, 4 * align);
+
+    clutils::BufferView whole (dBuf);
+    ASSERT_FALSE (whole.isSubBuffer ());
+    ASSERT_EQ (0u, whole.offset ());
+    ASSERT_EQ (4 * align, whole.size ());
+
+    clutils::BufferView aligned (dBuf, align, 2 * align);
+    ASSERT_TRUE (aligned.isSubBuffer ());
+    ASSERT_EQ (0u, aligned.offset ());
+    ASSERT_EQ (2 * align, aligned.size ());
+
+    clutils::BufferView unaligned (dBuf, sizeof (cl_int), align);
+    ASSERT_FALSE (unaligned.isSubBuffer ());
+    ASSERT_EQ (1u, unaligned.offset<cl_int> ());
+    ASSERT_EQ (align, unaligned.size ());
+
+    // A slice of a sub-buffer is placed on the parent
+    clutils::BufferView inner = aligned.slice (sizeof (cl_int), sizeof (cl_int));
+    ASSERT_FALSE (inner.isSubBuffer ());
+    ASSERT_EQ (align + sizeof (cl_int), inner.offset ());
+    clutils::BufferView innerAligned = aligned.slice (align, align);
+    ASSERT_TRUE (innerAligned.isSubBuffer ());
+
+    ASSERT_THROW (clutils::BufferView (dBuf, 3 * align, 2 * align), cl::Error);
+}
+
+
+/*! \brief Reduces and scans unaligned views, and checks 
+ *         that the data around them are left untouched.
+ */
+TEST (BufferView, Primitives)
+{
+    std::uniform_int_distribution<cl_int> distribution (0, 32);
+    const unsigned int size = n_view + 2 * pad;
+    std::vector<cl_int> hIn (size), hOut (size, -1), hRef (n_view);
+    for (auto &v : hIn) v = distribution (v_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dIn (context, CL_MEM_READ_ONLY, size * sizeof (cl_int));
+    cl::Buffer dOut (context, CL_MEM_READ_WRITE, size * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dIn, CL_FALSE, 0, size * sizeof (cl_int), hIn.data ());
+    queue.enqueueWriteBuffer (dOut, CL_FALSE, 0, size * sizeof (cl_int), hOut.data ());
+
+    clutils::BufferView vIn (dIn, pad * sizeof (cl_int), n_view * sizeof (cl_int));
+    clutils::BufferView vOut (dOut, (pad - 1) * sizeof (cl_int), n_view * sizeof (cl_int));
+
+    clutils::Reduce<cl_int> reduce (clEnv);
+    ASSERT_EQ (std::accumulate (hIn.begin () + pad, hIn.end () - pad, 0), reduce.run (vIn, n_view));
+
+    clutils::Scan<cl_int> scan (clEnv);
+    scan.run (vIn, n_view, vOut, clutils::ScanType::INCLUSIVE);
+    queue.enqueueReadBuffer (dOut, CL_TRUE, 0, size * sizeof (cl_int), hOut.data ());
+
+    std::partial_sum (hIn.begin () + pad, hIn.end () - pad, hRef.begin ());
+    ASSERT_EQ (-1, hOut[pad - 2]);
+    for (unsigned int i = 0; i < n_view; ++i)
+        ASSERT_EQ (hRef[i], hOut[pad - 1 + i]);
+    for (unsigned int i = pad - 1 + n_view; i < size; ++i)
+        ASSERT_EQ (-1, hOut[i]);
+}
+
+
+/*! \brief Evaluates an expression on views with different 
+ *         offsets, and sorts a view of keys with values.
+ */
+TEST (BufferView, FusionAndSort)
+{
+    std::uniform_int_distribution<cl_int> distribution (-1000, 1000);
+    const unsigned int size = n_view + 2 * pad;
+    std::vector<cl_int> hA (size), hB (size), hRes (size);
+    for (auto &v : hA) v = distribution (v_generator);
+    for (auto &v : hB) v = distribution (v_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, size * sizeof (cl_int));
+    cl::Buffer dB (context, CL_MEM_READ_WRITE, size * sizeof (cl_int));
+    cl::Buffer dC (context, CL_MEM_READ_WRITE, size * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dA, CL_FALSE, 0, size * sizeof (cl_int), hA.data ());
+    queue.enqueueWriteBuffer (dB, CL_FALSE, 0, size * sizeof (cl_int), hB.data ());
+    queue.enqueueWriteBuffer (dC, CL_FALSE, 0, size * sizeof (cl_int), hB.data ());
+
+    // C[pad + i] = A[i] - B[2 * pad + i]
+    using namespace clutils::expr;
+    clutils::Elementwise<cl_int> ew (clEnv);
+    auto A = vec<cl_int> (dA);
+    auto B = vec<cl_int> (clutils::BufferView (dB, 2 * pad * sizeof (cl_int), n_view * sizeof (cl_int)));
+    clutils::BufferView vRes (dC, pad * sizeof (cl_int), n_view * sizeof (cl_int));
+    ew.run (vRes, A - B, n_view);
+    queue.enqueueReadBuffer (dC, CL_TRUE, 0, size * sizeof (cl_int), hRes.data ());
+
+    for (unsigned int i = 0; i < pad; ++i)
+        ASSERT_EQ (hB[i], hRes[i]);
+    for (unsigned int i = 0; i < n_view; ++i)
+        ASSERT_EQ (hA[i] - hB[2 * pad + i], hRes[pad + i]);
+    for (unsigned int i = pad + n_view; i < size; ++i)
+        ASSERT_EQ (hB[i], hRes[i]);
+
+    // Sort the keys in A[pad..] along with the values in B[1..]
+    clutils::BufferView vKeys (dA, pad * sizeof (cl_int), n_view * sizeof (cl_int));
+    clutils::BufferView vValues (dB, sizeof (cl_int), n_view * sizeof (cl_int));
+    std::vector<cl_int> hKeys (size), hValues (hB);
+
+    clutils::RadixSort<cl_int, cl_int> sort (clEnv);
+    sort.run (vKeys, vValues, n_view);
+    queue.enqueueReadBuffer (dA, CL_FALSE, 0, size * sizeof (cl_int), hKeys.data ());
+    queue.enqueueReadBuffer (dB, CL_TRUE, 0, size * sizeof (cl_int), hRes.data ());
+
+    std::vector<std::pair<cl_int, cl_int>> hRef (n_view);
+    for (unsigned int i = 0; i < n_view; ++i)
+        hRef[i] = std::make_pair (hA[pad + i], hValues[1 + i]);
+    std::stable_sort (hRef.begin (), hRef.end (), 
+        [] (const std::pair<cl_int, cl_int> &a, const std::pair<cl_int, cl_int> &b) 
+        { return a.first < b.first; });
+
+    for (unsigned int i = 0; i < pad; ++i)
+        ASSERT_EQ (hA[i], hKeys[i]);
+    ASSERT_EQ (hValues[0], hRes[0]);
+    for (unsigned int i = 0; i < n_view; ++i)
+    {
+        ASSERT_EQ (hRef[i].first, hKeys[pad + i]);
+        ASSERT_EQ (hRef[i].second, hRes[1 + i]);
+    }
+}
+
+
+/*! \brief Splits a buffer in aligned parts, and reduces 
+ *         every part on its own.
+ */
+TEST (BufferView, Partition)
+{
+    std::uniform_int_distribution<cl_int> distribution (-1000, 1000);
+    std::vector<cl_int> hBuf (n_view);
+    for (auto &v : hBuf) v = distribution (v_generator);
+
+    clutils::CLEnv clEnv;
+    cl::Context &context (clEnv.addContext (0));
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0));
+
+    cl::Buffer dBuf (context, CL_MEM_READ_ONLY, n_view * sizeof (cl_int));
+    queue.enqueueWriteBuffer (dBuf, CL_TRUE, 0, n_view * sizeof (cl_int), hBuf.data ());
+
+    std::vector<clutils::BufferView> parts = clutils::partition (dBuf, n_view, sizeof (cl_int), 3);
+    ASSERT_EQ (3u, parts.size ());
+
+    clutils::Reduce<cl_int> reduce (clEnv);
+    size_t covered = 0;
+    cl_int sum = 0;
+    for (auto &part : parts)
+    {
+        ASSERT_TRUE (part.isSubBuffer () || part.size () == 0);
+        covered += part.size ();
+        sum += reduce.run (part, part.size () / sizeof (cl_int));
+    }
+
+    ASSERT_EQ (n_view * sizeof (cl_int), covered);
+    ASSERT_EQ (std::accumulate (hBuf.begin (), hBuf.end (), 0), sum);
+}
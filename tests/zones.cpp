@@ -0,0 +1,166 @@
+/*! \file zones.cpp
+ *  \brief Google Test Unit Tests for the scoped profiling zones
+ *  \author Nick Lamprianidis
+ *  \version 0.2.2
+ *  \date 2014-2015
+ *  \copyright The MIT License (MIT)
+ *  \par
+ *  Copyright (c) 2014 Nick Lamprianidis
+ *  \par
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *  \par
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *  \par
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#define CLUTILS_ENABLE_ZONES
+
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <gtest/gtest.h>
+#include <CLUtils.hpp>
+#include <CLUtils/zones.hpp>
+
+
+/*! \brief Keeps the thread busy for some microseconds. */
+void spin (unsigned int us)
+{
+    auto start = std::chrono::steady_clock::now ();
+    while (std::chrono::steady_clock::now () - start < std::chrono::microseconds (us));
+}
+
+
+/*! \brief Finds the statistics of a zone by name. */
+const clutils::ZoneStats* findZone (const std::vector<clutils::ZoneStats> &zones, const char *name)
+{
+    for (auto &z : zones)
+        if (z.name == name)
+            return &z;
+
+    return nullptr;
+}
+
+
+/*! \brief Checks the structure of the call-tree, and its inclusive/exclusive times.
+ */
+TEST (Zones, CallTree)
+{
+    clutils::ZoneProfiler &profiler (clutils::ZoneProfiler::instance ());
+    profiler.reset ();
+
+    for (unsigned int i = 0; i < 10; ++i)
+    {
+        CLUTILS_ZONE ("tree/request");
+        spin (200);
+        {
+            CLUTILS_ZONE ("tree/stage");
+            spin (300);
+        }
+        {
+            CLUTILS_ZONE ("tree/stage");
+            spin (100);
+        }
+    }
+
+    std::vector<clutils::ZoneStats> zones (profiler.stats ());
+    const clutils::ZoneStats *request = findZone (zones, "tree/request");
+    const clutils::ZoneStats *stage = findZone (zones, "tree/stage");
+    ASSERT_NE (nullptr, request);
+    ASSERT_NE (nullptr, stage);
+
+    EXPECT_EQ (0u, request->depth);
+    EXPECT_EQ (1u, stage->depth);
+    EXPECT_EQ (10u, request->calls);
+    EXPECT_EQ (20u, stage->calls);
+
+    EXPECT_GE (request->inclusive, 6.0);
+    EXPECT_GE (request->exclusive, 2.0);
+    EXPECT_NEAR (request->inclusive, request->exclusive + stage->inclusive, 1e-6);
+    EXPECT_GE (stage->inclusive, 4.0);
+    EXPECT_EQ (stage->inclusive, stage->exclusive);
+}
+
+
+/*! \brief Checks that the zones of many threads get merged.
+ */
+TEST (Zones, Threads)
+{
+    clutils::ZoneProfiler &profiler (clutils::ZoneProfiler::instance ());
+    profiler.reset ();
+
+    const unsigned int nThreads = 4, nZones = 1000;
+    std::vector<std::thread> threads;
+    for (unsigned int t = 0; t < nThreads; ++t)
+        threads.emplace_back ([] ()
+        {
+            for (unsigned int i = 0; i < nZones; ++i)
+            {
+                CLUTILS_ZONE ("threads/outer");
+                CLUTILS_ZONE ("threads/inner");
+            }
+        });
+
+    // Collecting while the threads record
+    for (unsigned int i = 0; i < 10; ++i)
+        profiler.stats ();
+
+    for (auto &thread : threads)
+        thread.join ();
+
+    std::vector<clutils::ZoneStats> zones (profiler.stats ());
+    ASSERT_NE (nullptr, findZone (zones, "threads/inner"));
+    EXPECT_EQ (nThreads * nZones, findZone (zones, "threads/outer")->calls);
+    EXPECT_EQ (nThreads * nZones, findZone (zones, "threads/inner")->calls);
+    EXPECT_EQ (0u, profiler.dropped ());
+}
+
+
+/*! \brief Checks that device events get correlated with the zones that enqueued them.
+ */
+TEST (Zones, DeviceEvents)
+{
+    clutils::CLEnv clEnv ("kernels/kernels.cl");
+    cl::Context &context (clEnv.getContext ());
+    cl::CommandQueue &queue (clEnv.addQueue (0, 0, CL_QUEUE_PROFILING_ENABLE));
+    cl::Device device (queue.getInfo<CL_QUEUE_DEVICE> ());
+    cl::Kernel &kernel (clEnv.getKernel ("vecAddN"));
+
+    const unsigned int n = 1 << 20;
+    cl::Buffer dA (context, CL_MEM_READ_WRITE, n * sizeof (cl_int));
+    kernel.setArg (0, dA);
+    kernel.setArg (1, dA);
+    kernel.setArg (2, dA);
+    kernel.setArg (3, n);
+
+    clutils::ZoneProfiler &profiler (clutils::ZoneProfiler::instance ());
+    profiler.reset ();
+
+    {
+        CLUTILS_ZONE ("events/request");
+        clutils::Zone zone ("events/kernel");
+        clutils::GPUTimer<std::milli> timer (device);
+        queue.enqueueNDRangeKernel (kernel, cl::NullRange, cl::NDRange (n), cl::NDRange (256), 
+                                    nullptr, &timer.event ());
+        zone.attach (timer);
+        queue.finish ();
+    }
+
+    std::vector<clutils::ZoneStats> zones (profiler.stats ());
+    ASSERT_NE (nullptr, findZone (zones, "events/kernel"));
+    EXPECT_GT (findZone (zones, "events/kernel")->device, 0.0);
+    EXPECT_EQ (0.0, findZone (zones, "events/request")->device);
+}